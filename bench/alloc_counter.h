@@ -0,0 +1,61 @@
+/*!
+ * This file is part of Barrel, a header-only C++ library that provides
+ * programmatic access to the Homebrew command line interface.
+ *
+ * Copyright (C) 2022 aydwi <contact@aydwi.com>
+ *
+ * Barrel is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*! \file  alloc_counter.h
+    \brief Replaces the global operator new and operator delete with ones which count the
+           allocations made, for the benchmarks which report them.
+
+    Include it from exactly one translation unit of a benchmark: the replacements aren't
+    `inline`, as the standard forbids for them.
+*/
+
+#ifndef BARREL_BENCH_ALLOC_COUNTER_H__
+#define BARREL_BENCH_ALLOC_COUNTER_H__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+namespace {
+
+/*! \brief Allocations made through operator new since the program started.
+ */
+std::atomic<std::size_t> allocations{0};
+
+} // namespace
+
+void* operator new(std::size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* ptr = std::malloc(size == 0 ? 1 : size))
+        return ptr;
+    throw std::bad_alloc();
+}
+
+// Kept out of line, so that GCC doesn't mistake the library's std::function deallocations,
+// once inlined into these, for a mismatch with malloc()
+[[gnu::noinline]] void operator delete(void* ptr) noexcept {
+    std::free(ptr);
+}
+
+[[gnu::noinline]] void operator delete(void* ptr, std::size_t) noexcept {
+    std::free(ptr);
+}
+
+#endif
@@ -0,0 +1,134 @@
+/*!
+ * This file is part of Barrel, a header-only C++ library that provides
+ * programmatic access to the Homebrew command line interface.
+ *
+ * Copyright (C) 2022 aydwi <contact@aydwi.com>
+ *
+ * Barrel is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*! \file  capture.cpp
+    \brief Throughput and allocation benchmark for capturing large outputs, comparing the
+           read-in-place path of BarrelCmd::Proc against the 1 KiB chunk-and-copy path it
+           replaced.
+
+    Usage: barrel_bench_capture [size in MiB] [iterations]
+*/
+
+#include "proc.h"
+
+#include "alloc_counter.h"
+
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <string>
+
+namespace {
+
+// The capture path used before output was read in place: a fixed 1 KiB buffer, a temporary
+// string per chunk, and a full copy of the dump into the command's result
+std::string legacyCapture(std::string const& cmd) {
+    std::array<char, 1024> read_buffer;
+    std::string dump;
+    FILE* file = popen(cmd.c_str(), "r");
+    if (file == nullptr) {
+        throw std::runtime_error("legacyCapture(): popen() failed to initialize");
+    }
+
+    std::size_t read_bytes;
+    while ((read_bytes = std::fread(read_buffer.data(), sizeof(read_buffer.at(0)), sizeof(read_buffer),
+                                    file)) != 0) {
+        dump += std::string(read_buffer.data(), read_bytes);
+    }
+    pclose(file);
+
+    std::string result = dump;
+    return result;
+}
+
+struct Sample {
+    double mib_per_s;
+    double allocations_per_mib;
+};
+
+Sample measure(std::size_t iterations, std::size_t bytes, std::function<std::size_t()> const& fn) {
+    fn(); // Warm up the page cache and the dynamic loader
+
+    std::size_t const allocations_before = allocations.load();
+    std::size_t captured = 0;
+    auto const start = std::chrono::steady_clock::now();
+    for (std::size_t idx = 0; idx < iterations; ++idx)
+        captured += fn();
+    auto const elapsed = std::chrono::steady_clock::now() - start;
+
+    if (captured != bytes * iterations)
+        throw std::runtime_error("measure(): Captured " + std::to_string(captured) + " bytes");
+
+    double const mib = static_cast<double>(captured) / (1024.0 * 1024.0);
+    return {mib / std::chrono::duration<double>(elapsed).count(),
+            static_cast<double>(allocations.load() - allocations_before) / mib};
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    std::size_t const mib = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 16;
+    std::size_t const iterations = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 10;
+    std::size_t const bytes = mib * 1024 * 1024;
+
+    BarrelCmd::Argv const cmd_argv{"head", "-c", std::to_string(bytes), "/dev/zero"};
+    std::string const cmd_line = cmd_argv.join(LE_SPACER);
+
+    Sample const legacy =
+        measure(iterations, bytes, [&cmd_line]() { return legacyCapture(cmd_line).size(); });
+
+    Sample const in_place = measure(iterations, bytes, [&cmd_argv]() {
+        BarrelCmd::Proc proc(cmd_argv, BarrelCmd::Stream::STDOUT);
+        proc.execute();
+        return proc.takeStreamDump().size();
+    });
+
+    Sample const hinted = measure(iterations, bytes, [&cmd_argv, bytes]() {
+        BarrelCmd::Proc proc(cmd_argv, BarrelCmd::Stream::STDOUT);
+        proc.reserveOutput(bytes);
+        proc.execute();
+        return proc.takeStreamDump().size();
+    });
+
+    std::string stream_dump, error_dump;
+    Sample const reused = measure(iterations, bytes, [&cmd_argv, &stream_dump, &error_dump]() {
+        BarrelCmd::Proc proc(cmd_argv, BarrelCmd::Stream::STDOUT);
+        proc.reuseBuffers(std::move(stream_dump), std::move(error_dump));
+        proc.execute();
+        stream_dump = proc.takeStreamDump();
+        error_dump = proc.takeErrorDump();
+        return stream_dump.size();
+    });
+
+    auto report = [](char const* name, Sample const& sample) {
+        std::cout << name << sample.mib_per_s << " MiB/s, " << sample.allocations_per_mib
+                  << " allocations/MiB\n";
+    };
+
+    std::cout << "command:           " << cmd_line << '\n' << "iterations:        " << iterations << '\n';
+    report("legacy (1 KiB):    ", legacy);
+    report("in place:          ", in_place);
+    report("in place + hint:   ", hinted);
+    report("in place, reused:  ", reused);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,400 @@
+/*!
+ * This file is part of Barrel, a header-only C++ library that provides
+ * programmatic access to the Homebrew command line interface.
+ *
+ * Copyright (C) 2022 aydwi <contact@aydwi.com>
+ *
+ * Barrel is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*! \file  fakebrew.cpp
+    \brief A stand-in for the `brew` binary, so that Barrel can be benchmarked without
+           Homebrew (or its Ruby startup time) in the measurements.
+
+    It answers `--version` with "Homebrew <version>", and any other command with filler
+    output. What it emulates is read from the environment:
+
+    - FAKEBREW_STARTUP_MS:   Milliseconds to sleep before writing anything (default 0)
+    - FAKEBREW_STDOUT_BYTES: Bytes to write to stdout (default 0)
+    - FAKEBREW_STDERR_BYTES: Bytes to write to stderr (default 0)
+    - FAKEBREW_LINE_LENGTH:  Length of each line written, newline included (default 80)
+    - FAKEBREW_LINGER_MS:    Milliseconds to sleep after writing, before exiting (default 0)
+    - FAKEBREW_ORPHAN_MS:    Milliseconds a child forked after writing outlives it for, holding
+                             its output open, like a daemon it started (default 0)
+    - FAKEBREW_EXIT:         Exit status (default 0)
+    - FAKEBREW_VERSION:      Version reported by `--version` (default 4.2.0)
+
+    `fetch` and `install` additionally emulate the cost of each formula named:
+
+    - FAKEBREW_FETCH_MS:     Milliseconds to download a formula (default 0)
+    - FAKEBREW_INSTALL_MS:   Milliseconds to pour a formula (default 0)
+    - FAKEBREW_CACHE:        Directory standing in for the download cache. `fetch` leaves a
+                             file per formula in it, and `install` skips the download of a
+                             formula found there. Without it, nothing is cached.
+    - FAKEBREW_FAIL:         A formula which fails to fetch or install (exit status 1)
+
+    With FAKEBREW_QUERY set, `info --json[=v1|v2]`, `outdated --json=v2`, `desc` and `deps`
+    answer for each formula named, instead of with filler. Formula "name" is described as
+    "Description of name", and depends on "name-a" and "name-b":
+
+    - FAKEBREW_OUTDATED:     Formulae which `outdated` lists, separated by commas. It exits 1
+                             once it lists any, as Homebrew does for formulae named
+    - FAKEBREW_FAIL:         A formula which is unknown (exit status 1, and nothing printed)
+
+    `ruby -e <driver>`, which is how BrewWorker boots Homebrew, makes it a worker instead: it
+    speaks the protocol of ::WORKER_DRIVER on stdin/stdout, and answers each request from a
+    fork of itself, as it would the same command run on its own. Its startup delay is only
+    paid once, when the worker boots.
+
+    - FAKEBREW_WORKER_FAULT: How a worker fails the second request it is sent: "exit" exits
+                             without replying, "midway" exits once part of the reply is out,
+                             and "malformed" replies with a line which isn't a frame
+*/
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace {
+
+std::size_t const WRITE_CHUNK_SZ{64 * 1024};
+
+std::size_t getSetting(char const* name, std::size_t fallback) {
+    char const* value = std::getenv(name);
+    return value != nullptr && *value != '\0' ? std::strtoull(value, nullptr, 10) : fallback;
+}
+
+void sleepFor(std::size_t ms) {
+    timespec delay{static_cast<time_t>(ms / 1000), static_cast<long>(ms % 1000) * 1'000'000};
+    while (nanosleep(&delay, &delay) != 0 && errno == EINTR) {
+    }
+}
+
+bool writeAll(int fd, char const* data, std::size_t size) {
+    while (size > 0) {
+        ssize_t const written = write(fd, data, size);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            return false; // The reader went away
+        }
+        data += written;
+        size -= static_cast<std::size_t>(written);
+    }
+    return true;
+}
+
+// Emulates `fetch` or `install` of the formulae named, one after the other like Homebrew
+int provision(std::string_view command, int argc, char** argv) {
+    char const* cache = std::getenv("FAKEBREW_CACHE");
+    char const* fail = std::getenv("FAKEBREW_FAIL");
+    std::size_t const fetch_ms = getSetting("FAKEBREW_FETCH_MS", 0);
+    std::size_t const install_ms = getSetting("FAKEBREW_INSTALL_MS", 0);
+
+    for (int idx = 2; idx < argc; ++idx) {
+        std::string_view const name = argv[idx];
+        if (name.starts_with("-"))
+            continue;
+        if (fail != nullptr && name == fail)
+            return EXIT_FAILURE;
+
+        std::filesystem::path bottle;
+        if (cache != nullptr && *cache != '\0')
+            bottle = std::filesystem::path(cache) / name;
+        std::error_code ec;
+        if (bottle.empty() || !std::filesystem::exists(bottle, ec)) {
+            sleepFor(fetch_ms);
+            if (!bottle.empty())
+                std::ofstream const touched(bottle);
+        }
+        if (command == "install")
+            sleepFor(install_ms);
+    }
+    return EXIT_SUCCESS;
+}
+
+// Answers the queries FAKEBREW_QUERY enables for the formulae named, or returns -1 for
+// any other command
+int query(int argc, char** argv) {
+    std::string_view const command = argv[1];
+    std::vector<std::string_view> flags, names;
+    for (int idx = 2; idx < argc; ++idx)
+        (std::string_view(argv[idx]).starts_with("-") ? flags : names).emplace_back(argv[idx]);
+    auto const flagged = [&flags](std::string_view flag) {
+        return std::find(flags.begin(), flags.end(), flag) != flags.end();
+    };
+    bool const v2 = flagged("--json=v2");
+    bool const v1 = flagged("--json") || flagged("--json=v1");
+    if (!(command == "info" && (v1 || v2)) && !(command == "outdated" && v2) && command != "desc" &&
+        command != "deps")
+        return -1;
+
+    char const* fail = std::getenv("FAKEBREW_FAIL");
+    for (std::string_view const name : names) {
+        if (fail != nullptr && name == fail) {
+            std::string error{"Error: No available formula with the name \""};
+            error.append(name).append("\".\n");
+            writeAll(STDERR_FILENO, error.data(), error.size());
+            return EXIT_FAILURE;
+        }
+    }
+    char const* listing = std::getenv("FAKEBREW_OUTDATED");
+    std::string const listed = std::string(",") + (listing != nullptr ? listing : "") + ",";
+    auto const outdated = [&listed](std::string_view name) {
+        return listed.find("," + std::string(name) + ",") != std::string::npos;
+    };
+
+    std::string output;
+    int status = EXIT_SUCCESS;
+    if (command == "info" || command == "outdated") {
+        std::string records;
+        for (std::string_view const name : names) {
+            if (command == "outdated" && !outdated(name))
+                continue;
+            std::string const quoted = "\"" + std::string(name) + "\"";
+            records.append(records.empty() ? "{\"name\":" : ",{\"name\":").append(quoted);
+            records.append(",\"full_name\":").append(quoted);
+            if (command == "info")
+                records.append(",\"desc\":\"Description of ").append(name).append("\"");
+            records.append(",\"dependencies\":[\"").append(name).append("-a\",\"").append(name);
+            records.append("-b\"]}");
+            if (command == "outdated")
+                status = EXIT_FAILURE;
+        }
+        output = v2 ? "{\"formulae\":[" + records + "],\"casks\":[]}\n" : "[" + records + "]\n";
+    } else {
+        for (std::string_view const name : names) {
+            if (command == "desc")
+                output.append(name).append(": Description of ").append(name).append("\n");
+            else if (flagged("--for-each"))
+                output.append(name).append(": ").append(name).append("-a ").append(name).append("-b\n");
+            else
+                output.append(name).append("-a\n").append(name).append("-b\n");
+        }
+    }
+    writeAll(STDOUT_FILENO, output.data(), output.size());
+    return status;
+}
+
+// Lines of filler text, each ending in a newline, written a chunk at a time
+bool writeFiller(int fd, std::size_t bytes, std::size_t line_length) {
+    std::string chunk(std::min(bytes, WRITE_CHUNK_SZ), 'x');
+    for (std::size_t idx = line_length - 1; idx < chunk.size(); idx += line_length)
+        chunk[idx] = '\n';
+
+    // Every chunk but the last is a whole number of lines, so that lines stay aligned
+    std::size_t const stride =
+        chunk.size() < line_length ? chunk.size() : chunk.size() / line_length * line_length;
+    while (bytes > 0) {
+        std::size_t const size = std::min(bytes, stride);
+        if (!writeAll(fd, chunk.data(), size))
+            return false;
+        bytes -= size;
+    }
+    return true;
+}
+
+// Answers a command like `brew` would, once started
+int respond(int argc, char** argv) {
+    if (argc > 1 && std::string_view(argv[1]) == "--version") {
+        char const* version = std::getenv("FAKEBREW_VERSION");
+        std::string const line = std::string("Homebrew ") + (version != nullptr ? version : "4.2.0") + "\n";
+        writeAll(STDOUT_FILENO, line.data(), line.size());
+        return EXIT_SUCCESS;
+    }
+
+    if (argc > 1 && std::getenv("FAKEBREW_QUERY") != nullptr) {
+        int const status = query(argc, argv);
+        if (status != -1)
+            return status;
+    }
+
+    if (argc > 1 && (std::string_view(argv[1]) == "fetch" || std::string_view(argv[1]) == "install")) {
+        int const status = provision(argv[1], argc, argv);
+        if (status != EXIT_SUCCESS)
+            return status;
+    }
+
+    std::size_t const line_length = std::max<std::size_t>(getSetting("FAKEBREW_LINE_LENGTH", 80), 1);
+    if (!writeFiller(STDOUT_FILENO, getSetting("FAKEBREW_STDOUT_BYTES", 0), line_length) ||
+        !writeFiller(STDERR_FILENO, getSetting("FAKEBREW_STDERR_BYTES", 0), line_length))
+        return EXIT_FAILURE;
+
+    std::size_t const orphan_ms = getSetting("FAKEBREW_ORPHAN_MS", 0);
+    if (orphan_ms > 0 && fork() == 0) {
+        sleepFor(orphan_ms);
+        _exit(EXIT_SUCCESS);
+    }
+    std::size_t const linger_ms = getSetting("FAKEBREW_LINGER_MS", 0);
+    if (linger_ms > 0)
+        sleepFor(linger_ms);
+    return static_cast<int>(getSetting("FAKEBREW_EXIT", 0));
+}
+
+// Requests read from stdin, buffered since they arrive as a stream
+class Requests {
+private:
+    std::string inbox_{};
+
+    bool fill() {
+        std::array<char, WRITE_CHUNK_SZ> buffer;
+        for (;;) {
+            ssize_t const read_bytes = read(STDIN_FILENO, buffer.data(), buffer.size());
+            if (read_bytes > 0) {
+                inbox_.append(buffer.data(), static_cast<std::size_t>(read_bytes));
+                return true;
+            }
+            if (read_bytes == -1 && errno == EINTR)
+                continue;
+            return false;
+        }
+    }
+
+public:
+    bool readLine(std::string& line) {
+        std::size_t newline;
+        while ((newline = inbox_.find('\n')) == std::string::npos) {
+            if (!fill())
+                return false;
+        }
+        line.assign(inbox_, 0, newline);
+        inbox_.erase(0, newline + 1);
+        return true;
+    }
+
+    bool readExact(std::size_t length, std::string& sink) {
+        while (inbox_.size() < length) {
+            if (!fill())
+                return false;
+        }
+        sink.assign(inbox_, 0, length);
+        inbox_.erase(0, length);
+        return true;
+    }
+};
+
+// Runs one request in a fork, and relays its output in frames tagged with the stream
+int relay(char* self, std::vector<std::string>& args) {
+    int out[2];
+    int err[2];
+    if (pipe(out) != 0 || pipe(err) != 0)
+        return EXIT_FAILURE;
+
+    pid_t const pid = fork();
+    if (pid == 0) {
+        int const null = open("/dev/null", O_RDONLY);
+        dup2(null, STDIN_FILENO);
+        dup2(out[1], STDOUT_FILENO);
+        dup2(err[1], STDERR_FILENO);
+        for (int fd : {null, out[0], out[1], err[0], err[1]})
+            close(fd);
+        std::vector<char*> argv{self};
+        for (std::string& arg : args)
+            argv.push_back(arg.data());
+        argv.push_back(nullptr);
+        _exit(respond(static_cast<int>(argv.size() - 1), argv.data()));
+    }
+    close(out[1]);
+    close(err[1]);
+
+    std::array<pollfd, 2> fds{{{out[0], POLLIN, 0}, {err[0], POLLIN, 0}}};
+    std::array<char, WRITE_CHUNK_SZ> buffer;
+    bool relayed = true;
+    while (fds[0].fd != -1 || fds[1].fd != -1) {
+        if (poll(fds.data(), fds.size(), -1) == -1) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        for (std::size_t idx = 0; idx < fds.size(); ++idx) {
+            if (fds[idx].fd == -1 || fds[idx].revents == 0)
+                continue;
+            ssize_t const read_bytes = read(fds[idx].fd, buffer.data(), buffer.size());
+            if (read_bytes == -1 && errno == EINTR)
+                continue;
+            if (read_bytes <= 0) {
+                close(fds[idx].fd);
+                fds[idx].fd = -1;
+                continue;
+            }
+            std::string const header =
+                (idx == 0 ? "O " : "E ") + std::to_string(read_bytes) + '\n';
+            relayed = relayed && writeAll(STDOUT_FILENO, header.data(), header.size()) &&
+                      writeAll(STDOUT_FILENO, buffer.data(), static_cast<std::size_t>(read_bytes));
+        }
+    }
+
+    int status{0};
+    while (waitpid(pid, &status, 0) == -1 && errno == EINTR) {
+    }
+    int const exit_status = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+    std::string const trailer = "X " + std::to_string(exit_status) + '\n';
+    return relayed && writeAll(STDOUT_FILENO, trailer.data(), trailer.size()) ? EXIT_SUCCESS
+                                                                                : EXIT_FAILURE;
+}
+
+// The worker's side of the protocol, until stdin is closed
+int serve(char* self) {
+    if (!writeAll(STDOUT_FILENO, "R\n", 2))
+        return EXIT_FAILURE;
+
+    char const* fault = std::getenv("FAKEBREW_WORKER_FAULT");
+    std::size_t received = 0;
+    Requests requests;
+    std::string line;
+    while (requests.readLine(line)) {
+        std::vector<std::string> args(std::strtoull(line.c_str(), nullptr, 10));
+        for (std::string& arg : args) {
+            if (!requests.readLine(line))
+                return EXIT_FAILURE;
+            if (!requests.readExact(std::strtoull(line.c_str(), nullptr, 10), arg))
+                return EXIT_FAILURE;
+        }
+        if (++received == 2 && fault != nullptr) {
+            std::string_view const mode = fault;
+            if (mode == "midway")
+                writeAll(STDOUT_FILENO, "O 1\nx", 5);
+            if (mode == "malformed" && writeAll(STDOUT_FILENO, "?\n", 2))
+                continue; // Still serving, as far as it knows
+            return EXIT_FAILURE;
+        }
+        if (relay(self, args) != EXIT_SUCCESS)
+            return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    std::size_t const startup_ms = getSetting("FAKEBREW_STARTUP_MS", 0);
+    if (startup_ms > 0)
+        sleepFor(startup_ms);
+
+    if (argc == 4 && std::string_view(argv[1]) == "ruby" && std::string_view(argv[2]) == "-e")
+        return serve(argv[0]);
+    return respond(argc, argv);
+}
@@ -0,0 +1,100 @@
+/*!
+ * This file is part of Barrel, a header-only C++ library that provides
+ * programmatic access to the Homebrew command line interface.
+ *
+ * Copyright (C) 2022 aydwi <contact@aydwi.com>
+ *
+ * Barrel is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*! \file  json.cpp
+    \brief Throughput and allocation benchmark for BrewInfo, the `brew info --json=v2` parser.
+
+    The recorded fixture is tiled until the document reaches the requested size, to mimic
+    `brew info --json=v2 --installed` on a machine with many formulae and casks.
+
+    Usage: barrel_bench_json [fixture] [size in MiB] [iterations]
+*/
+
+#include "json.h"
+
+#include "alloc_counter.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+namespace {
+
+std::string tile(std::string const& fixture, std::size_t target) {
+    std::vector<std::string_view> formulae, casks;
+    BarrelCmd::JsonCursor cursor(fixture);
+    cursor.object([&](std::string_view key) {
+        auto& into = key == "formulae" ? formulae : casks;
+        cursor.array([&]() { into.push_back(cursor.skip()); });
+    });
+
+    std::string formulae_json, casks_json;
+    while (formulae_json.size() + casks_json.size() < target) {
+        for (auto const& formula : formulae)
+            (formulae_json += formulae_json.empty() ? "" : ",") += formula;
+        for (auto const& cask : casks)
+            (casks_json += casks_json.empty() ? "" : ",") += cask;
+    }
+    return "{\"formulae\":[" + formulae_json + "],\"casks\":[" + casks_json + "]}";
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    std::string const path = argc > 1 ? argv[1] : BARREL_BENCH_FIXTURES "/info_v2.json";
+    std::size_t const target_mib = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 32;
+    std::size_t const iterations = argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 10;
+
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        std::cerr << "barrel_bench_json: cannot open " << path << '\n';
+        return EXIT_FAILURE;
+    }
+    std::string const fixture{std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+    std::string const json = tile(fixture, target_mib * 1024 * 1024);
+
+    std::size_t formulae = 0, casks = 0, blocks = 0;
+    std::size_t const allocations_before = allocations.load();
+    auto const start = std::chrono::steady_clock::now();
+    for (std::size_t idx = 0; idx < iterations; ++idx) {
+        BrewInfo const info(json);
+        formulae = info.getFormulae().size();
+        casks = info.getCasks().size();
+        blocks = info.getArena().getBlockCount();
+    }
+    auto const elapsed = std::chrono::steady_clock::now() - start;
+    std::size_t const allocations_per_parse = (allocations.load() - allocations_before) / iterations;
+
+    double const seconds =
+        std::chrono::duration<double>(elapsed).count() / static_cast<double>(iterations);
+    double const mib = static_cast<double>(json.size()) / (1024.0 * 1024.0);
+
+    std::cout << "fixture:            " << path << '\n'
+              << "document:           " << mib << " MiB, " << formulae << " formulae, " << casks << " casks\n"
+              << "iterations:         " << iterations << '\n'
+              << "parse:              " << seconds * 1000.0 << " ms\n"
+              << "throughput:         " << mib / seconds << " MiB/s\n"
+              << "allocations/parse:  " << allocations_per_parse << " (" << blocks << " arena blocks)\n";
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,78 @@
+/*!
+ * This file is part of Barrel, a header-only C++ library that provides
+ * programmatic access to the Homebrew command line interface.
+ *
+ * Copyright (C) 2022 aydwi <contact@aydwi.com>
+ *
+ * Barrel is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*! \file  prepare.cpp
+    \brief Benchmark of setting up one command per formula name, constructing a BrewCommand
+           for each name against rebinding a single prepared one. Nothing is executed.
+
+    Usage: barrel_bench_prepare [names] [iterations]
+*/
+
+#include "barrel.h"
+
+#include "alloc_counter.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+int main(int argc, char** argv) {
+    std::size_t const count = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 10000;
+    std::size_t const iterations = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 10;
+
+    std::vector<std::string> names;
+    for (std::size_t idx = 0; idx < count; ++idx)
+        names.push_back("formula-" + std::to_string(idx));
+
+    Brew const brew(BrewValidation::SKIP);
+    std::size_t checksum = 0;
+
+    auto measure = [&](char const* label, auto&& fn) {
+        std::size_t const allocations_before = allocations.load();
+        auto const start = std::chrono::steady_clock::now();
+        for (std::size_t iteration = 0; iteration < iterations; ++iteration)
+            fn();
+        auto const elapsed = std::chrono::steady_clock::now() - start;
+
+        double const setups = static_cast<double>(count * iterations);
+        std::cout << label << std::chrono::duration<double, std::nano>(elapsed).count() / setups
+                  << " ns/command, " << static_cast<double>(allocations.load() - allocations_before) / setups
+                  << " allocations/command\n";
+    };
+
+    measure("constructed: ", [&]() {
+        for (auto const& name : names) {
+            BrewCommand<BrewCommandType::Builtin> cmd(brew, BrewCommandType::Builtin::INFO, "--json=v2",
+                                                      name);
+            checksum += cmd.getArgv().size();
+        }
+    });
+
+    using namespace BrewPlaceholder;
+    BrewCommand<BrewCommandType::Builtin> prepared(brew, BrewCommandType::Builtin::INFO, "--json=v2",
+                                                   _1);
+    measure("prepared:    ", [&]() {
+        for (auto const& name : names)
+            checksum += prepared.bind(name).getArgv().size();
+    });
+
+    return checksum == 2 * 4 * count * iterations ? EXIT_SUCCESS : EXIT_FAILURE;
+}
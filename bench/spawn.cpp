@@ -0,0 +1,97 @@
+/*!
+ * This file is part of Barrel, a header-only C++ library that provides
+ * programmatic access to the Homebrew command line interface.
+ *
+ * Copyright (C) 2022 aydwi <contact@aydwi.com>
+ *
+ * Barrel is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*! \file  spawn.cpp
+    \brief Microbenchmark comparing the posix_spawn() launch path of BarrelCmd::Proc
+           against the popen("sh -c ...") path it replaced.
+
+    Usage: barrel_bench_spawn [iterations] [command [args...]]
+*/
+
+#include "proc.h"
+
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <string>
+
+namespace {
+
+// The capture path BarrelCmd::Proc used before it stopped going through the shell
+int legacyPopen(std::string const& cmd, std::string& dump) {
+    std::array<char, READ_BUFFER_SZ> read_buffer;
+    FILE* file = popen((cmd + LE_SPACER + "2>&1"s).c_str(), "r");
+    if (file == nullptr) {
+        throw std::runtime_error("legacyPopen(): popen() failed to initialize");
+    }
+
+    std::size_t read_bytes;
+    while ((read_bytes = std::fread(read_buffer.data(), sizeof(read_buffer.at(0)), sizeof(read_buffer),
+                                    file)) != 0) {
+        dump += std::string(read_buffer.data(), read_bytes);
+    }
+    return WEXITSTATUS(pclose(file));
+}
+
+double measure(std::size_t iterations, std::function<void()> const& fn) {
+    fn(); // Warm up the page cache and the dynamic loader
+
+    auto const start = std::chrono::steady_clock::now();
+    for (std::size_t idx = 0; idx < iterations; ++idx)
+        fn();
+    auto const elapsed = std::chrono::steady_clock::now() - start;
+
+    return std::chrono::duration<double, std::micro>(elapsed).count() / static_cast<double>(iterations);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    std::size_t const iterations = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000;
+
+    BarrelCmd::Argv cmd_argv;
+    if (argc > 2) {
+        for (int idx = 2; idx < argc; ++idx)
+            cmd_argv.push(argv[idx]);
+    } else {
+        cmd_argv.push("true");
+    }
+    std::string const cmd_line = cmd_argv.join(LE_SPACER);
+
+    double const popen_us = measure(iterations, [&cmd_line]() {
+        std::string dump;
+        legacyPopen(cmd_line, dump);
+    });
+
+    double const spawn_us = measure(iterations, [&cmd_argv]() {
+        BarrelCmd::Proc proc(cmd_argv, BarrelCmd::Stream::STDOUT_STDERR);
+        proc.execute();
+    });
+
+    std::cout << "command:        " << cmd_line << '\n'
+              << "iterations:     " << iterations << '\n'
+              << "popen (sh -c):  " << popen_us << " us/call\n"
+              << "posix_spawn:    " << spawn_us << " us/call\n"
+              << "speedup:        " << popen_us / spawn_us << "x\n";
+
+    return EXIT_SUCCESS;
+}
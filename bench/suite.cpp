@@ -0,0 +1,806 @@
+/*!
+ * This file is part of Barrel, a header-only C++ library that provides
+ * programmatic access to the Homebrew command line interface.
+ *
+ * Copyright (C) 2022 aydwi <contact@aydwi.com>
+ *
+ * Barrel is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*! \file  suite.cpp
+    \brief End-to-end benchmark suite, measuring Barrel against the shell one-liners (and the
+           bare posix_spawn() calls) it stands in for. `brew` is replaced by the stand-in
+           built from fakebrew.cpp, so that only Barrel's own overhead is measured.
+
+    Usage: barrel_bench_suite [--iterations N] [--size MiB] [--filter TEXT] [--brew PATH]
+                              [--json FILE|-] [--compare FILE] [--threshold PERCENT]
+
+    Results are printed as a table, and written as JSON with --json. With --compare, the
+    medians are compared against the JSON of an earlier run, and the exit status is 2 if
+    any of them regressed by more than the threshold (10% by default).
+*/
+
+#include "barrel.h"
+#include "graph.h"
+#include "json.h"
+#include "pipeline.h"
+#include "reconciler.h"
+#include "search.h"
+#include "text.h"
+#include "worker.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+    std::size_t iterations{200};
+    std::size_t mib{32};
+    std::string filter{};
+    std::string brew_path{BARREL_BENCH_FAKEBREW};
+    std::string json_path{};
+    std::string compare_path{};
+    double threshold{10.0};
+};
+
+struct Result {
+    std::string name;
+    std::string unit;
+    bool higher_is_better;
+    std::size_t samples;
+    double min;
+    double median;
+    double p90;
+    double mean;
+};
+
+Result summarise(std::string name, std::string unit, bool higher_is_better, std::vector<double> samples) {
+    std::sort(samples.begin(), samples.end());
+    auto const quantile = [&samples](double q) {
+        return samples[static_cast<std::size_t>(std::lround(q * static_cast<double>(samples.size() - 1)))];
+    };
+    double sum = 0;
+    for (double sample : samples)
+        sum += sample;
+    return {std::move(name), std::move(unit), higher_is_better, samples.size(),
+            samples.front(),  quantile(0.5),  quantile(0.9),    sum / static_cast<double>(samples.size())};
+}
+
+double elapsedUs(Clock::time_point start, Clock::time_point end) {
+    return std::chrono::duration<double, std::micro>(end - start).count();
+}
+
+// What the stand-in emulates, for as long as this is in scope
+class Emulation {
+public:
+    Emulation(std::size_t stdout_bytes, std::size_t startup_ms = 0) {
+        setenv("FAKEBREW_STDOUT_BYTES", std::to_string(stdout_bytes).c_str(), 1);
+        setenv("FAKEBREW_STARTUP_MS", std::to_string(startup_ms).c_str(), 1);
+    }
+    ~Emulation() {
+        unsetenv("FAKEBREW_STDOUT_BYTES");
+        unsetenv("FAKEBREW_STARTUP_MS");
+    }
+};
+
+std::string quote(std::string const& arg) {
+    std::string quoted{"'"};
+    for (char ch : arg)
+        quoted += ch == '\'' ? std::string("'\\''") : std::string(1, ch);
+    return quoted + "'";
+}
+
+// The shell baseline, i.e. `output=$(brew ... 2>&1)`: popen() through `sh -c`, read to EOF
+std::size_t shellCapture(std::string const& cmd_line, Clock::time_point* first_byte = nullptr) {
+    FILE* file = popen((cmd_line + " 2>&1").c_str(), "r");
+    if (file == nullptr)
+        throw std::runtime_error("shellCapture(): popen() failed to initialize");
+
+    std::string dump;
+    std::array<char, READ_BUFFER_SZ> read_buffer;
+    ssize_t read_bytes;
+    while ((read_bytes = read(fileno(file), read_buffer.data(), read_buffer.size())) != 0) {
+        if (read_bytes < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        if (first_byte != nullptr && dump.empty())
+            *first_byte = Clock::now();
+        dump.append(read_buffer.data(), static_cast<std::size_t>(read_bytes));
+    }
+
+    int const status = pclose(file);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS)
+        throw std::runtime_error("shellCapture(): " + cmd_line + " failed");
+    return dump.size();
+}
+
+// The floor: posix_spawn() with one pipe for both streams, no shell, no Barrel
+std::size_t rawCapture(std::string const& path, char const* arg) {
+    int fds[2];
+    if (pipe(fds) != 0)
+        throw std::runtime_error("rawCapture(): pipe() failed");
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, fds[1], STDOUT_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, fds[1], STDERR_FILENO);
+    posix_spawn_file_actions_addclose(&actions, fds[0]);
+    posix_spawn_file_actions_addclose(&actions, fds[1]);
+
+    std::array<char*, 3> argv{const_cast<char*>(path.c_str()), const_cast<char*>(arg), nullptr};
+    pid_t pid;
+    int const err = posix_spawn(&pid, path.c_str(), &actions, nullptr, argv.data(), environ);
+    posix_spawn_file_actions_destroy(&actions);
+    close(fds[1]);
+    if (err != 0) {
+        close(fds[0]);
+        throw std::runtime_error("rawCapture(): posix_spawn() failed");
+    }
+
+    std::string dump;
+    std::array<char, READ_BUFFER_SZ> read_buffer;
+    ssize_t read_bytes;
+    while ((read_bytes = read(fds[0], read_buffer.data(), read_buffer.size())) != 0) {
+        if (read_bytes < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        dump.append(read_buffer.data(), static_cast<std::size_t>(read_bytes));
+    }
+    close(fds[0]);
+
+    int status;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {
+    }
+    return dump.size();
+}
+
+class Suite {
+private:
+    Options const& options_;
+    Brew brew_;
+    std::string cmd_line_;
+    std::vector<Result> results_{};
+
+private:
+    bool isSelected(std::string_view name) const {
+        return options_.filter.empty() || name.find(options_.filter) != std::string_view::npos;
+    }
+
+    // Times each call of fn, in microseconds, after one untimed call to warm up
+    void time(std::string const& name, std::size_t iterations, std::function<void()> const& fn) {
+        if (!isSelected(name))
+            return;
+        fn();
+        std::vector<double> samples;
+        samples.reserve(iterations);
+        for (std::size_t idx = 0; idx < iterations; ++idx) {
+            auto const start = Clock::now();
+            fn();
+            samples.push_back(elapsedUs(start, Clock::now()));
+        }
+        results_.push_back(summarise(name, "us", false, std::move(samples)));
+    }
+
+    // Records whatever each call of fn returns as the sample, e.g. a time-to-first-byte
+    void record(std::string const& name, std::string const& unit, bool higher_is_better,
+                std::size_t iterations, std::function<double()> const& fn) {
+        if (!isSelected(name))
+            return;
+        fn();
+        std::vector<double> samples;
+        samples.reserve(iterations);
+        for (std::size_t idx = 0; idx < iterations; ++idx)
+            samples.push_back(fn());
+        results_.push_back(summarise(name, unit, higher_is_better, std::move(samples)));
+    }
+
+    void spawnLatency();
+    void firstByte();
+    void throughput();
+    void brewConstruction();
+    void commandConstruction();
+    void parsing();
+    void normalizing();
+    void provisioning();
+    void reconciling();
+    void searching();
+
+public:
+    explicit Suite(Options const& options)
+        : options_(options), brew_(options.brew_path), cmd_line_(quote(options.brew_path) + " info"){};
+
+    std::vector<Result> const& run() {
+        spawnLatency();
+        firstByte();
+        throughput();
+        brewConstruction();
+        commandConstruction();
+        parsing();
+        normalizing();
+        provisioning();
+        reconciling();
+        searching();
+        return results_;
+    }
+};
+
+void Suite::spawnLatency() {
+    Emulation const emulation(0);
+    time("spawn/shell", options_.iterations, [this]() { shellCapture(cmd_line_); });
+    time("spawn/posix_spawn", options_.iterations, [this]() { rawCapture(options_.brew_path, "info"); });
+    time("spawn/barrel", options_.iterations, [this]() {
+        BrewCommand<BrewCommandType::Builtin> cmd(brew_, BrewCommandType::Builtin::INFO);
+        cmd.execute();
+    });
+
+    // The same, reported to an observer keeping counters
+    auto const counters = std::make_shared<BrewCounters>();
+    BrewMetrics::attach(counters);
+    time("spawn/barrel_observed", options_.iterations, [this]() {
+        BrewCommand<BrewCommandType::Builtin> cmd(brew_, BrewCommandType::Builtin::INFO);
+        cmd.execute();
+    });
+    BrewMetrics::detach(counters);
+
+    // The same, served by a worker booted once
+    BrewWorker worker(brew_);
+    time("spawn/barrel_worker", options_.iterations, [this, &worker]() {
+        BrewCommand<BrewCommandType::Builtin> cmd(brew_, BrewCommandType::Builtin::INFO);
+        worker.execute(cmd);
+    });
+}
+
+void Suite::firstByte() {
+    // Enough output that the first chunk arrives well before the command exits
+    Emulation const emulation(4 * 1024 * 1024);
+    record("first_byte/shell", "us", false, options_.iterations, [this]() {
+        Clock::time_point first_byte{};
+        auto const start = Clock::now();
+        shellCapture(cmd_line_, &first_byte);
+        return elapsedUs(start, first_byte);
+    });
+    record("first_byte/barrel", "us", false, options_.iterations, [this]() {
+        BrewCommand<BrewCommandType::Builtin> cmd(brew_, BrewCommandType::Builtin::INFO);
+        Clock::time_point first_byte{};
+        cmd.onChunk([&first_byte](BarrelCmd::Stream, std::string_view) {
+            if (first_byte == Clock::time_point{})
+                first_byte = Clock::now();
+        });
+        auto const start = Clock::now();
+        cmd.execute();
+        return elapsedUs(start, first_byte);
+    });
+}
+
+void Suite::throughput() {
+    std::size_t const bytes = options_.mib * 1024 * 1024;
+    std::size_t const iterations = std::max<std::size_t>(options_.iterations / 20, 3);
+    Emulation const emulation(bytes);
+
+    auto const mib_per_s = [bytes](std::size_t captured, Clock::time_point start) {
+        if (captured != bytes)
+            throw std::runtime_error("throughput(): Captured " + std::to_string(captured) + " bytes");
+        return static_cast<double>(bytes) / (1024.0 * 1024.0) /
+               std::chrono::duration<double>(Clock::now() - start).count();
+    };
+    record("throughput/shell", "MiB/s", true, iterations, [this, &mib_per_s]() {
+        auto const start = Clock::now();
+        return mib_per_s(shellCapture(cmd_line_), start);
+    });
+    record("throughput/posix_spawn", "MiB/s", true, iterations, [this, &mib_per_s]() {
+        auto const start = Clock::now();
+        return mib_per_s(rawCapture(options_.brew_path, "info"), start);
+    });
+    record("throughput/barrel", "MiB/s", true, iterations, [this, &mib_per_s]() {
+        auto const start = Clock::now();
+        BrewCommand<BrewCommandType::Builtin> cmd(brew_, BrewCommandType::Builtin::INFO);
+        cmd.execute();
+        return mib_per_s(cmd.getStreamDump().size(), start);
+    });
+
+    // The same under each bounded capture policy, counting what was read rather than kept
+    std::array<std::pair<char const*, BarrelCmd::CapturePolicy>, 3> const policies{{
+        {"throughput/barrel_tail", BarrelCmd::CapturePolicy::tail(64 * 1024)},
+        {"throughput/barrel_spill", BarrelCmd::CapturePolicy::spill(1024 * 1024)},
+        {"throughput/barrel_discard", BarrelCmd::CapturePolicy::discard()},
+    }};
+    for (auto const& [name, policy] : policies) {
+        BarrelCmd::CapturePolicy const capture = policy;
+        record(name, "MiB/s", true, iterations, [this, &mib_per_s, capture]() {
+            auto const start = Clock::now();
+            BrewCommand<BrewCommandType::Builtin> cmd(brew_, BrewCommandType::Builtin::INFO);
+            cmd.setCapture(capture);
+            cmd.execute();
+            return mib_per_s(cmd.getMetrics().bytes[0], start);
+        });
+    }
+}
+
+void Suite::brewConstruction() {
+    // A cold construction validates an installation nobody has seen yet, i.e. runs
+    // `brew --version`. Each one needs a path of its own, as validation is shared per path
+    std::size_t const iterations = std::min<std::size_t>(options_.iterations, 100);
+    std::filesystem::path const links =
+        std::filesystem::temp_directory_path() / ("barrel-bench-" + std::to_string(getpid()));
+    std::filesystem::create_directories(links);
+    std::vector<std::string> paths;
+    for (std::size_t idx = 0; idx <= iterations; ++idx) {
+        paths.push_back((links / ("brew-" + std::to_string(idx))).string());
+        std::filesystem::create_symlink(options_.brew_path, paths.back());
+    }
+
+    time("brew/shell", iterations, [this]() { shellCapture(quote(options_.brew_path) + " --version"); });
+    std::size_t next = 0;
+    time("brew/barrel_cold", iterations, [&paths, &next]() { Brew brew(paths.at(next++)); });
+    time("brew/barrel_warm", options_.iterations, [this]() { Brew brew(options_.brew_path); });
+    std::filesystem::remove_all(links);
+}
+
+void Suite::commandConstruction() {
+    // Too quick to time one at a time; each sample is the mean of a batch
+    std::size_t const batch = 1000;
+    auto const per_call = [batch](auto&& fn) {
+        return [batch, fn]() {
+            auto const start = Clock::now();
+            for (std::size_t idx = 0; idx < batch; ++idx)
+                fn();
+            return elapsedUs(start, Clock::now()) * 1000.0 / static_cast<double>(batch);
+        };
+    };
+
+    record("command/string", "ns", false, options_.iterations, per_call([this]() {
+               std::string cmd_line = cmd_line_ + " --json=v2 --installed";
+               asm volatile("" : : "r"(cmd_line.data()) : "memory");
+           }));
+    record("command/barrel", "ns", false, options_.iterations, per_call([this]() {
+               BrewCommand<BrewCommandType::Builtin> cmd(brew_, BrewCommandType::Builtin::INFO, "--json=v2",
+                                                         "--installed");
+               asm volatile("" : : "r"(&cmd) : "memory");
+           }));
+
+    using namespace BrewPlaceholder;
+    BrewCommand<BrewCommandType::Builtin> prepared(brew_, BrewCommandType::Builtin::INFO, _1, _2);
+    record("command/barrel_bind", "ns", false, options_.iterations,
+           per_call([&prepared]() { prepared.bind("--json=v2", "--installed"); }));
+}
+
+void Suite::parsing() {
+    // `list --versions` of a large installation, split by hand (the way output is usually
+    // post-processed), and by the typed parser
+    std::string output;
+    for (std::size_t idx = 0; idx < 5000; ++idx) {
+        std::string const number = std::to_string(idx);
+        output += "formula-" + number + " 1." + std::to_string(idx % 10) + ".0 2.0." + number + "\n";
+    }
+
+    time("parse/getline", options_.iterations, [&output]() {
+        std::istringstream lines(output);
+        std::vector<std::vector<std::string>> entries;
+        for (std::string line; std::getline(lines, line);) {
+            std::istringstream fields(line);
+            std::vector<std::string>& entry = entries.emplace_back();
+            for (std::string field; fields >> field;)
+                entry.push_back(field);
+        }
+        asm volatile("" : : "r"(entries.data()) : "memory");
+    });
+    time("parse/list_versions", options_.iterations, [&output]() {
+        std::vector<BrewListedVersions> const entries = BrewParse::listVersions(output);
+        asm volatile("" : : "r"(entries.data()) : "memory");
+    });
+}
+
+void Suite::normalizing() {
+    // The output of installing a closure of 16 formulae, downloads redrawing their progress
+    // bars as they go, repeated to 8 MiB. Its normalized form is the plain text case
+    std::ifstream file(BARREL_BENCH_FIXTURES "/install_progress.txt", std::ios::binary);
+    std::string const fixture{std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+    if (fixture.empty())
+        throw std::runtime_error("normalizing(): Failed to read install_progress.txt");
+    std::string progress;
+    while (progress.size() < 8 * 1024 * 1024)
+        progress += fixture;
+    std::string plain = progress;
+    BarrelCmd::normalize(plain);
+
+    std::size_t const iterations = std::max<std::size_t>(options_.iterations / 10, 5);
+    auto const mib_per_s = [](std::size_t bytes, Clock::time_point start) {
+        return static_cast<double>(bytes) / (1024.0 * 1024.0) /
+               std::chrono::duration<double>(Clock::now() - start).count();
+    };
+
+    // Finding the next escape or carriage return, which is all that's done to plain text
+    auto const scan = [&plain, &mib_per_s](auto&& find) {
+        return [&plain, &mib_per_s, find]() {
+            auto const start = Clock::now();
+            std::size_t const found = find(plain.data(), plain.size());
+            asm volatile("" : : "r"(found) : "memory");
+            return mib_per_s(plain.size(), start);
+        };
+    };
+    record("normalize/scan_scalar", "MiB/s", true, iterations, scan(BarrelCmd::findControlScalar));
+    record("normalize/scan_simd", "MiB/s", true, iterations, scan(BarrelCmd::findControl));
+
+    // Whole streams, fed through in reads of READ_BUFFER_SZ as Proc does
+    auto const stream = [&mib_per_s](std::string const& output) {
+        return [&output, &mib_per_s]() {
+            auto const start = Clock::now();
+            BarrelCmd::Normalizer normalizer;
+            std::string_view rest(output);
+            std::size_t kept = 0;
+            while (!rest.empty()) {
+                std::size_t const size = std::min<std::size_t>(rest.size(), READ_BUFFER_SZ);
+                kept += normalizer.feed(rest.substr(0, size)).size();
+                rest.remove_prefix(size);
+            }
+            kept += normalizer.finish().size();
+            asm volatile("" : : "r"(kept) : "memory");
+            return mib_per_s(output.size(), start);
+        };
+    };
+    record("normalize/progress", "MiB/s", true, iterations, stream(progress));
+    record("normalize/plain", "MiB/s", true, iterations, stream(plain));
+}
+
+void Suite::provisioning() {
+    // 24 formulae in layers of 6, each depending on two of the layer before, taking 40 ms to
+    // download and 15 ms to pour
+    std::string json{"{\"formulae\":["};
+    std::vector<std::string> requested;
+    for (std::size_t idx = 0; idx < 24; ++idx) {
+        std::string const name = "formula-" + std::to_string(idx);
+        json += (idx == 0 ? "{\"name\":\"" : ",{\"name\":\"") + name + "\",\"dependencies\":[";
+        if (idx >= 6) {
+            std::size_t const layer = idx / 6 * 6 - 6;
+            json.append("\"formula-").append(std::to_string(layer + idx % 6));
+            json.append("\",\"formula-").append(std::to_string(layer + (idx + 1) % 6)).append("\"");
+        }
+        json += "]}";
+        if (idx >= 18)
+            requested.push_back(name);
+    }
+    json += "],\"casks\":[]}";
+    BrewInfo const info(json);
+    std::vector<std::string_view> const names(requested.begin(), requested.end());
+
+    std::filesystem::path const cache =
+        std::filesystem::temp_directory_path() / ("barrel-bench-cache-" + std::to_string(getpid()));
+    setenv("FAKEBREW_CACHE", cache.c_str(), 1);
+    setenv("FAKEBREW_FETCH_MS", "40", 1);
+    setenv("FAKEBREW_INSTALL_MS", "15", 1);
+    auto const cold = [&cache]() {
+        std::filesystem::remove_all(cache);
+        std::filesystem::create_directories(cache);
+    };
+
+    // What bulk provisioning usually looks like: one `brew install` after the other
+    std::size_t const iterations = std::max<std::size_t>(options_.iterations / 50, 3);
+    time("provision/serial", iterations, [this, &info, &names, &cold]() {
+        cold();
+        BrewGraph const graph(info);
+        for (std::string_view name : graph.getTopologicalOrder(names)) {
+            BrewCommand<BrewCommandType::Builtin> cmd(brew_, BrewCommandType::Builtin::INSTALL, "--formula",
+                                                      name);
+            cmd.execute();
+        }
+    });
+    time("provision/pipeline", iterations, [this, &info, &names, &cold]() {
+        cold();
+        BrewGraph graph(info);
+        if (!BrewPipeline(brew_, graph).provision(names).succeeded())
+            throw std::runtime_error("provisioning(): Provisioning failed");
+    });
+
+    unsetenv("FAKEBREW_CACHE");
+    unsetenv("FAKEBREW_FETCH_MS");
+    unsetenv("FAKEBREW_INSTALL_MS");
+    std::filesystem::remove_all(cache);
+}
+
+void Suite::reconciling() {
+    // Converging an installation of 300 formulae, 20 of them pinned, 30 casks and 5 taps,
+    // which is in the desired state already
+    std::filesystem::path const prefix =
+        std::filesystem::temp_directory_path() / ("barrel-bench-prefix-" + std::to_string(getpid()));
+    std::filesystem::create_directories(prefix / "bin");
+    std::filesystem::create_symlink(std::filesystem::absolute(options_.brew_path), prefix / "bin" / "brew");
+    std::filesystem::create_directories(prefix / "Homebrew" / "Library" / "Homebrew");
+    std::filesystem::create_directories(prefix / "var" / "homebrew" / "pinned");
+
+    BrewDesiredState desired;
+    for (std::size_t idx = 0; idx < 300; ++idx) {
+        std::string const name = "formula-" + std::to_string(idx);
+        std::filesystem::create_directories(prefix / "Cellar" / name / "1.0_1");
+        if (idx % 15 == 0)
+            std::filesystem::create_directory_symlink(prefix / "Cellar" / name / "1.0_1",
+                                                      prefix / "var" / "homebrew" / "pinned" / name);
+        desired.formulae.push_back({name, "1.0", idx % 15 == 0});
+    }
+    for (std::size_t idx = 0; idx < 30; ++idx) {
+        std::string const token = "cask-" + std::to_string(idx);
+        std::filesystem::create_directories(prefix / "Caskroom" / token / "2.0");
+        desired.casks.push_back({token, "2.0"});
+    }
+    for (std::size_t idx = 0; idx < 5; ++idx) {
+        std::string const user = "user-" + std::to_string(idx);
+        std::filesystem::create_directories(prefix / "Homebrew" / "Library" / "Taps" / user /
+                                            "homebrew-tap");
+        desired.taps.push_back(user + "/tap");
+    }
+
+    BrewReconciler const reconciler(Brew((prefix / "bin" / "brew").string()));
+    time("reconcile/noop", options_.iterations, [&reconciler, &desired]() {
+        if (!reconciler.converge(desired).plan.empty())
+            throw std::runtime_error("reconciling(): Converging planned commands");
+    });
+    std::filesystem::remove_all(prefix);
+}
+
+void Suite::searching() {
+    // Catalogues the size of Homebrew's, 7000 formulae and 7000 casks, with names and
+    // descriptions made up of common syllables and words
+    std::array<char const*, 16> const syllables{"lib", "gn", "ru", "py", "ssl", "zip", "jq", "ex",
+                                                "on", "tar", "git", "xml", "lua", "io", "net", "ax"};
+    std::array<char const*, 16> const words{
+        "Library", "for", "command-line", "JSON", "tool", "fast", "parser", "network",
+        "GNU", "image", "server", "client", "Rust", "terminal", "data", "and"};
+    std::uint32_t seed = 1;
+    auto const next = [&seed]() {
+        seed = seed * 1664525 + 1013904223;
+        return seed >> 16;
+    };
+    auto const entry = [&](std::size_t idx, char const* key) {
+        std::string name;
+        for (std::uint32_t count = 2 + next() % 3; count > 0; --count)
+            name += syllables[next() % syllables.size()];
+        name.append("-").append(std::to_string(idx));
+        std::string desc = words[next() % words.size()];
+        for (std::uint32_t count = 4 + next() % 6; count > 0; --count)
+            desc.append(" ").append(words[next() % words.size()]);
+        std::string json{"{\""};
+        json.append(key).append("\":\"").append(name).append("\",\"tap\":\"homebrew/core\",\"desc\":\"");
+        json.append(desc).append("\",\"versions\":{\"stable\":\"1.").append(std::to_string(idx % 10));
+        json.append("\"},\"version\":\"2.0\"}");
+        return json;
+    };
+    std::string formulae{"["}, casks{"["};
+    for (std::size_t idx = 0; idx < 7000; ++idx) {
+        formulae.append(idx == 0 ? "" : ",").append(entry(idx, "name"));
+        casks.append(idx == 0 ? "" : ",").append(entry(idx, "token"));
+    }
+    formulae += "]";
+    casks += "]";
+
+    std::filesystem::path const api =
+        std::filesystem::temp_directory_path() / ("barrel-bench-api-" + std::to_string(getpid()));
+    std::filesystem::create_directories(api);
+    std::ofstream(api / "formula.json", std::ios::binary) << formulae;
+    std::ofstream(api / "cask.json", std::ios::binary) << casks;
+    std::filesystem::path const index_file = api / "barrel_search.idx";
+
+    // Without the index, every start parses the catalogues, and every query goes through them
+    std::size_t const iterations = std::max<std::size_t>(options_.iterations / 20, 5);
+    time("search/build", iterations, [&index_file, &api]() {
+        std::filesystem::remove(index_file);
+        BrewSearchIndex::open(index_file, api / "formula.json", api / "cask.json");
+    });
+    time("search/parse_catalogue", iterations, [&formulae]() {
+        BrewInfo const info(formulae);
+        asm volatile("" : : "r"(info.getFormulae().data()) : "memory");
+    });
+    time("search/open", options_.iterations, [&index_file, &api]() {
+        BrewSearchIndex const index =
+            BrewSearchIndex::open(index_file, api / "formula.json", api / "cask.json");
+        asm volatile("" : : "r"(&index) : "memory");
+    });
+
+    // A term as specific as what is usually searched for, matching a few dozen entries
+    BrewInfo const formula_info(formulae);
+    BrewInfo const cask_info("{\"casks\":" + casks + "}");
+    BrewSearchIndex const index = BrewSearchIndex::open(index_file, api / "formula.json", api / "cask.json");
+    time("search/desc_scan", options_.iterations, [&formula_info, &cask_info]() {
+        std::size_t found = 0;
+        for (BrewFormula const& formula : formula_info.getFormulae()) {
+            found += BarrelCmd::containsFolded(formula.name, "xmllua") ||
+                     BarrelCmd::containsFolded(formula.desc, "xmllua");
+        }
+        for (BrewCask const& cask : cask_info.getCasks()) {
+            found += BarrelCmd::containsFolded(cask.token, "xmllua") ||
+                     BarrelCmd::containsFolded(cask.desc, "xmllua");
+        }
+        asm volatile("" : : "r"(found) : "memory");
+    });
+    time("search/desc_substring", options_.iterations, [&index]() {
+        std::vector<BrewSearchHit> const hits = index.findSubstring("xmllua", true);
+        asm volatile("" : : "r"(hits.data()) : "memory");
+    });
+    time("search/substring", options_.iterations, [&index]() {
+        std::vector<BrewSearchHit> const hits = index.findSubstring("sslzip");
+        asm volatile("" : : "r"(hits.data()) : "memory");
+    });
+    time("search/prefix", options_.iterations, [&index]() {
+        std::vector<BrewSearchHit> const hits = index.findPrefix("gitlua", 20);
+        asm volatile("" : : "r"(hits.data()) : "memory");
+    });
+    time("search/fuzzy", options_.iterations, [&index]() {
+        std::vector<BrewSearchHit> const hits = index.findFuzzy("gitlau-12");
+        asm volatile("" : : "r"(hits.data()) : "memory");
+    });
+    std::filesystem::remove_all(api);
+}
+
+void writeJson(std::ostream& out, std::vector<Result> const& results, Options const& options) {
+    out << std::setprecision(6) << "{\n"
+        << "  \"suite\": \"barrel\",\n"
+        << "  \"version\": \"" << BARREL_VERSION << "\",\n"
+        << "  \"iterations\": " << options.iterations << ",\n"
+        << "  \"size_mib\": " << options.mib << ",\n"
+        << "  \"results\": [";
+    for (std::size_t idx = 0; idx < results.size(); ++idx) {
+        Result const& result = results[idx];
+        out << (idx == 0 ? "\n" : ",\n") << "    {\"name\": \"" << result.name << "\", \"unit\": \""
+            << result.unit << "\", \"better\": \"" << (result.higher_is_better ? "higher" : "lower")
+            << "\", \"samples\": " << result.samples << ", \"min\": " << result.min
+            << ", \"median\": " << result.median << ", \"p90\": " << result.p90
+            << ", \"mean\": " << result.mean << "}";
+    }
+    out << "\n  ]\n}\n";
+}
+
+// Medians by name, from the JSON of an earlier run
+std::map<std::string, double> readMedians(std::string const& path) {
+    std::ifstream file(path);
+    if (!file)
+        throw std::runtime_error("readMedians(): Cannot open " + path);
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    std::string const json = buffer.str();
+
+    std::map<std::string, double> medians;
+    BarrelCmd::Arena arena;
+    BarrelCmd::JsonCursor cursor(json);
+    cursor.object([&](std::string_view key) {
+        if (key != "results") {
+            cursor.skip();
+            return;
+        }
+        cursor.array([&]() {
+            std::string name;
+            double median = NAN;
+            cursor.object([&](std::string_view field) {
+                if (field == "name")
+                    name = cursor.string(arena);
+                else if (field == "median")
+                    median = std::strtod(std::string(cursor.skip()).c_str(), nullptr);
+                else
+                    cursor.skip();
+            });
+            medians[name] = median;
+        });
+    });
+    return medians;
+}
+
+// Prints how each median moved, and returns whether any regressed beyond the threshold
+bool compare(std::ostream& out, std::vector<Result> const& results,
+             std::map<std::string, double> const& baseline, double threshold) {
+    bool regressed = false;
+    out << "\nCompared with the baseline (threshold " << threshold << "%):\n";
+    for (Result const& result : results) {
+        auto const found = baseline.find(result.name);
+        if (found == baseline.end() || !(found->second > 0)) {
+            out << "  " << std::left << std::setw(28) << result.name << "(new)\n";
+            continue;
+        }
+        double const change = (result.median - found->second) / found->second * 100.0;
+        bool const worse = result.higher_is_better ? change < -threshold : change > threshold;
+        regressed = regressed || worse;
+        out << "  " << std::left << std::setw(28) << result.name << std::right << std::showpos << std::fixed
+            << std::setprecision(1) << std::setw(8) << change << "%" << std::noshowpos
+            << (worse ? "  REGRESSION" : "") << '\n';
+    }
+    return regressed;
+}
+
+void printTable(std::ostream& out, std::vector<Result> const& results) {
+    out << std::left << std::setw(28) << "benchmark" << std::right << std::setw(8) << "unit" << std::setw(12)
+        << "min" << std::setw(12) << "median" << std::setw(12) << "p90" << std::setw(12) << "mean" << '\n';
+    for (Result const& result : results) {
+        out << std::left << std::setw(28) << result.name << std::right << std::setw(8) << result.unit
+            << std::fixed << std::setprecision(2) << std::setw(12) << result.min << std::setw(12)
+            << result.median << std::setw(12) << result.p90 << std::setw(12) << result.mean << '\n';
+    }
+}
+
+Options parseOptions(int argc, char** argv) {
+    Options options;
+    for (int idx = 1; idx < argc; ++idx) {
+        std::string_view const arg = argv[idx];
+        if (idx + 1 >= argc)
+            throw std::runtime_error("parseOptions(): Missing value for " + std::string(arg));
+        char const* value = argv[++idx];
+        if (arg == "--iterations")
+            options.iterations = std::max<std::size_t>(std::strtoul(value, nullptr, 10), 1);
+        else if (arg == "--size")
+            options.mib = std::max<std::size_t>(std::strtoul(value, nullptr, 10), 1);
+        else if (arg == "--filter")
+            options.filter = value;
+        else if (arg == "--brew")
+            options.brew_path = value;
+        else if (arg == "--json")
+            options.json_path = value;
+        else if (arg == "--compare")
+            options.compare_path = value;
+        else if (arg == "--threshold")
+            options.threshold = std::strtod(value, nullptr);
+        else
+            throw std::runtime_error("parseOptions(): Unknown option " + std::string(arg));
+    }
+    return options;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    try {
+        Options const options = parseOptions(argc, argv);
+        std::vector<Result> const results = Suite(options).run();
+
+        // Keep stdout clean for the JSON if that is where it goes
+        std::ostream& report = options.json_path == "-" ? std::cerr : std::cout;
+        printTable(report, results);
+
+        if (options.json_path == "-") {
+            writeJson(std::cout, results, options);
+        } else if (!options.json_path.empty()) {
+            std::ofstream file(options.json_path);
+            writeJson(file, results, options);
+        }
+
+        if (!options.compare_path.empty() &&
+            compare(report, results, readMedians(options.compare_path), options.threshold))
+            return 2;
+    } catch (std::exception const& err) {
+        std::cerr << err.what() << '\n';
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
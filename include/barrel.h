@@ -25,45 +25,92 @@
 #ifndef BARREL_H__
 #define BARREL_H__
 
+#include "env.h"
+#include "layout.h"
+#include "metrics.h"
 #include "proc.h"
+#include "reactor.h"
+#include "registry.h"
 #include "spec.h"
+#include "text.h"
 #include "types.h"
 #include "utils.h"
 
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
 #include <climits>
 #include <cstddef>
 #include <cstdint>
-#include <queue>
+#include <memory>
+#include <optional>
+#include <stdexcept>
 #include <string>
 #include <string_view>
 #include <utility>
-#include <variant>
-
-#define BAD_EXIT_ST INT_MAX & 0xff
+#include <vector>
 
 using namespace std::string_literals;
 
 template <typename>
 struct FalseType : std::false_type {};
 
+class BrewWorker;
+class BrewCache;
+class BrewNative;
+class BrewExecutor;
+class BrewCoalescer;
+
+template <EnumType E>
+class BrewCommand;
+
+/*! \brief A placeholder for an argument of a BrewCommand which is supplied later, and may be
+ *         replaced any number of times, through BrewCommand::bind(). \sa BrewPlaceholder
+ */
+struct BrewSlot {
+    std::size_t index;
+};
+
+/*! \brief Placeholders for the arguments bound to a BrewCommand, in the order bind() takes
+ *         them.
+ */
+namespace BrewPlaceholder {
+inline constexpr BrewSlot _1{0};
+inline constexpr BrewSlot _2{1};
+inline constexpr BrewSlot _3{2};
+inline constexpr BrewSlot _4{3};
+} // namespace BrewPlaceholder
+
 /*! \brief Set up a Homebrew execution environment. Further, customize and validate
  *         the execution environment.
+ *
+ *  Validation state is kept per installation in the ::BrewRegistry, so constructing any
+ *  number of Brew objects for the same installation runs `brew --version` at most once
+ *  (again only if the `brew` binary is replaced).
  */
 class Brew {
+    template <EnumType E>
+    friend class BrewCommand;
+
 private:
     BrewTargetArch target_arch_;
     std::string install_path_;
-    std::string install_version_;
+    BrewValidation validation_;
+    std::shared_ptr<BarrelCmd::Installation> installation_;
+    BrewEnvProfile env_profile_{};
 
 private:
-    void validateBrewInstallation();
+    void validateBrewInstallation() const;
 
 public:
-    inline static bool is_installed{false};
-    inline static bool skip_validation{false};
     inline static std::string const spec_version{BarrelSpec::_BREW_VERSION};
 
+    /*! \brief Incremented every time a command which mutates an installation
+     *         (BrewLockClass::EXCLUSIVE) finishes executing through Barrel.
+     */
+    inline static std::atomic<std::uint64_t> state_generation{0};
+
 public:
     /*! \brief Default constructor for Brew.
      *
@@ -75,77 +122,128 @@ public:
      */
     Brew();
 
+    /*! \brief A constructor for Brew, which allows you to choose when the default
+     *         installation is validated.
+     *
+     *  \param validation Validation policy
+     */
+    explicit Brew(BrewValidation);
+
     /*! \brief A constructor for Brew, which allows you to specify your target architecture.
      *         Homebrew installation path is set to the default path for this architecture.
      *
      *  \param target_arch Target architecture
+     *  \param validation Validation policy
      *
      *  \sa BrewSpec
      */
-    explicit Brew(BrewTargetArch);
+    explicit Brew(BrewTargetArch, BrewValidation = BrewValidation::EAGER);
 
     /*! \brief A constructor for Brew, which allows you to specify a custom location for
      *         your Homebrew installation, specifically the `brew` binary. Barrel defaults
      *         the target architecture to BrewTargetArch::X86_64.
      *
      *  \param install_path Custom `brew` installation path
+     *  \param validation Validation policy
      *
      *  \sa BrewSpec
      */
-    explicit Brew(std::string const&);
+    explicit Brew(std::string const&, BrewValidation = BrewValidation::EAGER);
 
     /*! \brief A constructor for Brew, which allows you to specify both your target architecture
      *         and a custom path for your Homebrew installation.
      *
      *  \param target_arch Target architecture
      *  \param install_path Custom `brew` installation path
+     *  \param validation Validation policy
      *
      *  \sa BrewSpec
      */
-    Brew(BrewTargetArch, std::string const&);
+    Brew(BrewTargetArch, std::string const&, BrewValidation = BrewValidation::EAGER);
 
 public:
     std::string const& getInstallPath() const; // BARREL_H__001
-    std::string const& getInstallVersion() const;
-};
+    BrewTargetArch getTargetArch() const;
+    BrewValidation getValidation() const;
 
-void Brew::validateBrewInstallation() {
-    std::string const check_path =
-        install_path_ + LE_SPACER + getCommandHead(BrewCommandType::Builtin::VERSION);
+    /*! \brief The version Homebrew reports (e.g. "Homebrew 4.2.0"). Validates the
+     *         installation first if needed, unless validation is skipped.
+     */
+    std::string getInstallVersion() const;
 
-    BarrelCmd::Proc proc(check_path, BarrelCmd::Stream::STDOUT_STDERR);
-    proc.execute();
+    /*! \brief Whether `brew` runs successfully. Validates the installation first if needed,
+     *         unless validation is skipped (in which case the installation is assumed to be
+     *         usable).
+     */
+    bool isInstalled() const;
 
-    if (proc.getExitStatus() == EXIT_SUCCESS) {
-        Brew::is_installed = true;
-        std::string const dump = proc.getStreamDump();
-        install_version_ = {dump.begin(), std::find(dump.begin(), dump.end(), '\n')};
-    } else {
-        throw std::runtime_error(
-            "Brew::validateBrewInstallation(): Homebrew installation failed to validate!");
-    }
-}
+public:
+    /*! \brief Choose the environment every command constructed from this object (or a copy
+     *         of it made afterwards) executes in. Commands constructed before keep theirs.
+     *
+     *  \param profile The environment profile, e.g. BrewEnvProfile::fast()
+     */
+    void setEnvProfile(BrewEnvProfile);
+    BrewEnvProfile const& getEnvProfile() const;
+};
 
-Brew::Brew(BrewTargetArch target_arch, std::string const& install_path)
-    : target_arch_(target_arch), install_path_(install_path) {
-    if (Brew::skip_validation)
+inline void Brew::validateBrewInstallation() const {
+    if (validation_ == BrewValidation::SKIP || installation_->isValid())
         return;
-    validateBrewInstallation();
+    throw std::runtime_error("Brew::validateBrewInstallation(): Homebrew installation failed to validate!");
+}
+
+inline Brew::Brew(BrewTargetArch target_arch, std::string const& install_path, BrewValidation validation)
+    : target_arch_(target_arch), install_path_(install_path), validation_(validation),
+      installation_(BrewRegistry::acquire(install_path, target_arch)) {
+    if (validation_ == BrewValidation::EAGER)
+        validateBrewInstallation();
+    else if (validation_ == BrewValidation::BACKGROUND)
+        installation_->validateInBackground();
 };
 
-Brew::Brew(std::string const& install_path) : Brew{BrewTargetArch::X86_64, install_path} {};
+inline Brew::Brew(std::string const& install_path, BrewValidation validation)
+    : Brew{BrewTargetArch::X86_64, install_path, validation} {};
+
+inline Brew::Brew(BrewTargetArch target_arch, BrewValidation validation)
+    : Brew{target_arch,
+           target_arch == BrewTargetArch::X86_64 ? BrewSpec::_BREW_DEFAULT_PATH_X86_64
+                                                 : BrewSpec::_BREW_DEFAULT_PATH_ARM64,
+           validation} {};
 
-Brew::Brew(BrewTargetArch target_arch)
-    : Brew{target_arch, target_arch == BrewTargetArch::X86_64 ? BrewSpec::_BREW_DEFAULT_PATH_X86_64
-                                                              : BrewSpec::_BREW_DEFAULT_PATH_ARM64} {};
+inline Brew::Brew(BrewValidation validation)
+    : Brew{BrewTargetArch::X86_64, BrewSpec::_BREW_DEFAULT_PATH_X86_64, validation} {};
 
-Brew::Brew() : Brew{BrewTargetArch::X86_64, BrewSpec::_BREW_DEFAULT_PATH_X86_64} {}; // BARREL_H__002
+inline Brew::Brew() : Brew{BrewTargetArch::X86_64, BrewSpec::_BREW_DEFAULT_PATH_X86_64} {}; // BARREL_H__002
 
-std::string const& Brew::getInstallPath() const {
+inline std::string const& Brew::getInstallPath() const {
     return install_path_;
 }
-std::string const& Brew::getInstallVersion() const {
-    return install_version_;
+
+inline BrewTargetArch Brew::getTargetArch() const {
+    return target_arch_;
+}
+
+inline BrewValidation Brew::getValidation() const {
+    return validation_;
+}
+
+inline std::string Brew::getInstallVersion() const {
+    if (validation_ != BrewValidation::SKIP)
+        installation_->isValid();
+    return installation_->getVersion();
+}
+
+inline bool Brew::isInstalled() const {
+    return validation_ == BrewValidation::SKIP || installation_->isValid();
+}
+
+inline void Brew::setEnvProfile(BrewEnvProfile profile) {
+    env_profile_ = std::move(profile);
+}
+
+inline BrewEnvProfile const& Brew::getEnvProfile() const {
+    return env_profile_;
 }
 
 /*! \brief Work with Homebrew commands in your program including set-up, execution and
@@ -154,15 +252,57 @@ std::string const& Brew::getInstallVersion() const {
  */
 template <EnumType E>
 class BrewCommand {
+    friend class BrewWorker;
+    friend class BrewCache;
+    friend class BrewNative;
+    friend class BrewCoalescer;
+    friend class BrewExecutor;
+    friend class BrewReconciler;
+
 private:
+    Brew brew_;
     E cmd_;
-    std::string head_{};
+    std::string_view head_{};
     std::string chain_{};
+    BarrelCmd::Argv argv_{};
     std::string stream_dump_{};
+    std::string error_dump_{};
     int exit_status_{BAD_EXIT_ST};
+    BarrelCmd::Termination termination_{BarrelCmd::Termination::EXITED};
+
+private:
+    std::optional<std::chrono::steady_clock::time_point> deadline_{};
+    std::optional<std::chrono::steady_clock::duration> timeout_{};
+    std::optional<BarrelCmd::CancellationToken> cancellation_{};
 
 private:
-    std::queue<std::variant<const char*, std::string>> q_{};
+    BarrelCmd::ExecutionMetrics metrics_{};
+    std::chrono::steady_clock::duration queued_{}; // Spent in a BrewExecutor's queue before this execution
+
+private:
+    BarrelCmd::OutputHandler chunk_handler_{};
+    BarrelCmd::OutputHandler line_handler_{};
+    BarrelCmd::CapturePolicy capture_{};
+    std::array<std::size_t, 2> size_hints_{0, 0};
+    std::array<BarrelCmd::MappedOutput, 2> spills_{};
+    bool normalize_{false};
+
+private:
+    BrewEnvProfile env_;
+
+private:
+    BarrelCmd::Argv template_{};       // The argument vector, placeholders left empty, once prepared
+    std::vector<std::size_t> slots_{}; // Position of each placeholder in template_, by index
+    bool bound_{true};
+
+private:
+    template <typename T>
+    void append(T const&);
+    void checkBound() const;
+    BarrelCmd::Proc makeProc(BarrelCmd::Stream);
+    void collect(BarrelCmd::Proc&);
+    void report(bool);
+    void replay(BarrelCmd::Stream) const;
 
 public:
     /*! \brief A variadic constructor for BrewCommand.
@@ -172,55 +312,318 @@ public:
      *  you to pass a chain of Homebrew arguments that follow your choice of command thereby
      *  allowing any possible Homebrew command to be executed.
      *
+     *  Any argument may be a placeholder from ::BrewPlaceholder instead, to prepare the
+     *  command once and bind() its missing arguments before every execution.
+     *
      *  \param brew An object of type ::Brew
      *  \param cmd The brew command you want to execute
      *  \param args A parameter pack representing in order, the chain of options/text that
      *              follow *cmd* as prescribed by Homebrew. The following object types are
-     *              allowed in the parameter pack: `const char*`, `std::string`
+     *              allowed in the parameter pack: `const char*`, `std::string`,
+     *              `std::string_view`, ::BrewSlot
      *
      *  \sa BrewCommandType
      */
     template <typename... Args>
-    BrewCommand(Brew const&, E, Args...);
+    BrewCommand(Brew const&, E, Args const&...);
+
+public:
+    /*! \brief Supply the arguments of a prepared command, replacing those bound before. The
+     *         argument vector is rebuilt in place, so rebinding allocates nothing once it has
+     *         grown to fit the longest arguments.
+     *
+     *  \code
+     *  using namespace BrewPlaceholder;
+     *  BrewCommand<BrewCommandType::Builtin> desc(brew, BrewCommandType::Builtin::DESC, _1);
+     *  for (std::string_view name : names) {
+     *      desc.bind(name).execute();
+     *      // ...
+     *  }
+     *  \endcode
+     *
+     *  \param args One argument per placeholder, in the order of their indices
+     *
+     *  \return The command itself
+     */
+    template <typename... Args>
+    BrewCommand& bind(Args const&...);
+
+    /*! \brief Number of placeholders, i.e. of arguments bind() takes.
+     */
+    std::size_t getSlotCount() const;
+
+    /*! \brief Whether every placeholder has been bound, so that the command can be executed.
+     */
+    bool isBound() const;
 
 public:
-    std::string const& getHead() const;
+    E getCommand() const;
+    std::string_view getHead() const;
     std::string const& getChain() const;
+    BarrelCmd::Argv const& getArgv() const;
 
 public:
     std::string const& getStreamDump() const;
+
+    /*! \brief Output of `stderr`, captured separately from the stream dump. Only populated
+     *         by an execution with BarrelCmd::Stream::STDOUT_STDERR_SPLIT.
+     */
+    std::string const& getErrorDump() const;
+
+    /*! \brief The captured stream, wherever it is kept: the stream dump, or the file it
+     *         spilled to under BarrelCmd::CaptureMode::SPILL. Valid until the command is
+     *         executed again.
+     */
+    std::string_view getStreamView() const;
+
+    /*! \brief Like getStreamView(), for the error dump.
+     */
+    std::string_view getErrorView() const;
+
+    /*! \brief Output which spilled to a file under BarrelCmd::CaptureMode::SPILL (in which
+     *         case the stream dump is empty). Holding on to it keeps the file mapped beyond
+     *         the next execution.
+     */
+    BarrelCmd::MappedOutput const& getSpilledStream() const;
+    BarrelCmd::MappedOutput const& getSpilledError() const;
+
     int getExitStatus() const;
 
+    /*! \brief How the last execution ended. The exit status of a command which timed out or
+     *         was cancelled is that of the signal which ended it (128 + signal), or
+     *         `BAD_EXIT_ST` if it was cancelled before it started.
+     */
+    BarrelCmd::Termination getTermination() const;
+
+    /*! \brief Where the time of the last execution went, and what it consumed. Empty if it
+     *         was answered without running Homebrew (see BrewCache and BrewNative). Executions
+     *         can also be observed as they finish, through BrewMetrics.
+     */
+    BarrelCmd::ExecutionMetrics const& getMetrics() const;
+
+public:
+    /*! \brief Receive output in chunks, as it is read from the running command.
+     *
+     *  \param handler Called with a non-owning view of every chunk
+     */
+    void onChunk(BarrelCmd::OutputHandler);
+
+    /*! \brief Receive output line by line (without the trailing newline), as it is read
+     *         from the running command.
+     *
+     *  \param handler Called with a non-owning view of every line
+     */
+    void onLine(BarrelCmd::OutputHandler);
+
+    /*! \brief Choose whether the output is also accumulated for getStreamDump() and
+     *         getErrorDump(). Defaults to `true`. A consumer which only forwards output
+     *         through onChunk() or onLine() can turn this off to skip buffering entirely.
+     *         Shorthand for setCapture() with BarrelCmd::CapturePolicy::retain() or
+     *         BarrelCmd::CapturePolicy::discard().
+     *
+     *  \param retain Accumulate the output
+     */
+    void retainOutput(bool);
+
+    /*! \brief Bound the memory the output of each stream may take, however much of it
+     *         Homebrew prints (e.g. for `readall`, `audit` or a verbose `install`).
+     *
+     *  \code
+     *  cmd.setCapture(BarrelCmd::CapturePolicy::tail(64 * 1024)); // Enough to tell why it failed
+     *  \endcode
+     *
+     *  Commands executed with a bounded policy bypass BrewCache.
+     *
+     *  \param capture The capture policy, which applies to both streams
+     */
+    void setCapture(BarrelCmd::CapturePolicy);
+
+    /*! \brief Capture the output as a terminal would show it, e.g. for logging the output
+     *         of `install` or `fetch`: colours and other escape sequences are stripped, and
+     *         progress redrawn on one line is reduced to its last state. Defaults to `false`.
+     *         onChunk() and onLine() then only receive finished lines.
+     *
+     *  Commands executed with normalized output bypass BrewCache.
+     *
+     *  \param normalize Normalize the output
+     */
+    void normalizeOutput(bool);
+
+    /*! \brief Size the capture buffers up front for output of roughly the expected size,
+     *         e.g. the size of the previous run of `info --json=v2 --installed`. Without a
+     *         hint, they grow geometrically. A command executed again reuses the buffers of
+     *         its previous results either way.
+     *
+     *  \param stream_hint Expected size of the stream dump, in bytes
+     *  \param error_hint Expected size of the error dump, in bytes
+     */
+    void reserveOutput(std::size_t, std::size_t = 0);
+
+public:
+    /*! \brief Stop executing at the given time. Homebrew, and every process it launched, is
+     *         sent SIGTERM, then SIGKILL after ::KILL_GRACE_PERIOD. Output captured until
+     *         then is kept, and getTermination() reports BarrelCmd::Termination::TIMED_OUT.
+     *
+     *  \param deadline Time by which the command must have finished
+     */
+    void setDeadline(std::chrono::steady_clock::time_point);
+
+    /*! \brief Like setDeadline(), counted from the start of each execution.
+     *
+     *  \param timeout Longest the command may run for
+     */
+    void setTimeout(std::chrono::steady_clock::duration);
+
+    /*! \brief Stop executing once the token is cancelled, the same way as on a deadline.
+     *         getTermination() then reports BarrelCmd::Termination::CANCELLED.
+     *
+     *  \param token A token, possibly shared by other commands
+     */
+    void setCancellation(BarrelCmd::CancellationToken);
+
+public:
+    /*! \brief Execute in the given environment instead of that of the ::Brew object the
+     *         command was constructed from.
+     *
+     *  \param profile The environment profile
+     */
+    void setEnvProfile(BrewEnvProfile);
+
+    /*! \brief Set a variable for this command only, on top of its environment profile. The
+     *         profile's environment block is rebuilt for the command on its next execution.
+     *
+     *  \param key The variable's name
+     *  \param value Its value
+     */
+    void setEnv(std::string_view, std::string_view);
+
+    /*! \brief Unset a variable for this command only, on top of its environment profile.
+     *
+     *  \param key The variable's name
+     */
+    void unsetEnv(std::string_view);
+
+    BrewEnvProfile const& getEnvProfile() const;
+
 public:
     void execute();
+
+    /*! \brief Execute the command, capturing only the given stream(s).
+     *
+     *  With BarrelCmd::Stream::STDOUT_STDERR_SPLIT, `stdout` and `stderr` are captured
+     *  from a single execution into getStreamDump() and getErrorDump() respectively.
+     *
+     *  \param stream The stream(s) to capture
+     */
+    void execute(BarrelCmd::Stream);
+
+    /*! \brief Execute the command asynchronously on a reactor. The returned task completes
+     *         (and the results become available) once the command has exited and its output
+     *         has been fully captured. The command must outlive the task.
+     *
+     *  \code
+     *  co_await cmd.run(reactor);
+     *  \endcode
+     *
+     *  \param reactor The event loop driving the execution
+     *  \param stream The stream(s) to capture
+     */
+    BarrelCmd::Task<> run(BarrelCmd::Reactor&, BarrelCmd::Stream = BarrelCmd::Stream::STDOUT_STDERR);
 };
 
 template <EnumType E>
 template <typename... Args>
-BrewCommand<E>::BrewCommand(Brew const& brew, E cmd, Args... args)
-    : cmd_(cmd), head_(getCommandHead(cmd)), chain_(brew.getInstallPath()) {
-    (q_.push(std::forward<Args>(args)), ...);
-    chain_ += LE_SPACER + head_;
-
-    while (!q_.empty()) {
-        std::visit(
-            [&chain_ = chain_](auto&& arg) {
-                using Tt = std::decay_t<decltype(arg)>;
-                if constexpr (std::is_same_v<Tt, const char*> || std::is_same_v<Tt, std::string>)
-                    chain_ += LE_SPACER + arg;
-                // Consider string_view too
-                else
-                    static_assert(FalseType<Tt>::value,
-                                  "BrewCommand(Brew const&, E, Args...): Barrel Dev Error! Fix the "
-                                  "if-constexpr to make it exhaustive wrt the types q_ supports");
-            },
-            q_.front());
-        q_.pop();
+BrewCommand<E>::BrewCommand(Brew const& brew, E cmd, Args const&... args)
+    : brew_(brew), cmd_(cmd), head_(getCommandHead(cmd)), chain_(brew.getInstallPath()),
+      argv_{brew.getInstallPath(), head_}, env_(brew.getEnvProfile()) {
+    chain_ += LE_SPACER;
+    chain_ += head_;
+    (append(args), ...);
+
+    if (!slots_.empty()) {
+        if (std::find(slots_.begin(), slots_.end(), 0) != slots_.end())
+            throw std::runtime_error("BrewCommand::BrewCommand(): Placeholders must be numbered from _1 on");
+        template_ = argv_;
+        bound_ = false;
     }
 };
 
 template <EnumType E>
-std::string const& BrewCommand<E>::getHead() const {
+template <typename T>
+void BrewCommand<E>::append(T const& arg) {
+    if constexpr (std::is_same_v<T, BrewSlot>) {
+        if (arg.index >= slots_.size())
+            slots_.resize(arg.index + 1, 0);
+        if (slots_[arg.index] != 0)
+            throw std::runtime_error("BrewCommand::BrewCommand(): Placeholder _" +
+                                     std::to_string(arg.index + 1) + " is used more than once");
+        slots_[arg.index] = argv_.size(); // Never 0, which is the path of `brew`
+        chain_ += LE_SPACER;
+        argv_.push({});
+    } else if constexpr (std::is_convertible_v<T const&, std::string_view>) {
+        std::string_view const view = arg;
+        chain_ += LE_SPACER;
+        chain_ += view;
+        argv_.push(view);
+        if (!template_.empty())
+            template_.push(view); // Appended to a prepared command, so kept by bind()
+    } else
+        static_assert(FalseType<T>::value,
+                      "BrewCommand(Brew const&, E, Args...): Arguments must be strings or placeholders");
+}
+
+template <EnumType E>
+template <typename... Args>
+BrewCommand<E>& BrewCommand<E>::bind(Args const&... args) {
+    static_assert((std::is_convertible_v<Args const&, std::string_view> && ...),
+                  "BrewCommand::bind(): Arguments must be strings");
+    if (sizeof...(Args) != slots_.size())
+        throw std::runtime_error("BrewCommand::bind(): Expected " + std::to_string(slots_.size()) +
+                                 " argument(s), got " + std::to_string(sizeof...(Args)));
+
+    if (slots_.empty())
+        return *this; // Nothing to replace
+
+    std::array<std::string_view, sizeof...(Args)> const values{std::string_view(args)...};
+    argv_.clear();
+    chain_.clear();
+    for (std::size_t idx = 0; idx < template_.size(); ++idx) {
+        std::string_view arg = template_[idx];
+        auto const slot = std::find(slots_.begin(), slots_.end(), idx);
+        if (slot != slots_.end())
+            arg = values[static_cast<std::size_t>(slot - slots_.begin())];
+        if (idx != 0)
+            chain_ += LE_SPACER;
+        chain_ += arg;
+        argv_.push(arg);
+    }
+    bound_ = true;
+    return *this;
+}
+
+template <EnumType E>
+std::size_t BrewCommand<E>::getSlotCount() const {
+    return slots_.size();
+}
+
+template <EnumType E>
+bool BrewCommand<E>::isBound() const {
+    return bound_;
+}
+
+template <EnumType E>
+void BrewCommand<E>::checkBound() const {
+    if (!bound_)
+        throw std::runtime_error("BrewCommand::checkBound(): Placeholders must be bound before execution");
+}
+
+template <EnumType E>
+E BrewCommand<E>::getCommand() const {
+    return cmd_;
+}
+
+template <EnumType E>
+std::string_view BrewCommand<E>::getHead() const {
     return head_;
 }
 
@@ -229,22 +632,202 @@ std::string const& BrewCommand<E>::getChain() const {
     return chain_;
 }
 
+template <EnumType E>
+BarrelCmd::Argv const& BrewCommand<E>::getArgv() const {
+    return argv_;
+}
+
 template <EnumType E>
 std::string const& BrewCommand<E>::getStreamDump() const {
     return stream_dump_;
 }
 
+template <EnumType E>
+std::string const& BrewCommand<E>::getErrorDump() const {
+    return error_dump_;
+}
+
+template <EnumType E>
+std::string_view BrewCommand<E>::getStreamView() const {
+    return spills_[0].isMapped() ? spills_[0].view() : std::string_view(stream_dump_);
+}
+
+template <EnumType E>
+std::string_view BrewCommand<E>::getErrorView() const {
+    return spills_[1].isMapped() ? spills_[1].view() : std::string_view(error_dump_);
+}
+
+template <EnumType E>
+BarrelCmd::MappedOutput const& BrewCommand<E>::getSpilledStream() const {
+    return spills_[0];
+}
+
+template <EnumType E>
+BarrelCmd::MappedOutput const& BrewCommand<E>::getSpilledError() const {
+    return spills_[1];
+}
+
 template <EnumType E>
 int BrewCommand<E>::getExitStatus() const {
     return exit_status_;
 }
 
+template <EnumType E>
+BarrelCmd::Termination BrewCommand<E>::getTermination() const {
+    return termination_;
+}
+
+template <EnumType E>
+BarrelCmd::ExecutionMetrics const& BrewCommand<E>::getMetrics() const {
+    return metrics_;
+}
+
+template <EnumType E>
+void BrewCommand<E>::setDeadline(std::chrono::steady_clock::time_point deadline) {
+    deadline_ = deadline;
+}
+
+template <EnumType E>
+void BrewCommand<E>::setTimeout(std::chrono::steady_clock::duration timeout) {
+    timeout_ = timeout;
+}
+
+template <EnumType E>
+void BrewCommand<E>::setCancellation(BarrelCmd::CancellationToken token) {
+    cancellation_ = std::move(token);
+}
+
+template <EnumType E>
+void BrewCommand<E>::setEnvProfile(BrewEnvProfile profile) {
+    env_ = std::move(profile);
+}
+
+template <EnumType E>
+void BrewCommand<E>::setEnv(std::string_view key, std::string_view value) {
+    env_.set(key, value);
+}
+
+template <EnumType E>
+void BrewCommand<E>::unsetEnv(std::string_view key) {
+    env_.unset(key);
+}
+
+template <EnumType E>
+BrewEnvProfile const& BrewCommand<E>::getEnvProfile() const {
+    return env_;
+}
+
+template <EnumType E>
+void BrewCommand<E>::onChunk(BarrelCmd::OutputHandler handler) {
+    chunk_handler_ = std::move(handler);
+}
+
+template <EnumType E>
+void BrewCommand<E>::onLine(BarrelCmd::OutputHandler handler) {
+    line_handler_ = std::move(handler);
+}
+
+template <EnumType E>
+void BrewCommand<E>::retainOutput(bool retain) {
+    capture_ = retain ? BarrelCmd::CapturePolicy::retain() : BarrelCmd::CapturePolicy::discard();
+}
+
+template <EnumType E>
+void BrewCommand<E>::setCapture(BarrelCmd::CapturePolicy capture) {
+    capture_ = capture;
+}
+
+template <EnumType E>
+void BrewCommand<E>::normalizeOutput(bool normalize) {
+    normalize_ = normalize;
+}
+
+template <EnumType E>
+void BrewCommand<E>::reserveOutput(std::size_t stream_hint, std::size_t error_hint) {
+    size_hints_ = {stream_hint, error_hint};
+}
+
 template <EnumType E>
 void BrewCommand<E>::execute() {
-    BarrelCmd::Proc proc(chain_, BarrelCmd::Stream::STDOUT_STDERR);
+    execute(BarrelCmd::Stream::STDOUT_STDERR);
+}
+
+template <EnumType E>
+BarrelCmd::Proc BrewCommand<E>::makeProc(BarrelCmd::Stream stream) {
+    checkBound();
+    brew_.validateBrewInstallation(); // A no-op once validated, unless the binary changed
+
+    BarrelCmd::Proc proc(argv_, stream);
+    proc.onChunk(chunk_handler_);
+    proc.onLine(line_handler_);
+    proc.setCapture(capture_);
+    proc.normalizeOutput(normalize_);
+    if (!env_.isEmpty())
+        proc.setEnvironment(env_.getEnvironment());
+    proc.reserveOutput(size_hints_[0], size_hints_[1]);
+    proc.reuseBuffers(std::move(stream_dump_), std::move(error_dump_));
+    spills_ = {};
+    if (deadline_.has_value())
+        proc.setDeadline(*deadline_);
+    if (timeout_.has_value())
+        proc.setTimeout(*timeout_);
+    if (cancellation_.has_value())
+        proc.setCancellation(*cancellation_);
+    return proc;
+}
+
+// The captured output is handed over by move; it is never copied on its way to the caller
+template <EnumType E>
+void BrewCommand<E>::collect(BarrelCmd::Proc& proc) {
+    stream_dump_ = proc.takeStreamDump();
+    error_dump_ = proc.takeErrorDump();
+    spills_ = {proc.getSpilledStream(), proc.getSpilledError()};
+    termination_ = proc.getTermination();
+    exit_status_ = proc.getExitStatus() == INT_MIN ? BAD_EXIT_ST : proc.getExitStatus();
+    metrics_ = proc.getMetrics();
+
+    if (getLockClass(cmd_) == BrewLockClass::EXCLUSIVE)
+        ++Brew::state_generation;
+    report(false);
+}
+
+template <EnumType E>
+void BrewCommand<E>::report(bool on_worker) {
+    metrics_.queued = queued_;
+    queued_ = {};
+    BrewMetrics::report({head_, argv_, exit_status_, termination_, metrics_, on_worker, env_.getName()});
+}
+
+// Hands output which no process of this command produced (e.g. served from memory) to the
+// output handlers, tagged with the stream each part would have come from
+template <EnumType E>
+void BrewCommand<E>::replay(BarrelCmd::Stream stream) const {
+    using BarrelCmd::Stream;
+    auto const deliver = [this](Stream tag, std::string_view output) {
+        if (chunk_handler_ && !output.empty())
+            chunk_handler_(tag, output);
+        if (line_handler_) {
+            for (std::string_view const line : BarrelCmd::LineView(output))
+                line_handler_(tag, line);
+        }
+    };
+    deliver(stream == Stream::STDOUT_STDERR_SPLIT ? Stream::STDOUT : stream, stream_dump_);
+    if (stream == Stream::STDOUT_STDERR_SPLIT)
+        deliver(Stream::STDERR, error_dump_);
+}
+
+template <EnumType E>
+void BrewCommand<E>::execute(BarrelCmd::Stream stream) {
+    BarrelCmd::Proc proc = makeProc(stream);
     proc.execute();
-    stream_dump_ = proc.getStreamDump();
-    exit_status_ = proc.getExitStatus();
+    collect(proc);
+}
+
+template <EnumType E>
+BarrelCmd::Task<> BrewCommand<E>::run(BarrelCmd::Reactor& reactor, BarrelCmd::Stream stream) {
+    BarrelCmd::Proc proc = makeProc(stream);
+    co_await BarrelCmd::ProcAwaiter(proc, reactor);
+    collect(proc);
 }
 
 #endif
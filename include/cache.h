@@ -0,0 +1,311 @@
+/*!
+ * This file is part of Barrel, a header-only C++ library that provides
+ * programmatic access to the Homebrew command line interface.
+ *
+ * Copyright (C) 2022 aydwi <contact@aydwi.com>
+ *
+ * Barrel is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*! \file  cache.h
+ *  \brief Serve repeated read-only Homebrew queries from memory.
+ */
+
+#ifndef CACHE_H__
+#define CACHE_H__
+
+#include "barrel.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+inline extern std::size_t const CACHE_DEFAULT_CAPACITY{64 * 1024 * 1024};
+
+/*! \brief Snapshot of the counters kept by a BrewCache.
+ */
+struct BrewCacheStats {
+    std::uint64_t hits{0};          /*!< Executions served from memory */
+    std::uint64_t misses{0};        /*!< Cacheable executions which had to run Homebrew */
+    std::uint64_t invalidations{0}; /*!< Times the installation's state changed under the cache */
+    std::uint64_t evictions{0};     /*!< Entries dropped to stay within capacity */
+    std::size_t entries{0};         /*!< Entries currently cached */
+    std::size_t bytes{0};           /*!< Approximate memory held by the cached entries */
+
+    double getHitRate() const {
+        return hits + misses == 0 ? 0.0 : static_cast<double>(hits) / static_cast<double>(hits + misses);
+    }
+};
+
+/*! \brief Whether the result of a command is a pure function of the installation's state,
+ *         and may therefore be served from a BrewCache.
+ */
+template <EnumType E>
+constexpr bool isCacheable(E key) {
+    return getCommandInfo(key).has(BrewCommandFlag::CACHEABLE);
+}
+
+/*! \brief An opt-in, in-memory cache of the results of read-only commands against one
+ *         Homebrew installation.
+ *
+ *  Results are keyed on the command's full argument vector (which starts with the
+ *  installation's path), the changes its BrewEnvProfile makes to the environment, and the
+ *  captured stream(s). Changes made to this process's own environment are not told apart.
+ *  Only successful executions of commands for which isCacheable() holds are cached;
+ *  everything else passes through.
+ *
+ *  The whole cache is invalidated whenever the installation's state changes: when the
+ *  Cellar, Caskroom, `opt`, pin/link records, taps, the Homebrew repository, or the API
+ *  data in `$HOMEBREW_CACHE/api` get a new modification time, or when a mutating command
+ *  (BrewLockClass::EXCLUSIVE) is executed through Barrel in this process. Least recently
+ *  used entries are evicted beyond the configured capacity.
+ *
+ *  Results served from memory are handed to the command's output handlers, all at once, and
+ *  reported to BrewMetrics observers like any other execution, with empty timings.
+ */
+class BrewCache {
+private:
+    struct Entry {
+        std::string stream_dump;
+        std::string error_dump;
+        int exit_status;
+        std::list<std::string>::iterator lru;
+    };
+
+private:
+    std::filesystem::path prefix_;
+    std::filesystem::path repository_;
+    std::size_t capacity_;
+
+private:
+    mutable std::mutex mutex_{};
+    std::unordered_map<std::string, Entry> entries_{};
+    std::list<std::string> lru_{};
+    std::vector<std::filesystem::path> watched_{};
+    std::vector<std::filesystem::file_time_type> fingerprint_{};
+    std::uint64_t generation_{0};
+    std::uint64_t epoch_{0};
+    BrewCacheStats stats_{};
+
+private:
+    void watch();
+    std::vector<std::filesystem::file_time_type> snapshot() const;
+    void revalidate();
+    void dropAll();
+    void evict();
+    static std::size_t footprint(std::string const&, Entry const&);
+
+public:
+    /*! \brief Constructor for BrewCache.
+     *
+     *  \param brew An object of type ::Brew, the installation whose results are cached
+     *  \param capacity Approximate upper bound on the memory held by cached entries, in bytes
+     */
+    explicit BrewCache(Brew const&, std::size_t = CACHE_DEFAULT_CAPACITY);
+
+public:
+    /*! \brief Execute a command, or serve its results from the cache. The command's results
+     *         are populated either way.
+     *
+     *  \param cmd The command to execute
+     *  \param stream The stream(s) to capture
+     *
+     *  \return `true` if the results were served from the cache
+     */
+    template <EnumType E>
+    bool execute(BrewCommand<E>&, BarrelCmd::Stream = BarrelCmd::Stream::STDOUT_STDERR);
+
+    void clear();
+    BrewCacheStats getStats() const;
+};
+
+inline BrewCache::BrewCache(Brew const& brew, std::size_t capacity) : capacity_(capacity) {
+    BarrelCmd::Layout const layout(brew.getInstallPath());
+    prefix_ = layout.getPrefix();
+    repository_ = layout.getRepository();
+
+    generation_ = Brew::state_generation.load();
+    watch();
+    fingerprint_ = snapshot();
+}
+
+inline void BrewCache::watch() {
+    watched_ = {prefix_ / "Cellar",
+                prefix_ / "Caskroom",
+                prefix_ / "opt",
+                prefix_ / "var" / "homebrew" / "pinned",
+                prefix_ / "var" / "homebrew" / "linked",
+                repository_ / ".git",
+                repository_ / "Library" / "Taps"};
+
+    // Every tap is a git checkout; `brew update` and `brew tap` touch its .git directory
+    std::error_code ec;
+    for (auto const& user : std::filesystem::directory_iterator(repository_ / "Library" / "Taps", ec)) {
+        watched_.push_back(user.path());
+        std::error_code user_ec;
+        for (auto const& tap : std::filesystem::directory_iterator(user.path(), user_ec)) {
+            watched_.push_back(tap.path());
+            watched_.push_back(tap.path() / ".git");
+        }
+    }
+
+    // What `info`, `deps` or `outdated` print about formulae which aren't installed comes from
+    // the API data `brew update` downloads (formula.jws.json, cask.jws.json, ...)
+    std::filesystem::path const cache = BarrelCmd::getHomebrewCache();
+    if (cache.empty())
+        return;
+    watched_.push_back(cache / "api");
+    for (auto const& file : std::filesystem::directory_iterator(cache / "api", ec)) {
+        if (file.path().filename().string().ends_with(".jws.json"))
+            watched_.push_back(file.path());
+    }
+}
+
+inline std::vector<std::filesystem::file_time_type> BrewCache::snapshot() const {
+    std::vector<std::filesystem::file_time_type> fingerprint;
+    fingerprint.reserve(watched_.size());
+    for (auto const& path : watched_) {
+        std::error_code ec;
+        fingerprint.push_back(std::filesystem::last_write_time(path, ec)); // min() if missing
+    }
+    return fingerprint;
+}
+
+inline void BrewCache::revalidate() {
+    std::uint64_t const generation = Brew::state_generation.load();
+    auto fingerprint = snapshot();
+    if (generation == generation_ && fingerprint == fingerprint_)
+        return;
+
+    if (!entries_.empty()) {
+        ++stats_.invalidations;
+        dropAll();
+    }
+    generation_ = generation;
+    ++epoch_;
+    watch();
+    fingerprint_ = snapshot();
+}
+
+inline void BrewCache::dropAll() {
+    entries_.clear();
+    lru_.clear();
+    stats_.bytes = 0;
+}
+
+inline std::size_t BrewCache::footprint(std::string const& key, Entry const& entry) {
+    return sizeof(Entry) + 2 * key.capacity() + entry.stream_dump.capacity() + entry.error_dump.capacity();
+}
+
+inline void BrewCache::evict() {
+    while (stats_.bytes > capacity_ && !lru_.empty()) {
+        auto const node = entries_.find(lru_.back());
+        stats_.bytes -= footprint(node->first, node->second);
+        entries_.erase(node);
+        lru_.pop_back();
+        ++stats_.evictions;
+    }
+}
+
+inline void BrewCache::clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    dropAll();
+}
+
+inline BrewCacheStats BrewCache::getStats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    BrewCacheStats stats = stats_;
+    stats.entries = entries_.size();
+    return stats;
+}
+
+template <EnumType E>
+bool BrewCache::execute(BrewCommand<E>& cmd, BarrelCmd::Stream stream) {
+    // Output captured under a bounded policy is incomplete, and normalized output isn't Homebrew's
+    if (!isCacheable(cmd.getCommand()) || cmd.capture_.mode != BarrelCmd::CaptureMode::RETAIN ||
+        cmd.normalize_) {
+        cmd.execute(stream);
+        return false;
+    }
+    cmd.checkBound();
+
+    // Led by how many variables follow, so that none is mistaken for an argument. They're
+    // spelled the way they'd appear in an environment block, unset ones bare
+    std::vector<BarrelCmd::EnvChange> const& changes = cmd.env_.getChanges();
+    std::string key = std::to_string(changes.size());
+    for (BarrelCmd::EnvChange const& change : changes) {
+        key.append(1, '\0').append(change.key);
+        if (change.value.has_value())
+            key.append("=").append(*change.value);
+    }
+    key += '\0';
+    key += cmd.getArgv().join(std::string(1, '\0'));
+    key += '\0';
+    key += std::to_string(static_cast<int>(stream));
+
+    std::uint64_t epoch;
+    bool hit;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        revalidate();
+        epoch = epoch_;
+
+        auto const node = entries_.find(key);
+        hit = node != entries_.end();
+        if (hit) {
+            ++stats_.hits;
+            lru_.splice(lru_.begin(), lru_, node->second.lru);
+            cmd.stream_dump_ = node->second.stream_dump;
+            cmd.error_dump_ = node->second.error_dump;
+            cmd.exit_status_ = node->second.exit_status;
+            cmd.termination_ = BarrelCmd::Termination::EXITED;
+            cmd.metrics_ = {};
+            cmd.spills_ = {};
+        } else {
+            ++stats_.misses;
+        }
+    }
+
+    if (hit) {
+        cmd.replay(stream);
+        cmd.report(false);
+        return true;
+    }
+
+    cmd.execute(stream);
+    if (cmd.getExitStatus() != EXIT_SUCCESS)
+        return false;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    revalidate();
+    if (epoch != epoch_ || entries_.count(key) != 0)
+        return false; // The installation changed while the command was running
+
+    lru_.push_front(key);
+    Entry& entry = entries_
+                       .emplace(std::move(key), Entry{cmd.getStreamDump(), cmd.getErrorDump(),
+                                                      cmd.getExitStatus(), lru_.begin()})
+                       .first->second;
+    stats_.bytes += footprint(lru_.front(), entry);
+    evict();
+    return false;
+}
+
+#endif
@@ -0,0 +1,505 @@
+/*!
+ * This file is part of Barrel, a header-only C++ library that provides
+ * programmatic access to the Homebrew command line interface.
+ *
+ * Copyright (C) 2022 aydwi <contact@aydwi.com>
+ *
+ * Barrel is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*! \file  coalescer.h
+ *  \brief Combine per-formula queries into multi-formula Homebrew invocations.
+ */
+
+#ifndef COALESCER_H__
+#define COALESCER_H__
+
+#include "barrel.h"
+#include "json.h"
+#include "pool.h"
+#include "text.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/*! \brief The result of one name's query through a BrewCoalescer.
+ */
+struct BrewCoalescedResult {
+    std::string stream_dump{}; /*!< `stdout`, as a query for this name alone would have printed it */
+    std::string error_dump{};  /*!< `stderr`; only captured when the name was executed on its own */
+    int exit_status{BAD_EXIT_ST};
+    std::size_t batch_size{0}; /*!< Number of names in the invocation which produced this result */
+};
+
+/*! \brief Snapshot of the counters kept by a BrewCoalescer.
+ */
+struct BrewCoalescerStats {
+    std::uint64_t requests{0};    /*!< Names submitted */
+    std::uint64_t invocations{0}; /*!< Times Homebrew was executed */
+    std::uint64_t retries{0};     /*!< Invocations re-issuing part of a batch which failed */
+};
+
+namespace BarrelCmd {
+
+/*! \brief How the output of a multi-name invocation is split back into per-name results.
+ */
+enum class Splitter {
+    NONE,     /*!< Not splittable; every name is executed on its own */
+    JSON_V1,  /*!< An array of formula objects (`info --json=v1`) */
+    JSON_V2,  /*!< An object of "formulae" and "casks" arrays (`info`/`outdated` `--json=v2`) */
+    LINES,    /*!< One "name: ..." line per name (`desc`, `deps --for-each`) */
+    FOR_EACH, /*!< As LINES, from `deps` run with `--for-each` on the caller's behalf */
+};
+
+inline bool hasFlag(std::vector<std::string> const& flags, std::initializer_list<std::string_view> any) {
+    return std::any_of(flags.begin(), flags.end(), [any](std::string const& flag) {
+        return std::find(any.begin(), any.end(), flag) != any.end();
+    });
+}
+
+/*! \brief The splitter for a command and its flags. Combinations whose output is not keyed
+ *         by name, or which ignore names altogether (e.g. `--installed`), are not split.
+ */
+template <EnumType E>
+Splitter getSplitter(E cmd, std::vector<std::string> const& flags) {
+    if constexpr (!std::is_same_v<E, BrewCommandType::Builtin>) {
+        return Splitter::NONE;
+    } else {
+        if (hasFlag(flags, {"--installed", "--eval-all", "--all"}))
+            return Splitter::NONE;
+
+        switch (cmd) {
+        case BrewCommandType::Builtin::INFO:
+            if (hasFlag(flags, {"--json=v2"}))
+                return Splitter::JSON_V2;
+            return hasFlag(flags, {"--json", "--json=v1"}) ? Splitter::JSON_V1 : Splitter::NONE;
+        case BrewCommandType::Builtin::OUTDATED:
+            return hasFlag(flags, {"--json=v2"}) ? Splitter::JSON_V2 : Splitter::NONE;
+        case BrewCommandType::Builtin::DESC:
+            if (hasFlag(flags, {"-s", "-n", "-d", "--search", "--name", "--description"}))
+                return Splitter::NONE; // Searching prints whatever matches, not the names given
+            return Splitter::LINES;
+        case BrewCommandType::Builtin::DEPS:
+            if (hasFlag(flags, {"--tree", "--graph", "--dot", "--annotate", "--union"}))
+                return Splitter::NONE;
+            return hasFlag(flags, {"--for-each"}) ? Splitter::LINES : Splitter::FOR_EACH;
+        default:
+            return Splitter::NONE;
+        }
+    }
+}
+
+/*! \brief Whether a key Homebrew printed (a name, or a fully qualified "user/tap/name")
+ *         refers to the requested name.
+ */
+inline bool isSameName(std::string_view key, std::string_view name) {
+    auto const qualifies = [](std::string_view full, std::string_view bare) {
+        return full.size() > bare.size() && full.ends_with(bare) &&
+               full[full.size() - bare.size() - 1] == '/';
+    };
+    return key == name || qualifies(key, name) || qualifies(name, key);
+}
+
+/*! \brief The `--json=v2` document of a name left out of the output, e.g. one which isn't
+ *         outdated.
+ */
+inline constexpr std::string_view UNLISTED_JSON_V2{"{\"formulae\":[],\"casks\":[]}\n"};
+
+/*! \brief Split a JSON document into one document per name, shaped as if each name had been
+ *         queried alone.
+ *
+ *  \return The documents, or `std::nullopt` if the output can't be attributed to every name
+ */
+inline std::optional<std::vector<std::string>> splitJson(std::string_view output,
+                                                               std::vector<std::string_view> const& names,
+                                                               Splitter splitter, bool absent_is_empty) {
+    std::optional<BrewInfo> info;
+    try {
+        info.emplace(output);
+    } catch (std::runtime_error const&) {
+        return std::nullopt;
+    }
+
+    std::vector<std::string> parts;
+    parts.reserve(names.size());
+    for (std::string_view const name : names) {
+        std::span<BrewFormula const> const formulae = info->getFormulae();
+        auto const formula = std::find_if(formulae.begin(), formulae.end(), [name](auto const& entry) {
+            return isSameName(entry.full_name, name) || isSameName(entry.name, name) ||
+                   std::find(entry.aliases.begin(), entry.aliases.end(), name) != entry.aliases.end();
+        });
+        std::span<BrewCask const> const casks = info->getCasks();
+        auto const cask = std::find_if(casks.begin(), casks.end(), [name](auto const& entry) {
+            return isSameName(entry.full_token, name);
+        });
+
+        std::string_view formula_raw, cask_raw;
+        if (formula != formulae.end())
+            formula_raw = formula->raw;
+        else if (cask != casks.end())
+            cask_raw = cask->raw;
+        else if (!absent_is_empty)
+            return std::nullopt; // Possibly renamed or aliased in a way only Homebrew knows
+
+        std::string part;
+        if (formula_raw.empty() && cask_raw.empty() && splitter == Splitter::JSON_V2) {
+            part = UNLISTED_JSON_V2;
+        } else if (splitter == Splitter::JSON_V1) {
+            if (!cask_raw.empty())
+                return std::nullopt;
+            part = "[" + std::string(formula_raw) + "]\n";
+        } else {
+            part = "{\"formulae\":[" + std::string(formula_raw) + "],\"casks\":[" + std::string(cask_raw) +
+                   "]}\n";
+        }
+        parts.push_back(std::move(part));
+    }
+    return parts;
+}
+
+/*! \brief Split "name: ..." lines into the lines of each name. With `reflow`, the words after
+ *         the colon are printed one per line instead, as `deps` does without `--for-each`.
+ *
+ *  \return The lines, or `std::nullopt` if the output can't be attributed to every name
+ */
+inline std::optional<std::vector<std::string>> splitLines(std::string_view output,
+                                                                std::vector<std::string_view> const& names,
+                                                                bool reflow) {
+    std::vector<std::pair<std::string_view, std::string_view>> lines; // Key, and the rest after ": "
+    for (std::string_view const line : LineView(output)) {
+        std::size_t const colon = line.find(':');
+        if (colon == std::string_view::npos)
+            return std::nullopt;
+        std::string_view rest = line.substr(colon + 1);
+        rest.remove_prefix(std::min(rest.find_first_not_of(' '), rest.size()));
+        lines.emplace_back(line.substr(0, colon), rest);
+    }
+
+    std::vector<std::string> parts;
+    parts.reserve(names.size());
+    for (std::string_view const name : names) {
+        auto const found = std::find_if(lines.begin(), lines.end(),
+                                        [name](auto const& line) { return isSameName(line.first, name); });
+        if (found == lines.end())
+            return std::nullopt;
+
+        std::string part;
+        if (!reflow) {
+            part.append(found->first).append(": ").append(found->second).push_back('\n');
+        } else {
+            std::string_view words = found->second;
+            while (!words.empty()) {
+                std::size_t const space = std::min(words.find(' '), words.size());
+                if (space != 0)
+                    part.append(words.substr(0, space)).push_back('\n');
+                words.remove_prefix(std::min(space + 1, words.size()));
+            }
+        }
+        parts.push_back(std::move(part));
+    }
+    return parts;
+}
+
+} // namespace BarrelCmd
+
+/*! \brief Coalesce queries about single formulae (or casks) into invocations of Homebrew
+ *         covering many names at once, whose cost is dominated by Homebrew's start-up.
+ *
+ *  Names submitted for the same command and flags are collected for up to a short window,
+ *  or until a batch is full, and then queried with one invocation on a pool of threads. Its
+ *  output is split back into per-name results, which read as if each name had been queried
+ *  alone:
+ *
+ *  - `info --json=v2` / `outdated --json=v2` / `info --json=v1`, by the records' names
+ *    (each result is a compact document holding that name's record)
+ *  - `desc`, by the "name: description" lines
+ *  - `deps`, run with `--for-each` and split by its "name: deps" lines
+ *
+ *  Each result carries the exit status of that name queried alone, as `outdated` exits 1 for a
+ *  name it lists. If an invocation fails (for `outdated`, exits 1 listing none of the names), or
+ *  its output can't be attributed to every name, the batch is halved and each half retried,
+ *  down to single names, so that one unknown name doesn't sink the rest. Other read-only
+ *  commands which take names are accepted too, but executed once per name.
+ */
+class BrewCoalescer {
+private:
+    using Clock = std::chrono::steady_clock;
+    using Invoke = std::function<BrewCoalescedResult(std::vector<std::string_view> const&)>;
+
+    struct Request {
+        std::string name;
+        std::promise<BrewCoalescedResult> promise;
+    };
+
+    struct Batch {
+        Invoke invoke;
+        BarrelCmd::Splitter splitter;
+        bool absent_is_empty;
+        std::vector<Request> requests;
+        Clock::time_point deadline;
+    };
+
+private:
+    Brew brew_;
+    std::size_t max_batch_;
+    Clock::duration window_;
+
+private:
+    std::mutex mutex_{};
+    std::condition_variable cv_{};
+    std::map<std::string, std::shared_ptr<Batch>> pending_{}; // By command head and flags
+    BrewCoalescerStats stats_{};
+    bool stop_{false};
+    std::thread timer_{};
+
+private:
+    BarrelCmd::ThreadPool pool_; // Declared last, so queued batches finish before the above go away
+
+private:
+    void tick();
+    void dispatch(std::shared_ptr<Batch>);
+    void resolve(std::shared_ptr<Batch>, std::size_t, std::size_t, bool);
+    void count(std::uint64_t BrewCoalescerStats::*);
+
+public:
+    /*! \brief Constructor for BrewCoalescer.
+     *
+     *  \param brew An object of type ::Brew
+     *  \param max_batch Most names per invocation
+     *  \param window Longest a name waits for others to join its batch
+     *  \param threads Most invocations executing at once
+     */
+    explicit BrewCoalescer(Brew const&, std::size_t = 256,
+                           std::chrono::milliseconds = std::chrono::milliseconds(10),
+                           std::size_t = std::thread::hardware_concurrency());
+    BrewCoalescer(BrewCoalescer const&) = delete;
+    BrewCoalescer& operator=(BrewCoalescer const&) = delete;
+
+    /*! \brief Executes whatever is pending, and waits for it to finish.
+     */
+    ~BrewCoalescer();
+
+public:
+    /*! \brief Query one name.
+     *
+     *  \param cmd A read-only command taking formula or cask names
+     *  \param name The name to query
+     *  \param flags The options to pass along with it; names are only batched with others
+     *               submitted with the same options
+     *
+     *  \return A future which becomes ready once the name has been queried
+     */
+    template <EnumType E>
+    std::future<BrewCoalescedResult> submit(E, std::string_view, std::vector<std::string> = {});
+
+    /*! \brief Execute every pending batch now, without waiting for its window to close.
+     */
+    void flush();
+
+    BrewCoalescerStats getStats();
+};
+
+inline BrewCoalescer::BrewCoalescer(Brew const& brew, std::size_t max_batch,
+                                    std::chrono::milliseconds window, std::size_t threads)
+    : brew_(brew), max_batch_(std::max<std::size_t>(max_batch, 1)), window_(window), pool_(threads) {
+    timer_ = std::thread(&BrewCoalescer::tick, this);
+}
+
+inline BrewCoalescer::~BrewCoalescer() {
+    flush();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    timer_.join();
+}
+
+// Closes the windows of pending batches as they expire
+inline void BrewCoalescer::tick() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stop_) {
+        if (pending_.empty()) {
+            cv_.wait(lock);
+            continue;
+        }
+
+        Clock::time_point earliest = Clock::time_point::max();
+        Clock::time_point const now = Clock::now();
+        for (auto it = pending_.begin(); it != pending_.end();) {
+            if (it->second->deadline <= now) {
+                dispatch(std::move(it->second));
+                it = pending_.erase(it);
+            } else {
+                earliest = std::min(earliest, it->second->deadline);
+                ++it;
+            }
+        }
+        if (earliest != Clock::time_point::max())
+            cv_.wait_until(lock, earliest);
+    }
+}
+
+inline void BrewCoalescer::dispatch(std::shared_ptr<Batch> batch) {
+    std::size_t const size = batch->requests.size();
+    pool_.submit([this, batch = std::move(batch), size]() { resolve(batch, 0, size, false); });
+}
+
+inline void BrewCoalescer::count(std::uint64_t BrewCoalescerStats::*counter) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++(stats_.*counter);
+}
+
+// Answers requests [first, last) of a batch, halving the range whenever an invocation
+// covering it fails or can't be split
+inline void BrewCoalescer::resolve(std::shared_ptr<Batch> batch, std::size_t first, std::size_t last,
+                                   bool retry) {
+    std::vector<std::string_view> names;
+    for (std::size_t idx = first; idx < last; ++idx)
+        names.push_back(batch->requests[idx].name);
+
+    BrewCoalescedResult outcome;
+    try {
+        count(&BrewCoalescerStats::invocations);
+        if (retry)
+            count(&BrewCoalescerStats::retries);
+        outcome = batch->invoke(names);
+    } catch (...) {
+        for (std::size_t idx = first; idx < last; ++idx)
+            batch->requests[idx].promise.set_exception(std::current_exception());
+        return;
+    }
+
+    if (names.size() == 1) {
+        outcome.batch_size = 1;
+        batch->requests[first].promise.set_value(std::move(outcome));
+        return;
+    }
+
+    // `outdated` exits 1 whenever it lists a name it was given, which isn't a failure
+    std::optional<std::vector<std::string>> parts{};
+    bool const listed = batch->absent_is_empty && outcome.exit_status == EXIT_FAILURE;
+    if (outcome.exit_status == EXIT_SUCCESS || listed) {
+        switch (batch->splitter) {
+        case BarrelCmd::Splitter::JSON_V1:
+        case BarrelCmd::Splitter::JSON_V2:
+            parts =
+                BarrelCmd::splitJson(outcome.stream_dump, names, batch->splitter, batch->absent_is_empty);
+            if (listed && parts.has_value() &&
+                std::all_of(parts->begin(), parts->end(),
+                            [](auto const& part) { return part == BarrelCmd::UNLISTED_JSON_V2; }))
+                parts.reset();
+            break;
+        default:
+            parts = BarrelCmd::splitLines(outcome.stream_dump, names,
+                                          batch->splitter == BarrelCmd::Splitter::FOR_EACH);
+        }
+    }
+
+    if (parts.has_value()) {
+        for (std::size_t idx = first; idx < last; ++idx) {
+            std::string& part = (*parts)[idx - first];
+            int const status =
+                batch->absent_is_empty && part != BarrelCmd::UNLISTED_JSON_V2 ? EXIT_FAILURE : EXIT_SUCCESS;
+            BrewCoalescedResult result{std::move(part), {}, status, names.size()};
+            batch->requests[idx].promise.set_value(std::move(result));
+        }
+        return;
+    }
+
+    std::size_t const middle = first + (last - first) / 2;
+    pool_.submit([this, batch, first, middle]() { resolve(batch, first, middle, true); });
+    resolve(batch, middle, last, true);
+}
+
+template <EnumType E>
+std::future<BrewCoalescedResult> BrewCoalescer::submit(E cmd, std::string_view name,
+                                                      std::vector<std::string> flags) {
+    if (getLockClass(cmd) != BrewLockClass::SHARED || !acceptsFormulae(cmd))
+        throw std::runtime_error("BrewCoalescer::submit(): Only read-only commands taking names qualify");
+    if (name.empty() || name.starts_with("-"))
+        throw std::runtime_error("BrewCoalescer::submit(): Not a name: '" + std::string(name) + "'");
+
+    BarrelCmd::Splitter const splitter = BarrelCmd::getSplitter(cmd, flags);
+    std::string key(getCommandHead(cmd));
+    for (auto const& flag : flags) {
+        key += '\0';
+        key += flag;
+    }
+
+    Request request{std::string(name), {}};
+    std::future<BrewCoalescedResult> result = request.promise.get_future();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++stats_.requests;
+    std::shared_ptr<Batch>& batch = pending_[key];
+    if (!batch) {
+        Invoke invoke = [this, cmd, flags = std::move(flags), splitter](auto const& names) {
+            BrewCommand<E> command(brew_, cmd);
+            for (auto const& flag : flags)
+                command.append(flag);
+            if (splitter == BarrelCmd::Splitter::FOR_EACH && names.size() > 1)
+                command.append(std::string_view("--for-each"));
+            for (auto const batch_name : names)
+                command.append(batch_name);
+            command.execute(BarrelCmd::Stream::STDOUT_STDERR_SPLIT);
+            return BrewCoalescedResult{std::move(command.stream_dump_), std::move(command.error_dump_),
+                                       command.exit_status_, names.size()};
+        };
+        // A name which isn't outdated is simply left out of the output, and one which is makes
+        // it exit 1, for each part as for the whole
+        bool absent_is_empty = false;
+        if constexpr (std::is_same_v<E, BrewCommandType::Builtin>)
+            absent_is_empty = cmd == BrewCommandType::Builtin::OUTDATED;
+        batch = std::make_shared<Batch>(
+            Batch{std::move(invoke), splitter, absent_is_empty, {}, Clock::now() + window_});
+        cv_.notify_one();
+    }
+    batch->requests.push_back(std::move(request));
+
+    if (splitter == BarrelCmd::Splitter::NONE || batch->requests.size() >= max_batch_) {
+        dispatch(std::move(batch));
+        pending_.erase(key);
+    }
+    return result;
+}
+
+inline void BrewCoalescer::flush() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& [key, batch] : pending_)
+        dispatch(std::move(batch));
+    pending_.clear();
+}
+
+inline BrewCoalescerStats BrewCoalescer::getStats() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+#endif
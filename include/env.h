@@ -0,0 +1,190 @@
+/*!
+ * This file is part of Barrel, a header-only C++ library that provides
+ * programmatic access to the Homebrew command line interface.
+ *
+ * Copyright (C) 2022 aydwi <contact@aydwi.com>
+ *
+ * Barrel is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*! \file  env.h
+ *  \brief Choose the environment Homebrew is executed in.
+ */
+
+#ifndef ENV_H__
+#define ENV_H__
+
+#include "proc.h"
+
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+/*! \brief A named set of changes to the environment Homebrew is executed in, e.g. to turn
+ *         off the work it does implicitly (auto-updating, cleaning up, sending analytics).
+ *
+ *  The environment block is built once, from this process's environment as it is when the
+ *  profile is first used, and is shared by every copy of the profile until one of them is
+ *  changed. Variables are handed to Homebrew as they are; nothing goes through a shell.
+ *
+ *  \code
+ *  Brew brew;
+ *  brew.setEnvProfile(BrewEnvProfile::fast());
+ *
+ *  BrewCommand<BrewCommandType::Builtin> install(brew, BrewCommandType::Builtin::INSTALL, "wget");
+ *  install.setEnv("HOMEBREW_VERBOSE", "1"); // For this command only
+ *  install.execute();
+ *  \endcode
+ */
+class BrewEnvProfile {
+private:
+    struct Built {
+        std::once_flag once{};
+        std::shared_ptr<BarrelCmd::Environment const> environment{};
+    };
+
+private:
+    std::string name_;
+    std::vector<BarrelCmd::EnvChange> changes_{};
+    std::vector<std::pair<std::string, std::string>> disabled_{}; // By the variable turning it off
+    std::shared_ptr<Built> built_{std::make_shared<Built>()};
+
+private:
+    void change(std::string_view, std::optional<std::string_view>);
+
+public:
+    /*! \brief Constructor for BrewEnvProfile. A profile without changes leaves Homebrew with
+     *         this process's environment, as it is at every execution.
+     *
+     *  \param name A name to tell executions under the profile apart by (see BrewCounters)
+     */
+    explicit BrewEnvProfile(std::string = "inherit");
+
+    /*! \brief The profile for scripted use: no auto-update before `install`, `upgrade` and
+     *         `tap`, no cleanup after them, no check of installed dependents after `upgrade`,
+     *         no analytics, and no environment hints. What it turns off is listed by
+     *         getDisabled().
+     */
+    static BrewEnvProfile fast();
+
+public:
+    /*! \brief Set a variable, replacing any earlier change to it.
+     *
+     *  \param key The variable's name
+     *  \param value Its value
+     *  \param disables What setting it turns off in Homebrew, if anything, for getDisabled()
+     *
+     *  \return The profile itself
+     */
+    BrewEnvProfile& set(std::string_view, std::string_view, std::string_view = {});
+
+    /*! \brief Unset a variable, replacing any earlier change to it.
+     *
+     *  \return The profile itself
+     */
+    BrewEnvProfile& unset(std::string_view);
+
+public:
+    std::string const& getName() const;
+    std::vector<BarrelCmd::EnvChange> const& getChanges() const;
+
+    /*! \brief What the profile turns off in Homebrew, e.g. "auto-update", to put measurements
+     *         of executions under it into context.
+     */
+    std::vector<std::string> getDisabled() const;
+
+    /*! \brief Whether the profile changes nothing.
+     */
+    bool isEmpty() const;
+
+    /*! \brief The environment block, built on first use. Empty if the profile changes nothing.
+     */
+    std::shared_ptr<BarrelCmd::Environment const> getEnvironment() const;
+};
+
+inline BrewEnvProfile::BrewEnvProfile(std::string name) : name_(std::move(name)){};
+
+inline BrewEnvProfile BrewEnvProfile::fast() {
+    BrewEnvProfile profile("fast");
+    profile.set("HOMEBREW_NO_AUTO_UPDATE", "1", "auto-update")
+        .set("HOMEBREW_NO_INSTALL_CLEANUP", "1", "cleanup after install, upgrade and reinstall")
+        .set("HOMEBREW_NO_INSTALLED_DEPENDENTS_CHECK", "1", "check of installed dependents after upgrade")
+        .set("HOMEBREW_NO_ANALYTICS", "1", "analytics")
+        .set("HOMEBREW_NO_ENV_HINTS", "1", "environment hints")
+        .set("HOMEBREW_NO_UPDATE_REPORT_NEW", "1", "report of new formulae and casks after update");
+    return profile;
+}
+
+inline void BrewEnvProfile::change(std::string_view key, std::optional<std::string_view> value) {
+    if (key.empty() || key.find_first_of(std::string_view("=\0", 2)) != std::string_view::npos)
+        throw std::runtime_error("BrewEnvProfile::change(): Invalid variable name '" + std::string(key) +
+                                 "'");
+    if (value.has_value() && value->find('\0') != std::string_view::npos)
+        throw std::runtime_error("BrewEnvProfile::change(): Value of " + std::string(key) + " contains NUL");
+
+    std::erase_if(changes_, [key](BarrelCmd::EnvChange const& change) { return change.key == key; });
+    std::erase_if(disabled_, [key](auto const& disabled) { return disabled.first == key; });
+    std::optional<std::string> owned;
+    if (value.has_value())
+        owned.emplace(*value);
+    changes_.push_back({std::string(key), std::move(owned)});
+    built_ = std::make_shared<Built>(); // Copies keep the block built for them
+}
+
+inline BrewEnvProfile& BrewEnvProfile::set(std::string_view key, std::string_view value,
+                                           std::string_view disables) {
+    change(key, value);
+    if (!disables.empty())
+        disabled_.emplace_back(key, disables);
+    return *this;
+}
+
+inline BrewEnvProfile& BrewEnvProfile::unset(std::string_view key) {
+    change(key, std::nullopt);
+    return *this;
+}
+
+inline std::string const& BrewEnvProfile::getName() const {
+    return name_;
+}
+
+inline std::vector<BarrelCmd::EnvChange> const& BrewEnvProfile::getChanges() const {
+    return changes_;
+}
+
+inline std::vector<std::string> BrewEnvProfile::getDisabled() const {
+    std::vector<std::string> disabled;
+    for (auto const& [key, description] : disabled_)
+        disabled.push_back(description);
+    return disabled;
+}
+
+inline bool BrewEnvProfile::isEmpty() const {
+    return changes_.empty();
+}
+
+inline std::shared_ptr<BarrelCmd::Environment const> BrewEnvProfile::getEnvironment() const {
+    if (changes_.empty())
+        return nullptr;
+    std::call_once(built_->once, [this]() {
+        built_->environment = std::make_shared<BarrelCmd::Environment const>(changes_);
+    });
+    return built_->environment;
+}
+
+#endif
@@ -0,0 +1,170 @@
+/*!
+ * This file is part of Barrel, a header-only C++ library that provides
+ * programmatic access to the Homebrew command line interface.
+ *
+ * Copyright (C) 2022 aydwi <contact@aydwi.com>
+ *
+ * Barrel is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*! \file  executor.h
+ *  \brief Execute batches of Homebrew commands on multiple threads.
+ */
+
+#ifndef EXECUTOR_H__
+#define EXECUTOR_H__
+
+#include "barrel.h"
+#include "pool.h"
+
+#include <chrono>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/*! \brief Execute BrewCommand objects of any BrewCommandType on a pool of threads, with
+ *         bounded parallelism.
+ *
+ *  Commands are scheduled according to their ::BrewLockClass. Read-only commands
+ *  (BrewLockClass::SHARED) run fully in parallel. Commands which mutate the installation
+ *  (BrewLockClass::EXCLUSIVE) run one at a time, in the order they were submitted, so they
+ *  never contend for Homebrew's lock files. Read-only commands keep running alongside them.
+ *
+ *  The executor does not own the commands; each one must outlive its execution.
+ */
+class BrewExecutor {
+private:
+    std::mutex exclusive_mutex_{};
+    std::deque<std::function<void()>> exclusive_queue_{};
+    bool exclusive_running_{false};
+
+private:
+    BarrelCmd::ThreadPool pool_; // Declared last, so queued jobs finish before the above go away
+
+private:
+    void dispatch(BrewLockClass, std::function<void()>);
+    void releaseExclusive();
+
+public:
+    /*! \brief Constructor for BrewExecutor.
+     *
+     *  \param threads Maximum number of commands executing at once. Defaults to the number
+     *                 of hardware threads.
+     */
+    explicit BrewExecutor(std::size_t = std::thread::hardware_concurrency());
+
+public:
+    /*! \brief Schedule a single command.
+     *
+     *  \param cmd The command to execute
+     *  \param stream The stream(s) to capture
+     *
+     *  \return A future which becomes ready once the command has executed
+     */
+    template <EnumType E>
+    std::future<void> submit(BrewCommand<E>&, BarrelCmd::Stream = BarrelCmd::Stream::STDOUT_STDERR);
+
+    /*! \brief Execute a batch of commands of any types, and wait for all of them to finish.
+     *         Rethrows the first exception raised by any of the executions.
+     *
+     *  \param cmds The commands to execute
+     */
+    template <typename... Cmds>
+    void execute(Cmds&...);
+
+    /*! \brief Execute a batch of commands of the same type, and wait for all of them to
+     *         finish. Rethrows the first exception raised by any of the executions.
+     *
+     *  \param cmds The commands to execute
+     */
+    template <EnumType E>
+    void execute(std::vector<BrewCommand<E>>&);
+};
+
+inline BrewExecutor::BrewExecutor(std::size_t threads) : pool_(threads){};
+
+inline void BrewExecutor::dispatch(BrewLockClass lock_class, std::function<void()> job) {
+    if (lock_class == BrewLockClass::SHARED) {
+        pool_.submit(std::move(job));
+        return;
+    }
+
+    std::function<void()> guarded = [this, job = std::move(job)]() {
+        job();
+        releaseExclusive();
+    };
+
+    std::lock_guard<std::mutex> lock(exclusive_mutex_);
+    if (exclusive_running_) {
+        exclusive_queue_.push_back(std::move(guarded));
+        return;
+    }
+    exclusive_running_ = true;
+    pool_.submit(std::move(guarded));
+}
+
+inline void BrewExecutor::releaseExclusive() {
+    std::lock_guard<std::mutex> lock(exclusive_mutex_);
+    if (exclusive_queue_.empty()) {
+        exclusive_running_ = false;
+        return;
+    }
+    pool_.submit(std::move(exclusive_queue_.front()));
+    exclusive_queue_.pop_front();
+}
+
+template <EnumType E>
+std::future<void> BrewExecutor::submit(BrewCommand<E>& cmd, BarrelCmd::Stream stream) {
+    auto task = std::make_shared<std::packaged_task<void()>>(
+        [&cmd, stream, submitted = std::chrono::steady_clock::now()]() {
+            cmd.queued_ = std::chrono::steady_clock::now() - submitted;
+            cmd.execute(stream);
+        });
+    std::future<void> result = task->get_future();
+
+    dispatch(getLockClass(cmd.getCommand()), [task]() { (*task)(); });
+    return result;
+}
+
+template <typename... Cmds>
+void BrewExecutor::execute(Cmds&... cmds) {
+    std::vector<std::future<void>> results;
+    results.reserve(sizeof...(cmds));
+    (results.push_back(submit(cmds)), ...);
+
+    for (auto& result : results)
+        result.wait();
+    for (auto& result : results)
+        result.get();
+}
+
+template <EnumType E>
+void BrewExecutor::execute(std::vector<BrewCommand<E>>& cmds) {
+    std::vector<std::future<void>> results;
+    results.reserve(cmds.size());
+    for (auto& cmd : cmds)
+        results.push_back(submit(cmd));
+
+    for (auto& result : results)
+        result.wait();
+    for (auto& result : results)
+        result.get();
+}
+
+#endif
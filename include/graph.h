@@ -0,0 +1,578 @@
+/*!
+ * This file is part of Barrel, a header-only C++ library that provides
+ * programmatic access to the Homebrew command line interface.
+ *
+ * Copyright (C) 2022 aydwi <contact@aydwi.com>
+ *
+ * Barrel is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*! \file  graph.h
+ *  \brief Answer dependency queries (deps, uses, leaves) from memory.
+ */
+
+#ifndef GRAPH_H__
+#define GRAPH_H__
+
+#include "barrel.h"
+#include "json.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace BarrelCmd {
+
+/*! \brief Hash for string-keyed containers, which allows lookups by `std::string_view`
+ *         without constructing a `std::string`.
+ */
+struct StringHash {
+    using is_transparent = void;
+
+    std::size_t operator()(std::string_view text) const {
+        return std::hash<std::string_view>{}(text);
+    }
+};
+
+} // namespace BarrelCmd
+
+/*! \brief How far a dependency query follows the graph.
+ */
+enum class BrewGraphScope {
+    DIRECT,    /*!< Only immediate dependencies/dependents, like `brew deps --1` or `brew uses` */
+    TRANSITIVE /*!< The full closure, like `brew deps` or `brew uses --recursive` */
+};
+
+/*! \brief An in-memory graph of formulae and their runtime dependencies, which answers the
+ *         questions of `brew deps`, `brew uses` and `brew leaves` without running Homebrew.
+ *
+ *  Formulae are numbered densely and the edges are stored in compressed sparse row form,
+ *  once in each direction, so traversals touch contiguous memory only. Dependencies named
+ *  by a formula but missing from the source document still get a node, so queries about
+ *  them work (they just have no dependencies of their own). Build and test dependencies
+ *  are not part of the graph.
+ *
+ *  The topology is fixed once built; what is installed is not. Pass mutating commands
+ *  executed against the installation to apply() to keep it current cheaply. If the Cellar
+ *  is known, any other mutating command executed through Barrel is noticed on the next
+ *  query, which re-reads the Cellar. Queries may run concurrently with each other and with
+ *  apply().
+ */
+class BrewGraph {
+private:
+    std::unordered_map<std::string, std::uint32_t, BarrelCmd::StringHash, std::equal_to<>> index_{};
+    std::vector<std::string_view> names_{}; // Views into the keys of index_
+    std::vector<std::uint32_t> dep_offsets_{};
+    std::vector<std::uint32_t> deps_{};
+    std::vector<std::uint32_t> use_offsets_{};
+    std::vector<std::uint32_t> uses_{};
+
+private:
+    mutable std::shared_mutex mutex_{};
+    mutable std::vector<std::uint8_t> installed_{};
+    mutable std::vector<std::uint8_t> on_request_{};
+    mutable std::uint64_t generation_{0};
+    std::filesystem::path cellar_{};
+
+private:
+    void build(std::span<BrewFormula const>);
+    void scanCellar() const;
+    std::shared_lock<std::shared_mutex> acquire() const;
+    std::uint32_t require(std::string_view) const;
+    std::vector<std::uint32_t> closure(std::uint32_t, bool, BrewGraphScope, bool) const;
+    std::vector<std::string_view> sortedNames(std::vector<std::uint32_t> const&) const;
+    std::span<std::uint32_t const> depsOf(std::uint32_t) const;
+    std::span<std::uint32_t const> usesOf(std::uint32_t) const;
+
+public:
+    /*! \brief Build the graph from parsed `brew info --json=v2` output. Use `--eval-all` (or
+     *         `--installed`, to cover only what is installed) to describe more than one formula.
+     *
+     *  \param info The parsed document, which need not outlive the graph
+     *  \param cellar The installation's Cellar. If given, the installed formulae are read
+     *                from it rather than from the document, and apply() re-reads it after
+     *                mutating commands it cannot interpret.
+     */
+    explicit BrewGraph(BrewInfo const&, std::filesystem::path = {});
+
+    /*! \brief Build the graph from Homebrew's local API cache (`formula.jws.json`, as kept
+     *         under `$HOMEBREW_CACHE/api` by `brew update`), reading installed formulae from
+     *         the Cellar.
+     *
+     *  \param cache_file Path to the API cache file (signed `formula.jws.json`, or a plain
+     *                    `formula.json` array)
+     *  \param cellar The installation's Cellar
+     */
+    static BrewGraph fromApiCache(std::filesystem::path const&, std::filesystem::path const&);
+
+    /*! \brief Build the graph from the API cache of the given installation, located the
+     *         way Homebrew locates it: `$HOMEBREW_CACHE`, or the platform's default cache.
+     *
+     *  \param brew An object of type ::Brew
+     */
+    static BrewGraph fromApiCache(Brew const&);
+
+    BrewGraph(BrewGraph&&) noexcept;
+
+public:
+    /*! \brief Dependencies of a formula, sorted by name.
+     *
+     *  \param name Name, full name or alias of the formula
+     *  \param scope Whether to resolve dependencies transitively
+     *  \param installed Only report installed dependencies
+     *
+     *  \throws std::out_of_range If the formula is unknown
+     */
+    std::vector<std::string_view> getDeps(std::string_view, BrewGraphScope = BrewGraphScope::TRANSITIVE,
+                                          bool = false) const;
+
+    /*! \brief Formulae which depend on a formula, sorted by name.
+     *
+     *  \param name Name, full name or alias of the formula
+     *  \param scope Whether to resolve dependents transitively
+     *  \param installed Only report installed dependents, like `brew uses --installed`
+     *
+     *  \throws std::out_of_range If the formula is unknown
+     */
+    std::vector<std::string_view> getUses(std::string_view, BrewGraphScope = BrewGraphScope::DIRECT,
+                                          bool = true) const;
+
+    /*! \brief Installed formulae which no other installed formula depends on, sorted by name.
+     *
+     *  \param on_request Only report formulae installed on request, like
+     *                    `brew leaves --installed-on-request`
+     */
+    std::vector<std::string_view> getLeaves(bool = false) const;
+
+    /*! \brief The given formulae and everything they depend on, ordered so that each formula
+     *         comes after all of its dependencies (i.e. a valid installation order).
+     *
+     *  \param names Names, full names or aliases of the formulae. If empty, the order covers
+     *               the whole graph.
+     *
+     *  \throws std::out_of_range If a formula is unknown
+     */
+    std::vector<std::string_view> getTopologicalOrder(std::span<std::string_view const> = {}) const;
+
+    /*! \brief The name of a formula, given its name, full name or alias.
+     *
+     *  \throws std::out_of_range If the formula is unknown
+     */
+    std::string_view getName(std::string_view) const;
+
+    bool contains(std::string_view) const;
+    bool isInstalled(std::string_view) const;
+    std::size_t size() const;
+
+public:
+    /*! \brief Update the installed state after a command has executed against the
+     *         installation. Installs (`install`, `reinstall`, `upgrade`) mark the named
+     *         formulae and their dependencies installed; `uninstall` marks the named formulae
+     *         uninstalled; `tab` marks whether they were installed on request. Any other
+     *         mutating command, or one that failed, causes the Cellar to be re-read if it is
+     *         known. Read-only commands are ignored.
+     *
+     *  \param cmd An executed command
+     *
+     *  \return `true` if the installed state may have changed
+     */
+    template <EnumType E>
+    bool apply(BrewCommand<E> const&);
+};
+
+inline BrewGraph::BrewGraph(BrewInfo const& info, std::filesystem::path cellar)
+    : cellar_(std::move(cellar)) {
+    generation_ = Brew::state_generation.load();
+    build(info.getFormulae());
+    if (!cellar_.empty())
+        scanCellar();
+}
+
+inline BrewGraph::BrewGraph(BrewGraph&& other) noexcept
+    : index_(std::move(other.index_)), names_(std::move(other.names_)),
+      dep_offsets_(std::move(other.dep_offsets_)), deps_(std::move(other.deps_)),
+      use_offsets_(std::move(other.use_offsets_)), uses_(std::move(other.uses_)),
+      installed_(std::move(other.installed_)), on_request_(std::move(other.on_request_)),
+      generation_(other.generation_), cellar_(std::move(other.cellar_)){};
+
+inline BrewGraph BrewGraph::fromApiCache(std::filesystem::path const& cache_file,
+                                         std::filesystem::path const& cellar) {
+    std::ifstream file(cache_file, std::ios::binary);
+    if (!file)
+        throw std::runtime_error("BrewGraph::fromApiCache(): Cannot read " + cache_file.string());
+    std::string const json{std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+
+    BarrelCmd::Arena arena;
+    return BrewGraph(BrewInfo(BarrelCmd::getApiPayload(json, arena)), cellar);
+}
+
+inline BrewGraph BrewGraph::fromApiCache(Brew const& brew) {
+    std::filesystem::path const cache = BarrelCmd::getHomebrewCache();
+    std::filesystem::path const signed_file = cache / "api" / "formula.jws.json";
+    std::filesystem::path const plain_file = cache / "api" / "formula.json";
+    std::error_code ec;
+    return fromApiCache(std::filesystem::exists(signed_file, ec) ? signed_file : plain_file,
+                        BarrelCmd::Layout(brew.getInstallPath()).getCellar());
+}
+
+inline void BrewGraph::build(std::span<BrewFormula const> formulae) {
+    // Number the described formulae first, then whatever else their dependencies name
+    auto intern = [this](std::string_view name) {
+        auto const id = static_cast<std::uint32_t>(names_.size());
+        auto const [node, added] = index_.try_emplace(std::string(name), id);
+        if (added)
+            names_.push_back(node->first);
+        return node->second;
+    };
+
+    std::vector<std::uint32_t> ids;
+    ids.reserve(formulae.size());
+    for (BrewFormula const& formula : formulae)
+        ids.push_back(intern(formula.name));
+    for (BrewFormula const& formula : formulae) {
+        for (std::string_view dep : formula.dependencies)
+            intern(dep);
+    }
+
+    std::size_t const nodes = names_.size();
+    installed_.assign(nodes, 0);
+    on_request_.assign(nodes, 0);
+
+    // A formula may be described more than once (`brew info a a`, or a catalogue merged with
+    // `--installed`). Its edges come from the first description, and it's installed if any says so
+    std::vector<std::size_t> described(nodes, formulae.size());
+    for (std::size_t idx = 0; idx < formulae.size(); ++idx) {
+        if (described[ids[idx]] == formulae.size())
+            described[ids[idx]] = idx;
+        if (formulae[idx].isInstalled())
+            installed_[ids[idx]] = 1;
+        if (formulae[idx].installed_on_request)
+            on_request_[ids[idx]] = 1;
+    }
+
+    // Forward edges, a row per node in the order of their ids
+    dep_offsets_.assign(nodes + 1, 0);
+    for (std::size_t node = 0; node < nodes; ++node) {
+        std::size_t const edges =
+            described[node] == formulae.size() ? 0 : formulae[described[node]].dependencies.size();
+        dep_offsets_[node + 1] = dep_offsets_[node] + static_cast<std::uint32_t>(edges);
+    }
+
+    deps_.resize(dep_offsets_.back());
+    for (std::size_t node = 0; node < nodes; ++node) {
+        if (described[node] == formulae.size())
+            continue;
+        std::uint32_t cursor = dep_offsets_[node];
+        for (std::string_view dep : formulae[described[node]].dependencies)
+            deps_[cursor++] = index_.find(dep)->second;
+    }
+
+    // Reverse edges, by counting sort over the forward ones
+    use_offsets_.assign(nodes + 1, 0);
+    for (std::uint32_t dep : deps_)
+        ++use_offsets_[dep + 1];
+    for (std::size_t idx = 0; idx < nodes; ++idx)
+        use_offsets_[idx + 1] += use_offsets_[idx];
+
+    uses_.resize(deps_.size());
+    std::vector<std::uint32_t> fill(use_offsets_.begin(), use_offsets_.end() - 1);
+    for (std::uint32_t node = 0; node < nodes; ++node) {
+        for (std::uint32_t dep : depsOf(node))
+            uses_[fill[dep]++] = node;
+    }
+
+    // Full names and aliases resolve to the same nodes, without becoming nodes of their own
+    for (std::size_t idx = 0; idx < formulae.size(); ++idx) {
+        index_.try_emplace(std::string(formulae[idx].full_name), ids[idx]);
+        for (std::string_view alias : formulae[idx].aliases)
+            index_.try_emplace(std::string(alias), ids[idx]);
+    }
+    index_.erase(std::string());
+}
+
+inline void BrewGraph::scanCellar() const {
+    std::fill(installed_.begin(), installed_.end(), 0);
+    std::fill(on_request_.begin(), on_request_.end(), 0);
+
+    std::error_code ec;
+    for (auto const& rack : std::filesystem::directory_iterator(cellar_, ec)) {
+        auto const node = index_.find(rack.path().filename().string());
+        if (node == index_.end())
+            continue;
+
+        // A rack is installed if it holds at least one keg; the receipt says why it was
+        std::error_code rack_ec;
+        for (auto const& keg : std::filesystem::directory_iterator(rack.path(), rack_ec)) {
+            if (!keg.is_directory(rack_ec))
+                continue;
+            installed_[node->second] = 1;
+
+            std::ifstream file(keg.path() / "INSTALL_RECEIPT.json", std::ios::binary);
+            std::string const receipt{std::istreambuf_iterator<char>(file),
+                                      std::istreambuf_iterator<char>()};
+            try {
+                BarrelCmd::JsonCursor cursor(receipt);
+                cursor.object([&](std::string_view key) {
+                    if (key == "installed_on_request")
+                        on_request_[node->second] |= cursor.boolean();
+                    else
+                        cursor.skip();
+                });
+            } catch (std::runtime_error const&) {
+                // A missing or damaged receipt only loses the on-request flag
+            }
+        }
+    }
+}
+
+inline std::shared_lock<std::shared_mutex> BrewGraph::acquire() const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    std::uint64_t const generation = Brew::state_generation.load();
+    if (cellar_.empty() || generation_ == generation)
+        return lock;
+
+    // A mutating command went through Barrel without being passed to apply()
+    lock.unlock();
+    {
+        std::unique_lock<std::shared_mutex> exclusive(mutex_);
+        if (generation_ != generation) {
+            scanCellar();
+            generation_ = generation;
+        }
+    }
+    lock.lock();
+    return lock;
+}
+
+inline std::uint32_t BrewGraph::require(std::string_view name) const {
+    auto const node = index_.find(name);
+    if (node == index_.end())
+        throw std::out_of_range("BrewGraph: No formula named " + std::string(name));
+    return node->second;
+}
+
+inline std::span<std::uint32_t const> BrewGraph::depsOf(std::uint32_t node) const {
+    return std::span<std::uint32_t const>(deps_).subspan(dep_offsets_[node],
+                                                          dep_offsets_[node + 1] - dep_offsets_[node]);
+}
+
+inline std::span<std::uint32_t const> BrewGraph::usesOf(std::uint32_t node) const {
+    return std::span<std::uint32_t const>(uses_).subspan(use_offsets_[node],
+                                                         use_offsets_[node + 1] - use_offsets_[node]);
+}
+
+inline std::vector<std::uint32_t> BrewGraph::closure(std::uint32_t root, bool reverse, BrewGraphScope scope,
+                                                     bool installed) const {
+    std::vector<std::uint8_t> seen(names_.size(), 0);
+    std::vector<std::uint32_t> result, stack{root};
+    seen[root] = 1;
+
+    while (!stack.empty()) {
+        std::uint32_t const node = stack.back();
+        stack.pop_back();
+        for (std::uint32_t next : reverse ? usesOf(node) : depsOf(node)) {
+            if (seen[next])
+                continue;
+            seen[next] = 1;
+            if (!installed || installed_[next])
+                result.push_back(next);
+            if (scope == BrewGraphScope::TRANSITIVE)
+                stack.push_back(next);
+        }
+    }
+    return result;
+}
+
+inline std::vector<std::string_view> BrewGraph::sortedNames(std::vector<std::uint32_t> const& nodes) const {
+    std::vector<std::string_view> result;
+    result.reserve(nodes.size());
+    for (std::uint32_t node : nodes)
+        result.push_back(names_[node]);
+    std::sort(result.begin(), result.end());
+    return result;
+}
+
+inline std::vector<std::string_view> BrewGraph::getDeps(std::string_view name, BrewGraphScope scope,
+                                                        bool installed) const {
+    std::shared_lock<std::shared_mutex> const lock = acquire();
+    return sortedNames(closure(require(name), false, scope, installed));
+}
+
+inline std::vector<std::string_view> BrewGraph::getUses(std::string_view name, BrewGraphScope scope,
+                                                        bool installed) const {
+    std::shared_lock<std::shared_mutex> const lock = acquire();
+    return sortedNames(closure(require(name), true, scope, installed));
+}
+
+inline std::vector<std::string_view> BrewGraph::getLeaves(bool on_request) const {
+    std::shared_lock<std::shared_mutex> const lock = acquire();
+    std::vector<std::uint32_t> leaves;
+    for (std::uint32_t node = 0; node < names_.size(); ++node) {
+        if (!installed_[node] || (on_request && !on_request_[node]))
+            continue;
+        auto const uses = usesOf(node);
+        bool const used = std::any_of(uses.begin(), uses.end(), [this](std::uint32_t use) {
+            return installed_[use] != 0;
+        });
+        if (!used)
+            leaves.push_back(node);
+    }
+    return sortedNames(leaves);
+}
+
+inline std::vector<std::string_view>
+BrewGraph::getTopologicalOrder(std::span<std::string_view const> names) const {
+    std::vector<std::uint32_t> roots;
+    if (names.empty()) {
+        roots.resize(names_.size());
+        for (std::uint32_t node = 0; node < names_.size(); ++node)
+            roots[node] = node;
+    } else {
+        for (std::string_view name : names)
+            roots.push_back(require(name));
+    }
+
+    // Iterative post-order DFS; a node is emitted once all of its dependencies have been
+    enum : std::uint8_t { UNSEEN, OPEN, DONE };
+    std::vector<std::uint8_t> state(names_.size(), UNSEEN);
+    std::vector<std::pair<std::uint32_t, std::uint32_t>> stack; // Node, next edge to follow
+    std::vector<std::string_view> order;
+
+    for (std::uint32_t root : roots) {
+        if (state[root] != UNSEEN)
+            continue;
+        stack.emplace_back(root, 0);
+        state[root] = OPEN;
+
+        while (!stack.empty()) {
+            auto& [node, edge] = stack.back();
+            auto const deps = depsOf(node);
+            if (edge < deps.size()) {
+                std::uint32_t const next = deps[edge++];
+                if (state[next] == UNSEEN) { // An OPEN dependency is a cycle; it is broken here
+                    state[next] = OPEN;
+                    stack.emplace_back(next, 0);
+                }
+                continue;
+            }
+            state[node] = DONE;
+            order.push_back(names_[node]);
+            stack.pop_back();
+        }
+    }
+    return order;
+}
+
+inline std::string_view BrewGraph::getName(std::string_view name) const {
+    return names_[require(name)];
+}
+
+inline bool BrewGraph::contains(std::string_view name) const {
+    return index_.find(name) != index_.end();
+}
+
+inline bool BrewGraph::isInstalled(std::string_view name) const {
+    std::shared_lock<std::shared_mutex> const lock = acquire();
+    return installed_[require(name)] != 0;
+}
+
+inline std::size_t BrewGraph::size() const {
+    return names_.size();
+}
+
+template <EnumType E>
+bool BrewGraph::apply(BrewCommand<E> const& cmd) {
+    if (getLockClass(cmd.getCommand()) == BrewLockClass::SHARED)
+        return false;
+
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    generation_ = Brew::state_generation.load();
+
+    std::optional<bool> mark{};
+    bool requested = false;
+    bool tab = false;
+    if constexpr (std::is_same_v<E, BrewCommandType::Builtin>) {
+        switch (cmd.getCommand()) {
+        case BrewCommandType::Builtin::INSTALL:
+            requested = true;
+            mark = true;
+            break;
+        case BrewCommandType::Builtin::REINSTALL:
+        case BrewCommandType::Builtin::UPGRADE:
+            mark = true;
+            break;
+        case BrewCommandType::Builtin::UNINSTALL:
+            mark = false;
+            break;
+        case BrewCommandType::Builtin::TAB: // Only what it sets, the named formulae stay installed
+            tab = true;
+            mark = true;
+            break;
+        default:
+            break;
+        }
+    }
+
+    // Named formulae follow the head in the argument vector; casks are not in the graph
+    std::vector<std::uint32_t> named;
+    BarrelCmd::Argv const& argv = cmd.getArgv();
+    for (std::size_t idx = 2; mark.has_value() && idx < argv.size(); ++idx) {
+        if (argv[idx] == "--cask" || argv[idx] == "--casks")
+            return false;
+        if (argv[idx] == "--installed-on-request" || argv[idx] == "--no-installed-on-request")
+            requested = argv[idx] == "--installed-on-request";
+        if (argv[idx].starts_with("-"))
+            continue;
+        auto const node = index_.find(argv[idx]);
+        if (node == index_.end())
+            mark.reset(); // Something the graph doesn't know about; fall back to the Cellar
+        else
+            named.push_back(node->second);
+    }
+
+    if (!mark.has_value() || cmd.getExitStatus() != EXIT_SUCCESS) {
+        if (!cellar_.empty())
+            scanCellar();
+        return true;
+    }
+
+    for (std::uint32_t node : named) {
+        if (tab) {
+            on_request_[node] = requested;
+            continue;
+        }
+        installed_[node] = *mark;
+        on_request_[node] = *mark && (requested || on_request_[node]);
+        if (*mark) {
+            for (std::uint32_t dep : closure(node, false, BrewGraphScope::TRANSITIVE, false))
+                installed_[dep] = 1;
+        }
+    }
+    return true;
+}
+
+#endif
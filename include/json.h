@@ -0,0 +1,785 @@
+/*!
+ * This file is part of Barrel, a header-only C++ library that provides
+ * programmatic access to the Homebrew command line interface.
+ *
+ * Copyright (C) 2022 aydwi <contact@aydwi.com>
+ *
+ * Barrel is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*! \file  json.h
+ *  \brief Typed access to the JSON emitted by `brew info --json=v2`.
+ */
+
+#ifndef JSON_H__
+#define JSON_H__
+
+#include <algorithm>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+using namespace std::string_literals;
+
+inline extern std::size_t const ARENA_BLOCK_SZ{64 * 1024};
+
+namespace BarrelCmd {
+
+/*! \brief A bump allocator. Memory is handed out from large blocks and released all at
+ *         once when the arena is destroyed; only trivially destructible objects may live
+ *         in it.
+ */
+class Arena {
+private:
+    std::vector<std::unique_ptr<std::byte[]>> blocks_{};
+    std::byte* cursor_{nullptr};
+    std::size_t left_{0};
+    std::size_t used_{0};
+
+public:
+    Arena() = default;
+    Arena(Arena const&) = delete;
+    Arena& operator=(Arena const&) = delete;
+    Arena(Arena&&) = default;
+    Arena& operator=(Arena&&) = default;
+
+public:
+    void* allocate(std::size_t, std::size_t);
+    std::string_view copy(std::string_view);
+
+    template <typename T>
+    std::span<T const> copy(std::span<T const>);
+
+    std::size_t getBlockCount() const;
+    std::size_t getBytesUsed() const;
+};
+
+inline void* Arena::allocate(std::size_t size, std::size_t align) {
+    std::size_t padding = (align - reinterpret_cast<std::uintptr_t>(cursor_) % align) % align;
+    if (cursor_ == nullptr || padding + size > left_) {
+        // Oversized requests get a block of their own, so they don't waste the rest of one
+        std::size_t const block_sz = std::max(ARENA_BLOCK_SZ, size + align);
+        blocks_.push_back(std::make_unique_for_overwrite<std::byte[]>(block_sz));
+        cursor_ = blocks_.back().get();
+        left_ = block_sz;
+        padding = (align - reinterpret_cast<std::uintptr_t>(cursor_) % align) % align;
+    }
+
+    std::byte* const result = cursor_ + padding;
+    cursor_ += padding + size;
+    left_ -= padding + size;
+    used_ += size;
+    return result;
+}
+
+inline std::string_view Arena::copy(std::string_view text) {
+    if (text.empty())
+        return {};
+    auto* const data = static_cast<char*>(allocate(text.size(), alignof(char)));
+    std::memcpy(data, text.data(), text.size());
+    return {data, text.size()};
+}
+
+template <typename T>
+std::span<T const> Arena::copy(std::span<T const> items) {
+    static_assert(std::is_trivially_destructible_v<T>, "Arena::copy(): T must be trivially destructible");
+    if (items.empty())
+        return {};
+    auto* const data = static_cast<T*>(allocate(items.size_bytes(), alignof(T)));
+    std::uninitialized_copy(items.begin(), items.end(), data);
+    return {data, items.size()};
+}
+
+inline std::size_t Arena::getBlockCount() const {
+    return blocks_.size();
+}
+
+inline std::size_t Arena::getBytesUsed() const {
+    return used_;
+}
+
+/*! \brief A forward-only, on-demand reader over a JSON document. Nothing is parsed until it
+ *         is asked for, and values nobody asks for are skipped without being decoded.
+ *
+ *  Strings are returned as views into the document when they contain no escape sequences,
+ *  and decoded into an Arena otherwise. The document must outlive every view returned.
+ */
+class JsonCursor {
+private:
+    std::string_view json_;
+    std::size_t pos_{0};
+
+private:
+    [[noreturn]] void fail(char const*) const;
+    void skipSpace();
+    void skipString();
+    std::string_view scanString(bool&);
+    static char* appendUtf8(char*, std::uint32_t);
+    std::uint32_t hex4();
+
+public:
+    explicit JsonCursor(std::string_view json) : json_(json){};
+
+public:
+    /*! \brief The next significant character, without consuming it. `'\0'` at the end.
+     */
+    char peek();
+
+    /*! \brief Whether the next value is `null`; consumes it if so.
+     */
+    bool null();
+
+    bool boolean();
+    std::int64_t integer();
+
+    /*! \brief The next string, unescaped (into the arena, if it has escapes). A `\u` escape
+     *         of a surrogate which isn't half of a pair decodes to U+FFFD.
+     */
+    std::string_view string(Arena&);
+
+    /*! \brief Skip the next value of any type.
+     *
+     *  \return The raw text of the skipped value
+     */
+    std::string_view skip();
+
+    /*! \brief Iterate the members of the next value, which must be an object.
+     *
+     *  \param on_member Called with each key. It must consume the member's value, through
+     *                   any of the cursor's methods (skip() if it isn't interested).
+     */
+    template <typename F>
+    void object(F&&);
+
+    /*! \brief Iterate the elements of the next value, which must be an array.
+     *
+     *  \param on_element Called once per element. It must consume the element.
+     */
+    template <typename F>
+    void array(F&&);
+
+    /*! \brief The raw text between an offset obtained from getOffset() and the current
+     *         position.
+     */
+    std::string_view since(std::size_t) const;
+
+    std::size_t getOffset() const;
+};
+
+inline void JsonCursor::fail(char const* what) const {
+    throw std::runtime_error("JsonCursor: "s + what + " at offset " + std::to_string(pos_));
+}
+
+inline void JsonCursor::skipSpace() {
+    while (pos_ < json_.size() &&
+           (json_[pos_] == ' ' || json_[pos_] == '\n' || json_[pos_] == '\r' || json_[pos_] == '\t'))
+        ++pos_;
+}
+
+inline char JsonCursor::peek() {
+    skipSpace();
+    return pos_ < json_.size() ? json_[pos_] : '\0';
+}
+
+inline std::size_t JsonCursor::getOffset() const {
+    return pos_;
+}
+
+inline std::string_view JsonCursor::since(std::size_t offset) const {
+    return json_.substr(offset, pos_ - offset);
+}
+
+inline bool JsonCursor::null() {
+    if (peek() != 'n')
+        return false;
+    if (json_.substr(pos_, 4) != "null")
+        fail("Malformed literal");
+    pos_ += 4;
+    return true;
+}
+
+inline bool JsonCursor::boolean() {
+    char const next = peek();
+    if (next == 't' && json_.substr(pos_, 4) == "true") {
+        pos_ += 4;
+        return true;
+    }
+    if (next == 'f' && json_.substr(pos_, 5) == "false") {
+        pos_ += 5;
+        return false;
+    }
+    if (null())
+        return false;
+    fail("Expected a boolean");
+}
+
+inline std::int64_t JsonCursor::integer() {
+    if (null())
+        return 0;
+    skipSpace();
+    std::int64_t value = 0;
+    auto const [end, ec] = std::from_chars(json_.data() + pos_, json_.data() + json_.size(), value);
+    if (ec != std::errc{})
+        fail("Expected an integer");
+    pos_ = static_cast<std::size_t>(end - json_.data());
+
+    // Tolerate a fractional part or exponent, which are truncated
+    std::string_view const numeric = ".eE+-0123456789";
+    while (pos_ < json_.size() && numeric.find(json_[pos_]) != std::string_view::npos)
+        ++pos_;
+    return value;
+}
+
+inline void JsonCursor::skipString() {
+    ++pos_; // Opening quote
+    for (;;) {
+        auto const* const quote =
+            static_cast<char const*>(std::memchr(json_.data() + pos_, '"', json_.size() - pos_));
+        if (quote == nullptr)
+            fail("Unterminated string");
+        std::size_t const end = static_cast<std::size_t>(quote - json_.data());
+
+        // The quote is escaped if it follows an odd number of backslashes
+        std::size_t slashes = 0;
+        while (end - slashes > pos_ && json_[end - slashes - 1] == '\\')
+            ++slashes;
+        pos_ = end + 1;
+        if (slashes % 2 == 0)
+            return;
+    }
+}
+
+inline std::string_view JsonCursor::scanString(bool& escaped) {
+    if (peek() != '"')
+        fail("Expected a string");
+    std::size_t const start = pos_ + 1;
+    skipString();
+    std::string_view const body = json_.substr(start, pos_ - start - 1);
+    escaped = body.find('\\') != std::string_view::npos;
+    return body;
+}
+
+inline std::uint32_t JsonCursor::hex4() {
+    if (pos_ + 4 > json_.size())
+        fail("Truncated escape sequence");
+    std::uint32_t value = 0;
+    auto const [end, ec] = std::from_chars(json_.data() + pos_, json_.data() + pos_ + 4, value, 16);
+    if (ec != std::errc{} || end != json_.data() + pos_ + 4)
+        fail("Malformed escape sequence");
+    pos_ += 4;
+    return value;
+}
+
+inline char* JsonCursor::appendUtf8(char* out, std::uint32_t cp) {
+    if (cp < 0x80) {
+        *out++ = static_cast<char>(cp);
+    } else if (cp < 0x800) {
+        *out++ = static_cast<char>(0xC0 | (cp >> 6));
+        *out++ = static_cast<char>(0x80 | (cp & 0x3F));
+    } else if (cp < 0x10000) {
+        *out++ = static_cast<char>(0xE0 | (cp >> 12));
+        *out++ = static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        *out++ = static_cast<char>(0x80 | (cp & 0x3F));
+    } else {
+        *out++ = static_cast<char>(0xF0 | (cp >> 18));
+        *out++ = static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+        *out++ = static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        *out++ = static_cast<char>(0x80 | (cp & 0x3F));
+    }
+    return out;
+}
+
+inline std::string_view JsonCursor::string(Arena& arena) {
+    if (null())
+        return {};
+
+    bool escaped = false;
+    std::string_view const body = scanString(escaped);
+    if (!escaped)
+        return body; // The common case: a view straight into the document
+
+    // Every escape sequence is at least as long as what it decodes to, so the decoded string
+    // is written straight into an arena allocation of the escaped length
+    auto* const decoded = static_cast<char*>(arena.allocate(body.size(), alignof(char)));
+    char* out = decoded;
+
+    std::size_t const resume = pos_;
+    pos_ = static_cast<std::size_t>(body.data() - json_.data());
+    std::size_t const end = pos_ + body.size();
+    while (pos_ < end) {
+        char const ch = json_[pos_++];
+        if (ch != '\\') {
+            *out++ = ch;
+            continue;
+        }
+        switch (json_[pos_++]) {
+        case 'b':
+            *out++ = '\b';
+            break;
+        case 'f':
+            *out++ = '\f';
+            break;
+        case 'n':
+            *out++ = '\n';
+            break;
+        case 'r':
+            *out++ = '\r';
+            break;
+        case 't':
+            *out++ = '\t';
+            break;
+        case 'u': {
+            // Half of a surrogate pair has no encoding of its own; alone, it decodes to U+FFFD
+            std::uint32_t cp = hex4();
+            if (cp >= 0xD800 && cp < 0xDC00 && json_.substr(pos_, 2) == "\\u") {
+                std::size_t const next = pos_;
+                pos_ += 2;
+                std::uint32_t const low = hex4();
+                if (low >= 0xDC00 && low < 0xE000)
+                    cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                else
+                    pos_ = next; // Not the other half: decoded on its own
+            }
+            if (cp >= 0xD800 && cp < 0xE000)
+                cp = 0xFFFD;
+            out = appendUtf8(out, cp);
+            break;
+        }
+        default: // \" \\ \/
+            *out++ = json_[pos_ - 1];
+            break;
+        }
+    }
+    pos_ = resume;
+    return {decoded, static_cast<std::size_t>(out - decoded)};
+}
+
+inline std::string_view JsonCursor::skip() {
+    char const next = peek();
+    std::size_t const start = pos_;
+
+    if (next == '"') {
+        skipString();
+    } else if (next == '{' || next == '[') {
+        std::size_t depth = 0;
+        while (pos_ < json_.size()) {
+            char const ch = json_[pos_];
+            if (ch == '"') {
+                skipString();
+                continue;
+            }
+            ++pos_;
+            if (ch == '{' || ch == '[') {
+                ++depth;
+            } else if ((ch == '}' || ch == ']') && --depth == 0) {
+                return json_.substr(start, pos_ - start);
+            }
+        }
+        fail("Unterminated container");
+    } else {
+        // A number or a literal runs until the next delimiter
+        while (pos_ < json_.size() && json_[pos_] != ',' && json_[pos_] != '}' && json_[pos_] != ']' &&
+               json_[pos_] != ' ' && json_[pos_] != '\n' && json_[pos_] != '\r' && json_[pos_] != '\t')
+            ++pos_;
+        if (pos_ == start)
+            fail("Expected a value");
+    }
+    return json_.substr(start, pos_ - start);
+}
+
+template <typename F>
+void JsonCursor::object(F&& on_member) {
+    if (null())
+        return;
+    if (peek() != '{')
+        fail("Expected an object");
+    ++pos_;
+    if (peek() == '}') {
+        ++pos_;
+        return;
+    }
+
+    for (;;) {
+        // Homebrew's keys never carry escape sequences, so they are compared undecoded
+        bool escaped = false;
+        std::string_view const key = scanString(escaped);
+        if (peek() != ':')
+            fail("Expected ':'");
+        ++pos_;
+        on_member(key);
+
+        char const next = peek();
+        ++pos_;
+        if (next == '}')
+            return;
+        if (next != ',')
+            fail("Expected ',' or '}'");
+    }
+}
+
+template <typename F>
+void JsonCursor::array(F&& on_element) {
+    if (null())
+        return;
+    if (peek() != '[')
+        fail("Expected an array");
+    ++pos_;
+    if (peek() == ']') {
+        ++pos_;
+        return;
+    }
+
+    for (;;) {
+        on_element();
+
+        char const next = peek();
+        ++pos_;
+        if (next == ']')
+            return;
+        if (next != ',')
+            fail("Expected ',' or ']'");
+    }
+}
+
+/*! \brief The document held by a file of Homebrew's API cache. Signed files (e.g.
+ *         `formula.jws.json`) wrap it in a JWS envelope, as an escaped string, which is
+ *         unescaped into the arena; plain ones (e.g. `formula.json`) are the document.
+ */
+inline std::string_view getApiPayload(std::string_view json, Arena& arena) {
+    std::string_view payload = json;
+    JsonCursor cursor(json);
+    if (cursor.peek() == '{') {
+        cursor.object([&](std::string_view key) {
+            if (key == "payload")
+                payload = cursor.string(arena);
+            else
+                cursor.skip();
+        });
+    }
+    return payload;
+}
+
+} // namespace BarrelCmd
+
+/*! \brief A formula, as described by `brew info --json=v2`. Strings and lists refer to the
+ *         parsed document, or to the owning BrewInfo's arena.
+ */
+struct BrewFormula {
+    std::string_view name{};
+    std::string_view full_name{};
+    std::string_view tap{};
+    std::string_view desc{};
+    std::string_view license{};
+    std::string_view homepage{};
+    std::string_view version{};    /*!< The stable version */
+    std::string_view linked_keg{}; /*!< Version of the linked keg, empty if not linked */
+    std::int64_t revision{0};
+    std::span<std::string_view const> aliases{};
+    std::span<std::string_view const> dependencies{};
+    std::span<std::string_view const> build_dependencies{};
+    std::span<std::string_view const> installed{}; /*!< Installed versions */
+    bool installed_on_request{false};
+    bool keg_only{false};
+    bool pinned{false};
+    bool outdated{false};
+    bool deprecated{false};
+    bool disabled{false};
+    std::string_view raw{}; /*!< The formula's complete JSON object, for fields not modelled here */
+
+    bool isInstalled() const {
+        return !installed.empty();
+    }
+};
+
+/*! \brief A cask, as described by `brew info --json=v2`. Strings and lists refer to the
+ *         parsed document, or to the owning BrewInfo's arena.
+ */
+struct BrewCask {
+    std::string_view token{};
+    std::string_view full_token{};
+    std::string_view tap{};
+    std::string_view desc{};
+    std::string_view homepage{};
+    std::string_view version{};
+    std::string_view installed{}; /*!< Installed version, empty if not installed */
+    std::span<std::string_view const> names{};
+    bool outdated{false};
+    bool auto_updates{false};
+    bool deprecated{false};
+    bool disabled{false};
+    std::string_view raw{}; /*!< The cask's complete JSON object, for fields not modelled here */
+
+    bool isInstalled() const {
+        return !installed.empty();
+    }
+};
+
+/*! \brief The typed contents of the output of `brew info --json=v2` (or the plain formula
+ *         array of `--json=v1`).
+ *
+ *  Parsing is single-pass, and allocates only for the record arrays and the arena which
+ *  holds lists and strings that needed unescaping. Every other string is a view into the
+ *  document, which must therefore outlive the BrewInfo, unless the BrewInfo was given
+ *  ownership of it.
+ *
+ *  \code{.cpp}
+ *  using BrewCommandType::Builtin;
+ *  BrewCommand<Builtin> info(brew, Builtin::INFO, "--json=v2", "--installed");
+ *  info.execute(BarrelCmd::Stream::STDOUT);
+ *
+ *  BrewInfo const parsed(info.getStreamDump());
+ *  for (BrewFormula const& formula : parsed.getFormulae())
+ *      std::cout << formula.name << ' ' << formula.version << '\n';
+ *  \endcode
+ */
+class BrewInfo {
+private:
+    std::unique_ptr<std::string> owned_{};
+    BarrelCmd::Arena arena_{};
+    std::vector<BrewFormula> formulae_{};
+    std::vector<BrewCask> casks_{};
+    std::vector<std::string_view> scratch_{};
+
+private:
+    void parse(std::string_view);
+    std::span<std::string_view const> strings(BarrelCmd::JsonCursor&);
+    BrewFormula formula(BarrelCmd::JsonCursor&);
+    BrewCask cask(BarrelCmd::JsonCursor&);
+
+public:
+    /*! \brief Parse a document without copying it. The document must outlive the BrewInfo.
+     *
+     *  \param json The JSON emitted by `brew info --json=v2`
+     */
+    explicit BrewInfo(std::string_view);
+
+    /*! \brief Parse a document, taking ownership of it.
+     *
+     *  \param json The JSON emitted by `brew info --json=v2`
+     */
+    explicit BrewInfo(std::string&&);
+
+public:
+    std::span<BrewFormula const> getFormulae() const;
+    std::span<BrewCask const> getCasks() const;
+
+    /*! \brief Find a formula by name or full name. Linear in the number of formulae.
+     *
+     *  \return The formula, or `nullptr` if absent
+     */
+    BrewFormula const* findFormula(std::string_view) const;
+
+    /*! \brief Find a cask by token or full token. Linear in the number of casks.
+     *
+     *  \return The cask, or `nullptr` if absent
+     */
+    BrewCask const* findCask(std::string_view) const;
+
+    BarrelCmd::Arena const& getArena() const;
+};
+
+inline BrewInfo::BrewInfo(std::string_view json) {
+    parse(json);
+}
+
+inline BrewInfo::BrewInfo(std::string&& json) : owned_(std::make_unique<std::string>(std::move(json))) {
+    parse(*owned_);
+}
+
+inline void BrewInfo::parse(std::string_view json) {
+    BarrelCmd::JsonCursor cursor(json);
+
+    if (cursor.peek() == '[') {
+        cursor.array([&]() { formulae_.push_back(formula(cursor)); });
+    } else {
+        cursor.object([&](std::string_view key) {
+            if (key == "formulae")
+                cursor.array([&]() { formulae_.push_back(formula(cursor)); });
+            else if (key == "casks")
+                cursor.array([&]() { casks_.push_back(cask(cursor)); });
+            else
+                cursor.skip();
+        });
+    }
+    if (cursor.peek() != '\0')
+        throw std::runtime_error("BrewInfo::parse(): Trailing data after the JSON document");
+
+    scratch_ = {};
+}
+
+inline std::span<std::string_view const> BrewInfo::strings(BarrelCmd::JsonCursor& cursor) {
+    // Lists are gathered in a reused buffer, and only their final size lands in the arena
+    std::size_t const mark = scratch_.size();
+    cursor.array([&]() {
+        char const next = cursor.peek();
+        if (next == '"' || next == 'n') {
+            scratch_.push_back(cursor.string(arena_));
+            return;
+        }
+        // Dependencies with options are objects; only the name is of interest
+        cursor.object([&](std::string_view key) {
+            if (key == "name" || key == "full_name")
+                scratch_.push_back(cursor.string(arena_));
+            else
+                cursor.skip();
+        });
+    });
+
+    std::span<std::string_view const> const result =
+        arena_.copy(std::span<std::string_view const>(scratch_).subspan(mark));
+    scratch_.resize(mark);
+    return result;
+}
+
+inline BrewFormula BrewInfo::formula(BarrelCmd::JsonCursor& fields) {
+    BrewFormula formula;
+    fields.peek();
+    std::size_t const start = fields.getOffset();
+
+    fields.object([&](std::string_view key) {
+        if (key == "name") {
+            formula.name = fields.string(arena_);
+        } else if (key == "full_name") {
+            formula.full_name = fields.string(arena_);
+        } else if (key == "tap") {
+            formula.tap = fields.string(arena_);
+        } else if (key == "desc") {
+            formula.desc = fields.string(arena_);
+        } else if (key == "license") {
+            formula.license = fields.string(arena_);
+        } else if (key == "homepage") {
+            formula.homepage = fields.string(arena_);
+        } else if (key == "versions") {
+            fields.object([&](std::string_view version_key) {
+                if (version_key == "stable")
+                    formula.version = fields.string(arena_);
+                else
+                    fields.skip();
+            });
+        } else if (key == "revision") {
+            formula.revision = fields.integer();
+        } else if (key == "aliases") {
+            formula.aliases = strings(fields);
+        } else if (key == "dependencies") {
+            formula.dependencies = strings(fields);
+        } else if (key == "build_dependencies") {
+            formula.build_dependencies = strings(fields);
+        } else if (key == "installed") {
+            std::size_t const mark = scratch_.size();
+            fields.array([&]() {
+                fields.object([&](std::string_view installed_key) {
+                    if (installed_key == "version")
+                        scratch_.push_back(fields.string(arena_));
+                    else if (installed_key == "installed_on_request")
+                        formula.installed_on_request = fields.boolean() || formula.installed_on_request;
+                    else
+                        fields.skip();
+                });
+            });
+            formula.installed = arena_.copy(std::span<std::string_view const>(scratch_).subspan(mark));
+            scratch_.resize(mark);
+        } else if (key == "linked_keg") {
+            formula.linked_keg = fields.string(arena_);
+        } else if (key == "keg_only") {
+            formula.keg_only = fields.boolean();
+        } else if (key == "pinned") {
+            formula.pinned = fields.boolean();
+        } else if (key == "outdated") {
+            formula.outdated = fields.boolean();
+        } else if (key == "deprecated") {
+            formula.deprecated = fields.boolean();
+        } else if (key == "disabled") {
+            formula.disabled = fields.boolean();
+        } else {
+            fields.skip();
+        }
+    });
+
+    formula.raw = fields.since(start);
+    return formula;
+}
+
+inline BrewCask BrewInfo::cask(BarrelCmd::JsonCursor& fields) {
+    BrewCask cask;
+    fields.peek();
+    std::size_t const start = fields.getOffset();
+
+    fields.object([&](std::string_view key) {
+        if (key == "token") {
+            cask.token = fields.string(arena_);
+        } else if (key == "full_token") {
+            cask.full_token = fields.string(arena_);
+        } else if (key == "tap") {
+            cask.tap = fields.string(arena_);
+        } else if (key == "desc") {
+            cask.desc = fields.string(arena_);
+        } else if (key == "homepage") {
+            cask.homepage = fields.string(arena_);
+        } else if (key == "version") {
+            cask.version = fields.string(arena_);
+        } else if (key == "installed") {
+            cask.installed = fields.string(arena_);
+        } else if (key == "name") {
+            cask.names = strings(fields);
+        } else if (key == "outdated") {
+            cask.outdated = fields.boolean();
+        } else if (key == "auto_updates") {
+            cask.auto_updates = fields.boolean();
+        } else if (key == "deprecated") {
+            cask.deprecated = fields.boolean();
+        } else if (key == "disabled") {
+            cask.disabled = fields.boolean();
+        } else {
+            fields.skip();
+        }
+    });
+
+    cask.raw = fields.since(start);
+    return cask;
+}
+
+inline std::span<BrewFormula const> BrewInfo::getFormulae() const {
+    return formulae_;
+}
+
+inline std::span<BrewCask const> BrewInfo::getCasks() const {
+    return casks_;
+}
+
+inline BrewFormula const* BrewInfo::findFormula(std::string_view name) const {
+    auto const found = std::find_if(formulae_.begin(), formulae_.end(), [name](BrewFormula const& formula) {
+        return formula.name == name || formula.full_name == name;
+    });
+    return found == formulae_.end() ? nullptr : &*found;
+}
+
+inline BrewCask const* BrewInfo::findCask(std::string_view token) const {
+    auto const found = std::find_if(casks_.begin(), casks_.end(), [token](BrewCask const& cask) {
+        return cask.token == token || cask.full_token == token;
+    });
+    return found == casks_.end() ? nullptr : &*found;
+}
+
+inline BarrelCmd::Arena const& BrewInfo::getArena() const {
+    return arena_;
+}
+
+#endif
@@ -0,0 +1,316 @@
+/*!
+ * This file is part of Barrel, a header-only C++ library that provides
+ * programmatic access to the Homebrew command line interface.
+ *
+ * Copyright (C) 2022 aydwi <contact@aydwi.com>
+ *
+ * Barrel is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*! \file  layout.h
+    \brief An internal header used by Barrel. Reads the on-disk layout of a Homebrew
+           installation (prefix, repository, Cellar, Caskroom) without running Homebrew.
+*/
+
+#ifndef LAYOUT_H__
+#define LAYOUT_H__
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+namespace BarrelCmd {
+
+/*! \brief Compare versions the way a person would: runs of digits compare numerically,
+ *         so that "1.9" sorts before "1.10".
+ */
+inline bool versionLess(std::string_view lhs, std::string_view rhs) {
+    std::size_t lpos = 0, rpos = 0;
+    while (lpos < lhs.size() && rpos < rhs.size()) {
+        if (std::isdigit(static_cast<unsigned char>(lhs[lpos])) &&
+            std::isdigit(static_cast<unsigned char>(rhs[rpos]))) {
+            std::size_t lend = lpos, rend = rpos;
+            while (lend < lhs.size() && std::isdigit(static_cast<unsigned char>(lhs[lend])))
+                ++lend;
+            while (rend < rhs.size() && std::isdigit(static_cast<unsigned char>(rhs[rend])))
+                ++rend;
+
+            // Without leading zeros, the longer run of digits is the larger number
+            std::string_view lnum = lhs.substr(lpos, lend - lpos), rnum = rhs.substr(rpos, rend - rpos);
+            lnum.remove_prefix(std::min(lnum.find_first_not_of('0'), lnum.size()));
+            rnum.remove_prefix(std::min(rnum.find_first_not_of('0'), rnum.size()));
+            if (lnum.size() != rnum.size())
+                return lnum.size() < rnum.size();
+            if (lnum != rnum)
+                return lnum < rnum;
+            lpos = lend;
+            rpos = rend;
+            continue;
+        }
+        if (lhs[lpos] != rhs[rpos])
+            return lhs[lpos] < rhs[rpos];
+        ++lpos;
+        ++rpos;
+    }
+    return lhs.size() - lpos < rhs.size() - rpos;
+}
+
+/*! \brief Homebrew's cache of downloads and API data, located the way Homebrew locates it:
+ *         `$HOMEBREW_CACHE`, or the platform's default cache. Empty if neither is set.
+ */
+inline std::filesystem::path getHomebrewCache() {
+    if (char const* env = std::getenv("HOMEBREW_CACHE"); env != nullptr && *env != '\0')
+        return env;
+    char const* home = std::getenv("HOME");
+    if (home == nullptr)
+        return {};
+#ifdef __APPLE__
+    return std::filesystem::path(home) / "Library" / "Caches" / "Homebrew";
+#else
+    char const* xdg = std::getenv("XDG_CACHE_HOME");
+    if (xdg != nullptr && *xdg != '\0')
+        return std::filesystem::path(xdg) / "Homebrew";
+    return std::filesystem::path(home) / ".cache" / "Homebrew";
+#endif
+}
+
+/*! \brief The directories of a Homebrew installation, derived from the location of its
+ *         `brew` binary (`<prefix>/bin/brew`).
+ *
+ *  The repository lives at `<prefix>/Homebrew` on Intel macOS and Linux, and at `<prefix>`
+ *  itself on Apple Silicon. A layout is recognised only if the binary sits in `bin/` and
+ *  the repository holds `Library/Homebrew`; anything else is left to Homebrew to interpret.
+ */
+class Layout {
+private:
+    std::filesystem::path prefix_{};
+    std::filesystem::path repository_{};
+    bool recognised_{false};
+
+private:
+    std::optional<std::string> readRef(std::string_view) const;
+
+public:
+    explicit Layout(std::filesystem::path const&);
+
+public:
+    bool isRecognised() const;
+    std::filesystem::path const& getPrefix() const;
+    std::filesystem::path const& getRepository() const;
+    std::filesystem::path getCellar() const;
+    std::filesystem::path getCaskroom() const;
+
+    /*! \brief Installed versions (kegs) of a formula, sorted. Empty if it isn't installed.
+     */
+    std::vector<std::string> getKegs(std::string_view) const;
+
+    /*! \brief Installed versions of a cask, sorted. Empty if it isn't installed.
+     */
+    std::vector<std::string> getCaskVersions(std::string_view) const;
+
+    /*! \brief Names of the installed formulae (racks holding at least one keg), sorted.
+     */
+    std::vector<std::string> getFormulae() const;
+
+    /*! \brief Tokens of the installed casks, sorted.
+     */
+    std::vector<std::string> getCasks() const;
+
+    /*! \brief Names of the installed taps ("user/repo"), sorted.
+     */
+    std::vector<std::string> getTaps() const;
+
+    /*! \brief Names of the pinned formulae, sorted.
+     */
+    std::vector<std::string> getPinned() const;
+
+    /*! \brief The version Homebrew reports for itself, derived from its repository the way
+     *         `git describe --tags` would. Only a checkout sitting exactly on a tag can be
+     *         described without walking the commit history.
+     *
+     *  \return The version (e.g. "4.2.0"), or `std::nullopt` if it cannot be determined
+     */
+    std::optional<std::string> getVersion() const;
+};
+
+inline std::vector<std::string> listDirectories(std::filesystem::path const& path) {
+    std::vector<std::string> names;
+    std::error_code ec;
+    for (auto const& entry : std::filesystem::directory_iterator(path, ec)) {
+        std::string name = entry.path().filename().string();
+        std::error_code entry_ec;
+        if (!name.starts_with(".") && entry.is_directory(entry_ec))
+            names.push_back(std::move(name));
+    }
+    return names;
+}
+
+inline Layout::Layout(std::filesystem::path const& install_path) {
+    std::error_code ec;
+    prefix_ = install_path.parent_path().parent_path();
+    if (install_path.filename() != "brew" || install_path.parent_path().filename() != "bin")
+        return;
+
+    if (std::filesystem::is_directory(prefix_ / "Homebrew" / "Library" / "Homebrew", ec))
+        repository_ = prefix_ / "Homebrew";
+    else if (std::filesystem::is_directory(prefix_ / "Library" / "Homebrew", ec))
+        repository_ = prefix_;
+    else
+        return;
+    recognised_ = true;
+}
+
+inline bool Layout::isRecognised() const {
+    return recognised_;
+}
+
+inline std::filesystem::path const& Layout::getPrefix() const {
+    return prefix_;
+}
+
+inline std::filesystem::path const& Layout::getRepository() const {
+    return repository_.empty() ? prefix_ : repository_;
+}
+
+inline std::filesystem::path Layout::getCellar() const {
+    return prefix_ / "Cellar";
+}
+
+inline std::filesystem::path Layout::getCaskroom() const {
+    return prefix_ / "Caskroom";
+}
+
+inline std::vector<std::string> Layout::getKegs(std::string_view name) const {
+    if (name.empty() || name.find('/') != std::string_view::npos)
+        return {};
+    std::vector<std::string> kegs = listDirectories(getCellar() / name);
+    std::sort(kegs.begin(), kegs.end(), versionLess);
+    return kegs;
+}
+
+inline std::vector<std::string> Layout::getCaskVersions(std::string_view token) const {
+    if (token.empty() || token.find('/') != std::string_view::npos)
+        return {};
+    std::vector<std::string> versions = listDirectories(getCaskroom() / token);
+    std::sort(versions.begin(), versions.end(), versionLess);
+    return versions;
+}
+
+inline std::vector<std::string> Layout::getFormulae() const {
+    std::vector<std::string> racks = listDirectories(getCellar());
+    std::erase_if(racks, [this](std::string const& rack) { return getKegs(rack).empty(); });
+    std::sort(racks.begin(), racks.end());
+    return racks;
+}
+
+inline std::vector<std::string> Layout::getCasks() const {
+    std::vector<std::string> casks = listDirectories(getCaskroom());
+    std::erase_if(casks, [this](std::string const& cask) { return getCaskVersions(cask).empty(); });
+    std::sort(casks.begin(), casks.end());
+    return casks;
+}
+
+inline std::vector<std::string> Layout::getTaps() const {
+    // Library/Taps/<user>/homebrew-<repo>, for a tap named "<user>/<repo>"
+    std::filesystem::path const taps = getRepository() / "Library" / "Taps";
+    std::vector<std::string> names;
+    for (auto const& user : listDirectories(taps)) {
+        for (auto const& repo : listDirectories(taps / user)) {
+            if (repo.starts_with("homebrew-"))
+                names.push_back(user + "/" + repo.substr(9));
+        }
+    }
+    std::sort(names.begin(), names.end());
+    return names;
+}
+
+inline std::vector<std::string> Layout::getPinned() const {
+    // var/homebrew/pinned holds a link to the pinned keg of each formula, named after it
+    std::vector<std::string> pinned = listDirectories(prefix_ / "var" / "homebrew" / "pinned");
+    std::sort(pinned.begin(), pinned.end());
+    return pinned;
+}
+
+inline std::optional<std::string> Layout::readRef(std::string_view ref) const {
+    std::filesystem::path const git = getRepository() / ".git";
+
+    std::ifstream loose(git / ref);
+    std::string line;
+    if (loose && std::getline(loose, line))
+        return line;
+
+    // Refs which haven't been touched since the last `git gc` only live in packed-refs
+    std::ifstream packed(git / "packed-refs");
+    while (std::getline(packed, line)) {
+        if (line.size() > 41 && line[40] == ' ' && std::string_view(line).substr(41) == ref)
+            return line.substr(0, 40);
+    }
+    return std::nullopt;
+}
+
+inline std::optional<std::string> Layout::getVersion() const {
+    if (!recognised_)
+        return std::nullopt;
+
+    std::optional<std::string> head = readRef("HEAD");
+    if (head.has_value() && head->starts_with("ref: "))
+        head = readRef(head->substr(5));
+    if (!head.has_value() || head->size() != 40)
+        return std::nullopt;
+
+    // A tag names the commit directly, or (annotated) through a peeled "^" line in packed-refs
+    std::filesystem::path const git = getRepository() / ".git";
+    std::optional<std::string> best{};
+    auto consider = [&best](std::string tag) {
+        if (!best.has_value() || versionLess(*best, tag))
+            best = std::move(tag);
+    };
+
+    std::error_code ec;
+    for (auto const& entry : std::filesystem::directory_iterator(git / "refs" / "tags", ec)) {
+        std::ifstream file(entry.path());
+        std::string commit;
+        if (std::getline(file, commit) && commit == *head)
+            consider(entry.path().filename().string());
+    }
+
+    std::ifstream packed(git / "packed-refs");
+    std::string line, tag;
+    while (std::getline(packed, line)) {
+        if (line.starts_with("^")) {
+            if (!tag.empty() && line.substr(1) == *head)
+                consider(tag);
+            continue;
+        }
+        tag.clear();
+        if (line.size() > 51 && line[40] == ' ' && std::string_view(line).substr(41, 10) == "refs/tags/") {
+            tag = line.substr(51);
+            if (line.compare(0, 40, *head) == 0)
+                consider(tag);
+        }
+    }
+    return best;
+}
+
+} // namespace BarrelCmd
+
+#endif
@@ -0,0 +1,432 @@
+/*!
+ * This file is part of Barrel, a header-only C++ library that provides
+ * programmatic access to the Homebrew command line interface.
+ *
+ * Copyright (C) 2022 aydwi <contact@aydwi.com>
+ *
+ * Barrel is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*! \file  metrics.h
+ *  \brief Observe every execution of a Homebrew command: where its time went, how much it
+ *         wrote, and what it cost. Includes aggregated counters and a trace exporter.
+ */
+
+#ifndef METRICS_H__
+#define METRICS_H__
+
+#include "proc.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+namespace BarrelCmd {
+
+/*! \brief Append a string to a JSON document, quoted and escaped.
+ */
+inline void appendJsonString(std::string& out, std::string_view text) {
+    out += '"';
+    for (char const ch : text) {
+        switch (ch) {
+        case '"':
+            out += "\\\"";
+            break;
+        case '\\':
+            out += "\\\\";
+            break;
+        case '\n':
+            out += "\\n";
+            break;
+        case '\t':
+            out += "\\t";
+            break;
+        default:
+            if (static_cast<unsigned char>(ch) < 0x20) {
+                char escaped[7];
+                std::snprintf(escaped, sizeof(escaped), "\\u%04x", static_cast<unsigned>(ch));
+                out += escaped;
+            } else {
+                out += ch;
+            }
+        }
+    }
+    out += '"';
+}
+
+inline char const* getTerminationName(Termination termination) {
+    switch (termination) {
+    case Termination::EXITED:
+        return "exited";
+    case Termination::SIGNALLED:
+        return "signalled";
+    case Termination::TIMED_OUT:
+        return "timed_out";
+    case Termination::CANCELLED:
+        return "cancelled";
+    }
+    return "unknown";
+}
+
+} // namespace BarrelCmd
+
+/*! \brief One finished execution of a command, as reported to every BrewObserver. Only valid
+ *         for the duration of the call.
+ */
+struct BrewExecution {
+    std::string_view head;                      /*!< The command, e.g. "info" */
+    BarrelCmd::Argv const& argv;                /*!< Everything that was executed, `brew` included */
+    int exit_status;                            /*!< As reported by BrewCommand::getExitStatus() */
+    BarrelCmd::Termination termination;         /*!< How it came to an end */
+    BarrelCmd::ExecutionMetrics const& metrics; /*!< Where its time went, and what it consumed */
+    bool on_worker; /*!< Served by a BrewWorker: nothing was spawned, and neither its first byte
+                         nor its own CPU time and memory are known */
+    std::string_view profile; /*!< Name of the BrewEnvProfile it was executed under */
+};
+
+/*! \brief Receives every execution of every command in the process, once attached through
+ *         BrewMetrics::attach(). That is every execution which ran Homebrew, as a process of
+ *         its own or on a BrewWorker, and every answer from a BrewCache (whose metrics are
+ *         empty); answers from BrewNative are not reported.
+ *
+ *  Called on the thread which executed the command (the reactor's, for BrewCommand::run()),
+ *  right after it finished. Implementations must be thread-safe, and should be quick.
+ */
+class BrewObserver {
+public:
+    virtual ~BrewObserver() = default;
+    virtual void onExecution(BrewExecution const&) = 0;
+};
+
+/*! \brief The process-wide list of observers. While none is attached, reporting an
+ *         execution costs a single atomic load.
+ */
+class BrewMetrics {
+private:
+    using Observers = std::vector<std::shared_ptr<BrewObserver>>;
+
+private:
+    inline static std::atomic<bool> active_{false};
+    inline static std::mutex mutex_{};
+    inline static std::shared_ptr<Observers const> observers_{std::make_shared<Observers const>()};
+
+public:
+    /*! \brief Start reporting executions to an observer.
+     */
+    static void attach(std::shared_ptr<BrewObserver>);
+
+    /*! \brief Stop reporting executions to an observer. A report already under way may still
+     *         reach it.
+     */
+    static void detach(std::shared_ptr<BrewObserver> const&);
+
+    /*! \brief Whether any observer is attached.
+     */
+    static bool isActive();
+
+    /*! \brief Report an execution to every attached observer.
+     */
+    static void report(BrewExecution const&);
+};
+
+inline void BrewMetrics::attach(std::shared_ptr<BrewObserver> observer) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto observers = std::make_shared<Observers>(*observers_);
+    observers->push_back(std::move(observer));
+    observers_ = std::move(observers);
+    active_.store(true, std::memory_order_release);
+}
+
+inline void BrewMetrics::detach(std::shared_ptr<BrewObserver> const& observer) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto observers = std::make_shared<Observers>(*observers_);
+    std::erase(*observers, observer);
+    active_.store(!observers->empty(), std::memory_order_release);
+    observers_ = std::move(observers);
+}
+
+inline bool BrewMetrics::isActive() {
+    return active_.load(std::memory_order_acquire);
+}
+
+inline void BrewMetrics::report(BrewExecution const& execution) {
+    if (!isActive())
+        return;
+
+    // Observers are called on a snapshot of the list, so that none is called under the lock
+    std::shared_ptr<Observers const> observers;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        observers = observers_;
+    }
+    for (auto const& observer : *observers)
+        observer->onExecution(execution);
+}
+
+/*! \brief Totals over any number of executions.
+ */
+struct BrewTotals {
+    std::uint64_t executions{0};
+    std::uint64_t failures{0}; /*!< Those with a non-zero exit status, however they ended */
+    std::uint64_t timed_out{0};
+    std::uint64_t cancelled{0};
+    std::uint64_t on_worker{0};
+    std::chrono::nanoseconds queued{};
+    std::chrono::nanoseconds spawn{};
+    std::chrono::nanoseconds first_byte{};
+    std::chrono::nanoseconds wall{};
+    std::chrono::microseconds user_cpu{};
+    std::chrono::microseconds system_cpu{};
+    std::uint64_t stream_bytes{0};
+    std::uint64_t error_bytes{0};
+    std::size_t max_rss{0}; /*!< The largest of any single execution, in bytes */
+
+    void add(BrewExecution const&);
+};
+
+inline void BrewTotals::add(BrewExecution const& execution) {
+    BarrelCmd::ExecutionMetrics const& metrics = execution.metrics;
+    ++executions;
+    failures += execution.exit_status != EXIT_SUCCESS;
+    timed_out += execution.termination == BarrelCmd::Termination::TIMED_OUT;
+    cancelled += execution.termination == BarrelCmd::Termination::CANCELLED;
+    on_worker += execution.on_worker;
+    queued += metrics.queued;
+    spawn += metrics.spawn;
+    first_byte += metrics.first_byte;
+    wall += metrics.wall;
+    user_cpu += metrics.user_cpu;
+    system_cpu += metrics.system_cpu;
+    stream_bytes += metrics.bytes[0];
+    error_bytes += metrics.bytes[1];
+    max_rss = std::max(max_rss, metrics.max_rss);
+}
+
+/*! \brief An observer which keeps running totals, overall and per command, for a metrics
+ *         scraper to query at any time.
+ *
+ *  \code
+ *  auto counters = std::make_shared<BrewCounters>();
+ *  BrewMetrics::attach(counters);
+ *  // ...
+ *  for (auto const& [head, totals] : counters->getTotalsByCommand())
+ *      std::cout << head << ": " << totals.executions << " executions\n";
+ *  \endcode
+ */
+class BrewCounters : public BrewObserver {
+private:
+    mutable std::mutex mutex_{};
+    BrewTotals totals_{};
+    std::map<std::string, BrewTotals, std::less<>> by_command_{};
+    std::map<std::string, BrewTotals, std::less<>> by_profile_{};
+
+public:
+    void onExecution(BrewExecution const&) override;
+
+public:
+    BrewTotals getTotals() const;
+
+    /*! \brief Totals per command head (e.g. "info").
+     */
+    std::map<std::string, BrewTotals, std::less<>> getTotalsByCommand() const;
+
+    /*! \brief Totals per environment profile (e.g. "fast"), to compare what a profile saves.
+     */
+    std::map<std::string, BrewTotals, std::less<>> getTotalsByProfile() const;
+
+    void reset();
+};
+
+inline void BrewCounters::onExecution(BrewExecution const& execution) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    totals_.add(execution);
+    auto const add = [&execution](auto& totals, std::string_view key) {
+        auto node = totals.find(key);
+        if (node == totals.end())
+            node = totals.emplace(std::string(key), BrewTotals{}).first;
+        node->second.add(execution);
+    };
+    add(by_command_, execution.head);
+    add(by_profile_, execution.profile);
+}
+
+inline BrewTotals BrewCounters::getTotals() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return totals_;
+}
+
+inline std::map<std::string, BrewTotals, std::less<>> BrewCounters::getTotalsByCommand() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return by_command_;
+}
+
+inline std::map<std::string, BrewTotals, std::less<>> BrewCounters::getTotalsByProfile() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return by_profile_;
+}
+
+inline void BrewCounters::reset() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    totals_ = {};
+    by_command_.clear();
+    by_profile_.clear();
+}
+
+/*! \brief An observer which records executions as trace events, in the JSON format read by
+ *         Chrome's `about:tracing` and by Perfetto.
+ *
+ *  Each execution is a slice named after its command, on a track per thread, split into
+ *  its phases: waiting in a BrewExecutor's queue, launching the process, waiting for its
+ *  first output, and capturing the rest until it was reaped. The slice's arguments hold the
+ *  full argument vector, the exit status, the bytes written to each stream, the environment
+ *  profile, and the CPU time and peak memory of the process.
+ */
+class BrewTraceExporter : public BrewObserver {
+private:
+    struct Event {
+        std::string name;
+        std::string args;
+        std::uint32_t thread;
+        BarrelCmd::ExecutionMetrics metrics;
+    };
+
+private:
+    mutable std::mutex mutex_{};
+    std::vector<Event> events_{};
+    std::map<std::thread::id, std::uint32_t> threads_{};
+    std::size_t max_events_;
+
+public:
+    /*! \brief Constructor for BrewTraceExporter.
+     *
+     *  \param max_events Executions to record at most. Those after are dropped.
+     */
+    explicit BrewTraceExporter(std::size_t = 100'000);
+
+public:
+    void onExecution(BrewExecution const&) override;
+
+public:
+    /*! \brief Write the trace recorded so far.
+     */
+    void write(std::ostream&) const;
+
+    /*! \brief Write the trace recorded so far to a file, replacing it.
+     */
+    void save(std::string const&) const;
+
+    std::size_t size() const;
+    void clear();
+};
+
+inline BrewTraceExporter::BrewTraceExporter(std::size_t max_events) : max_events_(max_events){};
+
+inline void BrewTraceExporter::onExecution(BrewExecution const& execution) {
+    // Everything but the timings is formatted here, while the views are still valid
+    std::string args{"{\"argv\":"};
+    BarrelCmd::appendJsonString(args, execution.argv.join(LE_SPACER));
+    args += ",\"exit_status\":" + std::to_string(execution.exit_status);
+    args += ",\"termination\":\""s + BarrelCmd::getTerminationName(execution.termination) + "\"";
+    args += ",\"stream_bytes\":" + std::to_string(execution.metrics.bytes[0]);
+    args += ",\"error_bytes\":" + std::to_string(execution.metrics.bytes[1]);
+    args += ",\"profile\":";
+    BarrelCmd::appendJsonString(args, execution.profile);
+    if (!execution.on_worker) {
+        args += ",\"user_cpu_us\":" + std::to_string(execution.metrics.user_cpu.count());
+        args += ",\"system_cpu_us\":" + std::to_string(execution.metrics.system_cpu.count());
+        args += ",\"max_rss\":" + std::to_string(execution.metrics.max_rss);
+    }
+    args += execution.on_worker ? ",\"worker\":true}" : ",\"worker\":false}";
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (events_.size() >= max_events_)
+        return;
+    auto const thread = threads_.try_emplace(std::this_thread::get_id(), threads_.size() + 1).first->second;
+    events_.push_back({"brew " + std::string(execution.head), std::move(args), thread, execution.metrics});
+}
+
+inline void BrewTraceExporter::write(std::ostream& out) const {
+    using Micros = std::chrono::duration<double, std::micro>;
+    auto const micros = [](auto duration) { return std::to_string(Micros(duration).count()); };
+    std::string const pid = std::to_string(getpid());
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::string json{"{\"displayTimeUnit\":\"ms\",\"traceEvents\":["};
+    bool first = true;
+    auto const slice = [&](std::string_view name, std::uint32_t thread, auto start, auto duration,
+                           std::string_view args) {
+        json += first ? "\n" : ",\n";
+        first = false;
+        json += "{\"name\":";
+        BarrelCmd::appendJsonString(json, name);
+        json += ",\"cat\":\"barrel\",\"ph\":\"X\",\"pid\":" + pid + ",\"tid\":" + std::to_string(thread);
+        json += ",\"ts\":" + micros(start.time_since_epoch()) + ",\"dur\":" + micros(duration);
+        if (!args.empty()) {
+            json += ",\"args\":";
+            json += args;
+        }
+        json += "}";
+    };
+
+    for (Event const& event : events_) {
+        BarrelCmd::ExecutionMetrics const& metrics = event.metrics;
+        if (metrics.queued.count() > 0)
+            slice("queued", event.thread, metrics.start - metrics.queued, metrics.queued, "");
+        slice(event.name, event.thread, metrics.start, metrics.wall, event.args);
+        if (metrics.spawn.count() > 0)
+            slice("spawn", event.thread, metrics.start, metrics.spawn, "");
+        if (metrics.first_byte.count() > 0) {
+            slice("waiting for output", event.thread, metrics.start + metrics.spawn,
+                  metrics.first_byte - metrics.spawn, "");
+            slice("capture", event.thread, metrics.start + metrics.first_byte,
+                  metrics.wall - metrics.first_byte, "");
+        }
+    }
+    json += "\n]}\n";
+    out << json;
+}
+
+inline void BrewTraceExporter::save(std::string const& path) const {
+    std::ofstream file(path, std::ios::trunc);
+    write(file);
+    if (!file)
+        throw std::runtime_error("BrewTraceExporter::save(): Failed to write " + path);
+}
+
+inline std::size_t BrewTraceExporter::size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return events_.size();
+}
+
+inline void BrewTraceExporter::clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    events_.clear();
+}
+
+#endif
@@ -0,0 +1,251 @@
+/*!
+ * This file is part of Barrel, a header-only C++ library that provides
+ * programmatic access to the Homebrew command line interface.
+ *
+ * Copyright (C) 2022 aydwi <contact@aydwi.com>
+ *
+ * Barrel is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*! \file  native.h
+ *  \brief Answer simple queries about a Homebrew installation straight from the filesystem.
+ */
+
+#ifndef NATIVE_H__
+#define NATIVE_H__
+
+#include "barrel.h"
+#include "layout.h"
+#include "text.h"
+
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/*! \brief Resolve commands which only report on the installation's layout by reading it
+ *         directly, without running Homebrew.
+ *
+ *  The following are answered natively, with the output Homebrew would print to a pipe:
+ *
+ *  - `--prefix`, `--cellar`, `--caskroom` and `--repository`, bare or with one name
+ *  - `list`, `list --formula` and `list --cask` (optionally with `-1`)
+ *  - `list --versions`, bare or with names, for formulae or (with `--cask`) casks
+ *  - `--version`, when the repository is checked out exactly at a release tag
+ *
+ *  Everything else, including any of the above with options not listed, or names which
+ *  are not installed, falls back to executing the command.
+ */
+class BrewNative {
+private:
+    BarrelCmd::Layout layout_;
+
+private:
+    template <EnumType E>
+    std::optional<std::string> resolve(BrewCommand<E> const&) const;
+    std::optional<std::string> resolveLocation(BrewCommandType::Builtin,
+                                               std::vector<std::string_view> const&) const;
+    std::optional<std::string> resolveList(std::vector<std::string_view> const&) const;
+
+public:
+    /*! \brief Constructor for BrewNative.
+     *
+     *  \param brew An object of type ::Brew, the installation to read
+     */
+    explicit BrewNative(Brew const&);
+
+public:
+    /*! \brief Whether the installation's layout was recognised. If not, every command falls
+     *         back to being executed.
+     */
+    bool isRecognised() const;
+
+    /*! \brief Populate the command's results natively if possible, or execute it otherwise.
+     *
+     *  \param cmd The command to execute
+     *  \param stream The stream(s) to capture
+     *
+     *  \return `true` if the command was answered without running Homebrew
+     */
+    template <EnumType E>
+    bool execute(BrewCommand<E>&, BarrelCmd::Stream = BarrelCmd::Stream::STDOUT_STDERR) const;
+};
+
+inline BrewNative::BrewNative(Brew const& brew) : layout_(brew.getInstallPath()){};
+
+inline bool BrewNative::isRecognised() const {
+    return layout_.isRecognised();
+}
+
+inline std::optional<std::string>
+BrewNative::resolveLocation(BrewCommandType::Builtin cmd, std::vector<std::string_view> const& args) const {
+    if (args.size() > 1 || (!args.empty() && args.front().starts_with("-")))
+        return std::nullopt;
+    // Only the name of a tap, "user/repo", may contain a slash
+    if (!args.empty() && cmd != BrewCommandType::Builtin::REPOSITORY &&
+        args.front().find('/') != std::string_view::npos)
+        return std::nullopt;
+
+    std::filesystem::path path;
+    switch (cmd) {
+    case BrewCommandType::Builtin::PREFIX:
+        path = args.empty() ? layout_.getPrefix() : layout_.getPrefix() / "opt" / args.front();
+        break;
+    case BrewCommandType::Builtin::CELLAR:
+        path = args.empty() ? layout_.getCellar() : layout_.getCellar() / args.front();
+        break;
+    case BrewCommandType::Builtin::CASKROOM:
+        path = args.empty() ? layout_.getCaskroom() : layout_.getCaskroom() / args.front();
+        break;
+    case BrewCommandType::Builtin::REPOSITORY: {
+        if (args.empty()) {
+            path = layout_.getRepository();
+            break;
+        }
+        // A tap, "user/repo", lives in Library/Taps/user/homebrew-repo
+        std::size_t const slash = args.front().find('/');
+        if (slash == std::string_view::npos || args.front().rfind('/') != slash)
+            return std::nullopt;
+        std::string_view const repo = args.front().substr(slash + 1);
+        path = layout_.getRepository() / "Library" / "Taps" / args.front().substr(0, slash) /
+               (repo.starts_with("homebrew-") ? std::string(repo) : "homebrew-" + std::string(repo));
+        break;
+    }
+    default:
+        return std::nullopt;
+    }
+
+    // Homebrew resolves names (aliases, renames, fully qualified names) that only it knows
+    // about, so a name is only answered for if it already exists on disk
+    std::error_code ec;
+    if (!args.empty() && !std::filesystem::exists(path, ec))
+        return std::nullopt;
+    return path.string() + "\n";
+}
+
+inline std::optional<std::string> BrewNative::resolveList(std::vector<std::string_view> const& args) const {
+    bool versions = false, formulae = false, casks = false;
+    std::vector<std::string_view> names;
+    for (std::string_view arg : args) {
+        if (arg == "--versions")
+            versions = true;
+        else if (arg == "--formula" || arg == "--formulae")
+            formulae = true;
+        else if (arg == "--cask" || arg == "--casks")
+            casks = true;
+        else if (arg == "-1")
+            continue;
+        else if (arg.starts_with("-"))
+            return std::nullopt;
+        else
+            names.push_back(arg);
+    }
+    if (formulae && casks)
+        return std::nullopt;
+
+    std::string output;
+    if (!versions) {
+        // With names, `list` prints the files of each keg instead
+        if (!names.empty())
+            return std::nullopt;
+        if (!casks) {
+            for (auto const& name : layout_.getFormulae())
+                output += name + "\n";
+        }
+        if (!formulae) {
+            for (auto const& token : layout_.getCasks())
+                output += token + "\n";
+        }
+        return output;
+    }
+
+    // `list --versions` covers formulae unless told otherwise, and fails for anything that
+    // isn't installed; leave that (and its message) to Homebrew
+    std::vector<std::string> all(names.begin(), names.end());
+    if (names.empty())
+        all = casks ? layout_.getCasks() : layout_.getFormulae();
+
+    for (auto const& name : all) {
+        std::vector<std::string> const installed =
+            casks ? layout_.getCaskVersions(name) : layout_.getKegs(name);
+        if (installed.empty())
+            return std::nullopt;
+        output += name;
+        for (auto const& version : installed)
+            output += " " + version;
+        output += "\n";
+    }
+    return output;
+}
+
+template <EnumType E>
+std::optional<std::string> BrewNative::resolve(BrewCommand<E> const& cmd) const {
+    if constexpr (!std::is_same_v<E, BrewCommandType::Builtin>) {
+        return std::nullopt;
+    } else {
+        if (!layout_.isRecognised())
+            return std::nullopt;
+
+        std::vector<std::string_view> args;
+        BarrelCmd::Argv const& argv = cmd.getArgv();
+        for (std::size_t idx = 2; idx < argv.size(); ++idx)
+            args.push_back(argv[idx]);
+
+        switch (cmd.getCommand()) {
+        case BrewCommandType::Builtin::PREFIX:
+        case BrewCommandType::Builtin::CELLAR:
+        case BrewCommandType::Builtin::CASKROOM:
+        case BrewCommandType::Builtin::REPOSITORY:
+            return resolveLocation(cmd.getCommand(), args);
+        case BrewCommandType::Builtin::LIST:
+            return resolveList(args);
+        case BrewCommandType::Builtin::VERSION: {
+            if (!args.empty())
+                return std::nullopt;
+            std::optional<std::string> const version = layout_.getVersion();
+            if (!version.has_value())
+                return std::nullopt;
+            return "Homebrew " + *version + "\n";
+        }
+        default:
+            return std::nullopt;
+        }
+    }
+}
+
+template <EnumType E>
+bool BrewNative::execute(BrewCommand<E>& cmd, BarrelCmd::Stream stream) const {
+    cmd.checkBound();
+    std::optional<std::string> output = resolve(cmd);
+    if (!output.has_value()) {
+        cmd.execute(stream);
+        return false;
+    }
+
+    cmd.stream_dump_.clear();
+    cmd.error_dump_.clear();
+    cmd.exit_status_ = EXIT_SUCCESS;
+    cmd.termination_ = BarrelCmd::Termination::EXITED;
+    cmd.metrics_ = {};
+    cmd.spills_ = {};
+    if (stream == BarrelCmd::Stream::STDERR)
+        return true; // Nothing would have been written to stderr
+
+    cmd.stream_dump_ = std::move(*output);
+    cmd.replay(stream); // Tagged STDOUT_STDERR for merged output, as a process's would be
+    BarrelCmd::applyCapture(cmd.capture_, cmd.stream_dump_);
+    return true;
+}
+
+#endif
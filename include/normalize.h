@@ -0,0 +1,279 @@
+/*!
+ * This file is part of Barrel, a header-only C++ library that provides
+ * programmatic access to the Homebrew command line interface.
+ *
+ * Copyright (C) 2022 aydwi <contact@aydwi.com>
+ *
+ * Barrel is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*! \file  normalize.h
+    \brief An internal header used by Barrel. Strips terminal control sequences from
+           output, and collapses lines redrawn with carriage returns to their final state.
+*/
+
+#ifndef NORMALIZE_H__
+#define NORMALIZE_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+#define BARREL_SIMD_X86 1
+#elif defined(__aarch64__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define BARREL_SIMD_NEON 1
+#endif
+
+namespace BarrelCmd {
+
+char const ESC{'\x1b'};
+
+/*! \brief Position of the first escape or carriage return, byte by byte. Returns `size` if
+ *         there is none.
+ */
+inline std::size_t findControlScalar(char const* data, std::size_t size) {
+    for (std::size_t idx = 0; idx < size; ++idx) {
+        if (data[idx] == ESC || data[idx] == '\r')
+            return idx;
+    }
+    return size;
+}
+
+#if defined(BARREL_SIMD_X86) && (defined(__GNUC__) || defined(__clang__))
+#define BARREL_SIMD_AVX2 1
+
+// Compiled for AVX2 whatever the target, and only called where the CPU supports it
+__attribute__((target("avx2"))) inline std::size_t findControlAvx2(char const* data, std::size_t size) {
+    __m256i const esc = _mm256_set1_epi8(ESC);
+    __m256i const cr = _mm256_set1_epi8('\r');
+    std::size_t idx = 0;
+    for (; idx + 32 <= size; idx += 32) {
+        __m256i const block = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(data + idx));
+        auto const mask = static_cast<std::uint32_t>(_mm256_movemask_epi8(
+            _mm256_or_si256(_mm256_cmpeq_epi8(block, esc), _mm256_cmpeq_epi8(block, cr))));
+        if (mask != 0)
+            return idx + static_cast<std::size_t>(__builtin_ctz(mask));
+    }
+    return idx + findControlScalar(data + idx, size - idx);
+}
+#endif
+
+/*! \brief Position of the first escape or carriage return, 16 bytes at a time (SSE2 on
+ *         x86-64, NEON on ARM64). Returns `size` if there is none.
+ */
+inline std::size_t findControlVector(char const* data, std::size_t size) {
+    std::size_t idx = 0;
+#if defined(BARREL_SIMD_X86)
+    __m128i const esc = _mm_set1_epi8(ESC);
+    __m128i const cr = _mm_set1_epi8('\r');
+    for (; idx + 16 <= size; idx += 16) {
+        __m128i const block = _mm_loadu_si128(reinterpret_cast<__m128i const*>(data + idx));
+        auto const mask = static_cast<std::uint32_t>(
+            _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(block, esc), _mm_cmpeq_epi8(block, cr))));
+        if (mask != 0)
+            return idx + static_cast<std::size_t>(__builtin_ctz(mask));
+    }
+#elif defined(BARREL_SIMD_NEON)
+    uint8x16_t const esc = vdupq_n_u8(static_cast<std::uint8_t>(ESC));
+    uint8x16_t const cr = vdupq_n_u8('\r');
+    for (; idx + 16 <= size; idx += 16) {
+        uint8x16_t const block = vld1q_u8(reinterpret_cast<std::uint8_t const*>(data + idx));
+        if (vmaxvq_u8(vorrq_u8(vceqq_u8(block, esc), vceqq_u8(block, cr))) != 0)
+            return idx + findControlScalar(data + idx, 16);
+    }
+#endif
+    return idx + findControlScalar(data + idx, size - idx);
+}
+
+/*! \brief Position of the first escape or carriage return, with the widest instructions the
+ *         CPU supports. Returns `size` if there is none.
+ */
+inline std::size_t findControl(char const* data, std::size_t size) {
+#if defined(BARREL_SIMD_AVX2)
+    static bool const avx2 = __builtin_cpu_supports("avx2");
+    if (avx2)
+        return findControlAvx2(data, size);
+#endif
+    return findControlVector(data, size);
+}
+
+/*! \brief Turns terminal output into the text it leaves on screen, as it streams in.
+ *
+ *  Escape sequences are removed: CSI sequences (colours, cursor movement, erasing, e.g.
+ *  `ESC [ 1 ; 3 4 m`), OSC sequences (titles, hyperlinks) ending in BEL or ST, and the
+ *  remaining two-byte escapes. A carriage return which isn't part of a CRLF line ending
+ *  rewinds to the start of the line, so that whatever is written next replaces it: of a
+ *  progress bar redrawn in place, only its last state is kept. Multi-line redraws, which
+ *  move the cursor up, are not followed; their lines are all kept.
+ *
+ *  Text is normalized in place. Scanning for the bytes which need attention is vectorized,
+ *  so text without any (most of it) is only moved, if at all.
+ */
+class Normalizer {
+private:
+    enum class State : std::uint8_t { TEXT, ESCAPE, INTERMEDIATE, CSI, OSC, OSC_ESCAPE };
+
+private:
+    State state_{State::TEXT};
+    bool rewind_{false};        // A carriage return was seen; the next text replaces the line
+    std::size_t line_start_{0}; // Where the line being written starts in the output
+    std::string held_{};        // The unfinished line, and what was returned by feed() before it
+    std::size_t returned_{0};
+
+public:
+    /*! \brief Normalize `text[from, end)` in place, as the continuation of `text[0, from)`,
+     *         which was normalized already. A redrawn line may reach back before `from`.
+     *
+     *  \return The end of the normalized text
+     */
+    std::size_t apply(char*, std::size_t, std::size_t);
+
+    /*! \brief Normalize the next chunk of a stream. Only finished lines are returned; the
+     *         line still being written is held back, as it may yet be redrawn.
+     *
+     *  \return The lines finished by the chunk, valid until the next call
+     */
+    std::string_view feed(std::string_view);
+
+    /*! \brief End the stream.
+     *
+     *  \return The last line, if it was left unfinished
+     */
+    std::string_view finish();
+
+    void reset();
+};
+
+inline std::size_t Normalizer::apply(char* text, std::size_t from, std::size_t end) {
+    std::size_t read = from, write = from;
+    while (read < end) {
+        if (state_ == State::TEXT) {
+            std::size_t const control = read + findControl(text + read, end - read);
+            if (control > read) {
+                // Text after a lone carriage return writes over the line; "\r\n" just ends it
+                if (rewind_) {
+                    if (text[read] != '\n')
+                        write = line_start_;
+                    rewind_ = false;
+                }
+                std::size_t const size = control - read;
+                if (write != read)
+                    std::memmove(text + write, text + read, size);
+                for (std::size_t idx = write + size; idx > write; --idx) {
+                    if (text[idx - 1] == '\n') {
+                        line_start_ = idx;
+                        break;
+                    }
+                }
+                write += size;
+                read = control;
+            }
+            if (read == end)
+                break;
+            if (text[read++] == '\r')
+                rewind_ = true;
+            else
+                state_ = State::ESCAPE;
+            continue;
+        }
+
+        unsigned char const ch = static_cast<unsigned char>(text[read++]);
+        switch (state_) {
+        case State::ESCAPE:
+            if (ch == '[')
+                state_ = State::CSI;
+            else if (ch == ']')
+                state_ = State::OSC;
+            else if (ch >= 0x20 && ch <= 0x2f)
+                state_ = State::INTERMEDIATE;
+            else
+                state_ = State::TEXT;
+            break;
+        case State::INTERMEDIATE:
+            if (ch < 0x20 || ch > 0x2f)
+                state_ = State::TEXT;
+            break;
+        case State::CSI:
+            // Parameters and intermediates run up to a final byte. A terminal acts on control
+            // characters within a sequence; they're kept by ending it early
+            if (ch >= 0x40 && ch <= 0x7e) {
+                state_ = State::TEXT;
+            } else if (ch < 0x20) {
+                state_ = State::TEXT;
+                --read;
+            }
+            break;
+        case State::OSC:
+            if (ch == 0x07)
+                state_ = State::TEXT;
+            else if (ch == static_cast<unsigned char>(ESC))
+                state_ = State::OSC_ESCAPE;
+            break;
+        case State::OSC_ESCAPE:
+            // ST is "ESC \"; any other escape ends the sequence and starts another
+            state_ = ch == '\\' ? State::TEXT : State::ESCAPE;
+            if (ch != '\\')
+                --read;
+            break;
+        default:
+            break;
+        }
+    }
+    return write;
+}
+
+inline std::string_view Normalizer::feed(std::string_view chunk) {
+    // What was returned last time goes; the line being written moves to the front
+    held_.erase(0, returned_);
+    line_start_ -= returned_;
+    returned_ = 0;
+
+    std::size_t const from = held_.size();
+    held_.append(chunk);
+    held_.resize(apply(held_.data(), from, held_.size()));
+    returned_ = line_start_;
+    return std::string_view(held_).substr(0, returned_);
+}
+
+inline std::string_view Normalizer::finish() {
+    held_.erase(0, returned_);
+    returned_ = held_.size();
+    line_start_ = 0;
+    state_ = State::TEXT;
+    rewind_ = false;
+    return held_;
+}
+
+inline void Normalizer::reset() {
+    state_ = State::TEXT;
+    rewind_ = false;
+    line_start_ = 0;
+    held_.clear();
+    returned_ = 0;
+}
+
+/*! \brief Normalize a whole text in place (see Normalizer).
+ */
+inline void normalize(std::string& text) {
+    Normalizer normalizer;
+    text.resize(normalizer.apply(text.data(), 0, text.size()));
+}
+
+} // namespace BarrelCmd
+
+#endif
@@ -0,0 +1,389 @@
+/*!
+ * This file is part of Barrel, a header-only C++ library that provides
+ * programmatic access to the Homebrew command line interface.
+ *
+ * Copyright (C) 2022 aydwi <contact@aydwi.com>
+ *
+ * Barrel is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*! \file  pipeline.h
+ *  \brief Install many formulae at once, downloading while installing.
+ */
+
+#ifndef PIPELINE_H__
+#define PIPELINE_H__
+
+#include "barrel.h"
+#include "graph.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/*! \brief What became of a formula in a BrewPipeline run.
+ */
+enum class BrewProvisionStatus {
+    INSTALLED,      /*!< Fetched and installed */
+    FETCH_FAILED,   /*!< `brew fetch` failed, so it was not installed */
+    INSTALL_FAILED, /*!< Fetched, but `brew install` failed */
+    SKIPPED         /*!< Not attempted, as a dependency failed or the run was cancelled */
+};
+
+/*! \brief One formula of a BrewPipeline run, and where its time went. The stages of different
+ *         formulae overlap, so their durations do not add up to the length of the run.
+ */
+struct BrewProvisioned {
+    std::string name{};
+    BrewProvisionStatus status{BrewProvisionStatus::SKIPPED};
+    int exit_status{BAD_EXIT_ST}; /*!< Of the stage which failed, or of `brew install` */
+    std::string output{};         /*!< Tail of the (normalized) output of the stage which failed */
+
+    std::chrono::steady_clock::duration fetch_queued{};   /*!< From the start of the run to its fetch */
+    std::chrono::steady_clock::duration fetch{};          /*!< Spent fetching */
+    std::chrono::steady_clock::duration install_queued{}; /*!< From fetched to installing, waiting on
+                                                               its dependencies or other installs */
+    std::chrono::steady_clock::duration install{};        /*!< Spent installing */
+};
+
+/*! \brief The outcome of a BrewPipeline run.
+ */
+struct BrewProvisioning {
+    std::vector<BrewProvisioned> formulae{}; /*!< In the order they were installed, then the rest */
+
+    std::chrono::steady_clock::duration wall{};       /*!< Length of the whole run */
+    std::chrono::steady_clock::duration fetching{};   /*!< Spent fetching, summed over the fetchers */
+    std::chrono::steady_clock::duration installing{}; /*!< Spent installing */
+    std::chrono::steady_clock::duration stalled{};    /*!< Spent with nothing to install, waiting on
+                                                           a fetch to finish */
+
+    /*! \brief Whether every formula was installed.
+     */
+    bool succeeded() const {
+        return std::all_of(formulae.begin(), formulae.end(), [](BrewProvisioned const& formula) {
+            return formula.status == BrewProvisionStatus::INSTALLED;
+        });
+    }
+};
+
+/*! \brief Install a set of formulae and every dependency of theirs which is missing, fetching
+ *         bottles concurrently while installing those already fetched.
+ *
+ *  The dependency closure is resolved from a ::BrewGraph, leaving out what is installed
+ *  already. Up to a given number of `brew fetch` commands run at once, in installation order,
+ *  so that what is needed first arrives first. Meanwhile `brew install` runs one formula at a
+ *  time (installs mutate the installation, see BrewLockClass::EXCLUSIVE), each as soon as it
+ *  is fetched and all of its dependencies are installed. The network is thus kept busy while
+ *  bottles are poured, rather than one waiting for the other.
+ *
+ *  \code
+ *  Brew brew;
+ *  brew.setEnvProfile(BrewEnvProfile::fast());
+ *  BrewGraph graph = BrewGraph::fromApiCache(brew);
+ *
+ *  BrewPipeline pipeline(brew, graph);
+ *  std::vector<std::string_view> const names{"ffmpeg", "imagemagick"};
+ *  BrewProvisioning const result = pipeline.provision(names);
+ *  \endcode
+ *
+ *  A formula whose fetch or install fails is reported as such, and whatever depends on it is
+ *  skipped; the rest of the closure is still installed. Dependencies are installed by name,
+ *  and so are recorded back as not installed on request (with `brew tab`) once installed, as
+ *  they would have been by `brew install` of what depends on them. Casks are not covered, as
+ *  they are not part of the graph.
+ */
+class BrewPipeline {
+private:
+    enum class Stage : std::uint8_t { QUEUED, FETCHING, FETCHED, FAILED, INSTALLED, SKIPPED };
+
+    struct Run {
+        std::vector<std::string_view> order{};
+        std::vector<std::vector<std::size_t>> deps{}; // Positions in order
+        std::vector<std::uint8_t> requested{};         // Named by the caller, not just depended on
+        std::vector<BrewProvisioned> results{};
+        std::vector<Stage> stages{};
+        std::vector<std::chrono::steady_clock::time_point> fetched{};
+        std::chrono::steady_clock::time_point start{};
+        std::atomic<std::size_t> next_fetch{0};
+        std::mutex mutex{};
+        std::condition_variable progress{};
+    };
+
+private:
+    Brew brew_;
+    BrewGraph& graph_;
+    std::size_t fetchers_;
+    std::optional<BarrelCmd::CancellationToken> cancellation_{};
+
+private:
+    bool isCancelled() const;
+    void fetch(Run&) const;
+    std::optional<std::size_t> nextInstall(Run&) const;
+    void install(Run&, std::size_t) const;
+
+    // Executes a single stage of a formula, recording its failure (if any) in the result
+    template <typename... Args>
+    bool execute(BrewProvisioned&, BrewCommandType::Builtin, Args const&...) const;
+
+public:
+    /*! \brief Constructor for BrewPipeline.
+     *
+     *  \param brew An object of type ::Brew, the installation to provision. Its environment
+     *              profile applies to every command executed.
+     *  \param graph The dependency graph of the installation, which is kept current as
+     *               formulae are installed (see BrewGraph::apply())
+     *  \param fetchers Maximum number of fetches running at once
+     */
+    BrewPipeline(Brew const&, BrewGraph&, std::size_t = 4);
+
+public:
+    /*! \brief Stop the run once the token is cancelled. The fetches and the install underway
+     *         are terminated, and every formula not installed by then is skipped.
+     *
+     *  \param token A token, possibly shared by other commands
+     */
+    void setCancellation(BarrelCmd::CancellationToken);
+
+    /*! \brief Install the given formulae and their missing dependencies, and wait for the run
+     *         to finish.
+     *
+     *  \param names Names, full names or aliases of the formulae
+     *
+     *  \return What became of every formula which was not installed already
+     *
+     *  \throws std::out_of_range If a formula is unknown to the graph
+     */
+    BrewProvisioning provision(std::span<std::string_view const>);
+};
+
+inline BrewPipeline::BrewPipeline(Brew const& brew, BrewGraph& graph, std::size_t fetchers)
+    : brew_(brew), graph_(graph), fetchers_(std::max<std::size_t>(fetchers, 1)){};
+
+inline void BrewPipeline::setCancellation(BarrelCmd::CancellationToken token) {
+    cancellation_ = std::move(token);
+}
+
+inline bool BrewPipeline::isCancelled() const {
+    return cancellation_.has_value() && cancellation_->isCancelled();
+}
+
+template <typename... Args>
+bool BrewPipeline::execute(BrewProvisioned& result, BrewCommandType::Builtin stage,
+                           Args const&... args) const {
+    BrewCommand<BrewCommandType::Builtin> cmd(brew_, stage, args...);
+    cmd.setCapture(BarrelCmd::CapturePolicy::tail(64 * 1024)); // Enough to tell why it failed
+    cmd.normalizeOutput(true); // Reduces download progress to its last state
+    if (cancellation_.has_value())
+        cmd.setCancellation(*cancellation_);
+
+    try {
+        cmd.execute();
+    } catch (std::exception const& err) {
+        result.exit_status = BAD_EXIT_ST;
+        result.output = err.what();
+        return false;
+    }
+    result.exit_status = cmd.getExitStatus();
+    if (cmd.getExitStatus() != EXIT_SUCCESS || cmd.getTermination() != BarrelCmd::Termination::EXITED) {
+        result.output = cmd.getStreamDump();
+        return false;
+    }
+    if (stage != BrewCommandType::Builtin::FETCH)
+        graph_.apply(cmd);
+    return true;
+}
+
+inline void BrewPipeline::fetch(Run& run) const {
+    for (;;) {
+        std::size_t const idx = run.next_fetch.fetch_add(1);
+        if (idx >= run.order.size())
+            return;
+        {
+            std::lock_guard<std::mutex> lock(run.mutex);
+            if (run.stages[idx] == Stage::SKIPPED) // A dependency failed already
+                continue;
+            run.stages[idx] = Stage::FETCHING;
+        }
+
+        BrewProvisioned& result = run.results[idx];
+        auto const start = std::chrono::steady_clock::now();
+        result.fetch_queued = start - run.start;
+        bool const fetched =
+            !isCancelled() && execute(result, BrewCommandType::Builtin::FETCH, "--formula", run.order[idx]);
+        auto const end = std::chrono::steady_clock::now();
+        result.fetch = end - start;
+
+        {
+            std::lock_guard<std::mutex> lock(run.mutex);
+            run.fetched[idx] = end;
+            if (!fetched && !isCancelled())
+                result.status = BrewProvisionStatus::FETCH_FAILED;
+            if (run.stages[idx] == Stage::FETCHING) // Or skipped meanwhile, as a dependency failed
+                run.stages[idx] = fetched ? Stage::FETCHED : Stage::FAILED;
+        }
+        run.progress.notify_all();
+    }
+}
+
+// The earliest formula in installation order which is fetched and whose dependencies are all
+// installed. Skips whatever can no longer be installed on the way. Called with the lock held
+inline std::optional<std::size_t> BrewPipeline::nextInstall(Run& run) const {
+    bool const cancelled = isCancelled();
+    for (std::size_t idx = 0; idx < run.order.size(); ++idx) {
+        Stage& stage = run.stages[idx];
+        if (stage == Stage::FAILED || stage == Stage::INSTALLED || stage == Stage::SKIPPED)
+            continue;
+
+        bool ready = stage == Stage::FETCHED;
+        for (std::size_t dep : run.deps[idx]) {
+            if (run.stages[dep] == Stage::FAILED || run.stages[dep] == Stage::SKIPPED) {
+                stage = Stage::SKIPPED;
+                break;
+            }
+            ready = ready && run.stages[dep] == Stage::INSTALLED;
+        }
+        // A fetch underway ends on its own once cancelled; it must be waited for
+        if (cancelled && stage != Stage::FETCHING)
+            stage = Stage::SKIPPED;
+        if (stage != Stage::SKIPPED && ready)
+            return idx;
+    }
+    return std::nullopt;
+}
+
+inline void BrewPipeline::install(Run& run, std::size_t idx) const {
+    BrewProvisioned& result = run.results[idx];
+    auto const start = std::chrono::steady_clock::now();
+    result.install_queued = start - run.fetched[idx];
+    bool const installed = execute(result, BrewCommandType::Builtin::INSTALL, "--formula", run.order[idx]);
+    // Should that fail, the dependency is still installed, only kept by `brew autoremove`
+    if (installed && !run.requested[idx]) {
+        BrewProvisioned marked;
+        execute(marked, BrewCommandType::Builtin::TAB, "--no-installed-on-request", run.order[idx]);
+    }
+    result.install = std::chrono::steady_clock::now() - start;
+    if (installed)
+        result.status = BrewProvisionStatus::INSTALLED;
+    else if (!isCancelled())
+        result.status = BrewProvisionStatus::INSTALL_FAILED;
+
+    std::lock_guard<std::mutex> lock(run.mutex);
+    run.stages[idx] = installed ? Stage::INSTALLED : Stage::FAILED;
+}
+
+inline BrewProvisioning BrewPipeline::provision(std::span<std::string_view const> names) {
+    Run run;
+    run.start = std::chrono::steady_clock::now();
+    for (std::string_view name : graph_.getTopologicalOrder(names)) {
+        if (!graph_.isInstalled(name))
+            run.order.push_back(name);
+    }
+
+    std::unordered_map<std::string_view, std::size_t> positions;
+    for (std::size_t idx = 0; idx < run.order.size(); ++idx)
+        positions.emplace(run.order[idx], idx);
+    run.deps.resize(run.order.size());
+    run.requested.resize(run.order.size());
+    for (std::string_view name : names) {
+        if (auto const position = positions.find(graph_.getName(name)); position != positions.end())
+            run.requested[position->second] = 1;
+    }
+    run.results.resize(run.order.size());
+    for (std::size_t idx = 0; idx < run.order.size(); ++idx) {
+        run.results[idx].name = run.order[idx];
+        for (std::string_view dep : graph_.getDeps(run.order[idx], BrewGraphScope::DIRECT)) {
+            if (auto const position = positions.find(dep); position != positions.end())
+                run.deps[idx].push_back(position->second);
+        }
+    }
+    run.stages.assign(run.order.size(), Stage::QUEUED);
+    run.fetched.resize(run.order.size());
+
+    // Joined however the run ends, as a thread destroyed while joinable ends the process. Should
+    // installing throw (as BrewGraph::apply() may), fetches not started yet are given up on
+    struct Fetchers {
+        Run& run;
+        std::vector<std::thread> threads{};
+
+        ~Fetchers() {
+            run.next_fetch = run.order.size();
+            for (auto& thread : threads)
+                thread.join();
+        }
+    } fetchers{run};
+    for (std::size_t idx = 0; idx < std::min(fetchers_, run.order.size()); ++idx)
+        fetchers.threads.emplace_back(&BrewPipeline::fetch, this, std::ref(run));
+
+    BrewProvisioning provisioning;
+    {
+        std::unique_lock<std::mutex> lock(run.mutex);
+        for (;;) {
+            std::optional<std::size_t> const next = nextInstall(run);
+            if (next.has_value()) {
+                lock.unlock();
+                install(run, *next);
+                provisioning.installing += run.results[*next].install;
+                lock.lock();
+                continue;
+            }
+
+            bool const pending = std::any_of(run.stages.begin(), run.stages.end(), [](Stage stage) {
+                return stage == Stage::QUEUED || stage == Stage::FETCHING || stage == Stage::FETCHED;
+            });
+            if (!pending)
+                break;
+            auto const stalled = std::chrono::steady_clock::now();
+            // Polled too, so that a cancellation between fetches is noticed
+            run.progress.wait_for(lock, std::chrono::milliseconds(100));
+            provisioning.stalled += std::chrono::steady_clock::now() - stalled;
+        }
+    }
+    for (auto& fetcher : fetchers.threads)
+        fetcher.join();
+    fetchers.threads.clear();
+
+    for (std::size_t idx = 0; idx < run.order.size(); ++idx)
+        provisioning.fetching += run.results[idx].fetch;
+
+    // Report in the order things were installed; what wasn't keeps its place in the closure
+    std::vector<std::size_t> sequence(run.order.size());
+    for (std::size_t idx = 0; idx < sequence.size(); ++idx)
+        sequence[idx] = idx;
+    std::stable_sort(sequence.begin(), sequence.end(), [&run](std::size_t lhs, std::size_t rhs) {
+        auto const installed_at = [&run](std::size_t idx) {
+            return run.results[idx].status == BrewProvisionStatus::INSTALLED
+                       ? run.fetched[idx] + run.results[idx].install_queued
+                       : std::chrono::steady_clock::time_point::max();
+        };
+        return installed_at(lhs) < installed_at(rhs);
+    });
+    for (std::size_t idx : sequence)
+        provisioning.formulae.push_back(std::move(run.results[idx]));
+    provisioning.wall = std::chrono::steady_clock::now() - run.start;
+    return provisioning;
+}
+
+#endif
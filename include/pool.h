@@ -0,0 +1,176 @@
+/*!
+ * This file is part of Barrel, a header-only C++ library that provides
+ * programmatic access to the Homebrew command line interface.
+ *
+ * Copyright (C) 2022 aydwi <contact@aydwi.com>
+ *
+ * Barrel is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*! \file  pool.h
+    \brief An internal header used by Barrel. Provides the work-stealing thread pool
+           used to execute commands on multiple threads.
+*/
+
+#ifndef POOL_H__
+#define POOL_H__
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace BarrelCmd {
+
+/*! \brief A fixed-size pool of threads, each with its own job queue. A thread serves its
+ *         own queue newest-first and, once that runs dry, steals the oldest jobs from the
+ *         other queues.
+ */
+class ThreadPool {
+private:
+    struct JobQueue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> jobs;
+    };
+
+private:
+    std::vector<std::unique_ptr<JobQueue>> queues_{};
+    std::vector<std::thread> threads_{};
+    std::atomic<std::size_t> next_queue_{0};
+
+private:
+    std::mutex idle_mutex_{};
+    std::condition_variable idle_cv_{};
+    std::size_t queued_{0};
+    bool stop_{false};
+
+private:
+    inline static thread_local ThreadPool const* current_pool_{nullptr};
+    inline static thread_local std::size_t current_queue_{0};
+
+private:
+    void work(std::size_t);
+    bool tryPop(std::size_t, std::function<void()>&);
+
+public:
+    /*! \brief Start a pool of the given number of threads (at least one).
+     *
+     *  \param threads Number of worker threads
+     */
+    explicit ThreadPool(std::size_t);
+    ThreadPool(ThreadPool const&) = delete;
+    ThreadPool& operator=(ThreadPool const&) = delete;
+
+    /*! \brief Finishes every queued job, then joins the worker threads.
+     */
+    ~ThreadPool();
+
+public:
+    void submit(std::function<void()>);
+    std::size_t size() const;
+};
+
+inline ThreadPool::ThreadPool(std::size_t threads) {
+    threads = std::max<std::size_t>(threads, 1);
+
+    for (std::size_t idx = 0; idx < threads; ++idx)
+        queues_.push_back(std::make_unique<JobQueue>());
+    for (std::size_t idx = 0; idx < threads; ++idx)
+        threads_.emplace_back(&ThreadPool::work, this, idx);
+}
+
+inline ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(idle_mutex_);
+        stop_ = true;
+    }
+    idle_cv_.notify_all();
+
+    for (auto& thread : threads_)
+        thread.join();
+}
+
+inline void ThreadPool::submit(std::function<void()> job) {
+    // Jobs spawned from within a job stay on the spawning thread's queue, for locality
+    std::size_t const idx =
+        current_pool_ == this ? current_queue_ : next_queue_.fetch_add(1) % queues_.size();
+    {
+        std::lock_guard<std::mutex> lock(queues_[idx]->mutex);
+        queues_[idx]->jobs.push_back(std::move(job));
+    }
+    {
+        std::lock_guard<std::mutex> lock(idle_mutex_);
+        ++queued_;
+    }
+    idle_cv_.notify_one();
+}
+
+inline std::size_t ThreadPool::size() const {
+    return threads_.size();
+}
+
+inline bool ThreadPool::tryPop(std::size_t idx, std::function<void()>& job) {
+    {
+        std::lock_guard<std::mutex> lock(queues_[idx]->mutex);
+        if (!queues_[idx]->jobs.empty()) {
+            job = std::move(queues_[idx]->jobs.back());
+            queues_[idx]->jobs.pop_back();
+            return true;
+        }
+    }
+
+    for (std::size_t offset = 1; offset < queues_.size(); ++offset) {
+        JobQueue& victim = *queues_[(idx + offset) % queues_.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.jobs.empty()) {
+            job = std::move(victim.jobs.front());
+            victim.jobs.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+inline void ThreadPool::work(std::size_t idx) {
+    current_pool_ = this;
+    current_queue_ = idx;
+
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(idle_mutex_);
+            idle_cv_.wait(lock, [this]() { return stop_ || queued_ != 0; });
+            if (queued_ == 0)
+                return; // Stopped, and nothing is left to run
+            --queued_;
+        }
+
+        // The job claimed is in some queue, since it was queued before being counted. Only a
+        // thread which has claimed one of its own pops, but it may be taking a job just
+        // queued while this one scans
+        std::function<void()> job;
+        while (!tryPop(idx, job))
+            std::this_thread::yield();
+        job();
+    }
+}
+
+} // namespace BarrelCmd
+
+#endif
@@ -25,101 +25,1192 @@
 #ifndef PROC_H__
 #define PROC_H__
 
+#include "normalize.h"
+
+#include <algorithm>
 #include <array>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <climits>
 #include <cstddef>
-#include <cstdio>
-#include <future>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <initializer_list>
 #include <memory>
+#include <optional>
 #include <stdexcept>
 #include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char** environ;
 
 using namespace std::string_literals;
 
-inline extern std::size_t const READ_BUFFER_SZ{1024};
+inline extern std::size_t const READ_BUFFER_SZ{16 * 1024};
+inline extern std::size_t const PIPE_READ_SZ{64 * 1024}; // The most a pipe holds by default
 
-inline extern std::string const STDOUT_CAPTURE{"2>/dev/null"s};
-inline extern std::string const STDERR_CAPTURE{"2>&1 1>/dev/null"s};
-inline extern std::string const STDOUT_STDERR_CAPTURE{"2>&1"s};
+inline extern std::chrono::milliseconds const KILL_GRACE_PERIOD{2000};
+
+inline extern std::string const DEV_NULL{"/dev/null"s};
 
 inline extern std::string const LE_SPACER{" "s};
 
+#define BAD_EXIT_ST (INT_MAX & 0xff)
+
 namespace BarrelCmd {
 
 enum class Stream {
     STDOUT,
     STDERR,
     STDOUT_STDERR,
+    STDOUT_STDERR_SPLIT,
+};
+
+/*! \brief How an executed process came to an end.
+ */
+enum class Termination {
+    EXITED,    /*!< It exited by itself; the exit status is its own */
+    SIGNALLED, /*!< A signal nobody here sent ended it; the exit status is 128 + the signal */
+    TIMED_OUT, /*!< Its deadline passed, and it was terminated */
+    CANCELLED, /*!< Its cancellation token was triggered, and it was terminated (or never started) */
+};
+
+/*! \brief Where the time of one execution went, and what it consumed. Phases are measured
+ *         from the start of the execution (just before its pipes are opened); a phase which
+ *         never happened is left at zero.
+ */
+struct ExecutionMetrics {
+    std::chrono::steady_clock::time_point start{};
+    std::chrono::steady_clock::duration queued{};     // Waiting for a thread (or a lock) beforehand
+    std::chrono::steady_clock::duration spawn{};      // Until the process was launched
+    std::chrono::steady_clock::duration first_byte{}; // Until the first output was read
+    std::chrono::steady_clock::duration wall{};       // Until it was reaped and its output captured
+    std::array<std::size_t, 2> bytes{0, 0};           // Read from the stream (or stdout) and stderr
+    std::chrono::microseconds user_cpu{};             // Of the process and the descendants it reaped
+    std::chrono::microseconds system_cpu{};
+    std::size_t max_rss{0}; // Peak resident set size of the largest of them, in bytes
+};
+
+/*! \brief Record the resource usage of a reaped process, as reported by `wait4()`.
+ */
+inline void recordUsage(ExecutionMetrics& metrics, rusage const& usage) {
+    auto const micros = [](timeval const& time) {
+        return std::chrono::seconds(time.tv_sec) + std::chrono::microseconds(time.tv_usec);
+    };
+    metrics.user_cpu = micros(usage.ru_utime);
+    metrics.system_cpu = micros(usage.ru_stime);
+#if defined(__APPLE__)
+    metrics.max_rss = static_cast<std::size_t>(usage.ru_maxrss); // Already in bytes
+#else
+    metrics.max_rss = static_cast<std::size_t>(usage.ru_maxrss) * 1024;
+#endif
+}
+
+/*! \brief How captured output is kept. \sa CapturePolicy
+ */
+enum class CaptureMode {
+    RETAIN,  /*!< All of it, in memory */
+    TAIL,    /*!< Only its last bytes, in a ring buffer of fixed size */
+    SPILL,   /*!< In memory up to a limit; past it, all of it in a temporary file, mapped back read-only */
+    DISCARD, /*!< None of it. Bytes are still counted, in ExecutionMetrics::bytes */
+};
+
+/*! \brief How much memory the capture of each stream may take, whatever Homebrew prints.
+ */
+struct CapturePolicy {
+    CaptureMode mode{CaptureMode::RETAIN};
+    std::size_t limit{0}; // Bytes kept by CaptureMode::TAIL, or held in memory by CaptureMode::SPILL
+
+    static CapturePolicy retain();
+
+    /*! \brief Keep the last `limit` bytes, e.g. to report why a verbose command failed.
+     */
+    static CapturePolicy tail(std::size_t);
+
+    /*! \brief Keep up to `limit` bytes in memory, and everything in a temporary file beyond.
+     */
+    static CapturePolicy spill(std::size_t);
+
+    static CapturePolicy discard();
+};
+
+inline CapturePolicy CapturePolicy::retain() {
+    return {CaptureMode::RETAIN, 0};
+}
+
+inline CapturePolicy CapturePolicy::tail(std::size_t limit) {
+    return {CaptureMode::TAIL, limit};
+}
+
+inline CapturePolicy CapturePolicy::spill(std::size_t limit) {
+    return {CaptureMode::SPILL, limit};
+}
+
+inline CapturePolicy CapturePolicy::discard() {
+    return {CaptureMode::DISCARD, 0};
+}
+
+/*! \brief Bring output which was captured in full (rather than through a Proc) in line with
+ *         a policy. Output beyond the limit of CaptureMode::SPILL stays in memory.
+ */
+inline void applyCapture(CapturePolicy const& policy, std::string& dump) {
+    if (policy.mode == CaptureMode::DISCARD)
+        dump.clear();
+    else if (policy.mode == CaptureMode::TAIL && dump.size() > policy.limit)
+        dump.erase(0, dump.size() - policy.limit);
+}
+
+/*! \brief Read-only view of output which spilled to a temporary file, mapped into memory.
+ *         Copies share the mapping, which is released along with the last of them. The file
+ *         has no name on disk, so nothing is left behind.
+ */
+class MappedOutput {
+private:
+    struct Mapping {
+        void* data;
+        std::size_t size;
+
+        Mapping(void* mapped, std::size_t length) : data(mapped), size(length){};
+        Mapping(Mapping const&) = delete;
+        Mapping& operator=(Mapping const&) = delete;
+        ~Mapping() {
+            if (data != nullptr)
+                munmap(data, size);
+        }
+    };
+
+private:
+    std::shared_ptr<Mapping const> mapping_{};
+
+public:
+    MappedOutput() = default;
+
+    /*! \brief Take ownership of a mapping made with `mmap()`.
+     */
+    MappedOutput(void*, std::size_t);
+
+public:
+    /*! \brief Whether there is a mapping, i.e. whether the output spilled.
+     */
+    bool isMapped() const;
+    std::size_t size() const;
+    std::string_view view() const;
+};
+
+inline MappedOutput::MappedOutput(void* data, std::size_t size)
+    : mapping_(std::make_shared<Mapping const>(data, size)){};
+
+inline bool MappedOutput::isMapped() const {
+    return mapping_ != nullptr;
+}
+
+inline std::size_t MappedOutput::size() const {
+    return mapping_ != nullptr ? mapping_->size : 0;
+}
+
+inline std::string_view MappedOutput::view() const {
+    if (mapping_ == nullptr || mapping_->data == nullptr)
+        return {};
+    return {static_cast<char const*>(mapping_->data), mapping_->size};
+}
+
+/*! \brief Open a temporary file for output to spill to, in `$TMPDIR` (or `/tmp`). It is
+ *         unlinked straight away, so that it disappears with its last descriptor and mapping.
+ *
+ *  \return The descriptor, or -1 on failure
+ */
+inline int openSpillFile() {
+    char const* tmpdir = std::getenv("TMPDIR");
+    std::string const dir = tmpdir != nullptr && *tmpdir != '\0' ? tmpdir : "/tmp";
+#if defined(O_TMPFILE)
+    int const fd = open(dir.c_str(), O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+    if (fd != -1)
+        return fd; // Otherwise the filesystem may not support it
+#endif
+    std::string path = dir + "/barrel-spill-XXXXXX";
+    int const named_fd = mkostemp(path.data(), O_CLOEXEC);
+    if (named_fd != -1)
+        unlink(path.c_str());
+    return named_fd;
+}
+
+/*! \brief A cooperative cancellation flag, shared by every copy of the token. Cancelling
+ *         terminates every process executing with one of its copies, and stops any that
+ *         hasn't started from starting.
+ */
+class CancellationToken {
+private:
+    struct State {
+        std::atomic<bool> cancelled{false};
+        int fds[2]{-1, -1}; // Read end becomes readable on cancellation, waking up waiters
+
+        ~State() {
+            for (int const fd : fds) {
+                if (fd != -1)
+                    close(fd);
+            }
+        }
+    };
+
+private:
+    std::shared_ptr<State> state_;
+
+public:
+    CancellationToken();
+
+public:
+    void cancel();
+    bool isCancelled() const;
+
+    /*! \brief A descriptor which becomes readable (and stays so) once the token is cancelled.
+     */
+    int getFd() const;
+};
+
+/*! \brief An argument vector stored as a single NUL-separated block. It is handed to
+ *         the spawned process as-is, so arguments are never re-parsed by a shell.
+ */
+class Argv {
+private:
+    std::string block_{};
+    std::vector<std::size_t> offsets_{};
+
+public:
+    Argv() = default;
+    Argv(std::initializer_list<std::string_view>);
+
+public:
+    void push(std::string_view);
+
+    /*! \brief Remove every argument, keeping the storage to be filled again.
+     */
+    void clear();
+
+    std::size_t size() const;
+    bool empty() const;
+    std::string_view operator[](std::size_t) const;
+    std::string join(std::string const&) const;
+
+public:
+    std::vector<char*> pointers();
+};
+
+inline Argv::Argv(std::initializer_list<std::string_view> args) {
+    for (auto const arg : args)
+        push(arg);
+}
+
+inline void Argv::push(std::string_view arg) {
+    offsets_.push_back(block_.size());
+    block_.append(arg);
+    block_.push_back('\0');
+}
+
+inline void Argv::clear() {
+    block_.clear();
+    offsets_.clear();
+}
+
+inline std::size_t Argv::size() const {
+    return offsets_.size();
+}
+
+inline bool Argv::empty() const {
+    return offsets_.empty();
+}
+
+inline std::string_view Argv::operator[](std::size_t idx) const {
+    return block_.data() + offsets_[idx];
+}
+
+inline std::string Argv::join(std::string const& separator) const {
+    std::string joined;
+    for (std::size_t idx = 0; idx < size(); ++idx) {
+        if (idx != 0)
+            joined += separator;
+        joined += (*this)[idx];
+    }
+    return joined;
+}
+
+inline std::vector<char*> Argv::pointers() {
+    std::vector<char*> ptrs;
+    ptrs.reserve(offsets_.size() + 1);
+    for (auto const offset : offsets_)
+        ptrs.push_back(block_.data() + offset);
+    ptrs.push_back(nullptr);
+    return ptrs;
+}
+
+/*! \brief A change to an environment: a variable set to a value, or unset.
+ */
+struct EnvChange {
+    std::string key;
+    std::optional<std::string> value; // Unset if empty
+};
+
+/*! \brief An environment block, i.e. "KEY=value" strings laid out the way `posix_spawnp()`
+ *         takes them. Built once, from this process's environment as it is at the time with
+ *         changes applied, and shared by every process launched with it.
+ */
+class Environment {
+private:
+    Argv entries_{};
+    std::vector<char*> pointers_{};
+
+public:
+    /*! \brief Constructor for Environment.
+     *
+     *  \param changes Changes to this process's environment, applied in order
+     */
+    explicit Environment(std::vector<EnvChange> const&);
+    Environment(Environment const&) = delete;
+    Environment& operator=(Environment const&) = delete;
+
+public:
+    /*! \brief The `NULL` terminated array of "KEY=value" strings.
+     */
+    char* const* get() const;
+
+    /*! \brief The value of a variable, or `std::nullopt` if it is not set.
+     */
+    std::optional<std::string_view> find(std::string_view) const;
+
+    std::size_t size() const;
 };
 
+inline Environment::Environment(std::vector<EnvChange> const& changes) {
+    auto const key_of = [](std::string_view entry) { return entry.substr(0, entry.find('=')); };
+
+    std::vector<std::string_view> entries;
+    for (char** entry = environ; *entry != nullptr; ++entry)
+        entries.emplace_back(*entry);
+
+    std::vector<std::string> assigned; // Storage for the entries the changes add
+    assigned.reserve(changes.size());
+    for (EnvChange const& change : changes) {
+        std::erase_if(entries, [&](std::string_view entry) { return key_of(entry) == change.key; });
+        if (change.value.has_value())
+            entries.emplace_back(assigned.emplace_back(change.key + "=" + *change.value));
+    }
+
+    for (std::string_view const entry : entries)
+        entries_.push(entry);
+    pointers_ = entries_.pointers();
+}
+
+inline char* const* Environment::get() const {
+    return pointers_.data();
+}
+
+inline std::optional<std::string_view> Environment::find(std::string_view key) const {
+    for (std::size_t idx = 0; idx < entries_.size(); ++idx) {
+        std::string_view const entry = entries_[idx];
+        if (entry.size() > key.size() && entry[key.size()] == '=' && entry.starts_with(key))
+            return entry.substr(key.size() + 1);
+    }
+    return std::nullopt;
+}
+
+inline std::size_t Environment::size() const {
+    return entries_.size();
+}
+
+/*! \brief Read at most `size` bytes from a descriptor straight onto the end of a string,
+ *         which only grows by what was read. Where the standard library allows it, nothing
+ *         is initialized ahead of the read; otherwise the room read into is zeroed first.
+ *
+ *  \return What read() returned
+ */
+inline ssize_t appendRead(int fd, std::string& buffer, std::size_t size) {
+    std::size_t const filled = buffer.size();
+    ssize_t read_bytes{-1};
+#if defined(__cpp_lib_string_resize_and_overwrite)
+    buffer.resize_and_overwrite(filled + size, [fd, filled, size, &read_bytes](char* data, std::size_t) {
+        read_bytes = read(fd, data + filled, size);
+        return filled + (read_bytes > 0 ? static_cast<std::size_t>(read_bytes) : 0);
+    });
+#else
+    buffer.resize(filled + size);
+    read_bytes = read(fd, buffer.data() + filled, size);
+    buffer.resize(filled + (read_bytes > 0 ? static_cast<std::size_t>(read_bytes) : 0));
+#endif
+    return read_bytes;
+}
+
+/*! \brief Open a pipe whose both ends are closed on `exec`, so that concurrently spawned
+ *         children never inherit each other's descriptors.
+ */
+inline int openPipe(int (&fds)[2]) {
+#if defined(__linux__)
+    return pipe2(fds, O_CLOEXEC);
+#else
+    if (pipe(fds) != 0)
+        return -1;
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+    return 0;
+#endif
+}
+
+/*! \brief Callback receiving live output. The first argument identifies the stream the
+ *         data came from (BarrelCmd::Stream::STDOUT_STDERR for merged output), the second
+ *         is a non-owning view which is only valid for the duration of the call.
+ */
+using OutputHandler = std::function<void(Stream, std::string_view)>;
+
+class ProcAwaiter;
+
 class Proc {
+    friend class ProcAwaiter;
+
 private:
-    std::string const cmd_;
+    Argv argv_;
     Stream stream_;
 
 private:
     std::string stream_dump_{};
+    std::string error_dump_{};
+    std::array<std::size_t, 2> filled_{0, 0};     // Captured bytes, including those spilled to a file
+    std::array<std::size_t, 2> size_hints_{0, 0};
     int exit_code_{INT_MIN};
 
+private:
+    CapturePolicy capture_{};
+    std::array<std::size_t, 2> ring_heads_{0, 0}; // Oldest byte of a full tail, written over next
+    std::array<int, 2> spill_fds_{-1, -1};
+    std::array<MappedOutput, 2> spills_{};
+
+private:
+    OutputHandler chunk_handler_{};
+    OutputHandler line_handler_{};
+    std::array<std::string, 2> partial_lines_{};
+    bool normalize_{false};
+    std::array<Normalizer, 2> normalizers_{};
+
+private:
+    pid_t pid_{-1};
+    pid_t group_{-1}; // The child's process group, if it has one of its own. Kept once the child is
+                      // reaped: the id isn't reused while any descendant is left in the group
+    std::array<int, 2> read_fds_{-1, -1};
+    std::shared_ptr<Environment const> environment_{}; // This process's own, if empty
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    std::optional<Clock::time_point> deadline_{};
+    std::optional<Clock::duration> timeout_{};
+    std::optional<CancellationToken> cancellation_{};
+    std::optional<Clock::time_point> due_{}; // The sooner of the deadline and timeout, once spawned
+    Termination termination_{Termination::EXITED};
+    std::optional<Clock::time_point> kill_at_{}; // When SIGTERM turns into SIGKILL
+    bool killed_{false};
+
+private:
+    ExecutionMetrics metrics_{};
+
+private:
+    void spawn();
+    void drain();
+    bool pump(std::size_t);
+    void release(std::size_t);
+    bool isInMemory(std::size_t) const;
+    void store(std::size_t, std::string_view);
+    void spill(std::size_t);
+    void consume(std::size_t, std::string_view);
+    void flush(std::size_t);
+    void trim(std::size_t);
+    void reap();
+    void settle(int, rusage const&);
+    void finish();
+    void terminate(Termination);
+    int escalate();
+    void signal(int);
+    void closeReadEnds();
+    Stream streamOf(std::size_t) const;
+
 public:
-    explicit Proc(std::string const&);
-    Proc(std::string const&, Stream);
+    explicit Proc(Argv);
+    Proc(Argv, Stream);
 
 public:
     std::string const& getStreamDump() const;
+    std::string const& getErrorDump() const;
+
+    /*! \brief Exit status of the last execution, with signals reported as 128 + signal.
+     *         `INT_MIN` if nothing was executed (yet, or because it was cancelled before it
+     *         started), and `BAD_EXIT_ST` if the process could not be waited for.
+     */
     int getExitStatus() const;
 
+    /*! \brief Move the captured output out, leaving the Proc without it.
+     */
+    std::string takeStreamDump();
+    std::string takeErrorDump();
+
+    /*! \brief Output which spilled to a file under CaptureMode::SPILL, in which case the
+     *         corresponding dump is empty.
+     */
+    MappedOutput const& getSpilledStream() const;
+    MappedOutput const& getSpilledError() const;
+
+public:
+    void onChunk(OutputHandler);
+    void onLine(OutputHandler);
+
+    /*! \brief Capture output as it would be left on a terminal: without escape sequences
+     *         (colours, cursor movement), and with lines redrawn in place (progress bars)
+     *         reduced to their last state (see Normalizer). Handlers then only see finished
+     *         lines, and getMetrics() still counts the bytes as read.
+     */
+    void normalizeOutput(bool);
+
+    /*! \brief Bound the memory taken by the captured output. Defaults to keeping all of it.
+     */
+    void setCapture(CapturePolicy);
+
+    /*! \brief Shorthand for setCapture() with CapturePolicy::retain() or CapturePolicy::discard().
+     */
+    void retainOutput(bool);
+
+    /*! \brief Size the capture buffers up front for output of roughly the expected size.
+     *         Without a hint, they grow geometrically as output arrives.
+     *
+     *  \param stream_hint Expected size of the stream dump, in bytes
+     *  \param error_hint Expected size of the error dump, in bytes
+     */
+    void reserveOutput(std::size_t, std::size_t = 0);
+
+    /*! \brief Capture into the given buffers, which are cleared but keep their capacity.
+     *         Lets a command executed repeatedly reuse the memory of its previous results.
+     */
+    void reuseBuffers(std::string&&, std::string&&);
+
+public:
+    /*! \brief Launch the process in the given environment, rather than in this process's own.
+     */
+    void setEnvironment(std::shared_ptr<Environment const>);
+
+public:
+    /*! \brief Terminate the process if it is still running at the given time.
+     */
+    void setDeadline(std::chrono::steady_clock::time_point);
+
+    /*! \brief Terminate the process if it is still running after the given time, counted
+     *         from when it is launched. Combines with setDeadline(); whichever comes first
+     *         applies.
+     */
+    void setTimeout(std::chrono::steady_clock::duration);
+
+    /*! \brief Terminate the process once the token is cancelled.
+     */
+    void setCancellation(CancellationToken);
+
+    Termination getTermination() const;
+
+    /*! \brief Timings and resource usage of the last execution.
+     */
+    ExecutionMetrics const& getMetrics() const;
+
 public:
+    /*! \brief Run the process to completion, capturing its output.
+     *
+     *  A process with a deadline, a timeout or a cancellation token is launched in a process
+     *  group of its own. On a deadline or cancellation, the whole group (Homebrew, and any
+     *  `git`, `curl` or `ruby` it started) is sent SIGTERM,
+     *  and SIGKILL after a grace period of ::KILL_GRACE_PERIOD. Output captured until then
+     *  is kept. Should descendants which left the group hold the pipes open, capture stops
+     *  one more grace period after SIGKILL.
+     */
     void execute();
 };
 
-Proc::Proc(std::string const& cmd, Stream stream) : cmd_(cmd), stream_(stream){};
+inline CancellationToken::CancellationToken() : state_(std::make_shared<State>()) {
+    if (openPipe(state_->fds) != 0)
+        throw std::runtime_error("CancellationToken::CancellationToken(): pipe() failed to initialize");
+}
+
+inline void CancellationToken::cancel() {
+    // The byte is never read, so that the descriptor stays readable for every waiter
+    if (!state_->cancelled.exchange(true)) {
+        [[maybe_unused]] ssize_t const written = write(state_->fds[1], "", 1);
+    }
+}
+
+inline bool CancellationToken::isCancelled() const {
+    return state_->cancelled.load();
+}
+
+inline int CancellationToken::getFd() const {
+    return state_->fds[0];
+}
+
+inline Proc::Proc(Argv argv, Stream stream) : argv_(std::move(argv)), stream_(stream){};
 
-Proc::Proc(std::string const& cmd) : Proc{cmd, Stream::STDOUT} {};
+inline Proc::Proc(Argv argv) : Proc{std::move(argv), Stream::STDOUT} {};
 
-std::string const& Proc::getStreamDump() const {
+inline std::string const& Proc::getStreamDump() const {
     return stream_dump_;
 }
 
-int Proc::getExitStatus() const {
-    return WEXITSTATUS(exit_code_);
+inline std::string const& Proc::getErrorDump() const {
+    return error_dump_;
 }
 
-void Proc::execute() {
-    const char* MODE = "r";
-    std::array<char, READ_BUFFER_SZ> read_buffer;
+inline int Proc::getExitStatus() const {
+    return exit_code_;
+}
+
+inline std::string Proc::takeStreamDump() {
+    return std::move(stream_dump_);
+}
+
+inline std::string Proc::takeErrorDump() {
+    return std::move(error_dump_);
+}
+
+inline MappedOutput const& Proc::getSpilledStream() const {
+    return spills_[0];
+}
+
+inline MappedOutput const& Proc::getSpilledError() const {
+    return spills_[1];
+}
+
+inline void Proc::reserveOutput(std::size_t stream_hint, std::size_t error_hint) {
+    size_hints_ = {stream_hint, error_hint};
+}
+
+inline void Proc::reuseBuffers(std::string&& stream_dump, std::string&& error_dump) {
+    stream_dump_ = std::move(stream_dump);
+    error_dump_ = std::move(error_dump);
+    stream_dump_.clear();
+    error_dump_.clear();
+}
 
-    std::string capture;
+inline void Proc::setEnvironment(std::shared_ptr<Environment const> environment) {
+    environment_ = std::move(environment);
+}
+
+inline void Proc::setDeadline(std::chrono::steady_clock::time_point deadline) {
+    deadline_ = deadline;
+}
+
+inline void Proc::setTimeout(std::chrono::steady_clock::duration timeout) {
+    timeout_ = timeout;
+}
+
+inline void Proc::setCancellation(CancellationToken token) {
+    cancellation_ = std::move(token);
+}
+
+inline Termination Proc::getTermination() const {
+    return termination_;
+}
+
+inline ExecutionMetrics const& Proc::getMetrics() const {
+    return metrics_;
+}
+
+inline void Proc::onChunk(OutputHandler handler) {
+    chunk_handler_ = std::move(handler);
+}
+
+inline void Proc::onLine(OutputHandler handler) {
+    line_handler_ = std::move(handler);
+}
+
+inline void Proc::normalizeOutput(bool normalize) {
+    normalize_ = normalize;
+}
+
+inline void Proc::setCapture(CapturePolicy capture) {
+    capture_ = capture;
+}
+
+inline void Proc::retainOutput(bool retain) {
+    capture_ = retain ? CapturePolicy::retain() : CapturePolicy::discard();
+}
+
+inline Stream Proc::streamOf(std::size_t idx) const {
+    if (idx == 1)
+        return Stream::STDERR;
+    return stream_ == Stream::STDOUT_STDERR_SPLIT ? Stream::STDOUT : stream_;
+}
+
+inline void Proc::spawn() {
+    if (argv_.empty()) {
+        throw std::runtime_error("Proc::spawn(): Empty argument vector");
+    }
+    metrics_ = {};
+    metrics_.start = Clock::now();
+    for (Normalizer& normalizer : normalizers_)
+        normalizer.reset();
+
+    int out_fds[2];
+    int err_fds[2]{-1, -1};
+    if (openPipe(out_fds) != 0) {
+        throw std::runtime_error("Proc::spawn(): pipe() failed to initialize");
+    }
+    if (stream_ == Stream::STDOUT_STDERR_SPLIT && openPipe(err_fds) != 0) {
+        close(out_fds[0]);
+        close(out_fds[1]);
+        throw std::runtime_error("Proc::spawn(): pipe() failed to initialize");
+    }
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
 
     switch (stream_) {
     case Stream::STDOUT:
-        capture = STDOUT_CAPTURE;
+        posix_spawn_file_actions_adddup2(&actions, out_fds[1], STDOUT_FILENO);
+        posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, DEV_NULL.c_str(), O_WRONLY, 0);
         break;
     case Stream::STDERR:
-        capture = STDERR_CAPTURE;
+        posix_spawn_file_actions_adddup2(&actions, out_fds[1], STDERR_FILENO);
+        posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, DEV_NULL.c_str(), O_WRONLY, 0);
         break;
     case Stream::STDOUT_STDERR:
-        capture = STDOUT_STDERR_CAPTURE;
+        posix_spawn_file_actions_adddup2(&actions, out_fds[1], STDOUT_FILENO);
+        posix_spawn_file_actions_adddup2(&actions, out_fds[1], STDERR_FILENO);
+        break;
+    case Stream::STDOUT_STDERR_SPLIT:
+        posix_spawn_file_actions_adddup2(&actions, out_fds[1], STDOUT_FILENO);
+        posix_spawn_file_actions_adddup2(&actions, err_fds[1], STDERR_FILENO);
         break;
     default:
         break;
     }
 
-    std::string const cmd = cmd_ + LE_SPACER + capture;
+    // A process group of its own lets a deadline or cancellation reach every descendant.
+    // Without either, the child stays in ours, so that job control (e.g. ^C in a terminal)
+    // still reaches it
+    bool const grouped = deadline_.has_value() || timeout_.has_value() || cancellation_.has_value();
+    posix_spawnattr_t attr;
+    posix_spawnattr_init(&attr);
+    short flags = 0;
+    if (grouped) {
+        posix_spawnattr_setpgroup(&attr, 0);
+        flags |= POSIX_SPAWN_SETPGROUP;
+    }
+#if defined(POSIX_SPAWN_USEVFORK)
+    flags |= POSIX_SPAWN_USEVFORK; // PROC_H__002
+#endif
+    posix_spawnattr_setflags(&attr, flags);
+
+    std::vector<char*> argv = argv_.pointers();
+    char* const* envp = environment_ ? environment_->get() : environ;
+    int const err = posix_spawnp(&pid_, argv[0], &actions, &attr, argv.data(), envp);
+    metrics_.spawn = Clock::now() - metrics_.start;
 
-    auto fptr_del = [&exit_code_ = exit_code_](FILE* file) { exit_code_ = pclose(file); }; // PROC_H__001
-    std::unique_ptr<FILE, decltype(fptr_del)> file(popen(cmd.c_str(), MODE), fptr_del);
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&actions);
+    close(out_fds[1]);
+    if (err_fds[1] != -1)
+        close(err_fds[1]);
+
+    read_fds_ = {out_fds[0], err_fds[0]};
+    group_ = grouped && err == 0 ? pid_ : -1;
+    termination_ = Termination::EXITED;
+    kill_at_.reset();
+    killed_ = false;
+    due_ = deadline_;
+    if (timeout_.has_value() && (!due_.has_value() || Clock::now() + *timeout_ < *due_))
+        due_ = Clock::now() + *timeout_;
+
+    if (err != 0) {
+        closeReadEnds();
+        pid_ = -1;
+        // Report an unlaunchable binary the way a shell would, rather than as an error
+        if (err == ENOENT || err == ENOTDIR) {
+            exit_code_ = 127;
+            return;
+        }
+        if (err == EACCES || err == ENOEXEC) {
+            exit_code_ = 126;
+            return;
+        }
+        throw std::runtime_error("Proc::spawn(): posix_spawnp() failed to launch "s + argv[0]);
+    }
+}
+
+// Both pipes are drained together, so a child blocked on a full stderr pipe can never
+// stall a parent that is waiting for stdout to reach EOF (and vice versa)
+inline void Proc::drain() {
+    int const cancel_fd = cancellation_.has_value() ? cancellation_->getFd() : -1;
+    std::array<pollfd, 3> pfds{
+        {{read_fds_[0], POLLIN, 0}, {read_fds_[1], POLLIN, 0}, {cancel_fd, POLLIN, 0}}};
+
+    while (read_fds_[0] != -1 || read_fds_[1] != -1) {
+        int const timeout_ms = escalate();
+        if (timeout_ms == 0)
+            break; // Killed, yet something outside the process group still holds the pipes
+        if (poll(pfds.data(), pfds.size(), timeout_ms) == -1) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+
+        if (pfds[2].fd != -1 && pfds[2].revents != 0) {
+            terminate(Termination::CANCELLED);
+            pfds[2].fd = -1;
+        }
+        for (std::size_t idx = 0; idx < read_fds_.size(); ++idx) {
+            if (pfds[idx].fd == -1 || pfds[idx].revents == 0)
+                continue;
+            if (!pump(idx))
+                pfds[idx].fd = -1; // poll() ignores negative descriptors
+        }
+    }
+
+    // Output read from pipes which were given up on is kept all the same
+    for (std::size_t idx = 0; idx < read_fds_.size(); ++idx) {
+        if (read_fds_[idx] != -1)
+            release(idx);
+    }
+}
+
+// Performs a single read from one of the pipes. Returns false once that pipe is exhausted.
+inline bool Proc::pump(std::size_t idx) {
+    std::array<char, READ_BUFFER_SZ> read_buffer;
+    char* window = read_buffer.data();
+    std::size_t window_sz = read_buffer.size();
+
+    // Output is read straight onto the end of the dump, within its capacity. Growing that is
+    // put off until more output actually arrives, rather than done just to read the end of
+    // the stream: until then, reads go through the stack buffer, as do those into a tail which
+    // has wrapped around, output which has spilled to a file, or output being normalized
+    bool in_place = false;
+    ssize_t read_bytes;
+    if (!normalize_ && isInMemory(idx)) {
+        std::string& dump = idx == 0 ? stream_dump_ : error_dump_;
+        std::size_t const limit = capture_.mode == CaptureMode::RETAIN ? SIZE_MAX : capture_.limit;
+        if (limit != SIZE_MAX && dump.capacity() < limit)
+            dump.reserve(limit); // Only the pages written to are ever touched
+        else if (size_hints_[idx] > dump.capacity())
+            dump.reserve(std::min(size_hints_[idx], limit));
+        std::size_t room = std::min(dump.capacity(), limit) - filled_[idx];
+#if !defined(__cpp_lib_string_resize_and_overwrite)
+        room = std::min(room, PIPE_READ_SZ); // Zeroed on every read, so no more than one can fill
+#endif
+        if (room >= READ_BUFFER_SZ) {
+            read_bytes = appendRead(read_fds_[idx], dump, room);
+            window = dump.data() + filled_[idx];
+            in_place = true;
+        }
+    }
+    if (!in_place)
+        read_bytes = read(read_fds_[idx], window, window_sz);
+    if (read_bytes > 0) {
+        std::size_t const size = static_cast<std::size_t>(read_bytes);
+        if (metrics_.bytes[0] == 0 && metrics_.bytes[1] == 0)
+            metrics_.first_byte = Clock::now() - metrics_.start;
+        metrics_.bytes[idx] += size;
+        std::string_view chunk(window, size);
+        if (normalize_)
+            chunk = normalizers_[idx].feed(chunk);
+        if (in_place)
+            filled_[idx] += size;
+        else
+            store(idx, chunk);
+        if (!chunk.empty())
+            consume(idx, chunk);
+        return true;
+    }
+    if (read_bytes == -1 && (errno == EINTR || errno == EAGAIN))
+        return true;
+
+    release(idx);
+    return false;
+}
+
+// Stops reading from one of the pipes, at its end or when given up on, and hands on what
+// was held back of its output
+inline void Proc::release(std::size_t idx) {
+    close(read_fds_[idx]);
+    read_fds_[idx] = -1;
+    flush(idx);
+    trim(idx);
+
+    // An unterminated last line is still a line
+    if (line_handler_ && !partial_lines_[idx].empty()) {
+        line_handler_(streamOf(idx), partial_lines_[idx]);
+        partial_lines_[idx].clear();
+    }
+}
+
+// Whether the next output of a stream goes into its dump, in order
+inline bool Proc::isInMemory(std::size_t idx) const {
+    switch (capture_.mode) {
+    case CaptureMode::RETAIN:
+        return true;
+    case CaptureMode::TAIL:
+        return filled_[idx] < capture_.limit;
+    case CaptureMode::SPILL:
+        return spill_fds_[idx] == -1;
+    default:
+        return false;
+    }
+}
+
+// Keeps output which was read outside of the dump, as the capture policy has it
+inline void Proc::store(std::size_t idx, std::string_view chunk) {
+    std::string& dump = idx == 0 ? stream_dump_ : error_dump_;
+    switch (capture_.mode) {
+    case CaptureMode::DISCARD:
+        return;
+    case CaptureMode::TAIL: {
+        std::size_t const limit = capture_.limit;
+        if (chunk.size() > limit)
+            chunk.remove_prefix(chunk.size() - limit);
+
+        // Fill the ring up in order, then write over its oldest bytes
+        std::size_t const room = std::min(limit - filled_[idx], chunk.size());
+        dump.append(chunk.data(), room);
+        filled_[idx] += room;
+        chunk.remove_prefix(room);
+        while (!chunk.empty()) {
+            std::size_t const size = std::min(chunk.size(), limit - ring_heads_[idx]);
+            std::memcpy(dump.data() + ring_heads_[idx], chunk.data(), size);
+            ring_heads_[idx] = (ring_heads_[idx] + size) % limit;
+            chunk.remove_prefix(size);
+        }
+        return;
+    }
+    case CaptureMode::SPILL:
+        if (spill_fds_[idx] == -1 && filled_[idx] + chunk.size() > capture_.limit)
+            spill(idx);
+        if (spill_fds_[idx] == -1)
+            break;
+        while (!chunk.empty()) {
+            ssize_t const written = write(spill_fds_[idx], chunk.data(), chunk.size());
+            if (written == -1 && errno == EINTR)
+                continue;
+            if (written <= 0)
+                throw std::runtime_error("Proc::store(): write() failed to spill output");
+            chunk.remove_prefix(static_cast<std::size_t>(written));
+            filled_[idx] += static_cast<std::size_t>(written);
+        }
+        return;
+    default:
+        break;
+    }
+
+    dump.append(chunk);
+    filled_[idx] += chunk.size();
+}
+
+// Moves what a stream captured so far out to a temporary file, to which the rest is appended
+inline void Proc::spill(std::size_t idx) {
+    int const fd = openSpillFile();
+    if (fd == -1)
+        throw std::runtime_error("Proc::spill(): Failed to create a file to spill output to");
+
+    std::string_view pending((idx == 0 ? stream_dump_ : error_dump_).data(), filled_[idx]);
+    while (!pending.empty()) {
+        ssize_t const written = write(fd, pending.data(), pending.size());
+        if (written == -1 && errno == EINTR)
+            continue;
+        if (written <= 0) {
+            close(fd);
+            throw std::runtime_error("Proc::spill(): write() failed to spill output");
+        }
+        pending.remove_prefix(static_cast<std::size_t>(written));
+    }
+    spill_fds_[idx] = fd;
+}
+
+inline void Proc::consume(std::size_t idx, std::string_view chunk) {
+    Stream const stream = streamOf(idx);
+    if (chunk_handler_)
+        chunk_handler_(stream, chunk);
+    if (!line_handler_)
+        return;
+
+    // Complete lines are handed out as views into the chunk; only a line that straddles
+    // two reads is copied
+    std::string& partial = partial_lines_[idx];
+    while (!chunk.empty()) {
+        auto const* newline = static_cast<char const*>(std::memchr(chunk.data(), '\n', chunk.size()));
+        if (newline == nullptr) {
+            partial.append(chunk);
+            return;
+        }
+
+        std::string_view const line = chunk.substr(0, static_cast<std::size_t>(newline - chunk.data()));
+        if (partial.empty()) {
+            line_handler_(stream, line);
+        } else {
+            partial.append(line);
+            line_handler_(stream, partial);
+            partial.clear();
+        }
+        chunk.remove_prefix(line.size() + 1);
+    }
+}
+
+// Hands on the last line of normalized output, which was held back in case it was redrawn
+inline void Proc::flush(std::size_t idx) {
+    if (!normalize_)
+        return;
+    std::string_view const rest = normalizers_[idx].finish();
+    if (rest.empty())
+        return;
+    store(idx, rest);
+    consume(idx, rest);
+}
+
+inline void Proc::trim(std::size_t idx) {
+    std::string& dump = idx == 0 ? stream_dump_ : error_dump_;
+    if (spill_fds_[idx] != -1) {
+        int const fd = std::exchange(spill_fds_[idx], -1);
+        void* const data = mmap(nullptr, filled_[idx], PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (data == MAP_FAILED)
+            throw std::runtime_error("Proc::trim(): mmap() failed to map spilled output");
+        spills_[idx] = MappedOutput(data, filled_[idx]);
+        dump.clear();
+        return;
+    }
+    if (capture_.mode == CaptureMode::DISCARD)
+        return;
+
+    // A tail which wrapped around starts at its oldest byte
+    if (ring_heads_[idx] != 0) {
+        std::rotate(dump.begin(), dump.begin() + static_cast<std::ptrdiff_t>(ring_heads_[idx]),
+                    dump.begin() + static_cast<std::ptrdiff_t>(filled_[idx]));
+        ring_heads_[idx] = 0;
+    }
+    dump.resize(filled_[idx]);
+}
+
+inline void Proc::closeReadEnds() {
+    for (auto& fd : read_fds_) {
+        if (fd != -1)
+            close(fd);
+        fd = -1;
+    }
+}
+
+inline void Proc::reap() {
+    int status;
+    rusage usage{};
+    while (wait4(pid_, &status, 0, &usage) == -1) {
+        if (errno != EINTR) {
+            pid_ = -1;
+            exit_code_ = BAD_EXIT_ST;
+            return;
+        }
+    }
+    pid_ = -1;
+    settle(status, usage);
+}
+
+inline void Proc::settle(int status, rusage const& usage) {
+    recordUsage(metrics_, usage);
+
+    // Signalled children are reported with the shell's 128 + signal convention
+    exit_code_ = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+    if (termination_ != Termination::TIMED_OUT && termination_ != Termination::CANCELLED)
+        termination_ = WIFEXITED(status) ? Termination::EXITED : Termination::SIGNALLED;
+}
+
+inline void Proc::finish() {
+    metrics_.wall = Clock::now() - metrics_.start;
+}
+
+inline void Proc::terminate(Termination reason) {
+    bool const reading = read_fds_[0] != -1 || read_fds_[1] != -1;
+    if (kill_at_.has_value() || (pid_ == -1 && !reading))
+        return;
+    termination_ = reason;
+    kill_at_ = Clock::now() + KILL_GRACE_PERIOD;
+    if (pid_ != -1) {
+        signal(SIGTERM);
+        return;
+    }
+
+    // Reaped already (on a Reactor), so only descendants hold the pipes: nothing would wait
+    // for them to exit on SIGTERM, they're killed outright
+    signal(SIGKILL);
+    killed_ = true;
+}
+
+// Acts on a passed deadline or grace period. Returns how long (in milliseconds) until the
+// next one is due, -1 if none is pending, or 0 once the last one has passed
+inline int Proc::escalate() {
+    Clock::time_point const now = Clock::now();
+    if (due_.has_value() && now >= *due_)
+        terminate(Termination::TIMED_OUT);
+    if (kill_at_.has_value() && now >= *kill_at_) {
+        if (killed_)
+            return 0;
+        signal(SIGKILL);
+        killed_ = true;
+        kill_at_ = now + KILL_GRACE_PERIOD;
+    }
+
+    std::optional<Clock::time_point> const next = kill_at_.has_value() ? kill_at_ : due_;
+    if (!next.has_value())
+        return -1;
+    auto const wait = std::chrono::ceil<std::chrono::milliseconds>(*next - now);
+    return static_cast<int>(std::clamp<std::chrono::milliseconds::rep>(wait.count(), 1, INT_MAX));
+}
+
+// Signals the child, or its process group if it has one of its own
+inline void Proc::signal(int sig) {
+    if (group_ != -1)
+        kill(-group_, sig);
+    else if (pid_ != -1) // Once reaped, its pid may belong to another
+        kill(pid_, sig);
+}
+
+inline void Proc::execute() {
+    if (cancellation_.has_value() && cancellation_->isCancelled()) {
+        termination_ = Termination::CANCELLED;
+        metrics_ = {};
+        return;
+    }
 
-    if (file == nullptr) {
-        throw std::runtime_error("Proc::execute(): popen() failed to initialize");
+    spawn();
+    if (pid_ == -1) {
+        finish();
+        return;
     }
 
-    std::size_t read_bytes;
-    while ((read_bytes = std::fread(read_buffer.data(), sizeof(read_buffer.at(0)), sizeof(read_buffer),
-                                    file.get())) != 0) {
-        stream_dump_ += std::string(read_buffer.data(), read_bytes);
+    try {
+        drain();
+    } catch (...) {
+        closeReadEnds();
+        reap();
+        finish();
+        try {
+            trim(0);
+            trim(1);
+        } catch (...) {
+            // The original failure is the one worth reporting
+        }
+        throw;
     }
+    reap();
+    finish();
 }
 
 } // namespace BarrelCmd
 
-#endif
\ No newline at end of file
+#endif
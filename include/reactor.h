@@ -0,0 +1,678 @@
+/*!
+ * This file is part of Barrel, a header-only C++ library that provides
+ * programmatic access to the Homebrew command line interface.
+ *
+ * Copyright (C) 2022 aydwi <contact@aydwi.com>
+ *
+ * Barrel is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*! \file  reactor.h
+    \brief An internal header used by Barrel. Provides a single-threaded event loop and
+           the coroutine types used to execute commands asynchronously.
+*/
+
+#ifndef REACTOR_H__
+#define REACTOR_H__
+
+#include "proc.h"
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <sys/epoll.h>
+#include <sys/syscall.h>
+#elif defined(__APPLE__)
+#include <sys/event.h>
+#include <sys/time.h>
+#else
+#error "BarrelCmd::Reactor needs epoll (Linux) or kqueue (macOS)"
+#endif
+
+inline extern int const EXIT_POLL_INTERVAL_MS{10};
+inline extern std::size_t const MAX_REACTOR_EVENTS{64};
+
+namespace BarrelCmd {
+
+template <typename T>
+class Task;
+
+struct TaskPromiseBase {
+    std::coroutine_handle<> continuation_{std::noop_coroutine()};
+    std::exception_ptr exception_{};
+
+    struct FinalAwaiter {
+        bool await_ready() noexcept {
+            return false;
+        }
+        template <typename P>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<P> handle) noexcept {
+            return handle.promise().continuation_;
+        }
+        void await_resume() noexcept {
+        }
+    };
+
+    std::suspend_always initial_suspend() noexcept {
+        return {};
+    }
+    FinalAwaiter final_suspend() noexcept {
+        return {};
+    }
+    void unhandled_exception() {
+        exception_ = std::current_exception();
+    }
+};
+
+template <typename T>
+struct TaskPromise : TaskPromiseBase {
+    std::optional<T> value_{};
+
+    Task<T> get_return_object();
+    void return_value(T value) {
+        value_ = std::move(value);
+    }
+};
+
+template <>
+struct TaskPromise<void> : TaskPromiseBase {
+    Task<void> get_return_object();
+    void return_void() {
+    }
+};
+
+/*! \brief A lazily started coroutine. It begins running when it is `co_await`ed, or when
+ *         it is handed to Reactor::spawn(), and resumes its awaiter once it finishes.
+ */
+template <typename T = void>
+class Task {
+public:
+    using promise_type = TaskPromise<T>;
+
+private:
+    std::coroutine_handle<promise_type> handle_;
+
+public:
+    explicit Task(std::coroutine_handle<promise_type>);
+    Task(Task&&) noexcept;
+    Task& operator=(Task&&) noexcept;
+    Task(Task const&) = delete;
+    Task& operator=(Task const&) = delete;
+    ~Task();
+
+public:
+    bool done() const;
+    std::coroutine_handle<> handle() const;
+
+    /*! \brief Result of a finished task. Rethrows the exception the task exited with, if any.
+     */
+    T result();
+
+public:
+    bool await_ready() const noexcept;
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<>) noexcept;
+    T await_resume();
+};
+
+template <typename T>
+Task<T> TaskPromise<T>::get_return_object() {
+    return Task<T>{std::coroutine_handle<TaskPromise<T>>::from_promise(*this)};
+}
+
+inline Task<void> TaskPromise<void>::get_return_object() {
+    return Task<void>{std::coroutine_handle<TaskPromise<void>>::from_promise(*this)};
+}
+
+template <typename T>
+Task<T>::Task(std::coroutine_handle<promise_type> handle) : handle_(handle){};
+
+template <typename T>
+Task<T>::Task(Task&& other) noexcept : handle_(std::exchange(other.handle_, nullptr)){};
+
+template <typename T>
+Task<T>& Task<T>::operator=(Task&& other) noexcept {
+    if (this != &other) {
+        if (handle_)
+            handle_.destroy();
+        handle_ = std::exchange(other.handle_, nullptr);
+    }
+    return *this;
+}
+
+template <typename T>
+Task<T>::~Task() {
+    if (handle_)
+        handle_.destroy();
+}
+
+template <typename T>
+bool Task<T>::done() const {
+    return !handle_ || handle_.done();
+}
+
+template <typename T>
+std::coroutine_handle<> Task<T>::handle() const {
+    return handle_;
+}
+
+template <typename T>
+T Task<T>::result() {
+    if (handle_.promise().exception_)
+        std::rethrow_exception(handle_.promise().exception_);
+    if constexpr (!std::is_void_v<T>)
+        return std::move(*handle_.promise().value_);
+}
+
+template <typename T>
+bool Task<T>::await_ready() const noexcept {
+    return done();
+}
+
+template <typename T>
+std::coroutine_handle<> Task<T>::await_suspend(std::coroutine_handle<> awaiting) noexcept {
+    handle_.promise().continuation_ = awaiting;
+    return handle_;
+}
+
+template <typename T>
+T Task<T>::await_resume() {
+    return result();
+}
+
+/*! \brief Callback receiving the raw `wait4()` status of an exited child, and its resource
+ *         usage.
+ */
+using ExitHandler = std::function<void(int, rusage const&)>;
+
+/*! \brief A single-threaded event loop which multiplexes the pipes and exits of any number
+ *         of children, and resumes the coroutines waiting on them.
+ *
+ *  Pipes are watched with `epoll` on Linux and `kqueue` on macOS. Child exits are observed
+ *  through a pidfd on Linux (falling back to periodic `wait4()` on kernels without
+ *  `pidfd_open`), and through `EVFILT_PROC` on macOS.
+ *
+ *  \code
+ *  BarrelCmd::Task<> info(Brew const& brew, BarrelCmd::Reactor& reactor) {
+ *      BrewCommand<BrewCommandType::Builtin> cmd(brew, BrewCommandType::Builtin::INFO);
+ *      co_await cmd.run(reactor);
+ *      std::cout << cmd.getStreamDump();
+ *  }
+ *
+ *  BarrelCmd::Reactor reactor;
+ *  reactor.spawn(info(brew, reactor));
+ *  reactor.run();
+ *  \endcode
+ */
+class Reactor {
+private:
+    int poller_{-1};
+    std::unordered_map<int, std::unique_ptr<std::function<void()>>> watches_{};
+    std::unordered_map<pid_t, ExitHandler> exits_{};
+    std::vector<std::unique_ptr<std::function<void()>>> retired_{};
+    std::deque<std::coroutine_handle<>> ready_{};
+    std::list<Task<>> tasks_{};
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    std::map<std::uint64_t, std::pair<Clock::time_point, std::function<void()>>> timers_{};
+    std::uint64_t next_timer_{0};
+
+private:
+    void dispatch(int);
+    void wait(int);
+    void reapExits();
+    void fireTimers();
+    void resumeReady();
+
+public:
+    Reactor();
+    Reactor(Reactor const&) = delete;
+    Reactor& operator=(Reactor const&) = delete;
+    ~Reactor();
+
+public:
+    void watchReadable(int, std::function<void()>);
+    void unwatch(int);
+    void watchExit(pid_t, ExitHandler);
+    void schedule(std::coroutine_handle<>);
+
+    /*! \brief Call a handler once, after the given time.
+     *
+     *  \return An identifier to pass to cancelTimer()
+     */
+    std::uint64_t addTimer(std::chrono::steady_clock::time_point, std::function<void()>);
+    void cancelTimer(std::uint64_t);
+
+public:
+    /*! \brief Start a detached task, owned by the reactor until it finishes.
+     *
+     *  \param task The task to run
+     */
+    void spawn(Task<>);
+
+    /*! \brief Whether any coroutine, pipe, child or timer is still being waited on.
+     */
+    bool pending() const;
+
+    /*! \brief Run a single iteration of the event loop.
+     *
+     *  \param timeout_ms Maximum time to block for events, or -1 to block indefinitely
+     */
+    void runOnce(int timeout_ms = -1);
+
+    /*! \brief Run the event loop until nothing is pending. Rethrows the first exception a
+     *         detached task exits with, or a handler throws; a watch whose handler threw is
+     *         removed first.
+     */
+    void run();
+};
+
+inline Reactor::Reactor() {
+#if defined(__linux__)
+    poller_ = epoll_create1(EPOLL_CLOEXEC);
+#elif defined(__APPLE__)
+    poller_ = kqueue();
+#endif
+    if (poller_ == -1) {
+        throw std::runtime_error("Reactor::Reactor(): Event queue failed to initialize");
+    }
+}
+
+inline Reactor::~Reactor() {
+    close(poller_);
+}
+
+inline void Reactor::watchReadable(int fd, std::function<void()> handler) {
+#if defined(__linux__)
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.fd = fd;
+    int const err = epoll_ctl(poller_, EPOLL_CTL_ADD, fd, &event);
+#elif defined(__APPLE__)
+    struct kevent event;
+    EV_SET(&event, fd, EVFILT_READ, EV_ADD, 0, 0, nullptr);
+    int const err = kevent(poller_, &event, 1, nullptr, 0, nullptr);
+#endif
+    if (err == -1) {
+        throw std::runtime_error("Reactor::watchReadable(): Failed to watch descriptor");
+    }
+    watches_[fd] = std::make_unique<std::function<void()>>(std::move(handler));
+}
+
+inline void Reactor::unwatch(int fd) {
+    auto const node = watches_.find(fd);
+    if (node == watches_.end())
+        return;
+
+#if defined(__linux__)
+    epoll_ctl(poller_, EPOLL_CTL_DEL, fd, nullptr);
+#elif defined(__APPLE__)
+    struct kevent event;
+    EV_SET(&event, fd, EVFILT_READ, EV_DELETE, 0, 0, nullptr);
+    kevent(poller_, &event, 1, nullptr, 0, nullptr);
+#endif
+
+    // The handler may be the one currently running, so it outlives this iteration
+    retired_.push_back(std::move(node->second));
+    watches_.erase(node);
+}
+
+inline void Reactor::watchExit(pid_t pid, ExitHandler handler) {
+#if defined(__linux__) && defined(SYS_pidfd_open)
+    int const pidfd = static_cast<int>(syscall(SYS_pidfd_open, pid, 0));
+    if (pidfd != -1) {
+        fcntl(pidfd, F_SETFD, FD_CLOEXEC);
+        watchReadable(pidfd, [this, pid, pidfd, handler = std::move(handler)]() {
+            int status{0};
+            rusage usage{};
+            while (wait4(pid, &status, 0, &usage) == -1 && errno == EINTR) {
+            }
+            unwatch(pidfd);
+            close(pidfd);
+            handler(status, usage);
+        });
+        return;
+    }
+#elif defined(__APPLE__)
+    struct kevent event;
+    EV_SET(&event, pid, EVFILT_PROC, EV_ADD | EV_ONESHOT, NOTE_EXIT, 0, nullptr);
+    if (kevent(poller_, &event, 1, nullptr, 0, nullptr) != -1) {
+        exits_[pid] = std::move(handler);
+        return;
+    }
+#endif
+    // No descriptor to wait on (or the child is already gone), fall back to polling
+    exits_[pid] = std::move(handler);
+}
+
+inline void Reactor::schedule(std::coroutine_handle<> handle) {
+    ready_.push_back(handle);
+}
+
+inline std::uint64_t Reactor::addTimer(std::chrono::steady_clock::time_point when,
+                                       std::function<void()> handler) {
+    timers_.emplace(next_timer_, std::make_pair(when, std::move(handler)));
+    return next_timer_++;
+}
+
+inline void Reactor::cancelTimer(std::uint64_t timer) {
+    timers_.erase(timer);
+}
+
+inline void Reactor::spawn(Task<> task) {
+    tasks_.push_back(std::move(task));
+    schedule(tasks_.back().handle());
+}
+
+inline bool Reactor::pending() const {
+    return !ready_.empty() || !watches_.empty() || !exits_.empty() || !timers_.empty();
+}
+
+inline void Reactor::dispatch(int fd) {
+    auto const node = watches_.find(fd);
+    if (node == watches_.end())
+        return;
+
+    // A handler which throws would otherwise be called again for the same event, forever
+    try {
+        (*node->second)();
+    } catch (...) {
+        unwatch(fd);
+        retired_.clear();
+        throw;
+    }
+}
+
+inline void Reactor::wait(int timeout_ms) {
+#if defined(__linux__)
+    std::array<epoll_event, MAX_REACTOR_EVENTS> events;
+    int const count = epoll_wait(poller_, events.data(), static_cast<int>(events.size()), timeout_ms);
+
+    for (int idx = 0; idx < count; ++idx)
+        dispatch(events[idx].data.fd);
+#elif defined(__APPLE__)
+    std::array<struct kevent, MAX_REACTOR_EVENTS> events;
+    timespec const timeout{timeout_ms / 1000, (timeout_ms % 1000) * 1000000L};
+    int const count = kevent(poller_, nullptr, 0, events.data(), static_cast<int>(events.size()),
+                             timeout_ms < 0 ? nullptr : &timeout);
+
+    for (int idx = 0; idx < count; ++idx) {
+        if (events[idx].filter == EVFILT_READ) {
+            dispatch(static_cast<int>(events[idx].ident));
+        } else if (events[idx].filter == EVFILT_PROC) {
+            auto node = exits_.extract(static_cast<pid_t>(events[idx].ident));
+            if (node.empty())
+                continue;
+            int status{0};
+            rusage usage{};
+            while (wait4(node.key(), &status, 0, &usage) == -1 && errno == EINTR) {
+            }
+            node.mapped()(status, usage);
+        }
+    }
+#else
+#error "BarrelCmd::Reactor::wait() needs epoll (Linux) or kqueue (macOS)"
+#endif
+    retired_.clear();
+}
+
+inline void Reactor::reapExits() {
+    for (auto it = exits_.begin(); it != exits_.end();) {
+        int status{0};
+        rusage usage{};
+        pid_t const reaped = wait4(it->first, &status, WNOHANG, &usage);
+        if (reaped == 0 || (reaped == -1 && errno == EINTR)) {
+            ++it;
+            continue;
+        }
+
+        ExitHandler handler = std::move(it->second);
+        it = exits_.erase(it);
+        handler(status, usage);
+    }
+}
+
+inline void Reactor::fireTimers() {
+    Clock::time_point const now = Clock::now();
+    std::vector<std::uint64_t> due;
+    for (auto const& [timer, entry] : timers_) {
+        if (entry.first <= now)
+            due.push_back(timer);
+    }
+
+    // A handler may add or cancel timers, including those which are due
+    for (std::uint64_t const timer : due) {
+        auto node = timers_.extract(timer);
+        if (!node.empty())
+            node.mapped().second();
+    }
+}
+
+inline void Reactor::resumeReady() {
+    while (!ready_.empty()) {
+        std::coroutine_handle<> const handle = ready_.front();
+        ready_.pop_front();
+        handle.resume();
+    }
+
+    for (auto it = tasks_.begin(); it != tasks_.end();) {
+        if (!it->done()) {
+            ++it;
+            continue;
+        }
+        Task<> task = std::move(*it);
+        it = tasks_.erase(it);
+        task.result();
+    }
+}
+
+inline void Reactor::runOnce(int timeout_ms) {
+    resumeReady();
+    if (watches_.empty() && exits_.empty() && timers_.empty())
+        return;
+
+    if (!exits_.empty() && (timeout_ms < 0 || timeout_ms > EXIT_POLL_INTERVAL_MS))
+        timeout_ms = EXIT_POLL_INTERVAL_MS;
+    for (auto const& [timer, entry] : timers_) {
+        auto const due = std::chrono::ceil<std::chrono::milliseconds>(entry.first - Clock::now()).count();
+        int const due_ms = static_cast<int>(std::clamp<std::chrono::milliseconds::rep>(due, 0, INT_MAX));
+        if (timeout_ms < 0 || due_ms < timeout_ms)
+            timeout_ms = due_ms;
+    }
+
+    wait(timeout_ms);
+    reapExits();
+    fireTimers();
+    resumeReady();
+}
+
+inline void Reactor::run() {
+    while (pending())
+        runOnce();
+}
+
+/*! \brief Awaitable which runs a BarrelCmd::Proc on a Reactor. The awaiting coroutine is
+ *         resumed once the child has exited and all of its output has been consumed.
+ */
+class ProcAwaiter {
+private:
+    Proc& proc_;
+    Reactor& reactor_;
+    std::coroutine_handle<> awaiting_{};
+    std::size_t pending_{0};
+
+private:
+    std::optional<std::uint64_t> deadline_timer_{};
+    std::optional<std::uint64_t> kill_timer_{};
+    int cancel_fd_{-1}; // A duplicate of the token's, since a descriptor can only be watched once
+
+private:
+    void terminate(Termination);
+    void escalate();
+    void unwatchCancellation();
+    void settleOne();
+
+public:
+    ProcAwaiter(Proc&, Reactor&);
+
+public:
+    bool await_ready() const noexcept;
+    bool await_suspend(std::coroutine_handle<>);
+    void await_resume() const noexcept;
+};
+
+inline ProcAwaiter::ProcAwaiter(Proc& proc, Reactor& reactor) : proc_(proc), reactor_(reactor){};
+
+inline bool ProcAwaiter::await_ready() const noexcept {
+    return false;
+}
+
+inline bool ProcAwaiter::await_suspend(std::coroutine_handle<> awaiting) {
+    if (proc_.cancellation_.has_value() && proc_.cancellation_->isCancelled()) {
+        proc_.termination_ = Termination::CANCELLED;
+        proc_.metrics_ = {};
+        return false;
+    }
+
+    proc_.spawn();
+    if (proc_.pid_ == -1) {
+        proc_.finish();
+        return false; // Nothing was launched, the exit status is already known
+    }
+
+    awaiting_ = awaiting;
+
+    if (proc_.due_.has_value()) {
+        deadline_timer_ = reactor_.addTimer(*proc_.due_, [this]() {
+            deadline_timer_.reset();
+            terminate(Termination::TIMED_OUT);
+        });
+    }
+    if (proc_.cancellation_.has_value()) {
+        cancel_fd_ = fcntl(proc_.cancellation_->getFd(), F_DUPFD_CLOEXEC, 0);
+        if (cancel_fd_ != -1) {
+            reactor_.watchReadable(cancel_fd_, [this]() {
+                unwatchCancellation();
+                terminate(Termination::CANCELLED);
+            });
+        }
+    }
+
+    for (std::size_t idx = 0; idx < proc_.read_fds_.size(); ++idx) {
+        int const fd = proc_.read_fds_[idx];
+        if (fd == -1)
+            continue;
+
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        ++pending_;
+        reactor_.watchReadable(fd, [this, idx, fd]() {
+            if (proc_.pump(idx))
+                return;
+            reactor_.unwatch(fd);
+            settleOne();
+        });
+    }
+
+    ++pending_;
+    reactor_.watchExit(proc_.pid_, [this](int status, rusage const& usage) {
+        proc_.pid_ = -1;
+        proc_.settle(status, usage);
+        settleOne();
+    });
+
+    return true;
+}
+
+inline void ProcAwaiter::await_resume() const noexcept {
+}
+
+inline void ProcAwaiter::terminate(Termination reason) {
+    proc_.terminate(reason);
+    if (!proc_.kill_at_.has_value() || kill_timer_.has_value())
+        return;
+
+    kill_timer_ = reactor_.addTimer(*proc_.kill_at_, [this]() { escalate(); });
+}
+
+// Mirrors Proc::escalate(): SIGKILL once the grace period has passed, and one more grace
+// period later, gives up on pipes still held open by descendants which left the group
+inline void ProcAwaiter::escalate() {
+    kill_timer_.reset();
+    if (!proc_.killed_) {
+        proc_.signal(SIGKILL);
+        proc_.killed_ = true;
+        proc_.kill_at_ = std::chrono::steady_clock::now() + KILL_GRACE_PERIOD;
+        kill_timer_ = reactor_.addTimer(*proc_.kill_at_, [this]() { escalate(); });
+        return;
+    }
+
+    for (std::size_t idx = 0; idx < proc_.read_fds_.size(); ++idx) {
+        int const fd = proc_.read_fds_[idx];
+        if (fd == -1)
+            continue;
+        reactor_.unwatch(fd);
+        proc_.release(idx);
+        settleOne();
+    }
+}
+
+inline void ProcAwaiter::unwatchCancellation() {
+    if (cancel_fd_ == -1)
+        return;
+    reactor_.unwatch(cancel_fd_);
+    close(cancel_fd_);
+    cancel_fd_ = -1;
+}
+
+inline void ProcAwaiter::settleOne() {
+    if (--pending_ != 0)
+        return;
+
+    if (deadline_timer_.has_value())
+        reactor_.cancelTimer(*deadline_timer_);
+    if (kill_timer_.has_value())
+        reactor_.cancelTimer(*kill_timer_);
+    unwatchCancellation();
+    proc_.finish();
+    reactor_.schedule(awaiting_);
+}
+
+} // namespace BarrelCmd
+
+#endif
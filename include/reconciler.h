@@ -0,0 +1,465 @@
+/*!
+ * This file is part of Barrel, a header-only C++ library that provides
+ * programmatic access to the Homebrew command line interface.
+ *
+ * Copyright (C) 2022 aydwi <contact@aydwi.com>
+ *
+ * Barrel is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*! \file  reconciler.h
+ *  \brief Converge an installation on a declared state with as few commands as possible.
+ */
+
+#ifndef RECONCILER_H__
+#define RECONCILER_H__
+
+#include "barrel.h"
+#include "layout.h"
+#include "text.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <optional>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+/*! \brief A formula or cask as it should be.
+ */
+struct BrewPackage {
+    std::string name{};                  /*!< Name (formulae may be qualified by their tap) or token */
+    std::optional<std::string> version{}; /*!< Version it must be installed at; any if unset */
+    std::optional<bool> pinned{};         /*!< Whether it must be pinned; left as it is if unset */
+    bool absent{false};                   /*!< It must not be installed at all */
+};
+
+/*! \brief The state an installation should be in. Whatever it doesn't mention is left alone.
+ */
+struct BrewDesiredState {
+    std::vector<std::string> taps{}; /*!< Taps which must be installed, as "user/repo" */
+    std::vector<BrewPackage> formulae{};
+    std::vector<BrewPackage> casks{};
+};
+
+/*! \brief The state of an installation, as far as a BrewDesiredState can describe it.
+ */
+struct BrewInstalledState {
+    /*! \brief Installed versions of each formula, sorted. */
+    std::map<std::string, std::vector<std::string>, std::less<>> formulae{};
+    /*! \brief Installed versions of each cask, sorted. */
+    std::map<std::string, std::vector<std::string>, std::less<>> casks{};
+    std::set<std::string, std::less<>> taps{};
+    std::set<std::string, std::less<>> pinned{};
+};
+
+/*! \brief The commands which converge an installation on a desired state, and how far
+ *         executing them got.
+ */
+struct BrewConvergence {
+    std::vector<BrewCommand<BrewCommandType::Builtin>> plan{}; /*!< In the order they must execute */
+    std::size_t executed{0}; /*!< Commands executed; execution stops at the first which fails */
+    std::vector<std::string> unreachable{}; /*!< Formulae and casks installed at a version other
+                                                 than the one required, which no upgrade (or,
+                                                 for those installed anew, no install) reached */
+
+    /*! \brief Whether the installation is now in the desired state, i.e. every command was
+     *         executed and succeeded, and no version required is unreachable. A dry run never
+     *         succeeds unless there was nothing to do.
+     */
+    bool succeeded() const {
+        return executed == plan.size() && (plan.empty() || plan.back().getExitStatus() == EXIT_SUCCESS) &&
+               unreachable.empty();
+    }
+};
+
+/*! \brief Bring an installation into a declared state, executing only the commands needed
+ *         to get there, rather than running `brew install` or `brew upgrade` over the whole
+ *         list on every convergence.
+ *
+ *  The installed state is read from the installation's layout on disk (the Cellar, the
+ *  Caskroom, the taps and the pins), without running Homebrew, so converging an installation
+ *  which is already in the desired state executes nothing. Only if the layout isn't
+ *  recognised is it asked of Homebrew, with four read-only commands.
+ *
+ *  The difference is planned as the following commands, in this order, each executed at most
+ *  once and naming every package it applies to:
+ *
+ *  1. `brew tap`, once per missing tap (Homebrew taps one at a time)
+ *  2. `brew unpin`, for formulae to be unpinned, upgraded or uninstalled
+ *  3. `brew uninstall --formula` and `brew uninstall --cask`
+ *  4. `brew install --formula` and `brew install --cask`
+ *  5. `brew upgrade --formula` and `brew upgrade --cask`, for those installed at a version
+ *     other than the one required
+ *  6. `brew pin`, for formulae to be pinned, or re-pinned after an upgrade
+ *
+ *  A required version is checked, not chosen: Homebrew installs and upgrades to whatever the
+ *  formula or cask currently provides (a versioned formula such as `python@3.11` selects a
+ *  major version). A formula's version is matched against its newest keg, with or without
+ *  a revision suffix (i.e. "1.2" is satisfied by "1.2_1"), a cask's against its newest
+ *  version exactly. Should it not match, Homebrew is asked (with `brew outdated`) what an
+ *  upgrade would reach; a formula or cask it can't bring to the version required is not
+ *  upgraded, but reported in BrewConvergence::unreachable, so that no convergence plans the
+ *  same futile upgrade again. What an install reaches can only be known once it's done, so
+ *  converge() checks the version of those installed anew after executing the plan.
+ *  `homebrew/core` and `homebrew/cask` are served through Homebrew's API, and are never
+ *  tapped.
+ *
+ *  \code
+ *  BrewDesiredState desired;
+ *  desired.taps = {"hashicorp/tap"};
+ *  desired.formulae = {{"wget"}, {"hashicorp/tap/terraform", "1.6.6", true}, {"node", {}, {}, true}};
+ *
+ *  BrewReconciler reconciler(brew);
+ *  for (auto const& cmd : reconciler.plan(desired)) // A dry run
+ *      std::cout << cmd.getChain() << '\n';
+ *  BrewConvergence const result = reconciler.converge(desired);
+ *  \endcode
+ */
+class BrewReconciler {
+private:
+    Brew brew_;
+    BarrelCmd::Layout layout_;
+
+private:
+    BrewInstalledState query() const;
+    std::map<std::string, std::string, std::less<>> upgrades(std::string_view,
+                                                             std::vector<std::string_view> const&) const;
+    std::vector<BrewCommand<BrewCommandType::Builtin>> plan(BrewDesiredState const&,
+                                                            BrewInstalledState const&,
+                                                            std::vector<std::string>&) const;
+
+public:
+    /*! \brief Constructor for BrewReconciler.
+     *
+     *  \param brew An object of type ::Brew, the installation to converge. Its environment
+     *              profile applies to every command executed.
+     */
+    explicit BrewReconciler(Brew const&);
+
+public:
+    /*! \brief The installed state, as the plan is computed against.
+     */
+    BrewInstalledState snapshot() const;
+
+    /*! \brief The commands which would bring the installation into the desired state, without
+     *         executing them. Empty if it is in that state already.
+     *
+     *  \param desired The desired state
+     *  \param installed The installed state; taken with snapshot() if not given
+     *
+     *  Formulae and casks whose required version no upgrade would reach are left out of the
+     *  plan.
+     *
+     *  \throws std::runtime_error If the desired state asks for a cask to be pinned
+     */
+    std::vector<BrewCommand<BrewCommandType::Builtin>> plan(BrewDesiredState const&) const;
+    std::vector<BrewCommand<BrewCommandType::Builtin>> plan(BrewDesiredState const&,
+                                                            BrewInstalledState const&) const;
+
+    /*! \brief Plan, and execute the plan in order, stopping at the first command which fails.
+     *         Once every command succeeded, the formulae and casks installed with a version
+     *         required are checked to be at it.
+     *
+     *  \param desired The desired state
+     *  \param dry_run Only plan
+     */
+    BrewConvergence converge(BrewDesiredState const&, bool = false) const;
+};
+
+namespace BarrelCmd {
+
+/*! \brief The canonical name of a tap: lowercase, without the "homebrew-" prefix Homebrew
+ *         gives the repository.
+ */
+inline std::string normaliseTap(std::string_view tap) {
+    std::string name;
+    for (char ch : tap)
+        name += static_cast<char>(std::tolower(static_cast<unsigned char>(ch)));
+    std::size_t const slash = name.find('/');
+    if (slash != std::string::npos && name.compare(slash + 1, 9, "homebrew-") == 0)
+        name.erase(slash + 1, 9);
+    return name;
+}
+
+/*! \brief Whether an installed version (the name of a keg, or of a cask's version) is the
+ *         version required. A formula's may carry a revision suffix, i.e. "1.2" is satisfied
+ *         by "1.2_1".
+ */
+inline bool isVersion(std::string_view installed, std::string_view version, bool revisions) {
+    return installed == version || (revisions && installed.size() > version.size() &&
+                                    installed.starts_with(version) && installed[version.size()] == '_');
+}
+
+} // namespace BarrelCmd
+
+inline BrewReconciler::BrewReconciler(Brew const& brew) : brew_(brew), layout_(brew.getInstallPath()){};
+
+inline BrewInstalledState BrewReconciler::snapshot() const {
+    if (!layout_.isRecognised())
+        return query();
+
+    // Each rack is listed once; Layout::getFormulae() would list them again for their kegs
+    BrewInstalledState installed;
+    for (auto& name : BarrelCmd::listDirectories(layout_.getCellar())) {
+        if (std::vector<std::string> kegs = layout_.getKegs(name); !kegs.empty())
+            installed.formulae.emplace(std::move(name), std::move(kegs));
+    }
+    for (auto& token : BarrelCmd::listDirectories(layout_.getCaskroom())) {
+        if (std::vector<std::string> versions = layout_.getCaskVersions(token); !versions.empty())
+            installed.casks.emplace(std::move(token), std::move(versions));
+    }
+    for (auto& tap : layout_.getTaps())
+        installed.taps.insert(std::move(tap));
+    for (auto& name : layout_.getPinned())
+        installed.pinned.insert(std::move(name));
+    return installed;
+}
+
+inline BrewInstalledState BrewReconciler::query() const {
+    using Builtin = BrewCommandType::Builtin;
+    auto const output = [](BrewCommand<Builtin>&& cmd) {
+        cmd.execute(BarrelCmd::Stream::STDOUT);
+        if (cmd.getExitStatus() != EXIT_SUCCESS)
+            throw std::runtime_error("BrewReconciler::query(): `" + cmd.getChain() + "` failed");
+        return std::move(cmd.stream_dump_);
+    };
+    auto const versions = [](std::string const& listed, auto& into) {
+        for (BrewListedVersions const& entry : BrewParse::listVersions(listed)) {
+            std::vector<std::string>& kegs = into[std::string(entry.name)];
+            for (std::string_view version : BarrelCmd::FieldView(entry.versions))
+                kegs.emplace_back(version);
+            std::sort(kegs.begin(), kegs.end(), BarrelCmd::versionLess);
+        }
+    };
+
+    BrewInstalledState installed;
+    versions(output({brew_, Builtin::LIST, "--formula", "--versions"}), installed.formulae);
+    versions(output({brew_, Builtin::LIST, "--cask", "--versions"}), installed.casks);
+
+    std::string const taps = output({brew_, Builtin::TAP});
+    for (std::string_view tap : BarrelCmd::LineView(taps))
+        installed.taps.insert(BarrelCmd::normaliseTap(BarrelCmd::trimSpace(tap)));
+    std::string const pinned = output({brew_, Builtin::LIST, "--pinned"});
+    for (std::string_view name : BarrelCmd::LineView(pinned))
+        installed.pinned.emplace(BarrelCmd::trimSpace(name));
+    return installed;
+}
+
+inline std::vector<BrewCommand<BrewCommandType::Builtin>>
+BrewReconciler::plan(BrewDesiredState const& desired) const {
+    return plan(desired, snapshot());
+}
+
+// The version `brew upgrade` would bring each of the given formulae or casks (by kind,
+// "--formula" or "--cask") to, by the name of its rack or its token. Those missing are up to
+// date already, as far as Homebrew knows
+inline std::map<std::string, std::string, std::less<>>
+BrewReconciler::upgrades(std::string_view kind, std::vector<std::string_view> const& names) const {
+    using Builtin = BrewCommandType::Builtin;
+    BrewCommand<Builtin> cmd(brew_, Builtin::OUTDATED, kind, "--verbose");
+    for (std::string_view name : names)
+        cmd.append(name);
+    cmd.execute(BarrelCmd::Stream::STDOUT);
+
+    // It exits 1 whenever a formula or cask it was given is outdated
+    if (cmd.getExitStatus() != EXIT_SUCCESS && cmd.getExitStatus() != EXIT_FAILURE)
+        throw std::runtime_error("BrewReconciler::upgrades(): `" + cmd.getChain() + "` failed");
+    std::map<std::string, std::string, std::less<>> versions;
+    for (BrewOutdated const& entry : BrewParse::outdated(cmd.getStreamView())) {
+        std::string_view const name = entry.name.substr(entry.name.rfind('/') + 1);
+        versions.insert_or_assign(std::string(name), std::string(entry.current));
+    }
+    return versions;
+}
+
+inline std::vector<BrewCommand<BrewCommandType::Builtin>>
+BrewReconciler::plan(BrewDesiredState const& desired, BrewInstalledState const& installed) const {
+    std::vector<std::string> unreachable;
+    return plan(desired, installed, unreachable);
+}
+
+inline std::vector<BrewCommand<BrewCommandType::Builtin>>
+BrewReconciler::plan(BrewDesiredState const& desired, BrewInstalledState const& installed,
+                     std::vector<std::string>& unreachable) const {
+    using Builtin = BrewCommandType::Builtin;
+
+    // A formula is installed (and pinned) under its bare name, whichever tap it comes from
+    auto const rack = [](std::string_view name) { return name.substr(name.rfind('/') + 1); };
+
+    std::vector<std::string> taps;
+    for (auto const& tap : desired.taps) {
+        std::string name = BarrelCmd::normaliseTap(tap);
+        if (name == "homebrew/core" || name == "homebrew/cask" || installed.taps.contains(name) ||
+            std::find(taps.begin(), taps.end(), name) != taps.end())
+            continue;
+        taps.push_back(std::move(name));
+    }
+
+    // Homebrew is only asked what an upgrade would reach for those at the wrong version
+    auto const mismatched = [&rack](BrewPackage const& package, auto const& versions, bool revisions) {
+        auto const found = versions.find(rack(package.name));
+        return !package.absent && package.version.has_value() && found != versions.end() &&
+               !found->second.empty() &&
+               !BarrelCmd::isVersion(found->second.back(), *package.version, revisions);
+    };
+    auto const reachable = [this, &mismatched](std::string_view kind,
+                                               std::vector<BrewPackage> const& packages,
+                                               auto const& versions, bool revisions) {
+        std::vector<std::string_view> stale;
+        for (BrewPackage const& package : packages) {
+            if (mismatched(package, versions, revisions))
+                stale.push_back(package.name);
+        }
+        return stale.empty() ? std::map<std::string, std::string, std::less<>>{} : upgrades(kind, stale);
+    };
+    auto const formula_upgrades = reachable("--formula", desired.formulae, installed.formulae, true);
+    auto const cask_upgrades = reachable("--cask", desired.casks, installed.casks, false);
+
+    std::vector<std::string_view> unpin, uninstall, install, upgrade, pin;
+    for (BrewPackage const& formula : desired.formulae) {
+        std::string_view const name = rack(formula.name);
+        auto const kegs = installed.formulae.find(name);
+        bool const present = kegs != installed.formulae.end() && !kegs->second.empty();
+        bool const pinned = installed.pinned.contains(name);
+
+        if (formula.absent) {
+            if (pinned)
+                unpin.push_back(name);
+            if (present)
+                uninstall.push_back(formula.name);
+            continue;
+        }
+
+        bool const wants_pin = formula.pinned.value_or(pinned);
+        if (!present) {
+            install.push_back(formula.name);
+        } else if (mismatched(formula, installed.formulae, true)) {
+            auto const next = formula_upgrades.find(name);
+            if (next == formula_upgrades.end() ||
+                !BarrelCmd::isVersion(next->second, *formula.version, true)) {
+                unreachable.push_back(formula.name);
+            } else {
+                upgrade.push_back(formula.name);
+                if (pinned) // Homebrew doesn't upgrade pinned formulae
+                    unpin.push_back(name);
+                if (wants_pin)
+                    pin.push_back(name);
+                continue;
+            }
+        }
+        if (wants_pin && !pinned)
+            pin.push_back(name);
+        else if (!wants_pin && pinned)
+            unpin.push_back(name);
+    }
+
+    std::vector<std::string_view> uninstall_casks, install_casks, upgrade_casks;
+    for (BrewPackage const& cask : desired.casks) {
+        if (cask.pinned.has_value())
+            throw std::runtime_error("BrewReconciler::plan(): Casks can't be pinned: '" + cask.name + "'");
+        auto const versions = installed.casks.find(rack(cask.name));
+        bool const present = versions != installed.casks.end() && !versions->second.empty();
+        if (cask.absent) {
+            if (present)
+                uninstall_casks.push_back(cask.name);
+        } else if (!present) {
+            install_casks.push_back(cask.name);
+        } else if (mismatched(cask, installed.casks, false)) {
+            auto const next = cask_upgrades.find(rack(cask.name));
+            if (next == cask_upgrades.end() || !BarrelCmd::isVersion(next->second, *cask.version, false))
+                unreachable.push_back(cask.name);
+            else
+                upgrade_casks.push_back(cask.name);
+        }
+    }
+
+    std::vector<BrewCommand<Builtin>> steps;
+    for (auto const& tap : taps)
+        steps.emplace_back(brew_, Builtin::TAP, tap);
+    // Every package a command applies to is named in a single execution of it
+    auto const batch = [this, &steps](Builtin cmd, std::string_view kind,
+                                      std::vector<std::string_view>& names) {
+        std::sort(names.begin(), names.end());
+        names.erase(std::unique(names.begin(), names.end()), names.end());
+        if (names.empty())
+            return;
+        BrewCommand<Builtin>& step = steps.emplace_back(brew_, cmd);
+        if (!kind.empty())
+            step.append(kind);
+        for (std::string_view name : names)
+            step.append(name);
+    };
+    batch(Builtin::UNPIN, {}, unpin);
+    batch(Builtin::UNINSTALL, "--formula", uninstall);
+    batch(Builtin::UNINSTALL, "--cask", uninstall_casks);
+    batch(Builtin::INSTALL, "--formula", install);
+    batch(Builtin::INSTALL, "--cask", install_casks);
+    batch(Builtin::UPGRADE, "--formula", upgrade);
+    batch(Builtin::UPGRADE, "--cask", upgrade_casks);
+    batch(Builtin::PIN, {}, pin);
+    return steps;
+}
+
+inline BrewConvergence BrewReconciler::converge(BrewDesiredState const& desired, bool dry_run) const {
+    BrewConvergence convergence;
+    BrewInstalledState const before = snapshot();
+    convergence.plan = plan(desired, before, convergence.unreachable);
+    if (dry_run)
+        return convergence;
+
+    for (auto& step : convergence.plan) {
+        step.execute();
+        ++convergence.executed;
+        if (step.getExitStatus() != EXIT_SUCCESS)
+            return convergence;
+    }
+
+    // Homebrew installs whatever version is current, which is only known once it has
+    auto const anew = [](std::vector<BrewPackage> const& packages, auto const& versions) {
+        std::vector<BrewPackage const*> fresh;
+        for (BrewPackage const& package : packages) {
+            auto const found = versions.find(package.name.substr(package.name.rfind('/') + 1));
+            if (!package.absent && package.version.has_value() &&
+                (found == versions.end() || found->second.empty()))
+                fresh.push_back(&package);
+        }
+        return fresh;
+    };
+    std::vector<BrewPackage const*> const formulae = anew(desired.formulae, before.formulae);
+    std::vector<BrewPackage const*> const casks = anew(desired.casks, before.casks);
+    if (formulae.empty() && casks.empty())
+        return convergence;
+
+    BrewInstalledState const after = snapshot();
+    auto const check = [&convergence](std::vector<BrewPackage const*> const& fresh, auto const& versions,
+                                      bool revisions) {
+        for (BrewPackage const* package : fresh) {
+            auto const found = versions.find(package->name.substr(package->name.rfind('/') + 1));
+            if (found == versions.end() || found->second.empty() ||
+                !BarrelCmd::isVersion(found->second.back(), *package->version, revisions))
+                convergence.unreachable.push_back(package->name);
+        }
+    };
+    check(formulae, after.formulae, true);
+    check(casks, after.casks, false);
+    return convergence;
+}
+
+#endif
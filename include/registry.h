@@ -0,0 +1,230 @@
+/*!
+ * This file is part of Barrel, a header-only C++ library that provides
+ * programmatic access to the Homebrew command line interface.
+ *
+ * Copyright (C) 2022 aydwi <contact@aydwi.com>
+ *
+ * Barrel is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*! \file  registry.h
+ *  \brief Share the validation state of each Homebrew installation across the process.
+ */
+
+#ifndef REGISTRY_H__
+#define REGISTRY_H__
+
+#include "layout.h"
+#include "proc.h"
+#include "types.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <utility>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*! \brief When a Brew object validates its installation (i.e. checks that `brew` runs, and
+ *         records the version it reports).
+ */
+enum class BrewValidation {
+    EAGER,      /*!< On construction, throwing if the installation is unusable */
+    LAZY,       /*!< On the first command executed (or the first query about the installation) */
+    BACKGROUND, /*!< On a background thread started on construction; the first command waits */
+    SKIP        /*!< Never */
+};
+
+namespace BarrelCmd {
+
+/*! \brief The validation state of one Homebrew installation, shared by every Brew object
+ *         referring to it. An installation is validated at most once for as long as its
+ *         `brew` binary keeps the same inode and modification time.
+ */
+class Installation {
+private:
+    struct Identity {
+        dev_t device{0};
+        ino_t inode{0};
+        std::int64_t mtime_ns{0};
+
+        bool operator==(Identity const&) const = default;
+    };
+
+private:
+    std::string install_path_;
+    BrewTargetArch target_arch_;
+
+private:
+    std::mutex mutex_{};
+    std::optional<Identity> identity_{}; // Of the binary that was validated; empty until then
+    bool valid_{false};
+    std::string version_{};
+    std::uint64_t validations_{0};
+    std::thread background_{};
+
+private:
+    Identity identify() const;
+    void validate(Identity const&);
+
+public:
+    Installation(std::string, BrewTargetArch);
+    Installation(Installation const&) = delete;
+    Installation& operator=(Installation const&) = delete;
+
+    /*! \brief Waits for a background validation, if one is running.
+     */
+    ~Installation();
+
+public:
+    /*! \brief Validate the installation now, unless its binary is unchanged since the last
+     *         validation. Concurrent callers wait for a single validation.
+     *
+     *  \return Whether `brew` ran successfully
+     */
+    bool isValid();
+
+    /*! \brief Start validating on a background thread, unless validated already.
+     */
+    void validateInBackground();
+
+    /*! \brief The version reported by the last validation (e.g. "Homebrew 4.2.0").
+     */
+    std::string getVersion();
+
+    std::string const& getInstallPath() const;
+    BrewTargetArch getTargetArch() const;
+    std::uint64_t getValidationCount();
+};
+
+inline Installation::Installation(std::string install_path, BrewTargetArch target_arch)
+    : install_path_(std::move(install_path)), target_arch_(target_arch){};
+
+inline Installation::~Installation() {
+    if (background_.joinable())
+        background_.join();
+}
+
+inline Installation::Identity Installation::identify() const {
+    struct stat info{};
+    if (stat(install_path_.c_str(), &info) != 0)
+        return {};
+#ifdef __APPLE__
+    std::int64_t const nanos = info.st_mtimespec.tv_nsec;
+#else
+    std::int64_t const nanos = info.st_mtim.tv_nsec;
+#endif
+    return {info.st_dev, info.st_ino, static_cast<std::int64_t>(info.st_mtime) * 1'000'000'000 + nanos};
+}
+
+inline void Installation::validate(Identity const& identity) {
+    ++validations_;
+    identity_ = identity;
+
+    // A release checkout names its version in its git refs, which spares launching Homebrew
+    std::optional<std::string> const version = Layout(install_path_).getVersion();
+    if (version.has_value() && access(install_path_.c_str(), X_OK) == 0) {
+        valid_ = true;
+        version_ = "Homebrew " + *version;
+        return;
+    }
+
+    Proc proc({install_path_, getCommandHead(BrewCommandType::Builtin::VERSION)}, Stream::STDOUT_STDERR);
+    proc.execute();
+
+    valid_ = proc.getExitStatus() == EXIT_SUCCESS;
+    std::string const& dump = proc.getStreamDump();
+    version_ = valid_ ? std::string(dump.begin(), std::find(dump.begin(), dump.end(), '\n')) : std::string();
+}
+
+inline bool Installation::isValid() {
+    Identity const identity = identify();
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!identity_.has_value() || *identity_ != identity)
+        validate(identity);
+    return valid_;
+}
+
+inline void Installation::validateInBackground() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (identity_.has_value() || background_.joinable())
+        return;
+    background_ = std::thread([this]() { isValid(); });
+}
+
+inline std::string Installation::getVersion() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return version_;
+}
+
+inline std::string const& Installation::getInstallPath() const {
+    return install_path_;
+}
+
+inline BrewTargetArch Installation::getTargetArch() const {
+    return target_arch_;
+}
+
+inline std::uint64_t Installation::getValidationCount() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return validations_;
+}
+
+} // namespace BarrelCmd
+
+/*! \brief The process-wide registry of Homebrew installations, keyed by the path of the
+ *         `brew` binary and the target architecture. Every Brew object referring to the
+ *         same installation shares its validation state through here.
+ */
+class BrewRegistry {
+private:
+    using Key = std::pair<std::string, BrewTargetArch>;
+
+private:
+    inline static std::mutex mutex_{};
+    inline static std::map<Key, std::shared_ptr<BarrelCmd::Installation>> installations_{};
+
+public:
+    /*! \brief Get the shared state of an installation, registering it on first use.
+     *
+     *  \param install_path Path of the `brew` binary
+     *  \param target_arch Target architecture
+     */
+    static std::shared_ptr<BarrelCmd::Installation> acquire(std::string const&, BrewTargetArch);
+
+    /*! \brief Number of installations registered so far.
+     */
+    static std::size_t size();
+};
+
+inline std::shared_ptr<BarrelCmd::Installation> BrewRegistry::acquire(std::string const& install_path,
+                                                                      BrewTargetArch target_arch) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& installation = installations_[Key{install_path, target_arch}];
+    if (!installation)
+        installation = std::make_shared<BarrelCmd::Installation>(install_path, target_arch);
+    return installation;
+}
+
+inline std::size_t BrewRegistry::size() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return installations_.size();
+}
+
+#endif
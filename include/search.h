@@ -0,0 +1,654 @@
+/*!
+ * This file is part of Barrel, a header-only C++ library that provides
+ * programmatic access to the Homebrew command line interface.
+ *
+ * Copyright (C) 2022 aydwi <contact@aydwi.com>
+ *
+ * Barrel is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*! \file  search.h
+ *  \brief Search formulae and casks by name and description without running Homebrew.
+ */
+
+#ifndef SEARCH_H__
+#define SEARCH_H__
+
+#include "json.h"
+#include "layout.h"
+#include "proc.h"
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*! \brief Whether a search hit is a formula or a cask.
+ */
+enum class BrewSearchKind : std::uint8_t { FORMULA, CASK };
+
+/*! \brief A formula or cask found by BrewSearchIndex. Strings are views into the index,
+ *         valid for as long as any copy of it is.
+ */
+struct BrewSearchHit {
+    std::string_view name{};    /*!< Name of the formula, or token of the cask */
+    std::string_view desc{};
+    std::string_view version{}; /*!< The stable version */
+    std::string_view tap{};
+    BrewSearchKind kind{BrewSearchKind::FORMULA};
+    float similarity{1.0f}; /*!< Of the name to the query, for fuzzy lookups; 1 otherwise */
+};
+
+namespace BarrelCmd {
+
+/*! \brief A 64-bit hash of some bytes, taken a word at a time. Good enough to tell versions
+ *         of a file apart; not meant to resist collisions made on purpose.
+ */
+inline std::uint64_t hashBytes(std::string_view data) {
+    std::uint64_t constexpr prime = 0x100000001b3ULL;
+    std::uint64_t hash = 0xcbf29ce484222325ULL;
+    std::size_t idx = 0;
+    for (; idx + 8 <= data.size(); idx += 8) {
+        std::uint64_t word;
+        std::memcpy(&word, data.data() + idx, sizeof(word));
+        hash = (hash ^ word) * prime;
+        hash ^= hash >> 29;
+    }
+    for (; idx < data.size(); ++idx)
+        hash = (hash ^ static_cast<unsigned char>(data[idx])) * prime;
+    return hash ^ data.size();
+}
+
+/*! \brief ASCII text in lower case, for comparisons which ignore case.
+ */
+inline std::string foldCase(std::string_view text) {
+    std::string folded(text);
+    for (char& ch : folded)
+        ch = static_cast<char>(std::tolower(static_cast<unsigned char>(ch)));
+    return folded;
+}
+
+/*! \brief Whether `text` contains `folded` (which is in lower case), ignoring the case of
+ *         `text`.
+ */
+inline bool containsFolded(std::string_view text, std::string_view folded) {
+    auto const equal = [](char lhs, char rhs) {
+        return std::tolower(static_cast<unsigned char>(lhs)) == static_cast<unsigned char>(rhs);
+    };
+    return std::search(text.begin(), text.end(), folded.begin(), folded.end(), equal) != text.end();
+}
+
+/*! \brief Whether `lhs` sorts before `rhs`, ignoring the case of both.
+ */
+inline bool lessFolded(std::string_view lhs, std::string_view rhs) {
+    auto const less = [](char lhs, char rhs) {
+        return std::tolower(static_cast<unsigned char>(lhs)) < std::tolower(static_cast<unsigned char>(rhs));
+    };
+    return std::lexicographical_compare(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(), less);
+}
+
+} // namespace BarrelCmd
+
+/*! \brief An index of Homebrew's formula and cask catalogues, which answers prefix,
+ *         substring and fuzzy lookups in microseconds, in place of `brew search` and
+ *         `brew desc --search`.
+ *
+ *  The index is built from Homebrew's local API cache (`formula.jws.json` and
+ *  `cask.jws.json`, as kept under `$HOMEBREW_CACHE/api` by `brew update`) into a file which
+ *  is queried through a read-only mapping, so opening it reads nothing up front. It holds
+ *  the formulae and casks sorted by name (ignoring case), with their description, version
+ *  and tap, and the trigrams of every (lower case) name and description, each with the
+ *  ordered list of entries it occurs in. The sizes, modification times and hashes of the source files are
+ *  kept with it: the index is rebuilt only once the content of either file changes, and
+ *  a file which was only touched is just hashed again.
+ *
+ *  Lookups ignore case, and are safe to run concurrently. Hits are views into the mapping;
+ *  copies of the index share it.
+ *
+ *  \code{.cpp}
+ *  BrewSearchIndex const index = BrewSearchIndex::fromApiCache();
+ *  for (BrewSearchHit const& hit : index.findSubstring("json", true))
+ *      std::cout << hit.name << ": " << hit.desc << '\n';
+ *  \endcode
+ */
+class BrewSearchIndex {
+private:
+    static constexpr std::array<char, 8> MAGIC{'B', 'R', 'L', 'S', 'R', 'C', 'H', '\0'};
+    static constexpr std::uint32_t FORMAT{2}; // Bumped whenever the layout or order of entries changes
+
+    struct Source {
+        std::uint64_t size;
+        std::int64_t mtime;
+        std::uint64_t hash;
+
+        bool operator==(Source const&) const = default;
+    };
+
+    struct Text {
+        std::uint32_t offset;
+        std::uint32_t size;
+    };
+
+    struct Entry {
+        Text name;
+        Text desc;
+        Text version;
+        Text tap;
+        std::uint32_t kind;
+        std::uint32_t grams; // Distinct trigrams of the padded name, for fuzzy similarity
+    };
+
+    struct Trigram {
+        std::uint32_t key;
+        std::uint32_t first; // Into the postings, which hold entry << 1 | in_name
+        std::uint32_t count;
+    };
+
+    // Followed by the entries, trigrams, postings and strings, in that order
+    struct Header {
+        std::array<char, 8> magic;
+        std::uint32_t format;
+        std::uint32_t entries;
+        std::array<Source, 2> sources; // Formulae, casks
+        std::uint32_t trigrams;
+        std::uint32_t postings;
+        std::uint64_t strings;
+        std::uint64_t size;
+    };
+
+    struct Row {
+        std::string_view name;
+        std::string_view desc;
+        std::string_view version;
+        std::string_view tap;
+        BrewSearchKind kind;
+    };
+
+private:
+    BarrelCmd::MappedOutput mapping_{};
+    Header const* header_{nullptr};
+    std::span<Entry const> entries_{};
+    std::span<Trigram const> trigrams_{};
+    std::span<std::uint32_t const> postings_{};
+    std::string_view strings_{};
+
+private:
+    BrewSearchIndex() = default;
+
+    static Source describe(std::filesystem::path const&);
+    static std::string read(std::filesystem::path const&, Source&);
+    static void write(std::filesystem::path const&, std::string_view, std::string_view,
+                      std::array<Source, 2> const&);
+    static std::vector<std::uint32_t> trigramsOf(std::string_view, bool);
+
+    bool load(std::filesystem::path const&);
+    void restamp(std::filesystem::path const&, std::array<Source, 2> const&) const;
+    std::string_view text(Text) const;
+    BrewSearchHit hit(std::uint32_t, float = 1.0f) const;
+    std::span<std::uint32_t const> postingsOf(std::uint32_t) const;
+
+public:
+    /*! \brief Open an index, building it first if it is missing, unreadable, or was built
+     *         from other contents of the source files.
+     *
+     *  \param index_file Where the index is kept
+     *  \param formula_file The formula catalogue (signed `formula.jws.json`, or a plain
+     *                      `formula.json` array)
+     *  \param cask_file The cask catalogue, if any (`cask.jws.json` or `cask.json`)
+     *
+     *  \throws std::runtime_error If the formula catalogue can't be read, or the index can't
+     *                             be written
+     */
+    static BrewSearchIndex open(std::filesystem::path const&, std::filesystem::path const&,
+                                std::filesystem::path const& = {});
+
+    /*! \brief Open the index of the local API cache (see BarrelCmd::getHomebrewCache()),
+     *         kept alongside it as `api/barrel_search.idx`.
+     */
+    static BrewSearchIndex fromApiCache();
+
+public:
+    /*! \brief Formulae and casks whose name starts with the text, sorted by name.
+     */
+    std::vector<BrewSearchHit> findPrefix(std::string_view, std::size_t = SIZE_MAX) const;
+
+    /*! \brief Formulae and casks whose name contains the text, like `brew search`, sorted
+     *         by name.
+     *
+     *  \param text What to look for
+     *  \param descriptions Also match descriptions, like `brew desc --search`
+     *  \param limit Most hits to return
+     */
+    std::vector<BrewSearchHit> findSubstring(std::string_view, bool = false, std::size_t = SIZE_MAX) const;
+
+    /*! \brief Formulae and casks whose name is similar to the text, e.g. despite a typo,
+     *         most similar first. Similarity is the share of trigrams the two have in
+     *         common, out of those either has.
+     *
+     *  \param text What to look for
+     *  \param limit Most hits to return
+     *  \param threshold Least similarity of a hit, between 0 and 1
+     */
+    std::vector<BrewSearchHit> findFuzzy(std::string_view, std::size_t = 10, float = 0.3f) const;
+
+    /*! \brief Number of formulae and casks in the index.
+     */
+    std::size_t size() const;
+};
+
+inline BrewSearchIndex BrewSearchIndex::open(std::filesystem::path const& index_file,
+                                             std::filesystem::path const& formula_file,
+                                             std::filesystem::path const& cask_file) {
+    std::array<Source, 2> sources{describe(formula_file),
+                                  cask_file.empty() ? Source{} : describe(cask_file)};
+
+    // Untouched sources are taken at their word, so that opening reads nothing else
+    BrewSearchIndex index;
+    bool const loaded = index.load(index_file);
+    auto const unchanged = [&index, &sources](std::size_t idx) {
+        Source const& built = index.header_->sources[idx];
+        return built.size == sources[idx].size && built.mtime == sources[idx].mtime;
+    };
+    if (loaded && unchanged(0) && unchanged(1))
+        return index;
+
+    std::string const formulae = read(formula_file, sources[0]);
+    std::string const casks = cask_file.empty() ? std::string() : read(cask_file, sources[1]);
+    if (loaded && index.header_->sources[0].hash == sources[0].hash &&
+        index.header_->sources[1].hash == sources[1].hash) {
+        index.restamp(index_file, sources);
+        return index;
+    }
+
+    write(index_file, formulae, casks, sources);
+    if (!index.load(index_file))
+        throw std::runtime_error("BrewSearchIndex::open(): Cannot read " + index_file.string());
+    return index;
+}
+
+inline BrewSearchIndex BrewSearchIndex::fromApiCache() {
+    std::filesystem::path const api = BarrelCmd::getHomebrewCache() / "api";
+    auto const catalogue = [&api](std::string const& name) {
+        std::error_code ec;
+        std::filesystem::path const signed_file = api / (name + ".jws.json");
+        return std::filesystem::exists(signed_file, ec) ? signed_file : api / (name + ".json");
+    };
+
+    std::filesystem::path cask_file = catalogue("cask");
+    std::error_code ec;
+    if (!std::filesystem::exists(cask_file, ec))
+        cask_file.clear(); // Not fetched on Linux
+    return open(api / "barrel_search.idx", catalogue("formula"), cask_file);
+}
+
+inline BrewSearchIndex::Source BrewSearchIndex::describe(std::filesystem::path const& path) {
+    struct stat info;
+    if (::stat(path.c_str(), &info) != 0)
+        return {};
+#ifdef __APPLE__
+    timespec const mtime = info.st_mtimespec;
+#else
+    timespec const mtime = info.st_mtim;
+#endif
+    return {static_cast<std::uint64_t>(info.st_size),
+            static_cast<std::int64_t>(mtime.tv_sec) * 1000000000 + mtime.tv_nsec, 0};
+}
+
+inline std::string BrewSearchIndex::read(std::filesystem::path const& path, Source& source) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+        throw std::runtime_error("BrewSearchIndex::read(): Cannot read " + path.string());
+    std::string content{std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+    source.size = content.size();
+    source.hash = BarrelCmd::hashBytes(content);
+    return content;
+}
+
+// Distinct trigrams of folded text, sorted. Names are padded the way pg_trgm pads words, so
+// that their first and last letters weigh as much as the others in fuzzy lookups
+inline std::vector<std::uint32_t> BrewSearchIndex::trigramsOf(std::string_view folded, bool padded) {
+    std::string const text = padded ? "  " + std::string(folded) + " " : std::string(folded);
+    std::vector<std::uint32_t> keys;
+    for (std::size_t idx = 0; idx + 3 <= text.size(); ++idx) {
+        keys.push_back(static_cast<std::uint32_t>(static_cast<unsigned char>(text[idx])) << 16 |
+                       static_cast<std::uint32_t>(static_cast<unsigned char>(text[idx + 1])) << 8 |
+                       static_cast<std::uint32_t>(static_cast<unsigned char>(text[idx + 2])));
+    }
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    return keys;
+}
+
+inline void BrewSearchIndex::write(std::filesystem::path const& index_file, std::string_view formula_json,
+                                   std::string_view cask_json, std::array<Source, 2> const& sources) {
+    BarrelCmd::Arena arena;
+    BrewInfo const formulae(BarrelCmd::getApiPayload(formula_json, arena));
+
+    // The cask catalogue is a bare array of casks, which BrewInfo reads as formulae
+    std::string cask_document{"{\"casks\":[]}"};
+    if (!cask_json.empty())
+        cask_document = "{\"casks\":" + std::string(BarrelCmd::getApiPayload(cask_json, arena)) + "}";
+    BrewInfo const casks(cask_document);
+
+    std::vector<Row> rows;
+    rows.reserve(formulae.getFormulae().size() + casks.getCasks().size());
+    for (BrewFormula const& formula : formulae.getFormulae())
+        rows.push_back({formula.name, formula.desc, formula.version, formula.tap, BrewSearchKind::FORMULA});
+    for (BrewCask const& cask : casks.getCasks())
+        rows.push_back({cask.token, cask.desc, cask.version, cask.tap, BrewSearchKind::CASK});
+    // Ignoring case, so that a prefix in any case finds the names it starts; ties (the same
+    // name in other cases, or a formula and a cask) are ordered by bytes, then by kind
+    auto const key = [](Row const& row) { return std::pair(row.name, row.kind); };
+    std::sort(rows.begin(), rows.end(), [&key](Row const& lhs, Row const& rhs) {
+        if (BarrelCmd::lessFolded(lhs.name, rhs.name))
+            return true;
+        if (BarrelCmd::lessFolded(rhs.name, lhs.name))
+            return false;
+        return key(lhs) < key(rhs);
+    });
+    rows.erase(std::unique(rows.begin(), rows.end(),
+                           [&key](Row const& lhs, Row const& rhs) { return key(lhs) == key(rhs); }),
+               rows.end());
+
+    // Taps repeat across thousands of entries, so they're stored once
+    std::string strings;
+    std::unordered_map<std::string_view, Text> taps;
+    auto const store = [&strings](std::string_view value) {
+        Text const stored{static_cast<std::uint32_t>(strings.size()),
+                          static_cast<std::uint32_t>(value.size())};
+        strings.append(value);
+        return stored;
+    };
+
+    std::vector<Entry> entries;
+    std::vector<std::uint64_t> occurrences; // trigram << 32 | entry << 1 | in_name
+    entries.reserve(rows.size());
+    for (std::size_t idx = 0; idx < rows.size(); ++idx) {
+        Row const& row = rows[idx];
+        auto const [tap, added] = taps.try_emplace(row.tap);
+        if (added)
+            tap->second = store(row.tap);
+        std::vector<std::uint32_t> const name_grams = trigramsOf(BarrelCmd::foldCase(row.name), true);
+        entries.push_back({store(row.name), store(row.desc), store(row.version), tap->second,
+                           static_cast<std::uint32_t>(row.kind),
+                           static_cast<std::uint32_t>(name_grams.size())});
+
+        std::uint64_t const id = static_cast<std::uint64_t>(idx) << 1;
+        for (std::uint32_t gram : name_grams)
+            occurrences.push_back(static_cast<std::uint64_t>(gram) << 32 | id | 1);
+        for (std::uint32_t gram : trigramsOf(BarrelCmd::foldCase(row.desc), false))
+            occurrences.push_back(static_cast<std::uint64_t>(gram) << 32 | id);
+    }
+    if (strings.size() > UINT32_MAX)
+        throw std::runtime_error("BrewSearchIndex::write(): Catalogue too large to index");
+
+    // A trigram in both the name and the description of an entry sorts last with its name bit
+    std::sort(occurrences.begin(), occurrences.end());
+    std::vector<Trigram> trigrams;
+    std::vector<std::uint32_t> postings;
+    postings.reserve(occurrences.size());
+    for (std::size_t idx = 0; idx < occurrences.size(); ++idx) {
+        std::uint64_t const occurrence = occurrences[idx];
+        if (idx + 1 < occurrences.size() && occurrences[idx + 1] >> 1 == occurrence >> 1)
+            continue;
+        auto const gram = static_cast<std::uint32_t>(occurrence >> 32);
+        if (trigrams.empty() || trigrams.back().key != gram)
+            trigrams.push_back({gram, static_cast<std::uint32_t>(postings.size()), 0});
+        ++trigrams.back().count;
+        postings.push_back(static_cast<std::uint32_t>(occurrence));
+    }
+
+    Header header{MAGIC,
+                  FORMAT,
+                  static_cast<std::uint32_t>(entries.size()),
+                  sources,
+                  static_cast<std::uint32_t>(trigrams.size()),
+                  static_cast<std::uint32_t>(postings.size()),
+                  strings.size(),
+                  0};
+    header.size = sizeof(Header) + entries.size() * sizeof(Entry) + trigrams.size() * sizeof(Trigram) +
+                  postings.size() * sizeof(std::uint32_t) + strings.size();
+
+    // Written aside and renamed over the old index, which stays usable to whoever has it open
+    std::filesystem::path const partial = index_file.string() + "." + std::to_string(getpid());
+    {
+        std::ofstream file(partial, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<char const*>(&header), sizeof(header));
+        file.write(reinterpret_cast<char const*>(entries.data()),
+                   static_cast<std::streamsize>(entries.size() * sizeof(Entry)));
+        file.write(reinterpret_cast<char const*>(trigrams.data()),
+                   static_cast<std::streamsize>(trigrams.size() * sizeof(Trigram)));
+        file.write(reinterpret_cast<char const*>(postings.data()),
+                   static_cast<std::streamsize>(postings.size() * sizeof(std::uint32_t)));
+        file.write(strings.data(), static_cast<std::streamsize>(strings.size()));
+        if (!file.flush()) {
+            std::filesystem::remove(partial);
+            throw std::runtime_error("BrewSearchIndex::write(): Cannot write " + partial.string());
+        }
+    }
+    std::error_code ec;
+    std::filesystem::rename(partial, index_file, ec);
+    if (ec) {
+        std::filesystem::remove(partial, ec);
+        throw std::runtime_error("BrewSearchIndex::write(): Cannot replace " + index_file.string());
+    }
+}
+
+// Maps an index, if it is one this version of Barrel wrote
+inline bool BrewSearchIndex::load(std::filesystem::path const& index_file) {
+    int const fd = ::open(index_file.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return false;
+    struct stat info;
+    if (fstat(fd, &info) != 0 || static_cast<std::size_t>(info.st_size) < sizeof(Header)) {
+        close(fd);
+        return false;
+    }
+    auto const size = static_cast<std::size_t>(info.st_size);
+    void* const data = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return false;
+    BarrelCmd::MappedOutput mapping(data, size);
+
+    auto const* header = static_cast<Header const*>(data);
+    if (header->magic != MAGIC || header->format != FORMAT || header->size != size)
+        return false;
+    char const* cursor = static_cast<char const*>(data) + sizeof(Header);
+    std::span<Entry const> const entries(reinterpret_cast<Entry const*>(cursor), header->entries);
+    cursor += entries.size_bytes();
+    std::span<Trigram const> const trigrams(reinterpret_cast<Trigram const*>(cursor), header->trigrams);
+    cursor += trigrams.size_bytes();
+    std::span<std::uint32_t const> const postings(reinterpret_cast<std::uint32_t const*>(cursor),
+                                                  header->postings);
+    cursor += postings.size_bytes();
+    if (static_cast<std::size_t>(cursor - static_cast<char const*>(data)) + header->strings != size)
+        return false;
+
+    mapping_ = std::move(mapping);
+    header_ = header;
+    entries_ = entries;
+    trigrams_ = trigrams;
+    postings_ = postings;
+    strings_ = {cursor, static_cast<std::size_t>(header->strings)};
+    return true;
+}
+
+// Records that the sources were touched without changing, so they're not hashed again
+inline void BrewSearchIndex::restamp(std::filesystem::path const& index_file,
+                                     std::array<Source, 2> const& sources) const {
+    int const fd = ::open(index_file.c_str(), O_WRONLY | O_CLOEXEC);
+    if (fd == -1)
+        return;
+    [[maybe_unused]] ssize_t const written =
+        pwrite(fd, sources.data(), sizeof(sources), static_cast<off_t>(offsetof(Header, sources)));
+    close(fd);
+}
+
+inline std::string_view BrewSearchIndex::text(Text stored) const {
+    if (static_cast<std::size_t>(stored.offset) + stored.size > strings_.size())
+        return {};
+    return strings_.substr(stored.offset, stored.size);
+}
+
+inline BrewSearchHit BrewSearchIndex::hit(std::uint32_t id, float similarity) const {
+    Entry const& entry = entries_[id];
+    return {text(entry.name), text(entry.desc), text(entry.version), text(entry.tap),
+            static_cast<BrewSearchKind>(entry.kind), similarity};
+}
+
+inline std::span<std::uint32_t const> BrewSearchIndex::postingsOf(std::uint32_t key) const {
+    auto const found =
+        std::lower_bound(trigrams_.begin(), trigrams_.end(), key,
+                         [](Trigram const& trigram, std::uint32_t want) { return trigram.key < want; });
+    if (found == trigrams_.end() || found->key != key ||
+        static_cast<std::size_t>(found->first) + found->count > postings_.size())
+        return {};
+    return postings_.subspan(found->first, found->count);
+}
+
+inline std::vector<BrewSearchHit> BrewSearchIndex::findPrefix(std::string_view prefix,
+                                                              std::size_t limit) const {
+    std::string const folded = BarrelCmd::foldCase(prefix);
+    auto const before = [this](Entry const& entry, std::string_view want) {
+        return BarrelCmd::lessFolded(text(entry.name), want);
+    };
+    auto const first = std::lower_bound(entries_.begin(), entries_.end(), std::string_view(folded), before);
+    auto id = static_cast<std::uint32_t>(first - entries_.begin());
+
+    std::vector<BrewSearchHit> hits;
+    for (; id < entries_.size() && hits.size() < limit; ++id) {
+        std::string_view const name = text(entries_[id].name);
+        if (name.size() < folded.size() || BarrelCmd::foldCase(name.substr(0, folded.size())) != folded)
+            break;
+        hits.push_back(hit(id));
+    }
+    return hits;
+}
+
+inline std::vector<BrewSearchHit> BrewSearchIndex::findSubstring(std::string_view substring,
+                                                                 bool descriptions,
+                                                                 std::size_t limit) const {
+    std::string const folded = BarrelCmd::foldCase(substring);
+    auto const matches = [this, &folded, descriptions](std::uint32_t id) {
+        Entry const& entry = entries_[id];
+        return BarrelCmd::containsFolded(text(entry.name), folded) ||
+               (descriptions && BarrelCmd::containsFolded(text(entry.desc), folded));
+    };
+
+    std::vector<BrewSearchHit> hits;
+    if (folded.size() < 3) {
+        // Too short to have a trigram; there are few enough entries to go through them all
+        for (std::uint32_t id = 0; id < entries_.size() && hits.size() < limit; ++id) {
+            if (matches(id))
+                hits.push_back(hit(id));
+        }
+        return hits;
+    }
+
+    // Entries holding every trigram of the text, rarest trigram first, are the candidates
+    std::vector<std::span<std::uint32_t const>> lists;
+    for (std::uint32_t gram : trigramsOf(folded, false)) {
+        lists.push_back(postingsOf(gram));
+        if (lists.back().empty())
+            return hits;
+    }
+    std::sort(lists.begin(), lists.end(),
+              [](auto const& lhs, auto const& rhs) { return lhs.size() < rhs.size(); });
+
+    std::vector<std::uint32_t> candidates;
+    for (std::uint32_t posting : lists.front()) {
+        if (descriptions || (posting & 1) != 0)
+            candidates.push_back(posting >> 1);
+    }
+    for (std::size_t list = 1; list < lists.size() && !candidates.empty(); ++list) {
+        std::size_t kept = 0;
+        auto posting = lists[list].begin();
+        for (std::uint32_t id : candidates) {
+            posting = std::lower_bound(posting, lists[list].end(), id << 1);
+            if (posting != lists[list].end() && *posting >> 1 == id && (descriptions || (*posting & 1) != 0))
+                candidates[kept++] = id;
+        }
+        candidates.resize(kept);
+    }
+
+    // Trigrams only narrow it down; "abcd" holds those of "abcbcd"
+    for (std::uint32_t id : candidates) {
+        if (hits.size() == limit)
+            break;
+        if (id < entries_.size() && matches(id))
+            hits.push_back(hit(id));
+    }
+    return hits;
+}
+
+inline std::vector<BrewSearchHit> BrewSearchIndex::findFuzzy(std::string_view query, std::size_t limit,
+                                                             float threshold) const {
+    std::vector<std::uint32_t> const grams = trigramsOf(BarrelCmd::foldCase(query), true);
+    std::vector<std::uint16_t> shared(entries_.size(), 0);
+    std::vector<std::uint32_t> touched;
+    for (std::uint32_t gram : grams) {
+        for (std::uint32_t posting : postingsOf(gram)) {
+            std::uint32_t const id = posting >> 1;
+            if ((posting & 1) == 0 || id >= shared.size())
+                continue;
+            if (shared[id]++ == 0)
+                touched.push_back(id);
+        }
+    }
+
+    std::vector<std::pair<float, std::uint32_t>> scored;
+    for (std::uint32_t id : touched) {
+        float const common = shared[id];
+        float const similarity = common / (static_cast<float>(grams.size() + entries_[id].grams) - common);
+        if (similarity >= threshold)
+            scored.emplace_back(similarity, id);
+    }
+    auto const better = [](auto const& lhs, auto const& rhs) {
+        return lhs.first != rhs.first ? lhs.first > rhs.first : lhs.second < rhs.second;
+    };
+    std::size_t const count = std::min(limit, scored.size());
+    std::partial_sort(scored.begin(), scored.begin() + static_cast<std::ptrdiff_t>(count), scored.end(),
+                      better);
+
+    std::vector<BrewSearchHit> hits;
+    hits.reserve(count);
+    for (std::size_t idx = 0; idx < count; ++idx)
+        hits.push_back(hit(scored[idx].second, scored[idx].first));
+    return hits;
+}
+
+inline std::size_t BrewSearchIndex::size() const {
+    return entries_.size();
+}
+
+#endif
@@ -0,0 +1,519 @@
+/*!
+ * This file is part of Barrel, a header-only C++ library that provides
+ * programmatic access to the Homebrew command line interface.
+ *
+ * Copyright (C) 2022 aydwi <contact@aydwi.com>
+ *
+ * Barrel is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*! \file  text.h
+ *  \brief Typed access to the plain text printed by common Homebrew commands.
+ */
+
+#ifndef TEXT_H__
+#define TEXT_H__
+
+#include <algorithm>
+#include <cctype>
+#include <concepts>
+#include <cstddef>
+#include <cstring>
+#include <iterator>
+#include <string_view>
+#include <vector>
+
+namespace BarrelCmd {
+
+/*! \brief The lines of a buffer, as views into it, without their newlines. A last line
+ *         which is not terminated is still a line; an empty buffer has none.
+ *
+ *  Newlines are found with `memchr()`, which the C library vectorizes, so walking the lines
+ *  costs little more than reading the buffer once.
+ *
+ *  \code
+ *  for (std::string_view line : BarrelCmd::LineView(cmd.getStreamView()))
+ *      // ...
+ *  \endcode
+ */
+class LineView {
+public:
+    class Iterator {
+    private:
+        char const* line_{nullptr};
+        char const* end_{nullptr};
+        std::size_t length_{0};
+
+    private:
+        void scan();
+
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = std::string_view;
+        using difference_type = std::ptrdiff_t;
+        using pointer = void;
+        using reference = std::string_view;
+
+    public:
+        Iterator() = default;
+        Iterator(char const*, char const*);
+
+    public:
+        std::string_view operator*() const;
+        Iterator& operator++();
+        Iterator operator++(int);
+        bool operator==(Iterator const&) const;
+    };
+
+private:
+    std::string_view text_;
+
+public:
+    explicit LineView(std::string_view text) : text_(text){};
+
+public:
+    Iterator begin() const;
+    Iterator end() const;
+
+    /*! \brief Number of lines, e.g. to size the storage for what is parsed out of them.
+     */
+    std::size_t count() const;
+};
+
+inline LineView::Iterator::Iterator(char const* line, char const* end) : line_(line), end_(end) {
+    scan();
+}
+
+inline void LineView::Iterator::scan() {
+    if (line_ == end_) {
+        length_ = 0;
+        return;
+    }
+    std::size_t const left = static_cast<std::size_t>(end_ - line_);
+    auto const* newline = static_cast<char const*>(std::memchr(line_, '\n', left));
+    length_ = static_cast<std::size_t>((newline != nullptr ? newline : end_) - line_);
+}
+
+inline std::string_view LineView::Iterator::operator*() const {
+    return {line_, length_};
+}
+
+inline LineView::Iterator& LineView::Iterator::operator++() {
+    char const* const next = line_ + length_;
+    line_ = next == end_ ? end_ : next + 1;
+    scan();
+    return *this;
+}
+
+inline LineView::Iterator LineView::Iterator::operator++(int) {
+    Iterator const previous = *this;
+    ++*this;
+    return previous;
+}
+
+inline bool LineView::Iterator::operator==(Iterator const& other) const {
+    return line_ == other.line_;
+}
+
+inline LineView::Iterator LineView::begin() const {
+    return {text_.data(), text_.data() + text_.size()};
+}
+
+inline LineView::Iterator LineView::end() const {
+    return {text_.data() + text_.size(), text_.data() + text_.size()};
+}
+
+inline std::size_t LineView::count() const {
+    std::size_t lines = 0;
+    char const* cursor = text_.data();
+    char const* const end = text_.data() + text_.size();
+    while (cursor != end) {
+        auto const* newline =
+            static_cast<char const*>(std::memchr(cursor, '\n', static_cast<std::size_t>(end - cursor)));
+        ++lines;
+        cursor = newline != nullptr ? newline + 1 : end;
+    }
+    return lines;
+}
+
+/*! \brief Remove the next field from the front of some text, along with the delimiters
+ *         around it.
+ *
+ *  \return The field, or an empty view once there are none left
+ */
+template <std::predicate<char> Delimiter>
+std::string_view takeField(std::string_view& rest, Delimiter is_delimiter) {
+    std::size_t start = 0;
+    while (start < rest.size() && is_delimiter(rest[start]))
+        ++start;
+    std::size_t end = start;
+    while (end < rest.size() && !is_delimiter(rest[end]))
+        ++end;
+    std::size_t next = end;
+    while (next < rest.size() && is_delimiter(rest[next]))
+        ++next;
+
+    std::string_view const field = rest.substr(start, end - start);
+    rest.remove_prefix(next);
+    return field;
+}
+
+/*! \brief Remove the next field delimited by spaces or tabs, as with takeField().
+ */
+inline std::string_view takeField(std::string_view& rest) {
+    return takeField(rest, [](char c) { return c == ' ' || c == '\t'; });
+}
+
+/*! \brief Remove the next field delimited by any of the given characters, as with takeField().
+ */
+inline std::string_view takeField(std::string_view& rest, std::string_view delimiters) {
+    return takeField(rest, [delimiters](char c) { return delimiters.find(c) != std::string_view::npos; });
+}
+
+/*! \brief The fields of some text, split on any run of the delimiters, as views into it.
+ *         Used to walk the lists which records below keep as a single view, e.g.
+ *         BrewListedVersions::versions.
+ */
+class FieldView {
+public:
+    class Iterator {
+    private:
+        std::string_view rest_{};
+        std::string_view delimiters_{};
+        std::string_view field_{};
+
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = std::string_view;
+        using difference_type = std::ptrdiff_t;
+        using pointer = void;
+        using reference = std::string_view;
+
+    public:
+        Iterator() = default;
+        Iterator(std::string_view, std::string_view);
+
+    public:
+        std::string_view operator*() const;
+        Iterator& operator++();
+        Iterator operator++(int);
+        bool operator==(Iterator const&) const;
+    };
+
+private:
+    std::string_view text_;
+    std::string_view delimiters_;
+
+public:
+    explicit FieldView(std::string_view text, std::string_view delimiters = " \t")
+        : text_(text), delimiters_(delimiters){};
+
+public:
+    Iterator begin() const;
+    Iterator end() const;
+};
+
+inline FieldView::Iterator::Iterator(std::string_view text, std::string_view delimiters)
+    : rest_(text), delimiters_(delimiters) {
+    field_ = takeField(rest_, delimiters_);
+}
+
+inline std::string_view FieldView::Iterator::operator*() const {
+    return field_;
+}
+
+inline FieldView::Iterator& FieldView::Iterator::operator++() {
+    field_ = takeField(rest_, delimiters_);
+    return *this;
+}
+
+inline FieldView::Iterator FieldView::Iterator::operator++(int) {
+    Iterator const previous = *this;
+    ++*this;
+    return previous;
+}
+
+inline bool FieldView::Iterator::operator==(Iterator const& other) const {
+    return field_.data() == other.field_.data() && field_.size() == other.field_.size();
+}
+
+inline FieldView::Iterator FieldView::begin() const {
+    return {text_, delimiters_};
+}
+
+inline FieldView::Iterator FieldView::end() const {
+    return {text_.substr(text_.size()), delimiters_};
+}
+
+/*! \brief Remove leading and trailing spaces and tabs.
+ */
+inline std::string_view trimSpace(std::string_view text) {
+    while (!text.empty() && (text.front() == ' ' || text.front() == '\t'))
+        text.remove_prefix(1);
+    while (!text.empty() && (text.back() == ' ' || text.back() == '\t'))
+        text.remove_suffix(1);
+    return text;
+}
+
+} // namespace BarrelCmd
+
+/*! \brief An installed formula or cask, as listed by `brew list --versions`.
+ */
+struct BrewListedVersions {
+    std::string_view name{};
+    std::string_view versions{}; /*!< Installed versions, separated by spaces */
+};
+
+/*! \brief An outdated formula or cask, as listed by `brew outdated`. Only the name is
+ *         printed without `--verbose`.
+ */
+struct BrewOutdated {
+    std::string_view name{};
+    std::string_view installed{}; /*!< Installed versions, separated by ", " */
+    std::string_view current{};   /*!< The version available */
+    std::string_view pinned{};    /*!< The version it is pinned at, empty if not pinned */
+};
+
+/*! \brief A node of the dependency trees printed by `brew deps --tree`, which are kept in
+ *         the order they are printed in (i.e. depth-first).
+ */
+struct BrewTreeNode {
+    std::string_view name{};
+    std::string_view annotation{}; /*!< Whatever follows the name, e.g. "[build]" with `--annotate` */
+    std::size_t depth{0};          /*!< 0 for a root */
+    std::ptrdiff_t parent{-1};     /*!< Index of the parent node, -1 for a root */
+};
+
+/*! \brief A setting printed by `brew config` or `brew --env`.
+ */
+struct BrewSetting {
+    std::string_view key{};
+    std::string_view value{};
+};
+
+/*! \brief A tap, as described by `brew tap-info`.
+ */
+struct BrewTapInfo {
+    std::string_view name{};
+    std::string_view contents{}; /*!< E.g. "2 commands, 7000 formulae", or "Not installed" */
+    std::string_view path{};
+    std::string_view remote{};
+    std::string_view head{};
+    std::string_view last_commit{};
+    std::string_view branch{}; /*!< Only printed when not the default branch */
+
+    bool isInstalled() const {
+        return !path.empty();
+    }
+};
+
+/*! \brief Parsers for the plain text printed by common Homebrew commands.
+ *
+ *  Each counts the lines of the output, then makes a single pass over them, and allocates
+ *  only the vector it returns, once.
+ *  Every string in the records is a view into the output, which must outlive them. Lines
+ *  which don't fit the expected format are skipped.
+ *
+ *  \code{.cpp}
+ *  using BrewCommandType::Builtin;
+ *  BrewCommand<Builtin> outdated(brew, Builtin::OUTDATED, "--verbose");
+ *  outdated.execute(BarrelCmd::Stream::STDOUT);
+ *
+ *  for (BrewOutdated const& formula : BrewParse::outdated(outdated.getStreamView()))
+ *      std::cout << formula.name << ' ' << formula.installed << " -> " << formula.current << '\n';
+ *  \endcode
+ */
+namespace BrewParse {
+
+/*! \brief Parse the output of `brew list --versions` (for formulae or casks).
+ */
+inline std::vector<BrewListedVersions> listVersions(std::string_view output) {
+    std::vector<BrewListedVersions> entries;
+    entries.reserve(BarrelCmd::LineView(output).count());
+    for (std::string_view line : BarrelCmd::LineView(output)) {
+        std::string_view const name = BarrelCmd::takeField(line);
+        if (!name.empty())
+            entries.push_back({name, BarrelCmd::trimSpace(line)});
+    }
+    return entries;
+}
+
+/*! \brief Parse the output of `brew outdated`, with or without `--verbose`. Formulae print
+ *         as "name (1.0) < 1.1", pinned ones with " [pinned at 1.0]", casks as
+ *         "name (1.0) != 1.1".
+ */
+inline std::vector<BrewOutdated> outdated(std::string_view output) {
+    std::vector<BrewOutdated> entries;
+    entries.reserve(BarrelCmd::LineView(output).count());
+    for (std::string_view line : BarrelCmd::LineView(output)) {
+        BrewOutdated entry;
+        entry.name = BarrelCmd::takeField(line);
+        if (entry.name.empty())
+            continue;
+
+        if (line.starts_with('(')) {
+            std::size_t const close = line.find(')');
+            if (close == std::string_view::npos)
+                continue;
+            entry.installed = line.substr(1, close - 1);
+            line.remove_prefix(close + 1);
+        }
+        std::string_view const comparison = BarrelCmd::takeField(line);
+        if (comparison == "<" || comparison == "!=")
+            entry.current = BarrelCmd::takeField(line);
+
+        std::size_t const pin = line.find("[pinned at ");
+        if (pin != std::string_view::npos) {
+            std::string_view pinned = line.substr(pin + std::strlen("[pinned at "));
+            entry.pinned = pinned.substr(0, std::min(pinned.find(']'), pinned.size()));
+        }
+        entries.push_back(entry);
+    }
+    return entries;
+}
+
+/*! \brief Parse the output of `brew leaves`, or any other list of one name per line.
+ */
+inline std::vector<std::string_view> leaves(std::string_view output) {
+    std::vector<std::string_view> names;
+    names.reserve(BarrelCmd::LineView(output).count());
+    for (std::string_view const line : BarrelCmd::LineView(output)) {
+        std::string_view const name = BarrelCmd::trimSpace(line);
+        if (!name.empty())
+            names.push_back(name);
+    }
+    return names;
+}
+
+/*! \brief Parse the output of `brew deps --tree`, for any number of formulae. Each level
+ *         of nesting is drawn four columns wide ("├── ", "│   "...), which is how depth is
+ *         told, whether the tree is drawn in box-drawing characters or in ASCII.
+ */
+inline std::vector<BrewTreeNode> depsTree(std::string_view output) {
+    std::vector<BrewTreeNode> nodes;
+    nodes.reserve(BarrelCmd::LineView(output).count());
+    std::vector<std::size_t> ancestors; // Index of the last node seen at each depth
+    for (std::string_view const line : BarrelCmd::LineView(output)) {
+        // The name starts at the first letter or digit; everything before it is drawing
+        std::size_t start = 0;
+        std::size_t columns = 0;
+        for (; start < line.size(); ++start) {
+            auto const byte = static_cast<unsigned char>(line[start]);
+            if (std::isalnum(byte) || byte == '@' || byte == '_')
+                break;
+            if ((byte & 0xc0) != 0x80) // Not a UTF-8 continuation byte
+                ++columns;
+        }
+        if (start == line.size())
+            continue;
+
+        std::string_view rest = line.substr(start);
+        BrewTreeNode node;
+        node.name = BarrelCmd::takeField(rest);
+        node.annotation = BarrelCmd::trimSpace(rest);
+        node.depth = std::min(columns / 4, ancestors.size());
+        if (node.depth > 0)
+            node.parent = static_cast<std::ptrdiff_t>(ancestors[node.depth - 1]);
+
+        ancestors.resize(node.depth);
+        ancestors.push_back(nodes.size());
+        nodes.push_back(node);
+    }
+    return nodes;
+}
+
+/*! \brief Parse the output of `brew config`, i.e. "Key: value" lines.
+ */
+inline std::vector<BrewSetting> config(std::string_view output) {
+    std::vector<BrewSetting> settings;
+    settings.reserve(BarrelCmd::LineView(output).count());
+    for (std::string_view const line : BarrelCmd::LineView(output)) {
+        std::size_t const colon = line.find(':');
+        if (colon == std::string_view::npos || colon == 0)
+            continue;
+        settings.push_back({line.substr(0, colon), BarrelCmd::trimSpace(line.substr(colon + 1))});
+    }
+    return settings;
+}
+
+/*! \brief Parse the output of `brew --env`: "KEY: value" lines, or the `export KEY="value"`
+ *         and `set -gx KEY "value"` lines of `--shell`. Values are kept as printed, less
+ *         the quotes around them.
+ */
+inline std::vector<BrewSetting> env(std::string_view output) {
+    std::vector<BrewSetting> settings;
+    settings.reserve(BarrelCmd::LineView(output).count());
+    for (std::string_view line : BarrelCmd::LineView(output)) {
+        BrewSetting setting;
+        if (line.starts_with("export ")) {
+            line.remove_prefix(std::strlen("export "));
+            std::size_t const equals = line.find('=');
+            if (equals == std::string_view::npos)
+                continue;
+            setting = {line.substr(0, equals), line.substr(equals + 1)};
+        } else if (line.starts_with("set -gx ")) {
+            line.remove_prefix(std::strlen("set -gx "));
+            setting.key = BarrelCmd::takeField(line);
+            setting.value = BarrelCmd::trimSpace(line);
+        } else {
+            std::size_t const colon = line.find(": ");
+            if (colon == std::string_view::npos)
+                continue;
+            setting = {line.substr(0, colon), BarrelCmd::trimSpace(line.substr(colon + 2))};
+        }
+
+        if (setting.value.size() >= 2 && setting.value.front() == '"' && setting.value.back() == '"')
+            setting.value = setting.value.substr(1, setting.value.size() - 2);
+        if (!setting.key.empty())
+            settings.push_back(setting);
+    }
+    return settings;
+}
+
+/*! \brief Parse the output of `brew tap-info`, for one or more taps. The summary printed
+ *         when no tap is named yields no records.
+ */
+inline std::vector<BrewTapInfo> tapInfo(std::string_view output) {
+    std::vector<BrewTapInfo> taps;
+    for (std::string_view const line : BarrelCmd::LineView(output)) {
+        std::size_t const colon = line.find(": ");
+        bool const keyed = colon != std::string_view::npos;
+        std::string_view const key = keyed ? line.substr(0, colon) : std::string_view();
+        std::string_view const value = keyed ? line.substr(colon + 2) : line;
+
+        // A record starts with "user/repo: ..."; its other lines name no tap
+        if (key.find('/') != std::string_view::npos && !key.starts_with('/')) {
+            taps.push_back({key, value});
+            continue;
+        }
+        if (taps.empty())
+            continue;
+
+        BrewTapInfo& tap = taps.back();
+        if (line.starts_with('/'))
+            tap.path = line.substr(0, std::min(line.find(" ("), line.size()));
+        else if (key == "From")
+            tap.remote = value;
+        else if (key == "HEAD")
+            tap.head = value;
+        else if (key == "last commit")
+            tap.last_commit = value;
+        else if (key == "branch")
+            tap.branch = value;
+    }
+    return taps;
+}
+
+} // namespace BrewParse
+
+#endif
@@ -25,8 +25,14 @@
 #ifndef TYPES_H__
 #define TYPES_H__
 
+#include "utils.h"
+
+#include <array>
+#include <cstddef>
+#include <stdexcept>
 #include <string>
-#include <unordered_map>
+#include <string_view>
+#include <type_traits>
 
 using namespace std::string_literals; // TYPES_H__001
 
@@ -89,6 +95,7 @@ enum class BrewCommandType::Builtin {
     REINSTALL,
     SEARCH,
     SHELLENV,
+    TAB,
     TAP,
     TAP_INFO,
     UNINSTALL,
@@ -101,6 +108,7 @@ enum class BrewCommandType::Builtin {
     UPGRADE,
     USES,
     VENDOR_INSTALL,
+    COUNT_, /*!< Not a command; one past the last */
 };
 
 /*! \brief Enumeration of built-in developer commands.
@@ -147,6 +155,7 @@ enum class BrewCommandType::BuiltinDev {
     UPDATE_PYTHON_RESOURCES,
     UPDATE_TEST,
     VENDOR_GEMS,
+    COUNT_, /*!< Not a command; one past the last */
 };
 
 /*! \brief Enumeration of external commands.
@@ -155,156 +164,246 @@ enum class BrewCommandType::External {
     ASPELL_DICTIONARIES = 0x1,
     DETERMINE_REBOTTLE_RUNNERS,
     POSTGRESQL_UPGRADE_DATABASE,
+    COUNT_, /*!< Not a command; one past the last */
 };
 
 // clang-format on
 
-/*! \brief A (namespace-like) type that declares mappings of Homebrew commands
- *         to command "heads".
+/*! \brief Enumeration of the ways a command may be scheduled alongside other commands
+ *         targeting the same Homebrew installation.
+ */
+enum class BrewLockClass {
+    SHARED,    /*!< Read-only; may run in parallel with any other command */
+    EXCLUSIVE, /*!< Mutates the installation (Cellar, Caskroom, taps, caches, ...); runs one at a time */
+};
+
+/*! \brief Properties of a Homebrew command, known at compile time.
+ */
+namespace BrewCommandFlag {
+inline constexpr unsigned NONE = 0;
+inline constexpr unsigned READ_ONLY = 1u << 0;    /*!< Never mutates the installation \sa BrewLockClass */
+inline constexpr unsigned JSON = 1u << 1;         /*!< Can print its output as JSON (`--json`) */
+inline constexpr unsigned FORMULA_ARGS = 1u << 2; /*!< Takes formula or cask names as arguments */
+inline constexpr unsigned CACHEABLE = 1u << 3;    /*!< Output depends on the installation's state alone */
+} // namespace BrewCommandFlag
+
+/*! \brief An entry of a command table: a command, its "head", and its ::BrewCommandFlag set.
  *
- * A command "head" is string representation of the first word of a Homebrew command.
- * For example, in `brew --cache`, `"--cache"` is the command head.
+ *  A command "head" is string representation of the first word of a Homebrew command.
+ *  For example, in `brew --cache`, `"--cache"` is the command head.
  */
-struct BrewCommandHead {
-    static std::unordered_map<BrewCommandType::Builtin, std::string> const Builtin;
-    static std::unordered_map<BrewCommandType::BuiltinDev, std::string> const BuiltinDev;
-    static std::unordered_map<BrewCommandType::External, std::string> const External;
+template <EnumType E>
+struct BrewCommandInfo {
+    E cmd;
+    std::string_view head;
+    unsigned flags;
+
+    constexpr bool has(unsigned flag) const {
+        return (flags & flag) == flag;
+    }
 };
 
 // clang-format off
 
-/*! \brief Mapping of built-in commands to their respective command heads.
- *         \sa BrewCommandType::Builtin, BrewCommandHead
+/*! \brief Command tables, each indexed by its enumeration (whose enumerators start at 1).
+ *         \sa BrewCommandType, getCommandInfo()
  */
-std::unordered_map<BrewCommandType::Builtin, std::string> const BrewCommandHead::Builtin {
-    { BrewCommandType::Builtin::CACHE,                          "--cache"s },
-    { BrewCommandType::Builtin::CASKROOM,                       "--caskroom"s },
-    { BrewCommandType::Builtin::CELLAR,                         "--cellar"s },
-    { BrewCommandType::Builtin::ENV,                            "--env"s },
-    { BrewCommandType::Builtin::PREFIX,                         "--prefix"s },
-    { BrewCommandType::Builtin::REPOSITORY,                     "--repository"s },
-    { BrewCommandType::Builtin::VERSION,                        "--version"s },
-    { BrewCommandType::Builtin::ANALYTICS,                      "analytics"s },
-    { BrewCommandType::Builtin::AUTOREMOVE,                     "autoremove"s },
-    { BrewCommandType::Builtin::CASKS,                          "casks"s },
-    { BrewCommandType::Builtin::CLEANUP,                        "cleanup"s },
-    { BrewCommandType::Builtin::COMMANDS,                       "commands"s },
-    { BrewCommandType::Builtin::COMPLETIONS,                    "completions"s },
-    { BrewCommandType::Builtin::CONFIG,                         "config"s },
-    { BrewCommandType::Builtin::DEPS,                           "deps"s },
-    { BrewCommandType::Builtin::DESC,                           "desc"s },
-    { BrewCommandType::Builtin::DEVELOPER,                      "developer"s },
-    { BrewCommandType::Builtin::DOCTOR,                         "doctor"s },
-    { BrewCommandType::Builtin::FETCH,                          "fetch"s },
-    { BrewCommandType::Builtin::FORMULAE,                       "formulae"s },
-    { BrewCommandType::Builtin::GIST_LOGS,                      "gist-logs"s },
-    { BrewCommandType::Builtin::HELP,                           "help"s },
-    { BrewCommandType::Builtin::HOME,                           "home"s },
-    { BrewCommandType::Builtin::INFO,                           "info"s },
-    { BrewCommandType::Builtin::INSTALL,                        "install"s },
-    { BrewCommandType::Builtin::LEAVES,                         "leaves"s },
-    { BrewCommandType::Builtin::LINK,                           "link"s },
-    { BrewCommandType::Builtin::LIST,                           "list"s },
-    { BrewCommandType::Builtin::LOG,                            "logv"s },
-    { BrewCommandType::Builtin::MIGRATE,                        "migrate"s },
-    { BrewCommandType::Builtin::MISSING,                        "missing"s },
-    { BrewCommandType::Builtin::OPTIONS,                        "options"s },
-    { BrewCommandType::Builtin::OUTDATED,                       "outdated"s },
-    { BrewCommandType::Builtin::PIN,                            "pin"s },
-    { BrewCommandType::Builtin::POSTINSTALL,                    "postinstall"s },
-    { BrewCommandType::Builtin::READALL,                        "readall"s },
-    { BrewCommandType::Builtin::REINSTALL,                      "reinstall"s },
-    { BrewCommandType::Builtin::SEARCH,                         "search"s },
-    { BrewCommandType::Builtin::SHELLENV,                       "shellenv"s },
-    { BrewCommandType::Builtin::TAP,                            "tap"s },
-    { BrewCommandType::Builtin::TAP_INFO,                       "tap-info"s },
-    { BrewCommandType::Builtin::UNINSTALL,                      "uninstall"s },
-    { BrewCommandType::Builtin::UNLINK,                         "unlink"s },
-    { BrewCommandType::Builtin::UNPIN,                          "unpin"s },
-    { BrewCommandType::Builtin::UNTAP,                          "untap"s },
-    { BrewCommandType::Builtin::UPDATE,                         "update"s },
-    { BrewCommandType::Builtin::UPDATE_REPORT,                  "update-report"s },
-    { BrewCommandType::Builtin::UPDATE_RESET,                   "update-reset"s },
-    { BrewCommandType::Builtin::UPGRADE,                        "upgrade"s },
-    { BrewCommandType::Builtin::USES,                           "uses"s },
-    { BrewCommandType::Builtin::VENDOR_INSTALL,                 "vendor-install"s },
-};
+namespace BrewCommandHead {
+using namespace std::string_view_literals;
 
-/*! \brief Mapping of built-in developer commands to their respective command heads.
- *         \sa BrewCommandType::BuiltinDev, BrewCommandHead
+/*! \brief Table of built-in commands.
  */
-std::unordered_map<BrewCommandType::BuiltinDev, std::string> const BrewCommandHead::BuiltinDev {
-    { BrewCommandType::BuiltinDev::AUDIT,                       "audit"s },
-    { BrewCommandType::BuiltinDev::BOTTLE,                      "bottle"s },
-    { BrewCommandType::BuiltinDev::BUMP,                        "bump"s },
-    { BrewCommandType::BuiltinDev::BUMP_CASK_PR,                "bump-cask-pr"s },
-    { BrewCommandType::BuiltinDev::BUMP_FORMULA_PR,             "bump-formula-pr"s },
-    { BrewCommandType::BuiltinDev::BUMP_REVISION,               "bump-revision"s },
-    { BrewCommandType::BuiltinDev::BUMP_UNVERSIONED_CASKS,      "bump-unversioned-casks"s },
-    { BrewCommandType::BuiltinDev::CAT,                         "cat"s },
-    { BrewCommandType::BuiltinDev::COMMAND,                     "command"s },
-    { BrewCommandType::BuiltinDev::CREATE,                      "create"s },
-    { BrewCommandType::BuiltinDev::DISPATCH_BUILD_BOTTLE,       "dispatch-build-bottle"s },
-    { BrewCommandType::BuiltinDev::EDIT,                        "edit"s },
-    { BrewCommandType::BuiltinDev::EXTRACT,                     "extract"s },
-    { BrewCommandType::BuiltinDev::FORMULA,                     "formula"s },
-    { BrewCommandType::BuiltinDev::GENERATE_MAN_COMPLETIONS,    "generate-man-completions"s },
-    { BrewCommandType::BuiltinDev::INSTALL_BUNDLER_GEMS,        "install-bundler-gems"s },
-    { BrewCommandType::BuiltinDev::IRB,                         "irb"s },
-    { BrewCommandType::BuiltinDev::LINKAGE,                     "linkage"s },
-    { BrewCommandType::BuiltinDev::LIVECHECK,                   "livecheck"s },
-    { BrewCommandType::BuiltinDev::PR_AUTOMERGE,                "pr-automerge"s },
-    { BrewCommandType::BuiltinDev::PR_PUBLISH,                  "pr-publish"s },
-    { BrewCommandType::BuiltinDev::PR_PULL,                     "pr-pull"s },
-    { BrewCommandType::BuiltinDev::PR_UPLOAD,                   "pr-upload"s },
-    { BrewCommandType::BuiltinDev::PROF,                        "prof"s },
-    { BrewCommandType::BuiltinDev::RELEASE,                     "release"s },
-    { BrewCommandType::BuiltinDev::RUBOCOP,                     "rubocop"s },
-    { BrewCommandType::BuiltinDev::RUBY,                        "ruby"s },
-    { BrewCommandType::BuiltinDev::SH,                          "sh"s },
-    { BrewCommandType::BuiltinDev::SPONSORS,                    "sponsors"s },
-    { BrewCommandType::BuiltinDev::STYLE,                       "style"s },
-    { BrewCommandType::BuiltinDev::TAP_NEW,                     "tap-new"s },
-    { BrewCommandType::BuiltinDev::TEST,                        "test"s },
-    { BrewCommandType::BuiltinDev::TESTS,                       "tests"s },
-    { BrewCommandType::BuiltinDev::TYPECHECK,                   "typecheck"s },
-    { BrewCommandType::BuiltinDev::UNBOTTLED,                   "unbottled"s },
-    { BrewCommandType::BuiltinDev::UNPACK,                      "unpack"s },
-    { BrewCommandType::BuiltinDev::UPDATE_LICENSE_DATA,         "update-license-data"s },
-    { BrewCommandType::BuiltinDev::UPDATE_MAINTAINERS,          "update-maintainers"s },
-    { BrewCommandType::BuiltinDev::UPDATE_PYTHON_RESOURCES,     "update-python-resources"s },
-    { BrewCommandType::BuiltinDev::UPDATE_TEST,                 "update-test"s },
-    { BrewCommandType::BuiltinDev::VENDOR_GEMS,                 "vendor-gems"s },
-};
+inline constexpr auto Builtin = [] {
+    using enum BrewCommandType::Builtin;
+    using namespace BrewCommandFlag;
+    return std::to_array<BrewCommandInfo<BrewCommandType::Builtin>>({
+        { CACHE,          "--cache"sv,        READ_ONLY | FORMULA_ARGS | CACHEABLE },
+        { CASKROOM,       "--caskroom"sv,     READ_ONLY | FORMULA_ARGS | CACHEABLE },
+        { CELLAR,         "--cellar"sv,       READ_ONLY | FORMULA_ARGS | CACHEABLE },
+        { ENV,            "--env"sv,          READ_ONLY | FORMULA_ARGS },
+        { PREFIX,         "--prefix"sv,       READ_ONLY | FORMULA_ARGS | CACHEABLE },
+        { REPOSITORY,     "--repository"sv,   READ_ONLY | CACHEABLE },
+        { VERSION,        "--version"sv,      READ_ONLY | CACHEABLE },
+        { ANALYTICS,      "analytics"sv,      NONE },
+        { AUTOREMOVE,     "autoremove"sv,     NONE },
+        { CASKS,          "casks"sv,          READ_ONLY },
+        { CLEANUP,        "cleanup"sv,        FORMULA_ARGS },
+        { COMMANDS,       "commands"sv,       READ_ONLY | CACHEABLE },
+        { COMPLETIONS,    "completions"sv,    NONE },
+        { CONFIG,         "config"sv,         READ_ONLY },
+        { DEPS,           "deps"sv,           READ_ONLY | FORMULA_ARGS | CACHEABLE },
+        { DESC,           "desc"sv,           READ_ONLY | FORMULA_ARGS | CACHEABLE },
+        { DEVELOPER,      "developer"sv,      NONE },
+        { DOCTOR,         "doctor"sv,         READ_ONLY },
+        { FETCH,          "fetch"sv,          FORMULA_ARGS },
+        { FORMULAE,       "formulae"sv,       READ_ONLY },
+        { GIST_LOGS,      "gist-logs"sv,      FORMULA_ARGS },
+        { HELP,           "help"sv,           READ_ONLY },
+        { HOME,           "home"sv,           READ_ONLY | FORMULA_ARGS },
+        { INFO,           "info"sv,           READ_ONLY | JSON | FORMULA_ARGS | CACHEABLE },
+        { INSTALL,        "install"sv,        FORMULA_ARGS },
+        { LEAVES,         "leaves"sv,         READ_ONLY | CACHEABLE },
+        { LINK,           "link"sv,           FORMULA_ARGS },
+        { LIST,           "list"sv,           READ_ONLY | FORMULA_ARGS | CACHEABLE },
+        { LOG,            "log"sv,            READ_ONLY | FORMULA_ARGS },
+        { MIGRATE,        "migrate"sv,        FORMULA_ARGS },
+        { MISSING,        "missing"sv,        READ_ONLY | FORMULA_ARGS },
+        { OPTIONS,        "options"sv,        READ_ONLY | FORMULA_ARGS | CACHEABLE },
+        { OUTDATED,       "outdated"sv,       READ_ONLY | JSON | FORMULA_ARGS | CACHEABLE },
+        { PIN,            "pin"sv,            FORMULA_ARGS },
+        { POSTINSTALL,    "postinstall"sv,    FORMULA_ARGS },
+        { READALL,        "readall"sv,        READ_ONLY },
+        { REINSTALL,      "reinstall"sv,      FORMULA_ARGS },
+        { SEARCH,         "search"sv,         READ_ONLY },
+        { SHELLENV,       "shellenv"sv,       READ_ONLY },
+        { TAB,            "tab"sv,            FORMULA_ARGS },
+        { TAP,            "tap"sv,            NONE },
+        { TAP_INFO,       "tap-info"sv,       READ_ONLY | JSON | CACHEABLE },
+        { UNINSTALL,      "uninstall"sv,      FORMULA_ARGS },
+        { UNLINK,         "unlink"sv,         FORMULA_ARGS },
+        { UNPIN,          "unpin"sv,          FORMULA_ARGS },
+        { UNTAP,          "untap"sv,          NONE },
+        { UPDATE,         "update"sv,         NONE },
+        { UPDATE_REPORT,  "update-report"sv,  NONE },
+        { UPDATE_RESET,   "update-reset"sv,   NONE },
+        { UPGRADE,        "upgrade"sv,        FORMULA_ARGS },
+        { USES,           "uses"sv,           READ_ONLY | FORMULA_ARGS | CACHEABLE },
+        { VENDOR_INSTALL, "vendor-install"sv, NONE },
+    });
+}();
 
-/*! \brief Mapping of external commands to their respective command heads.
- *         \sa BrewCommandType::External, BrewCommandHead
+/*! \brief Table of built-in developer commands.
  */
-std::unordered_map<BrewCommandType::External, std::string> const BrewCommandHead::External {
-    { BrewCommandType::External::ASPELL_DICTIONARIES,           "aspell-dictionaries"s },
-    { BrewCommandType::External::DETERMINE_REBOTTLE_RUNNERS,    "determine-rebottle-runners"s },
-    { BrewCommandType::External::POSTGRESQL_UPGRADE_DATABASE,   "postgresql-upgrade-database"s },
-};
+inline constexpr auto BuiltinDev = [] {
+    using enum BrewCommandType::BuiltinDev;
+    using namespace BrewCommandFlag;
+    return std::to_array<BrewCommandInfo<BrewCommandType::BuiltinDev>>({
+        { AUDIT,                    "audit"sv,                    FORMULA_ARGS },
+        { BOTTLE,                   "bottle"sv,                   JSON | FORMULA_ARGS },
+        { BUMP,                     "bump"sv,                     FORMULA_ARGS },
+        { BUMP_CASK_PR,             "bump-cask-pr"sv,             FORMULA_ARGS },
+        { BUMP_FORMULA_PR,          "bump-formula-pr"sv,          FORMULA_ARGS },
+        { BUMP_REVISION,            "bump-revision"sv,            FORMULA_ARGS },
+        { BUMP_UNVERSIONED_CASKS,   "bump-unversioned-casks"sv,   FORMULA_ARGS },
+        { CAT,                      "cat"sv,                      READ_ONLY | FORMULA_ARGS },
+        { COMMAND,                  "command"sv,                  READ_ONLY },
+        { CREATE,                   "create"sv,                   NONE },
+        { DISPATCH_BUILD_BOTTLE,    "dispatch-build-bottle"sv,    FORMULA_ARGS },
+        { EDIT,                     "edit"sv,                     FORMULA_ARGS },
+        { EXTRACT,                  "extract"sv,                  FORMULA_ARGS },
+        { FORMULA,                  "formula"sv,                  READ_ONLY | FORMULA_ARGS },
+        { GENERATE_MAN_COMPLETIONS, "generate-man-completions"sv, NONE },
+        { INSTALL_BUNDLER_GEMS,     "install-bundler-gems"sv,     NONE },
+        { IRB,                      "irb"sv,                      NONE },
+        { LINKAGE,                  "linkage"sv,                  FORMULA_ARGS },
+        { LIVECHECK,                "livecheck"sv,                READ_ONLY | JSON | FORMULA_ARGS },
+        { PR_AUTOMERGE,             "pr-automerge"sv,             NONE },
+        { PR_PUBLISH,               "pr-publish"sv,               NONE },
+        { PR_PULL,                  "pr-pull"sv,                  NONE },
+        { PR_UPLOAD,                "pr-upload"sv,                NONE },
+        { PROF,                     "prof"sv,                     NONE },
+        { RELEASE,                  "release"sv,                  NONE },
+        { RUBOCOP,                  "rubocop"sv,                  NONE },
+        { RUBY,                     "ruby"sv,                     NONE },
+        { SH,                       "sh"sv,                       NONE },
+        { SPONSORS,                 "sponsors"sv,                 NONE },
+        { STYLE,                    "style"sv,                    FORMULA_ARGS },
+        { TAP_NEW,                  "tap-new"sv,                  NONE },
+        { TEST,                     "test"sv,                     FORMULA_ARGS },
+        { TESTS,                    "tests"sv,                    NONE },
+        { TYPECHECK,                "typecheck"sv,                NONE },
+        { UNBOTTLED,                "unbottled"sv,                FORMULA_ARGS },
+        { UNPACK,                   "unpack"sv,                   FORMULA_ARGS },
+        { UPDATE_LICENSE_DATA,      "update-license-data"sv,      NONE },
+        { UPDATE_MAINTAINERS,       "update-maintainers"sv,       NONE },
+        { UPDATE_PYTHON_RESOURCES,  "update-python-resources"sv,  FORMULA_ARGS },
+        { UPDATE_TEST,              "update-test"sv,              NONE },
+        { VENDOR_GEMS,              "vendor-gems"sv,              NONE },
+    });
+}();
+
+/*! \brief Table of external commands.
+ */
+inline constexpr auto External = [] {
+    using enum BrewCommandType::External;
+    using namespace BrewCommandFlag;
+    return std::to_array<BrewCommandInfo<BrewCommandType::External>>({
+        { ASPELL_DICTIONARIES,         "aspell-dictionaries"sv,         NONE },
+        { DETERMINE_REBOTTLE_RUNNERS,  "determine-rebottle-runners"sv,  NONE },
+        { POSTGRESQL_UPGRADE_DATABASE, "postgresql-upgrade-database"sv, NONE },
+    });
+}();
+} // namespace BrewCommandHead
 
 // clang-format on
 
-template <typename T>
-inline auto getCommandHead(T key) {
+/*! \brief Whether every enumerator of a command type, up to its `COUNT_` sentinel, maps in
+ *         order to its own entry of a table.
+ */
+template <EnumType E, std::size_t N>
+consteval bool isCompleteTable(std::array<BrewCommandInfo<E>, N> const& table) {
+    if (N + 1 != static_cast<std::size_t>(enumUnderlyingType(E::COUNT_)))
+        return false;
+    for (std::size_t idx = 0; idx < N; ++idx) {
+        if (static_cast<std::size_t>(enumUnderlyingType(table[idx].cmd)) != idx + 1)
+            return false;
+        if (table[idx].head.empty())
+            return false;
+        // Only a read-only command can be served from a cache
+        if (table[idx].has(BrewCommandFlag::CACHEABLE) && !table[idx].has(BrewCommandFlag::READ_ONLY))
+            return false;
+    }
+    return true;
 }
 
-template <>
-inline auto getCommandHead<BrewCommandType::Builtin>(BrewCommandType::Builtin key) {
-    return BrewCommandHead::Builtin.at(key);
+static_assert(isCompleteTable(BrewCommandHead::Builtin),
+              "BrewCommandHead::Builtin must map every BrewCommandType::Builtin, in order");
+static_assert(isCompleteTable(BrewCommandHead::BuiltinDev),
+              "BrewCommandHead::BuiltinDev must map every BrewCommandType::BuiltinDev, in order");
+static_assert(isCompleteTable(BrewCommandHead::External),
+              "BrewCommandHead::External must map every BrewCommandType::External, in order");
+
+/*! \brief Look up the entry of a command in its table.
+ *
+ *  \throws std::out_of_range If the key isn't a command (such as `COUNT_`, or a value cast
+ *          to the enumeration)
+ */
+template <EnumType E>
+constexpr BrewCommandInfo<E> const& getCommandInfo(E key) {
+    std::size_t const idx = static_cast<std::size_t>(enumUnderlyingType(key)) - 1;
+    if constexpr (std::is_same_v<E, BrewCommandType::Builtin>)
+        return BrewCommandHead::Builtin.at(idx);
+    else if constexpr (std::is_same_v<E, BrewCommandType::BuiltinDev>)
+        return BrewCommandHead::BuiltinDev.at(idx);
+    else {
+        static_assert(std::is_same_v<E, BrewCommandType::External>, "Not a Homebrew command type");
+        return BrewCommandHead::External.at(idx);
+    }
 }
 
-template <>
-inline auto getCommandHead<BrewCommandType::BuiltinDev>(BrewCommandType::BuiltinDev key) {
-    return BrewCommandHead::BuiltinDev.at(key);
+template <EnumType E>
+constexpr std::string_view getCommandHead(E key) {
+    return getCommandInfo(key).head;
 }
 
-template <>
-inline auto getCommandHead<BrewCommandType::External>(BrewCommandType::External key) {
-    return BrewCommandHead::External.at(key);
+template <EnumType E>
+constexpr BrewLockClass getLockClass(E key) {
+    return getCommandInfo(key).has(BrewCommandFlag::READ_ONLY) ? BrewLockClass::SHARED
+                                                               : BrewLockClass::EXCLUSIVE;
+}
+
+/*! \brief Whether a command can print its output as JSON.
+ */
+template <EnumType E>
+constexpr bool isJsonCapable(E key) {
+    return getCommandInfo(key).has(BrewCommandFlag::JSON);
+}
+
+/*! \brief Whether a command takes formula or cask names as arguments.
+ */
+template <EnumType E>
+constexpr bool acceptsFormulae(E key) {
+    return getCommandInfo(key).has(BrewCommandFlag::FORMULA_ARGS);
 }
 
 #endif
\ No newline at end of file
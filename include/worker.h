@@ -0,0 +1,444 @@
+/*!
+ * This file is part of Barrel, a header-only C++ library that provides
+ * programmatic access to the Homebrew command line interface.
+ *
+ * Copyright (C) 2022 aydwi <contact@aydwi.com>
+ *
+ * Barrel is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*! \file  worker.h
+ *  \brief Execute Homebrew commands on a persistent, pre-booted Homebrew process.
+ */
+
+#ifndef WORKER_H__
+#define WORKER_H__
+
+#include "barrel.h"
+
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace std::string_literals;
+
+inline extern std::size_t const WORKER_READ_SZ{65536};
+
+// clang-format off
+
+/*! \brief Ruby driver run by the worker through `brew ruby -e`. It boots Homebrew once, then
+ *         serves each request from a fork of the already-booted interpreter.
+ *
+ *  Protocol (over the worker's stdin/stdout):
+ *  - Worker, once booted: `R\n`
+ *  - Request: `<argc>\n`, then `<length>\n<bytes>` for every argument
+ *  - Reply: any number of `O <length>\n<bytes>` (stdout) and `E <length>\n<bytes>` (stderr)
+ *    frames, in the order the output was produced, terminated by `X <exit status>\n`
+ */
+inline extern std::string const WORKER_DRIVER{R"RUBY(
+$stdout.binmode
+$stdout.sync = true
+$stdin.binmode
+$stdout.write("R\n")
+while (line = $stdin.gets)
+  args = Array.new(line.to_i) { $stdin.read($stdin.gets.to_i) }
+  out_r, out_w = IO.pipe
+  err_r, err_w = IO.pipe
+  pid = fork do
+    $stdin.reopen(File::NULL)
+    out_r.close
+    err_r.close
+    $stdout.reopen(out_w)
+    $stderr.reopen(err_w)
+    ARGV.replace(args)
+    load File.join(HOMEBREW_LIBRARY_PATH, "brew.rb")
+    exit 0
+  end
+  out_w.close
+  err_w.close
+  tags = { out_r => "O", err_r => "E" }
+  until tags.empty?
+    IO.select(tags.keys)[0].each do |io|
+      chunk = io.read_nonblock(65536, exception: false)
+      next if chunk == :wait_readable
+      if chunk.nil?
+        tags.delete(io)
+        io.close
+      else
+        $stdout.write("#{tags[io]} #{chunk.bytesize}\n", chunk)
+      end
+    end
+  end
+  Process.wait(pid)
+  $stdout.write("X #{$?.exitstatus || 128 + $?.termsig.to_i}\n")
+end
+)RUBY"s};
+
+// clang-format on
+
+/*! \brief A long-lived Homebrew process which executes commands without paying for
+ *         Homebrew's Ruby startup on every call.
+ *
+ *  The worker boots Homebrew once (through BrewCommandType::BuiltinDev::RUBY and
+ *  ::WORKER_DRIVER), then forwards each command to it over a pipe protocol and
+ *  demultiplexes the reply into the usual stream dump and exit status.
+ *
+ *  A worker which crashes, or which breaks the protocol (is poisoned), is torn down and
+ *  restarted transparently on the next command. A read-only command which never got a
+ *  reply is retried once on the fresh worker; any other command interrupted this way
+ *  reports `BAD_EXIT_ST`.
+ *
+ *  One worker executes one command at a time; use several workers for parallelism. Output
+ *  handlers set with BrewCommand::onChunk() / BrewCommand::onLine() are not invoked. A
+ *  command with a deadline or a cancellation token is executed in a process of its own
+ *  instead, since the worker can't be interrupted without losing its warm state. So is a
+ *  command whose environment differs from the worker's, i.e. from the BrewEnvProfile of the
+ *  ::Brew object the worker was constructed from.
+ */
+class BrewWorker {
+private:
+    BarrelCmd::Argv launch_argv_;
+    std::size_t max_requests_;
+    std::shared_ptr<BarrelCmd::Environment const> environment_{};
+
+private:
+    pid_t pid_{-1};
+    int channel_{-1};
+    std::string inbox_{};
+    std::size_t served_{0};
+    std::size_t boots_{0};
+    std::mutex mutex_{};
+
+private:
+    void start();
+    void stop();
+    bool send(BarrelCmd::Argv const&);
+    bool fill();
+    bool readLine(std::string&);
+    bool readExact(std::size_t, std::string&);
+
+    // Returns false if the worker died or broke the protocol; `replied` tells whether
+    // any part of a reply had been received by then
+    bool roundTrip(BarrelCmd::Argv const&, BarrelCmd::Stream, std::string&, std::string&, int&, bool&);
+
+public:
+    /*! \brief Constructor for BrewWorker, which boots the given Homebrew installation in
+     *         the environment of its BrewEnvProfile.
+     *
+     *  \param brew An object of type ::Brew
+     *  \param max_requests Recycle the worker after this many commands (0 for never)
+     */
+    explicit BrewWorker(Brew const&, std::size_t = 0);
+
+    /*! \brief Constructor for BrewWorker which launches the worker with a custom argument
+     *         vector, for example a stand-in `brew` speaking the same protocol.
+     *
+     *  \param launch_argv Argument vector which starts the worker
+     *  \param max_requests Recycle the worker after this many commands (0 for never)
+     */
+    explicit BrewWorker(BarrelCmd::Argv, std::size_t = 0);
+
+    BrewWorker(BrewWorker const&) = delete;
+    BrewWorker& operator=(BrewWorker const&) = delete;
+    ~BrewWorker();
+
+public:
+    /*! \brief Execute a command on the worker, booting (or rebooting) it first if needed.
+     *         The command's results are populated exactly as BrewCommand::execute() would.
+     *
+     *  \param cmd The command to execute
+     *  \param stream The stream(s) to capture
+     */
+    template <EnumType E>
+    void execute(BrewCommand<E>&, BarrelCmd::Stream = BarrelCmd::Stream::STDOUT_STDERR);
+
+    std::size_t getRestartCount() const;
+};
+
+inline BrewWorker::BrewWorker(BarrelCmd::Argv launch_argv, std::size_t max_requests)
+    : launch_argv_(std::move(launch_argv)), max_requests_(max_requests){};
+
+inline BrewWorker::BrewWorker(Brew const& brew, std::size_t max_requests)
+    : BrewWorker{{brew.getInstallPath(), getCommandHead(BrewCommandType::BuiltinDev::RUBY), "-e", WORKER_DRIVER},
+                 max_requests} {
+    environment_ = brew.getEnvProfile().getEnvironment();
+};
+
+inline BrewWorker::~BrewWorker() {
+    stop();
+}
+
+inline std::size_t BrewWorker::getRestartCount() const {
+    return boots_ == 0 ? 0 : boots_ - 1;
+}
+
+inline void BrewWorker::start() {
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+        throw std::runtime_error("BrewWorker::start(): socketpair() failed to initialize");
+    }
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+#if defined(SO_NOSIGPIPE)
+    int const on = 1;
+    setsockopt(fds[0], SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, fds[1], STDIN_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, fds[1], STDOUT_FILENO);
+    posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, DEV_NULL.c_str(), O_WRONLY, 0);
+
+    // In a process group of its own, so that stop() also kills the request it may be serving
+    posix_spawnattr_t attr;
+    posix_spawnattr_init(&attr);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP);
+    posix_spawnattr_setpgroup(&attr, 0);
+
+    std::vector<char*> argv = launch_argv_.pointers();
+    char* const* const envp = environment_ ? environment_->get() : environ;
+    int const err = posix_spawnp(&pid_, argv[0], &actions, &attr, argv.data(), envp);
+
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&actions);
+    close(fds[1]);
+
+    if (err != 0) {
+        close(fds[0]);
+        pid_ = -1;
+        throw std::runtime_error("BrewWorker::start(): Failed to launch "s + argv[0]);
+    }
+
+    channel_ = fds[0];
+    inbox_.clear();
+    served_ = 0;
+    ++boots_;
+
+    std::string ready;
+    if (!readLine(ready) || ready != "R") {
+        stop();
+        throw std::runtime_error("BrewWorker::start(): Worker failed to boot");
+    }
+}
+
+inline void BrewWorker::stop() {
+    if (channel_ != -1)
+        close(channel_); // The driver exits on EOF
+    channel_ = -1;
+
+    if (pid_ != -1) {
+        kill(-pid_, SIGKILL);
+        while (waitpid(pid_, nullptr, 0) == -1 && errno == EINTR) {
+        }
+    }
+    pid_ = -1;
+}
+
+inline bool BrewWorker::send(BarrelCmd::Argv const& args) {
+    std::string request = std::to_string(args.size()) + '\n';
+    for (std::size_t idx = 0; idx < args.size(); ++idx) {
+        request += std::to_string(args[idx].size()) + '\n';
+        request += args[idx];
+    }
+
+#if defined(MSG_NOSIGNAL)
+    int const flags = MSG_NOSIGNAL;
+#else
+    int const flags = 0;
+#endif
+    std::string_view pending = request;
+    while (!pending.empty()) {
+        ssize_t const sent = ::send(channel_, pending.data(), pending.size(), flags);
+        if (sent == -1) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        pending.remove_prefix(static_cast<std::size_t>(sent));
+    }
+    return true;
+}
+
+inline bool BrewWorker::fill() {
+    std::array<char, WORKER_READ_SZ> buffer;
+    for (;;) {
+        ssize_t const read_bytes = read(channel_, buffer.data(), buffer.size());
+        if (read_bytes > 0) {
+            inbox_.append(buffer.data(), static_cast<std::size_t>(read_bytes));
+            return true;
+        }
+        if (read_bytes == -1 && errno == EINTR)
+            continue;
+        return false;
+    }
+}
+
+inline bool BrewWorker::readLine(std::string& line) {
+    std::size_t newline;
+    while ((newline = inbox_.find('\n')) == std::string::npos) {
+        if (!fill())
+            return false;
+    }
+    line.assign(inbox_, 0, newline);
+    inbox_.erase(0, newline + 1);
+    return true;
+}
+
+inline bool BrewWorker::readExact(std::size_t length, std::string& sink) {
+    while (inbox_.size() < length) {
+        if (!fill())
+            return false;
+    }
+    sink.append(inbox_, 0, length);
+    inbox_.erase(0, length);
+    return true;
+}
+
+inline bool BrewWorker::roundTrip(BarrelCmd::Argv const& args, BarrelCmd::Stream stream,
+                                  std::string& stream_dump, std::string& error_dump, int& exit_status,
+                                  bool& replied) {
+    replied = false;
+    if (!send(args))
+        return false;
+
+    std::string header;
+    std::string discard;
+    for (;;) {
+        if (!readLine(header) || header.size() < 3 || header[1] != ' ')
+            return false;
+        replied = true;
+
+        std::size_t value;
+        try {
+            value = std::stoul(header.substr(2));
+        } catch (std::exception const&) {
+            return false;
+        }
+
+        switch (header[0]) {
+        case 'X':
+            exit_status = static_cast<int>(value);
+            return true;
+        case 'O':
+            if (!readExact(value, stream == BarrelCmd::Stream::STDERR ? discard : stream_dump))
+                return false;
+            break;
+        case 'E':
+            if (!readExact(value, stream == BarrelCmd::Stream::STDOUT               ? discard
+                                  : stream == BarrelCmd::Stream::STDOUT_STDERR_SPLIT ? error_dump
+                                                                                     : stream_dump))
+                return false;
+            break;
+        default:
+            return false;
+        }
+        discard.clear();
+    }
+}
+
+template <EnumType E>
+void BrewWorker::execute(BrewCommand<E>& cmd, BarrelCmd::Stream stream) {
+    if (cmd.deadline_.has_value() || cmd.timeout_.has_value() || cmd.cancellation_.has_value() ||
+        cmd.env_.getEnvironment() != environment_) {
+        cmd.execute(stream);
+        return;
+    }
+
+    cmd.checkBound();
+    auto const waiting = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(mutex_);
+    cmd.termination_ = BarrelCmd::Termination::EXITED;
+    cmd.metrics_ = {};
+    cmd.metrics_.start = std::chrono::steady_clock::now();
+    cmd.queued_ += cmd.metrics_.start - waiting; // Behind the requests served before it
+
+    bool const retriable = getLockClass(cmd.getCommand()) == BrewLockClass::SHARED;
+    if (!retriable)
+        ++Brew::state_generation; // Counted up front, since the command may have run even if it fails
+
+    // The worker is already running Homebrew, so it only needs what follows `brew`
+    BarrelCmd::Argv args;
+    for (std::size_t idx = 1; idx < cmd.argv_.size(); ++idx)
+        args.push(cmd.argv_[idx]);
+
+    bool answered = false;
+    for (int attempt = 0; attempt < 2; ++attempt) {
+        if (pid_ == -1 || (max_requests_ != 0 && served_ >= max_requests_)) {
+            stop();
+            start();
+        }
+
+        std::string stream_dump;
+        std::string error_dump;
+        int exit_status{BAD_EXIT_ST};
+        bool replied;
+
+        if (roundTrip(args, stream, stream_dump, error_dump, exit_status, replied)) {
+            ++served_;
+            cmd.stream_dump_ = std::move(stream_dump);
+            cmd.error_dump_ = std::move(error_dump);
+            cmd.exit_status_ = exit_status;
+            answered = true;
+            break;
+        }
+
+        // Crashed or poisoned. Tear it down so that the next command gets a fresh worker
+        stop();
+        if (replied || !retriable) {
+            cmd.stream_dump_ = std::move(stream_dump);
+            cmd.error_dump_ = std::move(error_dump);
+            cmd.exit_status_ = BAD_EXIT_ST;
+            answered = true;
+            break;
+        }
+    }
+
+    if (!answered) {
+        cmd.stream_dump_.clear();
+        cmd.error_dump_.clear();
+        cmd.exit_status_ = BAD_EXIT_ST;
+    }
+
+    // The request's own CPU time and memory can't be told apart from the worker's
+    cmd.metrics_.wall = std::chrono::steady_clock::now() - cmd.metrics_.start;
+    cmd.metrics_.bytes = {cmd.stream_dump_.size(), cmd.error_dump_.size()};
+
+    // Replies are read in full, so normalizing and a bounded capture policy only apply once they're in
+    if (cmd.normalize_) {
+        BarrelCmd::normalize(cmd.stream_dump_);
+        BarrelCmd::normalize(cmd.error_dump_);
+    }
+    BarrelCmd::applyCapture(cmd.capture_, cmd.stream_dump_);
+    BarrelCmd::applyCapture(cmd.capture_, cmd.error_dump_);
+    cmd.spills_ = {};
+    cmd.report(true);
+}
+
+#endif
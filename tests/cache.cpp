@@ -0,0 +1,107 @@
+/*!
+ * This file is part of Barrel, a header-only C++ library that provides
+ * programmatic access to the Homebrew command line interface.
+ *
+ * Copyright (C) 2022 aydwi <contact@aydwi.com>
+ *
+ * Barrel is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*! \file  cache.cpp
+    \brief Tests of BrewCache, in front of the stand-in `brew` (see bench/fakebrew.cpp).
+*/
+
+#include "cache.h"
+
+#include "check.h"
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+
+using Builtin = BrewCommandType::Builtin;
+
+// Output depends on the environment Homebrew is given, so results under different
+// variables are told apart
+void environment(Brew const& brew) {
+    BrewCache cache(brew);
+    for (char const* bytes : {"10", "2000", "10", "2000"}) {
+        BrewCommand<Builtin> cmd(brew, Builtin::INFO, "wget");
+        cmd.setEnv("FAKEBREW_STDOUT_BYTES", bytes);
+        cache.execute(cmd);
+        CHECK(cmd.getStreamDump().size() == std::stoul(bytes));
+    }
+    CHECK(cache.getStats().hits == 2);
+    CHECK(cache.getStats().misses == 2);
+
+    // A variable isn't mistaken for an argument spelled the same
+    BrewCommand<Builtin> spelled(brew, Builtin::INFO, "wget", "FAKEBREW_STDOUT_BYTES=10");
+    CHECK(!cache.execute(spelled));
+}
+
+// Counts the executions reported
+class Counter : public BrewObserver {
+public:
+    std::atomic<int> executions{0};
+    void onExecution(BrewExecution const&) override {
+        ++executions;
+    }
+};
+
+// A hit hands the output to the handlers, tagged as the process would have, and is reported
+void handlers(Brew const& brew) {
+    BrewCache cache(brew);
+    auto const counter = std::make_shared<Counter>();
+    BrewMetrics::attach(counter);
+    using BarrelCmd::Stream;
+    for (Stream const stream : {Stream::STDOUT_STDERR, Stream::STDOUT_STDERR, Stream::STDOUT_STDERR_SPLIT,
+                                Stream::STDOUT_STDERR_SPLIT}) {
+        std::vector<std::pair<Stream, std::string>> lines;
+        std::size_t chunked = 0;
+        BrewCommand<Builtin> cmd(brew, Builtin::INFO, "wget");
+        cmd.setEnv("FAKEBREW_STDOUT_BYTES", "20");
+        cmd.setEnv("FAKEBREW_STDERR_BYTES", "10");
+        cmd.setEnv("FAKEBREW_LINE_LENGTH", "10");
+        cmd.onChunk([&chunked](Stream, std::string_view chunk) { chunked += chunk.size(); });
+        cmd.onLine([&lines](Stream tag, std::string_view line) { lines.emplace_back(tag, line); });
+        cache.execute(cmd, stream);
+
+        CHECK(chunked == 30);
+        CHECK(lines.size() == 3);
+        std::size_t errors = 0;
+        for (auto const& [tag, line] : lines) {
+            CHECK(line.size() == 9);
+            if (stream == Stream::STDOUT_STDERR)
+                CHECK(tag == Stream::STDOUT_STDERR);
+            else
+                errors += tag == Stream::STDERR;
+        }
+        CHECK(stream == Stream::STDOUT_STDERR || errors == 1);
+    }
+    BrewMetrics::detach(counter);
+    CHECK(cache.getStats().hits == 2);
+    CHECK(counter->executions == 4);
+}
+
+} // namespace
+
+int main() {
+    Brew const brew(BARREL_TEST_FAKEBREW, BrewValidation::SKIP);
+    environment(brew);
+    handlers(brew);
+    return CHECK_RESULT();
+}
@@ -0,0 +1,51 @@
+/*!
+ * This file is part of Barrel, a header-only C++ library that provides
+ * programmatic access to the Homebrew command line interface.
+ *
+ * Copyright (C) 2022 aydwi <contact@aydwi.com>
+ *
+ * Barrel is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*! \file  check.h
+    \brief The few helpers Barrel's tests share. Each test is a plain executable which
+           exits non-zero once a check has failed, as ctest expects.
+*/
+
+#ifndef BARREL_TESTS_CHECK_H__
+#define BARREL_TESTS_CHECK_H__
+
+#include <cstdlib>
+#include <iostream>
+
+namespace {
+
+int failures{0};
+
+} // namespace
+
+/*! \brief Report, without stopping, a condition which doesn't hold.
+ */
+#define CHECK(cond)                                                                              \
+    do {                                                                                         \
+        if (!(cond)) {                                                                           \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK(" #cond ") failed" << std::endl; \
+            ++failures;                                                                          \
+        }                                                                                        \
+    } while (false)
+
+/*! \brief The exit status of a test: failing if any check has.
+ */
+#define CHECK_RESULT() (failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE)
+
+#endif
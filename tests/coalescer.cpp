@@ -0,0 +1,123 @@
+/*!
+ * This file is part of Barrel, a header-only C++ library that provides
+ * programmatic access to the Homebrew command line interface.
+ *
+ * Copyright (C) 2022 aydwi <contact@aydwi.com>
+ *
+ * Barrel is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*! \file  coalescer.cpp
+    \brief Tests of BrewCoalescer, against the stand-in `brew` answering queries (see
+           bench/fakebrew.cpp).
+*/
+
+#include "coalescer.h"
+
+#include "check.h"
+
+#include <cstdlib>
+#include <future>
+#include <string>
+#include <vector>
+
+namespace {
+
+using Builtin = BrewCommandType::Builtin;
+
+// Submits each name, and waits for the results of all of them
+std::vector<BrewCoalescedResult> query(BrewCoalescer& coalescer, Builtin cmd,
+                                       std::vector<std::string> const& names,
+                                       std::vector<std::string> const& flags = {}) {
+    std::vector<std::future<BrewCoalescedResult>> futures;
+    for (auto const& name : names)
+        futures.push_back(coalescer.submit(cmd, name, flags));
+    coalescer.flush();
+    std::vector<BrewCoalescedResult> results;
+    for (auto& future : futures)
+        results.push_back(future.get());
+    return results;
+}
+
+// Each name gets the document holding its record alone, from a single invocation
+void info(Brew const& brew) {
+    BrewCoalescer coalescer(brew);
+    auto const results = query(coalescer, Builtin::INFO, {"wget", "jq"}, {"--json=v2"});
+    CHECK(results[1].stream_dump == "{\"formulae\":[{\"name\":\"jq\",\"full_name\":\"jq\","
+                                    "\"desc\":\"Description of jq\",\"dependencies\":[\"jq-a\","
+                                    "\"jq-b\"]}],\"casks\":[]}\n");
+    CHECK(results[0].exit_status == EXIT_SUCCESS && results[0].batch_size == 2);
+    CHECK(coalescer.getStats().invocations == 1);
+
+    BrewCoalescer legacy(brew);
+    auto const v1 = query(legacy, Builtin::INFO, {"wget", "jq"}, {"--json"});
+    CHECK(v1[0].stream_dump == "[{\"name\":\"wget\",\"full_name\":\"wget\",\"desc\":\"Description of "
+                               "wget\",\"dependencies\":[\"wget-a\",\"wget-b\"]}]\n");
+}
+
+// `outdated` exits 1 once it lists a name, which is split rather than retried; each name
+// gets the exit status it would alone
+void outdated(Brew const& brew) {
+    setenv("FAKEBREW_OUTDATED", "jq", 1);
+    BrewCoalescer coalescer(brew);
+    auto const results = query(coalescer, Builtin::OUTDATED, {"wget", "jq", "gh"}, {"--json=v2"});
+    unsetenv("FAKEBREW_OUTDATED");
+    CHECK(results[0].stream_dump == BarrelCmd::UNLISTED_JSON_V2);
+    CHECK(results[0].exit_status == EXIT_SUCCESS);
+    CHECK(results[1].stream_dump.find("\"name\":\"jq\"") != std::string::npos);
+    CHECK(results[1].exit_status == EXIT_FAILURE);
+    CHECK(results[2].exit_status == EXIT_SUCCESS);
+    CHECK(coalescer.getStats().invocations == 1 && coalescer.getStats().retries == 0);
+}
+
+// `desc` is split by its lines, and `deps` is run with `--for-each`, then reflowed into the
+// list a single name prints
+void lines(Brew const& brew) {
+    BrewCoalescer coalescer(brew);
+    auto const desc = query(coalescer, Builtin::DESC, {"wget", "jq"});
+    CHECK(desc[0].stream_dump == "wget: Description of wget\n");
+    CHECK(desc[1].stream_dump == "jq: Description of jq\n");
+
+    auto const deps = query(coalescer, Builtin::DEPS, {"wget", "jq"});
+    CHECK(deps[0].stream_dump == "wget-a\nwget-b\n");
+    CHECK(deps[1].stream_dump == "jq-a\njq-b\n");
+    auto const for_each = query(coalescer, Builtin::DEPS, {"wget", "jq"}, {"--for-each"});
+    CHECK(for_each[1].stream_dump == "jq: jq-a jq-b\n");
+    CHECK(coalescer.getStats().invocations == 3);
+}
+
+// An unknown name fails the batch, which is halved until it fails alone
+void failing(Brew const& brew) {
+    setenv("FAKEBREW_FAIL", "gh", 1);
+    BrewCoalescer coalescer(brew);
+    auto const results = query(coalescer, Builtin::DESC, {"wget", "jq", "gh", "git"});
+    unsetenv("FAKEBREW_FAIL");
+    CHECK(results[0].stream_dump == "wget: Description of wget\n");
+    CHECK(results[1].exit_status == EXIT_SUCCESS);
+    CHECK(results[2].exit_status == EXIT_FAILURE && results[2].batch_size == 1);
+    CHECK(results[3].stream_dump == "git: Description of git\n");
+    CHECK(results[3].exit_status == EXIT_SUCCESS);
+    CHECK(coalescer.getStats().retries > 0);
+}
+
+} // namespace
+
+int main() {
+    setenv("FAKEBREW_QUERY", "1", 1);
+    Brew const brew(BARREL_TEST_FAKEBREW, BrewValidation::SKIP);
+    info(brew);
+    outdated(brew);
+    lines(brew);
+    failing(brew);
+    return CHECK_RESULT();
+}
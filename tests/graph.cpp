@@ -0,0 +1,67 @@
+/*!
+ * This file is part of Barrel, a header-only C++ library that provides
+ * programmatic access to the Homebrew command line interface.
+ *
+ * Copyright (C) 2022 aydwi <contact@aydwi.com>
+ *
+ * Barrel is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*! \file  graph.cpp
+    \brief Tests of BrewGraph.
+*/
+
+#include "graph.h"
+
+#include "check.h"
+
+#include <string_view>
+#include <vector>
+
+namespace {
+
+using Names = std::vector<std::string_view>;
+
+// The same formula described more than once, as `brew info a a` or a catalogue merged with
+// `brew info --installed` would have it, even with different dependencies: one node, whose
+// edges are those of its first description
+void duplicates() {
+    std::string_view const json = R"({"formulae":[
+        {"name":"a","dependencies":["b","c"]},
+        {"name":"b","dependencies":["c"]},
+        {"name":"a","dependencies":["c"],"installed":[{"version":"1.0","installed_on_request":true}]},
+        {"name":"c","dependencies":[]},
+        {"name":"b","dependencies":["c"]}
+    ],"casks":[]})";
+    BrewGraph const graph{BrewInfo(json)};
+
+    CHECK(graph.size() == 3);
+    CHECK(graph.getDeps("a", BrewGraphScope::DIRECT) == (Names{"b", "c"}));
+    CHECK(graph.getDeps("b", BrewGraphScope::DIRECT) == (Names{"c"}));
+    CHECK(graph.getDeps("c", BrewGraphScope::DIRECT).empty());
+    CHECK(graph.getUses("c", BrewGraphScope::DIRECT, false) == (Names{"a", "b"}));
+    CHECK(graph.getUses("b", BrewGraphScope::DIRECT, false) == (Names{"a"}));
+    CHECK(graph.getTopologicalOrder(Names{"a"}) == (Names{"c", "b", "a"}));
+
+    // Installed, as one of its descriptions says so
+    CHECK(graph.isInstalled("a"));
+    CHECK(!graph.isInstalled("b"));
+    CHECK(graph.getLeaves(true) == (Names{"a"}));
+}
+
+} // namespace
+
+int main() {
+    duplicates();
+    return CHECK_RESULT();
+}
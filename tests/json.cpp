@@ -0,0 +1,54 @@
+/*!
+ * This file is part of Barrel, a header-only C++ library that provides
+ * programmatic access to the Homebrew command line interface.
+ *
+ * Copyright (C) 2022 aydwi <contact@aydwi.com>
+ *
+ * Barrel is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*! \file  json.cpp
+    \brief Tests of JsonCursor.
+*/
+
+#include "json.h"
+
+#include "check.h"
+
+#include <string_view>
+
+namespace {
+
+std::string_view decode(BarrelCmd::Arena& arena, std::string_view json) {
+    BarrelCmd::JsonCursor cursor(json);
+    return cursor.string(arena);
+}
+
+// A surrogate pair decodes to the character it encodes; half of one, alone or followed by
+// anything but the other half, to U+FFFD
+void surrogates() {
+    BarrelCmd::Arena arena;
+    CHECK(decode(arena, R"("\ud83c\udf7a")") == "\xF0\x9F\x8D\xBA");
+    CHECK(decode(arena, R"("\ud83c")") == "\xEF\xBF\xBD");
+    CHECK(decode(arena, R"("\ud83cx")") == "\xEF\xBF\xBDx");
+    CHECK(decode(arena, R"("\udf7a\ud83c")") == "\xEF\xBF\xBD\xEF\xBF\xBD");
+    CHECK(decode(arena, R"("\ud83c\u00e9")") == "\xEF\xBF\xBD\xC3\xA9");
+    CHECK(decode(arena, R"("\ud83c\ud83c\udf7a")") == "\xEF\xBF\xBD\xF0\x9F\x8D\xBA");
+}
+
+} // namespace
+
+int main() {
+    surrogates();
+    return CHECK_RESULT();
+}
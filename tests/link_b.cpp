@@ -0,0 +1,47 @@
+/*!
+ * This file is part of Barrel, a header-only C++ library that provides
+ * programmatic access to the Homebrew command line interface.
+ *
+ * Copyright (C) 2022 aydwi <contact@aydwi.com>
+ *
+ * Barrel is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*! \file  link_b.cpp
+    \brief Includes every header, as link_a.cpp does, and is linked with it. A definition
+           in a header which isn't `inline` is then defined twice, and fails to link.
+*/
+
+#include "barrel.h"
+#include "cache.h"
+#include "coalescer.h"
+#include "env.h"
+#include "executor.h"
+#include "graph.h"
+#include "json.h"
+#include "layout.h"
+#include "metrics.h"
+#include "native.h"
+#include "normalize.h"
+#include "pipeline.h"
+#include "pool.h"
+#include "proc.h"
+#include "reactor.h"
+#include "reconciler.h"
+#include "registry.h"
+#include "search.h"
+#include "spec.h"
+#include "text.h"
+#include "types.h"
+#include "utils.h"
+#include "worker.h"
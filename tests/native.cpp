@@ -0,0 +1,174 @@
+/*!
+ * This file is part of Barrel, a header-only C++ library that provides
+ * programmatic access to the Homebrew command line interface.
+ *
+ * Copyright (C) 2022 aydwi <contact@aydwi.com>
+ *
+ * Barrel is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*! \file  native.cpp
+    \brief Tests of BrewNative, against a prefix laid out the way Homebrew lays one out, whose
+           `brew` is the stand-in (see bench/fakebrew.cpp).
+*/
+
+#include "native.h"
+
+#include "check.h"
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <unistd.h>
+
+namespace {
+
+using Builtin = BrewCommandType::Builtin;
+namespace fs = std::filesystem;
+
+std::string const HEAD{"0123456789abcdef0123456789abcdef01234567"};
+std::string const OTHER{"89abcdef0123456789abcdef0123456789abcdef"};
+
+void write(fs::path const& path, std::string const& contents) {
+    fs::create_directories(path.parent_path());
+    std::ofstream(path) << contents;
+}
+
+// An Intel macOS/Linux prefix: the repository in Homebrew/, on the stable branch, which
+// packed-refs has at an annotated tag
+fs::path makePrefix() {
+    fs::path const prefix = fs::temp_directory_path() / ("barrel-native-" + std::to_string(getpid()));
+    fs::remove_all(prefix);
+    fs::create_directories(prefix / "bin");
+    fs::create_symlink(BARREL_TEST_FAKEBREW, prefix / "bin" / "brew");
+    fs::create_directories(prefix / "Homebrew" / "Library" / "Homebrew");
+
+    for (char const* keg : {"wget/1.21", "wget/1.9", "jq/1.7.1", "jq/1.6_1"})
+        fs::create_directories(prefix / "Cellar" / keg);
+    fs::create_directories(prefix / "Cellar" / "gone"); // An empty rack isn't installed
+    fs::create_directories(prefix / "Caskroom" / "firefox" / "118.0");
+    fs::create_directories(prefix / "Caskroom" / "firefox" / ".metadata");
+    fs::create_directories(prefix / "Caskroom" / "iterm2" / "3.4.23");
+    fs::create_directories(prefix / "Homebrew" / "Library" / "Taps" / "hashicorp" / "homebrew-tap");
+    fs::create_directories(prefix / "Homebrew" / "Library" / "Taps" / "someone" / "scripts");
+    fs::create_directories(prefix / "var" / "homebrew" / "pinned");
+    fs::create_directory_symlink("../../../Cellar/jq/1.7.1", prefix / "var" / "homebrew" / "pinned" / "jq");
+    fs::create_directories(prefix / "opt");
+    fs::create_directory_symlink("../Cellar/wget/1.21", prefix / "opt" / "wget");
+
+    write(prefix / "Homebrew" / ".git" / "HEAD", "ref: refs/heads/stable\n");
+    std::string const TAGGED{"fedcba9876543210fedcba9876543210fedcba98"}; // The tag object
+    write(prefix / "Homebrew" / ".git" / "packed-refs",
+          "# pack-refs with: peeled fully-peeled sorted\n" + HEAD + " refs/heads/stable\n" + OTHER +
+              " refs/tags/4.1.25\n" + TAGGED + " refs/tags/4.2.0\n^" + HEAD + "\n");
+    return prefix;
+}
+
+// The command's output, and whether it was answered natively
+std::pair<std::string, bool> answer(BrewNative const& native, BrewCommand<Builtin>&& cmd) {
+    cmd.setEnv("FAKEBREW_STDOUT_BYTES", "5"); // Only reaches the stand-in, on a fallback
+    bool const native_answer = native.execute(cmd, BarrelCmd::Stream::STDOUT);
+    return {cmd.getStreamDump(), native_answer};
+}
+
+// Each command answered prints what Homebrew would
+void resolved(Brew const& brew, fs::path const& prefix) {
+    BrewNative const native(brew);
+    CHECK(native.isRecognised());
+    auto const expect = [&native](BrewCommand<Builtin>&& cmd, std::string const& output) {
+        auto const [printed, answered] = answer(native, std::move(cmd));
+        CHECK(answered);
+        CHECK(printed == output);
+    };
+
+    std::string const root = prefix.string();
+    expect({brew, Builtin::PREFIX}, root + "\n");
+    expect({brew, Builtin::PREFIX, "wget"}, root + "/opt/wget\n");
+    expect({brew, Builtin::CELLAR}, root + "/Cellar\n");
+    expect({brew, Builtin::CELLAR, "jq"}, root + "/Cellar/jq\n");
+    expect({brew, Builtin::CASKROOM, "firefox"}, root + "/Caskroom/firefox\n");
+    expect({brew, Builtin::REPOSITORY}, root + "/Homebrew\n");
+    expect({brew, Builtin::REPOSITORY, "hashicorp/tap"},
+           root + "/Homebrew/Library/Taps/hashicorp/homebrew-tap\n");
+
+    expect({brew, Builtin::LIST}, "jq\nwget\nfirefox\niterm2\n");
+    expect({brew, Builtin::LIST, "--formula", "-1"}, "jq\nwget\n");
+    expect({brew, Builtin::LIST, "--cask"}, "firefox\niterm2\n");
+    expect({brew, Builtin::LIST, "--versions"}, "jq 1.6_1 1.7.1\nwget 1.9 1.21\n");
+    expect({brew, Builtin::LIST, "--versions", "wget"}, "wget 1.9 1.21\n");
+    expect({brew, Builtin::LIST, "--cask", "--versions"}, "firefox 118.0\niterm2 3.4.23\n");
+    expect({brew, Builtin::VERSION}, "Homebrew 4.2.0\n");
+
+    BarrelCmd::Layout const layout(brew.getInstallPath());
+    CHECK(layout.getTaps() == std::vector<std::string>{"hashicorp/tap"});
+    CHECK(layout.getPinned() == std::vector<std::string>{"jq"});
+}
+
+// Whatever can't be answered from the layout is executed
+void fallbacks(Brew const& brew, fs::path const& prefix) {
+    BrewNative const native(brew);
+    auto const executed = [&native](BrewCommand<Builtin>&& cmd) {
+        auto const [printed, answered] = answer(native, std::move(cmd));
+        CHECK(!answered);
+        CHECK(printed.size() == 5);
+    };
+
+    executed({brew, Builtin::PREFIX, "curl"});               // Not on disk: maybe an alias
+    executed({brew, Builtin::PREFIX, "homebrew/core/wget"}); // Qualified
+    executed({brew, Builtin::LIST, "wget"});                 // Lists the keg's files
+    executed({brew, Builtin::LIST, "--versions", "gone"});   // Not installed
+    executed({brew, Builtin::LIST, "--pinned"});
+    executed({brew, Builtin::LIST, "--formula", "--cask"});
+    executed({brew, Builtin::INFO, "wget"});
+
+    // A checkout off any tag
+    write(prefix / "Homebrew" / ".git" / "HEAD", OTHER.substr(0, 39) + "0\n");
+    CHECK(!answer(native, {brew, Builtin::VERSION}).second); // The stand-in prints its own
+    write(prefix / "Homebrew" / ".git" / "HEAD", OTHER + "\n");
+    CHECK(answer(native, {brew, Builtin::VERSION}).first == "Homebrew 4.1.25\n");
+
+    // Nor is a prefix which isn't laid out the way Homebrew lays one out
+    fs::remove_all(prefix / "Homebrew" / "Library");
+    BrewNative const unrecognised(brew);
+    CHECK(!unrecognised.isRecognised());
+    auto const [printed, answered] = answer(unrecognised, {brew, Builtin::CELLAR});
+    CHECK(!answered && printed.size() == 5);
+}
+
+// Handlers see the output tagged with the stream it was captured as
+void handlers(Brew const& brew) {
+    BrewNative const native(brew);
+    for (BarrelCmd::Stream const stream : {BarrelCmd::Stream::STDOUT, BarrelCmd::Stream::STDOUT_STDERR}) {
+        std::vector<BarrelCmd::Stream> tags;
+        BrewCommand<Builtin> cmd(brew, Builtin::LIST, "--formula");
+        cmd.onChunk([&tags](BarrelCmd::Stream tag, std::string_view) { tags.push_back(tag); });
+        cmd.onLine([&tags](BarrelCmd::Stream tag, std::string_view) { tags.push_back(tag); });
+        CHECK(native.execute(cmd, stream));
+        CHECK(tags == std::vector<BarrelCmd::Stream>(3, stream));
+    }
+}
+
+} // namespace
+
+int main() {
+    fs::path const prefix = makePrefix();
+    Brew const brew((prefix / "bin" / "brew").string(), BrewValidation::SKIP);
+    resolved(brew, prefix);
+    handlers(brew);
+    fallbacks(brew, prefix);
+    fs::remove_all(prefix);
+    return CHECK_RESULT();
+}
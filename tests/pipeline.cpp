@@ -0,0 +1,163 @@
+/*!
+ * This file is part of Barrel, a header-only C++ library that provides
+ * programmatic access to the Homebrew command line interface.
+ *
+ * Copyright (C) 2022 aydwi <contact@aydwi.com>
+ *
+ * Barrel is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*! \file  pipeline.cpp
+    \brief Tests of BrewPipeline, run against the stand-in `brew` (see bench/fakebrew.cpp).
+*/
+
+#include "pipeline.h"
+
+#include "check.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using namespace std::chrono_literals;
+using Names = std::vector<std::string_view>;
+
+// a needs b and c, b needs c; d (also known as dee) needs e
+std::string_view const CATALOGUE = R"({"formulae":[
+    {"name":"a","dependencies":["b","c"]},
+    {"name":"b","dependencies":["c"]},
+    {"name":"c","dependencies":[]},
+    {"name":"d","aliases":["dee"],"dependencies":["e"]},
+    {"name":"e","dependencies":[]}
+],"casks":[]})";
+
+std::vector<std::string_view> const REQUESTED{"a", "dee"};
+
+// Every command executed, by its arguments
+class Recorder : public BrewObserver {
+public:
+    std::mutex mutex{};
+    std::vector<std::string> commands{};
+
+    void onExecution(BrewExecution const& execution) override {
+        std::string command(execution.head);
+        for (std::size_t idx = 2; idx < execution.argv.size(); ++idx)
+            command.append(" ").append(execution.argv[idx]);
+        std::lock_guard<std::mutex> lock(mutex);
+        commands.push_back(std::move(command));
+    }
+};
+
+BrewProvisioned const* find(BrewProvisioning const& result, std::string_view name) {
+    for (BrewProvisioned const& formula : result.formulae) {
+        if (formula.name == name)
+            return &formula;
+    }
+    return nullptr;
+}
+
+BrewProvisionStatus statusOf(BrewProvisioning const& result, std::string_view name) {
+    BrewProvisioned const* formula = find(result, name);
+    CHECK(formula != nullptr);
+    return formula == nullptr ? BrewProvisionStatus::SKIPPED : formula->status;
+}
+
+// Each formula is installed after its dependencies, and only those named by the caller stay
+// recorded as installed on request
+void order(Brew const& brew) {
+    BrewGraph graph{BrewInfo(CATALOGUE)};
+    auto const recorder = std::make_shared<Recorder>();
+    BrewMetrics::attach(recorder);
+    BrewProvisioning const result = BrewPipeline(brew, graph, 2).provision(REQUESTED);
+    BrewMetrics::detach(recorder);
+
+    CHECK(result.succeeded());
+    CHECK(result.formulae.size() == 5);
+    auto const position = [&result](std::string_view name) {
+        return find(result, name) - result.formulae.data();
+    };
+    CHECK(position("c") < position("b"));
+    CHECK(position("b") < position("a"));
+    CHECK(position("e") < position("d"));
+
+    for (std::string_view name : {"a", "b", "c", "d", "e"})
+        CHECK(graph.isInstalled(name));
+    CHECK(graph.getLeaves(true) == (Names{"a", "d"}));
+
+    std::lock_guard<std::mutex> lock(recorder->mutex);
+    std::vector<std::string> tabs;
+    for (std::string const& command : recorder->commands) {
+        if (command.starts_with("tab "))
+            tabs.push_back(command);
+    }
+    std::sort(tabs.begin(), tabs.end());
+    CHECK(tabs == (std::vector<std::string>{"tab --no-installed-on-request b",
+                                            "tab --no-installed-on-request c",
+                                            "tab --no-installed-on-request e"}));
+}
+
+// What depends on a formula which failed is skipped; the rest is installed all the same
+void failedDependency(Brew const& brew) {
+    setenv("FAKEBREW_FAIL", "b", 1);
+    BrewGraph graph{BrewInfo(CATALOGUE)};
+    BrewProvisioning const result = BrewPipeline(brew, graph).provision(REQUESTED);
+    unsetenv("FAKEBREW_FAIL");
+
+    CHECK(!result.succeeded());
+    CHECK(statusOf(result, "b") == BrewProvisionStatus::FETCH_FAILED);
+    CHECK(find(result, "b") != nullptr && find(result, "b")->exit_status == EXIT_FAILURE);
+    CHECK(statusOf(result, "a") == BrewProvisionStatus::SKIPPED);
+    for (std::string_view name : {"c", "d", "e"})
+        CHECK(statusOf(result, name) == BrewProvisionStatus::INSTALLED);
+    CHECK(!graph.isInstalled("a") && !graph.isInstalled("b"));
+}
+
+// A cancelled run terminates the install underway, and skips whatever was not installed
+void cancellation(Brew const& brew) {
+    setenv("FAKEBREW_INSTALL_MS", "10000", 1);
+    BrewGraph graph{BrewInfo(CATALOGUE)};
+    BarrelCmd::CancellationToken token;
+    BrewPipeline pipeline(brew, graph);
+    pipeline.setCancellation(token);
+    std::thread canceller([token]() mutable {
+        std::this_thread::sleep_for(200ms);
+        token.cancel();
+    });
+    auto const start = std::chrono::steady_clock::now();
+    BrewProvisioning const result = pipeline.provision(REQUESTED);
+    canceller.join();
+    unsetenv("FAKEBREW_INSTALL_MS");
+
+    CHECK(std::chrono::steady_clock::now() - start < 5s);
+    CHECK(result.formulae.size() == 5);
+    for (BrewProvisioned const& formula : result.formulae)
+        CHECK(formula.status == BrewProvisionStatus::SKIPPED);
+}
+
+} // namespace
+
+int main() {
+    Brew const brew(BARREL_TEST_FAKEBREW, BrewValidation::SKIP);
+    order(brew);
+    failedDependency(brew);
+    cancellation(brew);
+    return CHECK_RESULT();
+}
@@ -0,0 +1,130 @@
+/*!
+ * This file is part of Barrel, a header-only C++ library that provides
+ * programmatic access to the Homebrew command line interface.
+ *
+ * Copyright (C) 2022 aydwi <contact@aydwi.com>
+ *
+ * Barrel is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*! \file  termination.cpp
+    \brief Tests of deadlines and cancellation, on the stand-in `brew` (see bench/fakebrew.cpp),
+           both through BrewCommand::execute() and on a Reactor.
+*/
+
+#include "barrel.h"
+
+#include "check.h"
+
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <string>
+#include <thread>
+
+namespace {
+
+using namespace std::chrono_literals;
+using Builtin = BrewCommandType::Builtin;
+using BarrelCmd::Termination;
+
+// What the stand-in writes before it lingers, well past any test's deadline
+std::string const PARTIAL = std::string(49, 'x') + '\n' + std::string(49, 'x') + '\n';
+
+void execute(BrewCommand<Builtin>& cmd, bool on_reactor) {
+    if (!on_reactor) {
+        cmd.execute(BarrelCmd::Stream::STDOUT);
+        return;
+    }
+    BarrelCmd::Reactor reactor;
+    reactor.spawn(cmd.run(reactor, BarrelCmd::Stream::STDOUT));
+    reactor.run();
+}
+
+// The command is sent SIGTERM once its timeout has passed, and what it wrote until then kept
+void timeout(Brew const& brew, bool on_reactor) {
+    BrewCommand<Builtin> cmd(brew, Builtin::INFO);
+    cmd.setTimeout(200ms);
+    auto const start = std::chrono::steady_clock::now();
+    execute(cmd, on_reactor);
+    CHECK(std::chrono::steady_clock::now() - start < 5s);
+    CHECK(cmd.getTermination() == Termination::TIMED_OUT);
+    CHECK(cmd.getExitStatus() == 128 + SIGTERM);
+    CHECK(cmd.getStreamDump() == PARTIAL);
+}
+
+// A command cancelled before it starts is never launched
+void cancelBeforeStart(Brew const& brew, bool on_reactor) {
+    BarrelCmd::CancellationToken token;
+    token.cancel();
+    BrewCommand<Builtin> cmd(brew, Builtin::INFO);
+    cmd.setCancellation(token);
+    execute(cmd, on_reactor);
+    CHECK(cmd.getTermination() == Termination::CANCELLED);
+    CHECK(cmd.getExitStatus() == BAD_EXIT_ST);
+    CHECK(cmd.getStreamDump().empty());
+    CHECK(cmd.getMetrics().bytes[0] == 0);
+}
+
+// A command cancelled while it runs is sent SIGTERM, and what it wrote until then kept
+void cancelMidRun(Brew const& brew, bool on_reactor) {
+    BarrelCmd::CancellationToken token;
+    BrewCommand<Builtin> cmd(brew, Builtin::INFO);
+    cmd.setCancellation(token);
+    auto const start = std::chrono::steady_clock::now();
+    std::thread canceller([token]() mutable {
+        std::this_thread::sleep_for(200ms);
+        token.cancel();
+    });
+    execute(cmd, on_reactor);
+    canceller.join();
+    CHECK(std::chrono::steady_clock::now() - start < 5s);
+    CHECK(cmd.getTermination() == Termination::CANCELLED);
+    CHECK(cmd.getExitStatus() == 128 + SIGTERM);
+    CHECK(cmd.getStreamDump() == PARTIAL);
+}
+
+// A timeout passing once the command has exited, while a descendant still holds its output
+// open, kills what is left of its process group rather than waiting on it
+void timeoutAfterExit(Brew const& brew, bool on_reactor) {
+    setenv("FAKEBREW_LINGER_MS", "0", 1);
+    setenv("FAKEBREW_ORPHAN_MS", "30000", 1);
+    BrewCommand<Builtin> cmd(brew, Builtin::INFO);
+    cmd.setTimeout(300ms);
+    auto const start = std::chrono::steady_clock::now();
+    execute(cmd, on_reactor);
+    unsetenv("FAKEBREW_ORPHAN_MS");
+    setenv("FAKEBREW_LINGER_MS", "30000", 1);
+
+    CHECK(std::chrono::steady_clock::now() - start < 2s);
+    CHECK(cmd.getTermination() == Termination::TIMED_OUT);
+    CHECK(cmd.getExitStatus() == EXIT_SUCCESS); // Of the command itself, which exited
+    CHECK(cmd.getStreamDump() == PARTIAL);
+}
+
+} // namespace
+
+int main() {
+    setenv("FAKEBREW_STDOUT_BYTES", "100", 1);
+    setenv("FAKEBREW_LINE_LENGTH", "50", 1);
+    setenv("FAKEBREW_LINGER_MS", "30000", 1);
+
+    Brew const brew(BARREL_TEST_FAKEBREW, BrewValidation::SKIP);
+    for (bool const on_reactor : {false, true}) {
+        timeout(brew, on_reactor);
+        cancelBeforeStart(brew, on_reactor);
+        cancelMidRun(brew, on_reactor);
+        timeoutAfterExit(brew, on_reactor);
+    }
+    return CHECK_RESULT();
+}
@@ -0,0 +1,125 @@
+/*!
+ * This file is part of Barrel, a header-only C++ library that provides
+ * programmatic access to the Homebrew command line interface.
+ *
+ * Copyright (C) 2022 aydwi <contact@aydwi.com>
+ *
+ * Barrel is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*! \file  worker.cpp
+    \brief Tests of BrewWorker, booted on the stand-in `brew` (see bench/fakebrew.cpp).
+*/
+
+#include "worker.h"
+
+#include "check.h"
+
+#include <cstdlib>
+#include <string>
+
+namespace {
+
+using Builtin = BrewCommandType::Builtin;
+
+// Output and exit status come back as they would from a process of their own
+void roundTrip(Brew const& brew) {
+    BrewWorker worker(brew);
+    for (int idx = 0; idx < 3; ++idx) {
+        BrewCommand<Builtin> cmd(brew, Builtin::INFO, "--formula", "wget");
+        worker.execute(cmd, BarrelCmd::Stream::STDOUT_STDERR_SPLIT);
+        CHECK(cmd.getExitStatus() == 3);
+        CHECK(cmd.getStreamDump() == std::string(999, 'x') + '\n');
+        CHECK(cmd.getErrorDump() == std::string(100, 'x'));
+        CHECK(cmd.getTermination() == BarrelCmd::Termination::EXITED);
+    }
+
+    BrewCommand<Builtin> version(brew, Builtin::VERSION);
+    worker.execute(version);
+    CHECK(version.getExitStatus() == 0);
+    CHECK(version.getStreamDump().starts_with("Homebrew "));
+
+    // Every command was served by the worker booted for the first
+    CHECK(worker.getRestartCount() == 0);
+}
+
+// A worker is replaced after serving its share of commands, without the caller noticing
+void recycle(Brew const& brew) {
+    BrewWorker worker(brew, 2);
+    for (int idx = 0; idx < 5; ++idx) {
+        BrewCommand<Builtin> cmd(brew, Builtin::INFO);
+        worker.execute(cmd, BarrelCmd::Stream::STDOUT);
+        CHECK(cmd.getExitStatus() == 3);
+        CHECK(cmd.getStreamDump().size() == 1000);
+    }
+    CHECK(worker.getRestartCount() == 2);
+}
+
+// Executes a read-only command, then one which the stand-in fails as FAKEBREW_WORKER_FAULT
+// says, on a fresh worker
+BrewCommand<Builtin> faulted(Brew const& brew, BrewWorker& worker, char const* fault, Builtin cmd) {
+    setenv("FAKEBREW_WORKER_FAULT", fault, 1);
+    BrewCommand<Builtin> first(brew, Builtin::INFO);
+    worker.execute(first, BarrelCmd::Stream::STDOUT);
+    CHECK(first.getExitStatus() == 3);
+
+    BrewCommand<Builtin> second(brew, cmd, "wget");
+    worker.execute(second, BarrelCmd::Stream::STDOUT);
+    unsetenv("FAKEBREW_WORKER_FAULT");
+    return second;
+}
+
+// A read-only command which got no reply is retried once on a fresh worker; one whose reply
+// had started isn't, and neither is one which mutates the installation
+void faults(Brew const& brew) {
+    for (char const* fault : {"exit", "malformed"}) {
+        BrewWorker worker(brew);
+        BrewCommand<Builtin> const retried = faulted(brew, worker, fault, Builtin::INFO);
+        CHECK(retried.getExitStatus() == 3);
+        CHECK(retried.getStreamDump().size() == 1000);
+        CHECK(worker.getRestartCount() == 1);
+    }
+
+    for (char const* fault : {"exit", "malformed", "midway"}) {
+        BrewWorker worker(brew);
+        BrewCommand<Builtin> const failed = faulted(brew, worker, fault, Builtin::INSTALL);
+        CHECK(failed.getExitStatus() == BAD_EXIT_ST);
+        CHECK(worker.getRestartCount() == 0);
+
+        // The next command boots a fresh worker
+        BrewCommand<Builtin> next(brew, Builtin::INFO);
+        worker.execute(next, BarrelCmd::Stream::STDOUT);
+        CHECK(next.getExitStatus() == 3);
+        CHECK(worker.getRestartCount() == 1);
+    }
+
+    BrewWorker worker(brew);
+    BrewCommand<Builtin> const started = faulted(brew, worker, "midway", Builtin::INFO);
+    CHECK(started.getExitStatus() == BAD_EXIT_ST);
+    CHECK(worker.getRestartCount() == 0);
+}
+
+} // namespace
+
+int main() {
+    setenv("FAKEBREW_STDOUT_BYTES", "1000", 1);
+    setenv("FAKEBREW_STDERR_BYTES", "100", 1);
+    setenv("FAKEBREW_LINE_LENGTH", "1000", 1);
+    setenv("FAKEBREW_EXIT", "3", 1);
+
+    Brew const brew(BARREL_TEST_FAKEBREW, BrewValidation::SKIP);
+    roundTrip(brew);
+    recycle(brew);
+    faults(brew);
+    return CHECK_RESULT();
+}